@@ -0,0 +1,61 @@
+/*arena.cpp*/
+
+//
+// Bump ("arena") allocation for data built while loading the map.
+//
+
+#include <cstring>
+
+#include "arena.h"
+
+using namespace std;
+
+
+Arena::Arena(size_t initialBytes)
+  : Resource(initialBytes), BytesUsed(0)
+{
+}
+
+
+pmr::memory_resource* Arena::resource()
+{
+  return &this->Resource;
+}
+
+
+string_view Arena::store(string_view s)
+{
+  if (s.empty())
+    return string_view();
+
+  char* p = this->allocate<char>(s.size());
+  memcpy(p, s.data(), s.size());
+
+  return string_view(p, s.size());
+}
+
+
+string_view Arena::store(string_view a, string_view sep, string_view b)
+{
+  size_t n = a.size() + sep.size() + b.size();
+
+  if (n == 0)
+    return string_view();
+
+  char* p = this->allocate<char>(n);
+  char* q = p;
+
+  for (string_view part : { a, sep, b }) {
+    if (!part.empty())
+      memcpy(q, part.data(), part.size());
+    q += part.size();
+  }
+
+  return string_view(p, n);
+}
+
+
+size_t Arena::getBytesUsed() const
+{
+  return this->BytesUsed;
+}
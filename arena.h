@@ -0,0 +1,84 @@
+/*arena.h*/
+
+//
+// Bump ("arena") allocation for data built while loading the map.
+//
+// Load-time data is created once, never freed piece by piece, and
+// all dies together, so there is no point paying for one malloc per
+// string or vector. An Arena hands out memory from large blocks by
+// bumping a pointer, and releases every block at once when it is
+// destroyed. It is a std::pmr memory resource, so standard
+// containers can allocate from it:
+//
+//   Arena arena;
+//   pmr::vector<long long> ids(arena.resource());
+//
+// and it stores strings, returning string_views into its blocks:
+//
+//   string_view name = arena.store(attr->Value());
+//
+// Views and pointers into an arena are valid as long as the arena.
+//
+
+#pragma once
+
+#include <string_view>
+#include <memory_resource>
+#include <cstddef>
+
+using namespace std;
+
+
+class Arena
+{
+private:
+  pmr::monotonic_buffer_resource Resource;
+  size_t BytesUsed;
+
+public:
+  //
+  // constructor
+  //
+  // The first block is initialBytes long; each later block is
+  // larger than the one before (geometric growth).
+  //
+  explicit Arena(size_t initialBytes = 64 * 1024);
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  //
+  // resource
+  //
+  // For use as the memory resource of pmr containers.
+  //
+  pmr::memory_resource* resource();
+
+  //
+  // allocate
+  //
+  // Returns uninitialized space for n objects of type T.
+  //
+  template <typename T>
+  T* allocate(size_t n) {
+    this->BytesUsed += n * sizeof(T);
+    return static_cast<T*>(this->Resource.allocate(n * sizeof(T), alignof(T)));
+  }
+
+  //
+  // store
+  //
+  // Copies the string into the arena, returning a view of the copy.
+  // The 3-argument form stores the concatenation a + sep + b.
+  //
+  string_view store(string_view s);
+  string_view store(string_view a, string_view sep, string_view b);
+
+  //
+  // getBytesUsed
+  //
+  // Bytes handed out by allocate / store (not counting block slack
+  // or container allocations made through resource()).
+  //
+  size_t getBytesUsed() const;
+};
@@ -0,0 +1,241 @@
+/*batch.cpp*/
+
+//
+// Non-interactive batch mode: loads a map and bus stops, then runs
+// every query in a query file (or stdin), writing one line of JSON
+// per query.
+//
+// Queries are processed in blocks: the block is run on the shared
+// task pool (see taskpool.h), each query formatting its result into
+// the query's slot, an output buffer reused from block to block, and
+// then the block's results are written in order.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include "batch.h"
+#include "mapdata.h"
+#include "query.h"
+#include "predictions.h"
+#include "taskpool.h"
+#include "latency.h"
+
+using namespace std;
+
+
+static const size_t BLOCK_SIZE = 4096;  // queries per block
+
+
+//
+// parseBatchArgs
+//
+bool parseBatchArgs(int argc, char* argv[], BatchOptions& options)
+{
+  vector<string> positional;
+
+  for (int i = 2; i < argc; i++)
+  {
+    string arg = argv[i];
+
+    if (arg == "--threads" && i + 1 < argc)
+      options.Threads = max(1, atoi(argv[++i]));
+    else if (arg == "--output" && i + 1 < argc)
+      options.OutputFilename = argv[++i];
+    else if (arg == "--predictions")
+      options.Predictions = true;
+    else if (arg == "--prediction-source" && i + 1 < argc)
+      options.PredictionSpec = argv[++i];
+    else if (arg == "--format" && i + 1 < argc) {
+      if (!parseOutputFormat(argv[++i], options.Format)) {
+        cerr << "**ERROR: unknown format '" << argv[i] << "' (expected json, text or csv)" << endl;
+        return false;
+      }
+    }
+    else if (arg == "--profile-load" && i + 1 < argc)
+      options.ProfileFilename = argv[++i];
+    else if (arg == "--latency")
+      options.Latency = true;
+    else if (arg == "--distance" && i + 1 < argc) {
+      if (!parseDistancePolicy(argv[++i], options.Distance)) {
+        cerr << "**ERROR: unknown distance policy '" << argv[i]
+             << "' (expected exact, haversine, equirectangular, planar or squared-planar)" << endl;
+        return false;
+      }
+    }
+    else
+      positional.push_back(arg);
+  }
+
+  if (positional.size() != 3) {
+    cerr << "usage: EvanstonCampusNavigator --batch mapfile stopfile queryfile" << endl;
+    cerr << "         [--threads N] [--output filename] [--predictions]" << endl;
+    cerr << "         [--prediction-source live[:URL] | record:FILE[,spec] | replay:FILE | replay-fast:FILE]" << endl;
+    cerr << "         [--format json | text | csv]" << endl;
+    cerr << "         [--distance exact | haversine | equirectangular | planar | squared-planar]" << endl;
+    cerr << "         [--profile-load tracefile] [--latency]" << endl;
+    return false;
+  }
+
+  options.MapFilename = positional[0];
+  options.StopFilename = positional[1];
+  options.QueryFilename = positional[2];
+
+  return true;
+}
+
+
+//
+// readQueryLines
+//
+// Reads the non-blank, non-comment lines of the query file.
+//
+static bool readQueryLines(const string& filename, vector<string>& lines)
+{
+  ifstream file;
+  istream* in = &cin;
+
+  if (filename != "-") {
+    file.open(filename);
+    if (!file.is_open()) {
+      cerr << "**ERROR: unable to open query file '" << filename << "'" << endl;
+      return false;
+    }
+    in = &file;
+  }
+
+  string line;
+
+  while (getline(*in, line)) {
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == string::npos || line[first] == '#')
+      continue;
+    lines.push_back(line);
+  }
+
+  return true;
+}
+
+
+//
+// runBatch
+//
+int runBatch(const BatchOptions& options)
+{
+  vector<string> lines;
+
+  if (!readQueryLines(options.QueryFilename, lines))
+    return 1;
+
+  string error;
+  unique_ptr<PredictionSource> predictions = makePredictionSource(options.PredictionSpec, error);
+
+  if (predictions == nullptr) {
+    cerr << "**ERROR: " << error << endl;
+    return 1;
+  }
+
+  //
+  // loading and the queries share the pool (see taskpool.h):
+  //
+  TaskPool::setSharedThreads(max(1, options.Threads));
+
+  //
+  // query latency is recorded only if it's to be reported:
+  //
+  setLatencyRecording(options.Latency);
+
+  MapData data;
+  LoadOptions load;
+  LoadProfiler profiler;
+  load.Report = &cerr;
+
+  if (!options.ProfileFilename.empty())
+    load.Profiler = &profiler;
+
+  bool loaded = loadMapData(options.MapFilename, options.StopFilename, data, load);
+
+  if (load.Profiler != nullptr) {
+    profiler.printTable(cerr);
+    if (!profiler.writeChromeTrace(options.ProfileFilename))
+      cerr << "**ERROR: unable to write trace file '" << options.ProfileFilename << "'" << endl;
+  }
+
+  if (!loaded)
+    return 1;
+
+  data.busStops.setDistancePolicy(options.Distance);
+
+  //
+  // status goes to stderr, keeping stdout for results:
+  //
+  cerr << "# of nodes: " << data.nodes.getNumMapNodes() << endl;
+  cerr << "# of buildings: " << data.buildings.getNumMapBuildings() << endl;
+  cerr << "# of bus stops: " << data.busStops.getNumBusStops() << endl;
+  cerr << "# of queries: " << lines.size() << endl;
+
+  FILE* out = stdout;
+
+  if (!options.OutputFilename.empty()) {
+    out = fopen(options.OutputFilename.c_str(), "wb");
+    if (out == nullptr) {
+      cerr << "**ERROR: unable to open output file '" << options.OutputFilename << "'" << endl;
+      return 1;
+    }
+  }
+
+  int numThreads = max(1, min(options.Threads, (int) lines.size()));
+
+  vector<OutputBuffer> results(min(BLOCK_SIZE, max(lines.size(), (size_t) 1)));
+
+  if (options.Format == OutputFormat::Csv) {
+    OutputBuffer header;
+    formatCsvHeader(header);
+    header.writeTo(out);
+  }
+
+  for (size_t blockStart = 0; blockStart < lines.size(); blockStart += BLOCK_SIZE)
+  {
+    size_t blockEnd = min(lines.size(), blockStart + BLOCK_SIZE);
+    auto run = [&](size_t lo, size_t hi) {
+      for (size_t i = lo; i < hi; i++)
+      {
+        OutputBuffer& result = results[i - blockStart];
+
+        Query query;
+        string error;
+
+        if (parseQuery(lines[i], query, error))
+          formatResult(runQuery(query, data, predictions.get(), options.Predictions), options.Format, result);
+        else
+          formatQueryError(lines[i], error, options.Format, result);
+      }
+    };
+
+    if (numThreads == 1)
+      run(blockStart, blockEnd);
+    else
+      TaskPool::shared().parallelFor(blockStart, blockEnd, 1, run);
+
+    //
+    // write the block's results in order (each buffer is cleared,
+    // keeping its capacity for the next block):
+    //
+    for (size_t i = blockStart; i < blockEnd; i++)
+      results[i - blockStart].writeTo(out);
+  }
+
+  fflush(out);
+
+  if (out != stdout)
+    fclose(out);
+
+  if (options.Latency)
+    latencyReport(cerr);
+
+  return 0;
+}
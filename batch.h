@@ -0,0 +1,73 @@
+/*batch.h*/
+
+//
+// Non-interactive batch mode: loads a map and bus stops, then runs
+// every query in a query file (or stdin), writing one line of JSON
+// per query -- or, with --format, the results as text or CSV (see
+// format.h). See query.h for the query syntax.
+//
+// Usage:
+//
+//   EvanstonCampusNavigator --batch mapfile stopfile queryfile
+//       [--threads N] [--output filename] [--predictions]
+//       [--prediction-source spec] [--format json|text|csv]
+//       [--distance policy] [--profile-load tracefile] [--latency]
+//
+// A queryfile of "-" reads queries from stdin. Results come out in
+// the same order as the queries, whatever the thread count. Blank
+// lines and lines starting with '#' are skipped. Predictions come from
+// the live bus tracker unless another source is given, e.g. a
+// recording to replay (see predictions.h). The nearest bus stops are
+// found exactly unless a faster distance policy is given (see
+// distpolicy.h). How long each phase of loading took goes to stderr
+// with the other status lines (see startup.h). With --profile-load,
+// loading is profiled phase by phase (see profiler.h): a table of
+// time, memory and allocations goes to stderr, and a Chrome trace to
+// the file given. With --latency, the latency of each kind of search
+// the queries made is recorded, and its percentiles go to stderr at
+// the end (see latency.h).
+//
+
+#pragma once
+
+#include <string>
+
+#include "format.h"
+#include "distpolicy.h"
+
+using namespace std;
+
+
+//
+// BatchOptions
+//
+struct BatchOptions
+{
+  string MapFilename;
+  string StopFilename;
+  string QueryFilename;
+  string OutputFilename;     // empty => stdout
+  int Threads = 1;
+  bool Predictions = false;  // fetch predictions for building queries?
+  string PredictionSpec = "live";
+  OutputFormat Format = OutputFormat::Json;
+  DistancePolicy Distance = DistancePolicy::Exact;
+  string ProfileFilename;    // empty => don't profile loading
+  bool Latency = false;      // report query latency percentiles?
+};
+
+
+//
+// parseBatchArgs
+//
+// Parses the command line following "--batch". Returns true if
+// successful, false if not (a usage message has been output).
+//
+bool parseBatchArgs(int argc, char* argv[], BatchOptions& options);
+
+//
+// runBatch
+//
+// Runs batch mode, returning the process exit code.
+//
+int runBatch(const BatchOptions& options);
@@ -0,0 +1,719 @@
+/*bench.cpp*/
+
+//
+// Benchmark harness: times map loading and the query kernels
+// (building search, centroids, nearest bus stop and graph vertex,
+// walking routes) without touching the network or the console, so
+// runs are repeatable. Walking routes are timed on the walking
+// graph as built and again with its chains of shape nodes left
+// uncollapsed (see graph.h).
+//
+// Usage:
+//
+//   navbench mapfile stopfile [--queries filename] [--repeat N]
+//       [--predictions recording] [--node-order hilbert|id]
+//       [--threads N] [--profile-load tracefile]
+//
+// The queries file holds one building name (partial or complete)
+// per line, the same thing a user types at the CLI prompt. If no
+// file is given, every building's name is used as a query. The
+// stop file may also be a GTFS feed (directory or .zip), in which
+// case loading the feed, building the transit router and routing
+// between buildings by bus are timed too. Given a recording of bus
+// tracker replies (see predictions.h), the prediction pipeline --
+// fetch, parse, format -- is timed against it with no network delay.
+// Nodes are put in Hilbert curve order as the navigator loads them
+// (see Nodes::sortSpatially) unless --node-order id keeps them in id
+// order, for comparison. The nearest stop and graph point searches
+// are timed under each distance policy (see distpolicy.h).
+//
+// Loading is timed phase by phase, one after another, then as the
+// navigator does it, overlapped on the shared task pool (see
+// startup.h), and with --profile-load profiled phase by phase (see
+// profiler.h). Last, the scaling of the task pool (see taskpool.h)
+// is measured over the buildings and the nodes. The pool has up to
+// --threads threads (by default, one per hardware thread).
+//
+// The kernels are timed with query latency recording (see latency.h)
+// off; what recording costs is then measured on its own, as the
+// nearest stop searches and walking routes timed with it off and on.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <cstring>
+#include <thread>
+#include <functional>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "building.h"
+#include "buildings.h"
+#include "counters.h"
+#include "distpolicy.h"
+#include "busstops.h"
+#include "graph.h"
+#include "latency.h"
+#include "mapdata.h"
+#include "gtfs.h"
+#include "nodes.h"
+#include "osm.h"
+#include "predictions.h"
+#include "format.h"
+#include "raptor.h"
+#include "taskpool.h"
+#include "tinyxml2.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// cacheMisses
+//
+// Hardware cache misses by this process so far, from the kernel's
+// performance counters, or -1 where there are none to read (not
+// Linux, a VM without them, or perf_event_paranoid too strict).
+//
+static long long cacheMisses()
+{
+#ifdef __linux__
+  static int fd = [] {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }();
+
+  long long count;
+
+  if (fd >= 0 && read(fd, &count, sizeof(count)) == sizeof(count))
+    return count;
+#endif
+
+  return -1;
+}
+
+
+//
+// Stopwatch
+//
+// Wall-clock timer in milliseconds; in instrumented builds, also
+// counts heap allocations since the stopwatch was started, and
+// where the hardware counts them, cache misses.
+//
+class Stopwatch
+{
+private:
+  chrono::steady_clock::time_point Start;
+  unsigned long long StartAllocs;
+  long long StartMisses;
+
+  static unsigned long long allocsSoFar() {
+#ifdef NAV_INSTRUMENT
+    return counterGet(CTR_ALLOCATIONS);
+#else
+    return 0;
+#endif
+  }
+
+public:
+  Stopwatch() : Start(chrono::steady_clock::now()), StartAllocs(allocsSoFar()), StartMisses(cacheMisses()) { }
+
+  double elapsedMs() const {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - this->Start).count();
+  }
+
+  unsigned long long allocations() const {
+    return allocsSoFar() - this->StartAllocs;
+  }
+
+  long long misses() const {   // -1 if not counted
+    return (this->StartMisses < 0) ? -1 : cacheMisses() - this->StartMisses;
+  }
+};
+
+
+static void report(const string& phase, const Stopwatch& sw, long long ops)
+{
+  double ms = sw.elapsedMs();
+  long long misses = sw.misses();
+
+  cout << "  " << left << setw(32) << phase
+    << right << setw(12) << fixed << setprecision(3) << ms << " ms";
+
+  if (ops > 0)
+    cout << setw(14) << setprecision(1) << (ops / (ms / 1000.0)) << " ops/s";
+
+#ifdef NAV_INSTRUMENT
+  cout << setw(12) << sw.allocations() << " allocs";
+#endif
+
+  if (misses >= 0)
+    cout << setw(14) << misses << " misses";
+
+  cout << endl;
+}
+
+
+//
+// reportDiffering
+//
+// How many of the results found differ from the exact ones.
+//
+template <class T>
+static void reportDiffering(const vector<T>& found, const vector<T>& exact)
+{
+  size_t differing = 0;
+
+  for (size_t i = 0; i < found.size() && i < exact.size(); i++)
+    if (found[i] != exact[i])
+      differing++;
+
+  cout << "    " << differing << " of " << found.size() << " differ from exact" << endl;
+}
+
+
+static vector<string> readQueries(const string& filename)
+{
+  vector<string> queries;
+  ifstream file(filename);
+  string line;
+
+  while (getline(file, line)) {
+    if (!line.empty())
+      queries.push_back(line);
+  }
+
+  return queries;
+}
+
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    cerr << "usage: navbench mapfile stopfile [--queries filename] [--repeat N] [--predictions recording]"
+      << " [--node-order hilbert|id] [--threads N] [--profile-load tracefile]" << endl;
+    return 1;
+  }
+
+  string mapFilename = argv[1];
+  string stopFilename = argv[2];
+  string queryFilename;
+  string recordingFilename;
+  int repeat = 5;
+  bool spatial = true;
+  int maxThreads = max(1, (int) thread::hardware_concurrency());
+  string profileFilename;
+
+  for (int i = 3; i + 1 < argc; i += 2) {
+    string arg = argv[i];
+    if (arg == "--queries")
+      queryFilename = argv[i + 1];
+    else if (arg == "--repeat")
+      repeat = max(1, atoi(argv[i + 1]));
+    else if (arg == "--predictions")
+      recordingFilename = argv[i + 1];
+    else if (arg == "--node-order")
+      spatial = (string(argv[i + 1]) != "id");
+    else if (arg == "--threads")
+      maxThreads = max(1, atoi(argv[i + 1]));
+    else if (arg == "--profile-load")
+      profileFilename = argv[i + 1];
+  }
+
+  TaskPool::setSharedThreads(maxThreads);
+  setLatencyRecording(false);
+
+  XMLDocument xmldoc;
+  Nodes nodes;
+  Buildings buildings;
+  BusStops busStops;
+  Graph graph;
+  Graph fullGraph;   // every point a vertex, to compare against
+  unique_ptr<TransitRouter> router;
+
+  cout << "** load **" << endl;
+
+  if (gtfsIsFeed(stopFilename))
+  {
+    shared_ptr<GtfsFeed> feed = make_shared<GtfsFeed>();
+    string error;
+    {
+      Stopwatch sw;
+      if (!feed->load(stopFilename, error)) {
+        cerr << "**ERROR: " << error << endl;
+        return 1;
+      }
+      report("GtfsFeed::load", sw, feed->getNumStopTimes());
+    }
+    {
+      Stopwatch sw;
+      busStops.readFromGTFS(*feed);
+      report("readFromGTFS", sw, 0);
+    }
+
+    cout << "  (" << feed->getNumStops() << " stops, " << feed->getNumRoutes() << " routes, "
+      << feed->getNumTrips() << " trips, " << feed->getNumStopTimes() << " stop times, "
+      << fixed << setprecision(1) << feed->getMemoryBytes() / 1048576.0 << " MB)" << endl;
+
+    {
+      Stopwatch sw;
+      router = make_unique<TransitRouter>(feed);
+      report("TransitRouter", sw, 0);
+    }
+
+    cout << "  (" << router->getNumPatterns() << " patterns, " << router->getNumTransfers() << " transfers, "
+      << fixed << setprecision(1) << router->getMemoryBytes() / 1048576.0 << " MB)" << endl;
+  }
+  else
+  {
+    Stopwatch sw;
+    busStops.readFromCSV(stopFilename);
+    report("readFromCSV", sw, 0);
+  }
+  {
+    Stopwatch sw;
+    if (!osmLoadMapFile(mapFilename, xmldoc))
+      return 1;
+    report("osmLoadMapFile", sw, 0);
+  }
+  {
+    Stopwatch sw;
+    nodes.readMapNodes(xmldoc);
+    report("readMapNodes", sw, 0);
+  }
+  if (spatial)
+  {
+    Stopwatch sw;
+    nodes.sortSpatially();
+    report("sortSpatially", sw, 0);
+  }
+  {
+    Stopwatch sw;
+    buildings.readMapBuildings(xmldoc);
+    buildings.indexNodes(nodes);
+    report("readMapBuildings", sw, 0);
+  }
+  {
+    Stopwatch sw;
+    graph.readMapGraph(xmldoc, nodes);
+    report("readMapGraph", sw, 0);
+  }
+  {
+    Stopwatch sw;
+    fullGraph.readMapGraph(xmldoc, nodes, false);
+    report("readMapGraph (full)", sw, 0);
+  }
+
+  busStops.project(nodes.getProjection());
+
+  cout << "# of nodes: " << nodes.getNumMapNodes() << endl;
+  cout << "# of buildings: " << buildings.getNumMapBuildings() << endl;
+  cout << "# of bus stops: " << busStops.getNumBusStops() << endl;
+  cout << "# of graph vertices: " << graph.getNumVertices() << ", edges: " << graph.getNumEdges()
+    << " (of " << graph.getNumPoints() << " points, " << graph.getNumSegments() << " segments)" << endl;
+
+  //
+  // the same load as the navigator does it, with the phases that don't
+  // depend on each other overlapped on the task pool (see startup.h):
+  //
+  cout << "** concurrent load (" << TaskPool::shared().getNumThreads() << " threads) **" << endl;
+
+  {
+    MapData loaded;
+    LoadOptions load;
+    load.Report = &cout;
+
+    Stopwatch sw;
+    if (!loadMapData(mapFilename, stopFilename, loaded, load))
+      return 1;
+    report("loadMapData", sw, 0);
+  }
+
+  //
+  // and profiled, one phase at a time (see profiler.h):
+  //
+  if (!profileFilename.empty())
+  {
+    cout << "** profiled load **" << endl;
+
+    MapData loaded;
+    LoadOptions load;
+    LoadProfiler profiler;
+    load.Profiler = &profiler;
+
+    if (!loadMapData(mapFilename, stopFilename, loaded, load))
+      return 1;
+
+    profiler.printTable(cout);
+
+    if (!profiler.writeChromeTrace(profileFilename))
+      cerr << "**ERROR: unable to write trace file '" << profileFilename << "'" << endl;
+  }
+
+  vector<string> queries;
+
+  if (!queryFilename.empty())
+    queries = readQueries(queryFilename);
+  else
+    for (const Building& B : buildings.MapBuildings)
+      if (!B.Name.empty())
+        queries.push_back(string(B.Name));
+
+  //
+  // the checksum keeps the optimizer from discarding the work:
+  //
+  double checksum = 0.0;
+
+  cout << "** queries (" << queries.size() << " names, x" << repeat << ") **" << endl;
+
+  {
+    Stopwatch sw;
+    long long ops = 0;
+    for (int r = 0; r < repeat; r++) {
+      for (Building& B : buildings.MapBuildings) {
+        auto loc = B.getLocation(nodes);
+        checksum += loc.first + loc.second;
+        ops++;
+      }
+    }
+    report("centroids", sw, ops);
+  }
+
+  //
+  // the nearest stop and graph point by each distance policy (see
+  // distpolicy.h), and how often the approximate ones pick other
+  // than the exact one; the graph is a scan of every point, so at
+  // most 200 buildings' worth:
+  //
+  const DistancePolicy policies[] = { DistancePolicy::Exact, DistancePolicy::Haversine,
+    DistancePolicy::Equirectangular, DistancePolicy::Planar, DistancePolicy::SquaredPlanar };
+
+  vector<const BusStop*> exactStops;
+  vector<int> exactVertices;
+
+  for (DistancePolicy policy : policies)
+  {
+    string name = distancePolicyName(policy);
+    vector<const BusStop*> found;
+
+    busStops.setDistancePolicy(policy);
+
+    Stopwatch sw;
+    long long ops = 0;
+    for (int r = 0; r < repeat; r++) {
+      found.clear();
+      for (Building& B : buildings.MapBuildings) {
+        auto loc = B.getLocation(nodes);
+        auto south = busStops.findClosestStop(loc.first, loc.second, "Southbound");
+        auto north = busStops.findClosestStop(loc.first, loc.second, "Northbound");
+        checksum += south.second + north.second;
+        found.push_back(south.first);
+        found.push_back(north.first);
+        ops += 2;
+      }
+    }
+    report("findClosestStop/" + name, sw, ops);
+
+    if (policy == DistancePolicy::Exact)
+      exactStops = found;
+    else
+      reportDiffering(found, exactStops);
+  }
+
+  busStops.setDistancePolicy(DistancePolicy::Exact);
+
+  if (!buildings.MapBuildings.empty())
+  {
+    const size_t N = buildings.MapBuildings.size();
+    const size_t samples = min<size_t>(N, 200);
+
+    for (DistancePolicy policy : policies)
+    {
+      vector<int> found;
+
+      Stopwatch sw;
+      long long ops = 0;
+      for (int r = 0; r < repeat; r++) {
+        found.clear();
+        for (size_t i = 0; i < samples; i++) {
+          auto loc = buildings.MapBuildings[i * N / samples].getLocation(nodes);
+          int v = graph.nearestVertex(loc.first, loc.second, policy);
+          checksum += v;
+          found.push_back(v);
+          ops++;
+        }
+      }
+      report(string("nearestVertex/") + distancePolicyName(policy), sw, ops);
+
+      if (policy == DistancePolicy::Exact)
+        exactVertices = found;
+      else
+        reportDiffering(found, exactVertices);
+    }
+  }
+
+  {
+    Stopwatch sw;
+    long long ops = 0, matches = 0;
+    for (int r = 0; r < repeat; r++) {
+      for (const string& q : queries) {
+        for (Building& B : buildings.MapBuildings) {
+          if (B.Name.find(q) != string::npos) {
+            auto loc = B.getLocation(nodes);
+            auto south = busStops.findClosestStop(loc.first, loc.second, "Southbound");
+            auto north = busStops.findClosestStop(loc.first, loc.second, "Northbound");
+            checksum += south.second + north.second;
+            matches++;
+          }
+        }
+        ops++;
+      }
+    }
+    report("building search", sw, ops);
+    cout << "  (" << matches << " matches)" << endl;
+  }
+
+  //
+  // walking: between pairs of buildings spread across the map, on
+  // the graph as built and with every point a vertex:
+  //
+  if (graph.getNumPoints() > 0 && !buildings.MapBuildings.empty())
+  {
+    const size_t N = buildings.MapBuildings.size();
+    const size_t pairs = min<size_t>(N, 200);
+
+    for (const Graph* g : { &graph, &fullGraph })
+    {
+      vector<pair<int, int>> ends;
+      for (size_t i = 0; i < pairs; i++) {
+        ends.push_back({ g->vertexForBuilding(buildings.MapBuildings[i * N / pairs], nodes),
+          g->vertexForBuilding(buildings.MapBuildings[(i * N / pairs + N / 2) % N], nodes) });
+      }
+
+      Stopwatch sw;
+      long long ops = 0, found = 0;
+      for (int r = 0; r < repeat; r++) {
+        for (auto& e : ends) {
+          Path path = g->shortestPath(e.first, e.second);
+          checksum += path.Distance + path.NodeIDs.size();
+          found += path.Found;
+          ops++;
+        }
+      }
+      report(g == &graph ? "walk route" : "walk route (full graph)", sw, ops);
+      cout << "  (" << found << " found, " << fixed << setprecision(3)
+        << sw.elapsedMs() / max<long long>(ops, 1) << " ms/query)" << endl;
+    }
+  }
+
+  //
+  // transit: between pairs of buildings spread across the map,
+  // leaving through the morning:
+  //
+  if (router != nullptr && !buildings.MapBuildings.empty())
+  {
+    const size_t N = buildings.MapBuildings.size();
+    const size_t pairs = min<size_t>(N, 200);
+    long long ops = 0, journeys = 0;
+
+    vector<pair<double, double>> locations;
+    for (size_t i = 0; i < pairs; i++) {
+      locations.push_back(buildings.MapBuildings[i * N / pairs].getLocation(nodes));
+      locations.push_back(buildings.MapBuildings[(i * N / pairs + N / 2) % N].getLocation(nodes));
+    }
+
+    Stopwatch sw;
+    for (int r = 0; r < repeat; r++) {
+      for (size_t i = 0; i < pairs; i++) {
+        const auto& from = locations[2 * i];
+        const auto& to = locations[2 * i + 1];
+        int depart = 7 * 3600 + (int) (i * 37 % 10800);
+
+        auto result = router->route(from.first, from.second, to.first, to.second, depart);
+        checksum += result.back().Arrive;
+        journeys += result.size();
+        ops++;
+      }
+    }
+    report("transit route", sw, ops);
+    cout << "  (" << journeys << " Pareto journeys, " << fixed << setprecision(3)
+      << sw.elapsedMs() / max<long long>(ops, 1) << " ms/query)" << endl;
+  }
+
+  if (!recordingFilename.empty())
+  {
+    ReplayPredictionSource replay(0.0);
+    string error;
+
+    if (!replay.load(recordingFilename, error)) {
+      cerr << "**ERROR: " << error << endl;
+      return 1;
+    }
+
+    OutputBuffer text;
+    Stopwatch sw;
+    long long ops = 0, answered = 0;
+    for (int r = 0; r < repeat; r++) {
+      for (Building& B : buildings.MapBuildings) {
+        auto loc = B.getLocation(nodes);
+        for (const char* direction : { "Southbound", "Northbound" }) {
+          auto closest = busStops.findClosestStop(loc.first, loc.second, direction);
+          if (closest.first == nullptr)
+            continue;
+          Arrivals arrivals = busStops.getArrivals(*closest.first, &replay);
+          formatArrivalsText(arrivals, text);
+          answered += (arrivals.Result == Arrivals::Status::OK && !arrivals.List.empty());
+          checksum += text.size();
+          text.clear();
+          ops++;
+        }
+      }
+    }
+    report("predictions (replay)", sw, ops);
+    cout << "  (" << replay.getNumReplies() << " recorded replies, " << answered << " of " << ops << " calls answered)" << endl;
+  }
+
+  //
+  // the cost of latency recording (see latency.h): the nearest stop
+  // searches -- the shortest of the searches recorded -- and the
+  // walking routes, with recording off and on, best of 3 runs each:
+  //
+  cout << "** latency recording **" << endl;
+
+  {
+    const size_t N = buildings.MapBuildings.size();
+    const size_t pairs = min<size_t>(N, 200);
+
+    vector<pair<double, double>> locations;
+    vector<pair<int, int>> ends;
+
+    for (Building& B : buildings.MapBuildings)
+      locations.push_back(B.getLocation(nodes));
+
+    if (graph.getNumPoints() > 0)
+      for (size_t i = 0; i < pairs; i++)
+        ends.push_back({ graph.vertexForBuilding(buildings.MapBuildings[i * N / pairs], nodes),
+          graph.vertexForBuilding(buildings.MapBuildings[(i * N / pairs + N / 2) % N], nodes) });
+
+    auto nearest = [&]() {
+      for (int r = 0; r < repeat; r++)
+        for (auto& loc : locations)
+          checksum += busStops.findClosestStop(loc.first, loc.second, "Southbound").second
+            + busStops.findClosestStop(loc.first, loc.second, "Northbound").second;
+      return (long long) repeat * locations.size() * 2;
+    };
+
+    auto walk = [&]() {
+      for (int r = 0; r < repeat; r++)
+        for (auto& e : ends)
+          checksum += graph.shortestPath(e.first, e.second).Distance;
+      return (long long) repeat * ends.size();
+    };
+
+    for (auto kernel : { make_pair(string("findClosestStop"), function<long long()>(nearest)),
+                         make_pair(string("walk route"), function<long long()>(walk)) })
+    {
+      double best[2] = { 1e300, 1e300 };
+      long long ops = 0;
+
+      for (int run = 0; run < 3; run++)
+        for (int on = 0; on < 2; on++) {
+          setLatencyRecording(on == 1);
+          Stopwatch sw;
+          ops = kernel.second();
+          best[on] = min(best[on], sw.elapsedMs());
+        }
+
+      setLatencyRecording(false);
+
+      if (ops == 0)
+        continue;
+
+      cout << "  " << left << setw(32) << kernel.first << right << fixed << setprecision(1)
+        << setw(12) << (best[0] * 1e6 / ops) << " ns off" << setw(12) << (best[1] * 1e6 / ops) << " ns on"
+        << setw(10) << showpos << (100.0 * (best[1] - best[0]) / best[0]) << noshowpos << "%" << endl;
+    }
+
+    latencyReport(cout);
+  }
+
+  //
+  // scaling of the task pool's parallelFor (see taskpool.h): building
+  // centroids and projecting every node, at 1, 2, 4, ... threads up to
+  // --threads:
+  //
+  cout << "** parallelFor (1 to " << maxThreads << " threads) **" << endl;
+
+  {
+    const size_t NB = buildings.MapBuildings.size();
+    const size_t NN = nodes.getNumMapNodes();
+    const LocalProjection& projection = nodes.getProjection();
+
+    vector<double> centroids(NB), nodeX(NN), nodeY(NN);
+
+    for (int threads = 1; ; threads = min(2 * threads, maxThreads))
+    {
+      TaskPool pool(threads);
+      string suffix = "/" + to_string(threads) + (threads == 1 ? " thread" : " threads");
+
+      {
+        Stopwatch sw;
+        long long ops = 0;
+        for (int r = 0; r < repeat; r++) {
+          pool.parallelFor(0, NB, 0, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+              auto loc = buildings.MapBuildings[i].getLocation(nodes);
+              centroids[i] = loc.first + loc.second;
+            }
+          });
+          ops += NB;
+        }
+        report("centroids" + suffix, sw, ops);
+      }
+
+      {
+        Stopwatch sw;
+        long long ops = 0;
+        for (int r = 0; r < repeat; r++) {
+          pool.parallelFor(0, NN, 0, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+              const Node& N = nodes.getNode((int) i);
+              projection.project(N.getLat(), N.getLon(), nodeX[i], nodeY[i]);
+            }
+          });
+          ops += NN;
+        }
+        report("project nodes" + suffix, sw, ops);
+      }
+
+      if (threads == maxThreads)
+        break;
+    }
+
+    for (size_t i = 0; i < NB; i++)
+      checksum += centroids[i];
+    for (size_t i = 0; i < NN; i++)
+      checksum += nodeX[i] + nodeY[i];
+  }
+
+  cout << "checksum: " << setprecision(6) << checksum << endl;
+
+  return 0;
+}
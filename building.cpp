@@ -16,9 +16,9 @@
 #include <utility>
 #include <numeric>
 #include <iostream>
-#include <curl/curl.h>
 
 #include "building.h"
+#include "format.h"
 
 using namespace std;
 
@@ -26,8 +26,9 @@ using namespace std;
 //
 // constructor
 //
-Building::Building(long long id, string name, string streetAddr)
-  : ID(id), Name(name), StreetAddress(streetAddr)
+Building::Building(long long id, string_view name, string_view streetAddr,
+  pmr::memory_resource* resource)
+  : ID(id), Name(name), StreetAddress(streetAddr), NodeIDs(resource), NodeIndexes(resource)
 {
   //
   // the proper technique is to use member initialization list above,
@@ -37,7 +38,7 @@ Building::Building(long long id, string name, string streetAddr)
   //this->Name = name;
   //this->StreetAddress = streetAddr;
 
-  // vector is default initialized by its constructor
+  // vector is initialized empty, allocating from the given resource
 }
 
 //
@@ -61,62 +62,53 @@ bool Building::containsThisNode(long long nodeid)
 }
 
 //
-// print
-// 
-// prints information about a building --- id, name, etc. -- to
-// the console. The function is passed the Nodes for searching 
-// purposes.
+// describe
 //
-void Building::print(Nodes& nodes, const BusStops& busStops, CURL *curl)
+BuildingResult Building::describe(const Nodes& nodes, const BusStops& busStops, PredictionSource* predictions,
+  bool withPredictions) const
 {
-  cout << this->Name << endl;
-  cout << "Address: " << this->StreetAddress << endl;
-  cout << "Building ID: " << this->ID << endl;
-  std::cout << "# perimeter nodes: " << this->NodeIDs.size() << std::endl; // Number of perimeter nodes project 07
-  auto location = this->getLocation(nodes);
-  std::cout << "Location: (" << location.first << ", " << location.second << ")" << std::endl;
-
-
-///////remove if wrong project 7
-// Find the closest southbound bus stop
-    auto closestSouthbound = busStops.findClosestStop(location.first, location.second, "Southbound");
+  BuildingResult result;
 
-    // Find the closest northbound bus stop
-    auto closestNorthbound = busStops.findClosestStop(location.first, location.second, "Northbound");
+  result.B = this;
 
-    std::cout << "Closest southbound bus stop:" << endl; 
-        std::cout << "  " << closestSouthbound.first.getID() << ": " 
-          << closestSouthbound.first.getName() << ", bus #" 
-          << closestSouthbound.first.getRoute() 
-          // << closestSouthbound.first.getDirection()
-           << ", " 
-          << closestSouthbound.first.getCorner() <<  ", " 
-          << closestSouthbound.second << " miles" << std::endl;
-
-
-          ///predictions
-          // Get and print predictions for the southbound stop
-    std::string southboundPredictions = busStops.getPredictionsForStop(closestSouthbound.first, curl);
-    std::cout << southboundPredictions<<endl;
+  auto location = this->getLocation(nodes);
+  result.Lat = location.first;
+  result.Lon = location.second;
 
+  //
+  // the closest bus stop each way, and the buses due there:
+  //
+  for (StopResult* stop : { &result.Southbound, &result.Northbound })
+  {
+    auto closest = busStops.findClosestStop(location.first, location.second,
+      (stop == &result.Southbound) ? "Southbound" : "Northbound");
 
+    stop->Stop = closest.first;
+    stop->Miles = closest.second;
 
-   std::cout << "Closest northbound bus stop:" << endl; 
-     std::cout <<"  " 
-          << closestNorthbound.first.getID() << ": " 
-          << closestNorthbound.first.getName() << ", bus #" 
-          << closestNorthbound.first.getRoute()  
-          // << closestNorthbound.first.getDirection()
-           << ", " 
-          << closestNorthbound.first.getCorner() << ", " 
-          << closestNorthbound.second << " miles" << std::endl;
+    if (closest.first != nullptr && withPredictions) {
+      stop->Fetched = true;
+      stop->Predictions = busStops.getArrivals(*closest.first, predictions);
+    }
+  }
 
-          // Get and print predictions for the northbound stop
-    std::string northboundPredictions = busStops.getPredictionsForStop(closestNorthbound.first, curl);
-    std::cout << northboundPredictions<< endl;
+  return result;
+}
 
+//
+// print
+// 
+// prints information about a building --- id, name, etc. -- to
+// the console. The function is passed the Nodes for searching 
+// purposes.
+//
+void Building::print(Nodes& nodes, const BusStops& busStops, PredictionSource* predictions)
+{
+  OutputBuffer out;
 
+  formatBuildingText(this->describe(nodes, busStops, predictions, true), out);
 
+  out.writeTo(cout);
 
 //commented out
 
@@ -158,17 +150,33 @@ void Building::add(long long nodeid)
 // gets the center (lat, lon) of the building based
 // on the nodes that form the perimeter
 //
-pair<double, double> Building::getLocation(const Nodes& nodes)
+pair<double, double> Building::getLocation(const Nodes& nodes) const
 {
+  if (this->Located)
+    return std::make_pair(this->Lat, this->Lon);
+
 double sumLat = 0.0;
   double sumLon = 0.0;
 
-  for (auto id : this->NodeIDs) {
-    double lat, lon;
-    bool isEntrance; // This value is not used here
-    if (nodes.find(id, lat, lon, isEntrance)) {
-      sumLat += lat;
-      sumLon += lon;
+  //
+  // by index if the nodes have been looked up already, by id if not:
+  //
+  if (this->NodeIndexes.size() == this->NodeIDs.size()) {
+    for (int index : this->NodeIndexes) {
+      if (index >= 0) {
+        sumLat += nodes.getNode(index).getLat();
+        sumLon += nodes.getNode(index).getLon();
+      }
+    }
+  }
+  else {
+    for (auto id : this->NodeIDs) {
+      double lat, lon;
+      bool isEntrance; // This value is not used here
+      if (nodes.find(id, lat, lon, isEntrance)) {
+        sumLat += lat;
+        sumLon += lon;
+      }
     }
   }
 
@@ -9,15 +9,17 @@
 // 
 
 #pragma once
-#include "curl_util.h"
-#include <curl/curl.h>
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory_resource>
 #include "busstop.h"
 #include "busstops.h"
 #include "node.h"
 #include "nodes.h"
+#include "counters.h"
+#include "results.h"
 
 using namespace std;
 
@@ -32,18 +34,32 @@ using namespace std;
 // NOTE: the Name could be empty "", the HouseNumber could be
 // empty, and the Street could be empty. Imperfect data.
 //
+// NOTE: Name and StreetAddress are views of strings kept in the
+// string arena of the Buildings collection that loaded them (see
+// arena.h), and NodeIDs and NodeIndexes are allocated from that
+// collection's arena, so a Building must not outlive its Buildings.
+//
 class Building
 {
 public:
   long long ID;
-  string Name;
-  string StreetAddress;
-  vector<long long> NodeIDs;
+  string_view Name;
+  string_view StreetAddress;
+  pmr::vector<long long> NodeIDs;
+  pmr::vector<int> NodeIndexes;    // into Nodes, if indexed (see Buildings::indexNodes)
+  bool Located = false;            // Lat and Lon are getLocation's answer
+  double Lat = 0.0;                // (see Buildings::computeLocations)
+  double Lon = 0.0;
+
+#ifdef NAV_INSTRUMENT
+  InstanceCounter<CTR_BUILDINGS_CREATED, CTR_BUILDINGS_COPIED, CTR_BUILDINGS_MOVED> Counted;
+#endif
 
   //
   // constructor
   //
-  Building(long long id, string name, string streetAddr);
+  Building(long long id, string_view name, string_view streetAddr,
+    pmr::memory_resource* resource = pmr::get_default_resource());
 
   //
   // containsThisNode
@@ -53,6 +69,16 @@ public:
   //
   bool containsThisNode(long long nodeid);
 
+  //
+  // describe
+  //
+  // What there is to know about the building --- its location and
+  // the nearest bus stop each way, with the buses due there if
+  // withPredictions --- without printing any of it.
+  //
+  BuildingResult describe(const Nodes& nodes, const BusStops& busStops, PredictionSource* predictions,
+    bool withPredictions) const;
+
   //
   // print
   // 
@@ -60,7 +86,7 @@ public:
   // the console. The function is passed the Nodes for searching 
   // purposes.
   //
-  void print(Nodes& nodes, const BusStops& busStops, CURL *curl);
+  void print(Nodes& nodes, const BusStops& busStops, PredictionSource* predictions);
 
   //
   // adds the given nodeid to the end of the vector.
@@ -70,8 +96,9 @@ public:
 
   //
 // gets the center (lat, lon) of the building based
-// on the nodes that form the perimeter
+// on the nodes that form the perimeter; once computed
+// (see Buildings::computeLocations), just returns it
 //
-  pair<double, double> getLocation(const Nodes& nodes);
+  pair<double, double> getLocation(const Nodes& nodes) const;
 
 };
@@ -12,89 +12,229 @@
 #include <string>
 #include <vector>
 #include <cassert>
-#include <curl/curl.h>
+#include <algorithm>
 
 #include "busstop.h"
 #include "busstops.h"
 
 #include "buildings.h"
+#include "format.h"
+#include "latency.h"
 #include "nodes.h"
 #include "osm.h"
+#include "taskpool.h"
 #include "tinyxml2.h"
 
 using namespace std;
 using namespace tinyxml2;
 
 
+//
+// constructor
+//
+Buildings::Buildings()
+  : Strings(make_shared<Arena>()), Storage(make_shared<Arena>())
+{
+}
+
 //
 // readMapBuildings
 //
 // Given an XML document, reads through the document and 
 // stores all the buildings into the given vector.
 //
+// Names and addresses are copied straight from the XML document
+// into the string arena, and each building's node ids are gathered
+// into a reused scratch vector and then copied into an exactly
+// sized vector in the storage arena, so no per-building heap
+// allocations are made.
+//
 void Buildings::readMapBuildings(XMLDocument& xmldoc)
 {
   XMLElement* osm = xmldoc.FirstChildElement("osm");
   assert(osm != nullptr);
 
+  this->NameStarts.clear();   // the name index is out of date
+
+  vector<long long> nodeids;  // scratch, reused for each building
+
   //
-  // Parse the XML document way by way, looking for university buildings:
+  // find the buildings first, so the vector is allocated once and
+  // buildings are never moved by a reallocation:
   //
-  XMLElement* way = osm->FirstChildElement("way");
+  vector<XMLElement*> ways;
+
+  for (XMLElement* way = osm->FirstChildElement("way"); way != nullptr; way = way->NextSiblingElement("way"))
+  {
+    if (osmContainsKeyValue(way, "building", "university"))
+      ways.push_back(way);
+  }
 
-  while (way != nullptr)
+  this->MapBuildings.reserve(this->MapBuildings.size() + ways.size());
+
+  //
+  // Parse each university building:
+  //
+  for (XMLElement* way : ways)
   {
     const XMLAttribute* attr = way->FindAttribute("id");
     assert(attr != nullptr);
 
-    //
-    // if this is a building, store info into vector:
-    //
-    if (osmContainsKeyValue(way, "building", "university"))
-    {
-      string name = osmGetKeyValue(way, "name");
+    const char* name = osmFindKeyValue(way, "name");
+    const char* housenumber = osmFindKeyValue(way, "addr:housenumber");
+    const char* street = osmFindKeyValue(way, "addr:street");
+
+    string_view nameView = this->Strings->store(name == nullptr ? "" : name);
 
-      string streetAddr = osmGetKeyValue(way, "addr:housenumber")
-        + " "
-        + osmGetKeyValue(way, "addr:street");
+    string_view streetAddr = this->Strings->store(
+      housenumber == nullptr ? "" : housenumber,
+      " ",
+      street == nullptr ? "" : street);
 
-      //
-      // create building object, then add the associated
-      // node ids to the object:
-      //
-      long long id = attr->Int64Value();
+    //
+    // create the building in place at the end of the vector,
+    // then add the associated node ids to it:
+    //
+    long long id = attr->Int64Value();
 
-      Building B(id, name, streetAddr);
+    Building& B = this->MapBuildings.emplace_back(id, nameView, streetAddr, this->Storage->resource());
 
-      XMLElement* nd = way->FirstChildElement("nd");
+    nodeids.clear();
 
-      while (nd != nullptr)
-      {
-        const XMLAttribute* ndref = nd->FindAttribute("ref");
-        assert(ndref != nullptr);
+    XMLElement* nd = way->FirstChildElement("nd");
 
-        long long id = ndref->Int64Value();
+    while (nd != nullptr)
+    {
+      const XMLAttribute* ndref = nd->FindAttribute("ref");
+      assert(ndref != nullptr);
 
-        B.add(id);
+      long long id = ndref->Int64Value();
 
-        // advance to next node ref:
-        nd = nd->NextSiblingElement("nd");
-      }
+      nodeids.push_back(id);
 
-      //
-      // add the building to the vector:
-      //
-      this->MapBuildings.push_back(B);
-    }//if
+      // advance to next node ref:
+      nd = nd->NextSiblingElement("nd");
+    }
 
-    way = way->NextSiblingElement("way");
-  }//while
+    B.NodeIDs.assign(nodeids.begin(), nodeids.end());
+  }//for
 
   //
   // done:
   //
 }
 
+//
+// indexNodes
+//
+// Looks up each building's nodes once, so their positions are
+// then read by index; -1 for a node not in the map.
+//
+void Buildings::indexNodes(const Nodes& nodes)
+{
+  //
+  // the arena isn't thread-safe, so the indexes are allocated here
+  // and filled in on the shared task pool (see taskpool.h):
+  //
+  for (Building& B : this->MapBuildings)
+    B.NodeIndexes.assign(B.NodeIDs.size(), -1);
+
+  TaskPool::shared().parallelFor(0, this->MapBuildings.size(), 0, [&](size_t lo, size_t hi) {
+    for (size_t b = lo; b < hi; b++)
+    {
+      Building& B = this->MapBuildings[b];
+
+      for (size_t i = 0; i < B.NodeIDs.size(); i++)
+        B.NodeIndexes[i] = nodes.indexOf(B.NodeIDs[i]);
+    }
+  });
+}
+
+//
+// computeLocations
+//
+void Buildings::computeLocations(const Nodes& nodes)
+{
+  TaskPool::shared().parallelFor(0, this->MapBuildings.size(), 0, [&](size_t lo, size_t hi) {
+    for (size_t b = lo; b < hi; b++)
+    {
+      Building& B = this->MapBuildings[b];
+
+      B.Located = false;
+      auto location = B.getLocation(nodes);
+
+      B.Lat = location.first;
+      B.Lon = location.second;
+      B.Located = true;
+    }
+  });
+}
+
+//
+// indexNames
+//
+void Buildings::indexNames()
+{
+  size_t length = 0;
+
+  for (const Building& B : this->MapBuildings)
+    length += B.Name.size() + 1;
+
+  this->NameText.clear();
+  this->NameText.reserve(length);
+  this->NameStarts.clear();
+  this->NameStarts.reserve(this->MapBuildings.size() + 1);
+
+  for (const Building& B : this->MapBuildings) {
+    this->NameStarts.push_back(this->NameText.size());
+    this->NameText.append(B.Name);
+    this->NameText.push_back('\0');
+  }
+
+  this->NameStarts.push_back(this->NameText.size());
+}
+
+//
+// findNamed
+//
+// With the index, a match in the text is in the name whose start
+// most closely precedes it -- unless it runs on past that name's
+// '\0', which only a search for a string with a '\0' in it can, in
+// which case the search goes on from the next name.
+//
+size_t Buildings::findNamed(string_view name, size_t from) const
+{
+  size_t N = this->MapBuildings.size();
+
+  if (this->NameStarts.size() != N + 1)
+  {
+    for (size_t b = from; b < N; b++)
+      if (this->MapBuildings[b].Name.find(name) != string_view::npos)
+        return b;
+
+    return N;
+  }
+
+  string_view text = this->NameText;
+
+  while (from < N)
+  {
+    size_t at = text.find(name, this->NameStarts[from]);
+
+    if (at == string_view::npos)
+      return N;
+
+    size_t b = upper_bound(this->NameStarts.begin(), this->NameStarts.end(), at) - this->NameStarts.begin() - 1;
+
+    if (at + name.size() < this->NameStarts[b + 1])
+      return b;
+
+    from = b + 1;
+  }
+
+  return N;
+}
+
 //
 // print
 //
@@ -102,32 +242,73 @@ void Buildings::readMapBuildings(XMLDocument& xmldoc)
 //
 void Buildings::print()
 {
+  OutputBuffer out;
+
   for (const Building& B : this->MapBuildings) {
-    cout << B.ID << ": " << B.Name << ", " << B.StreetAddress << endl;
+    out.appendInt(B.ID);
+    out.append(": ");
+    out.append(B.Name);
+    out.append(", ");
+    out.append(B.StreetAddress);
+    out.append('\n');
   }
+
+  out.writeTo(cout);
 }
 
+//
+// # of stops in each direction whose predictions are prefetched
+// around each building found:
+//
+static const int PREFETCH_NEAREST = 3;
+
+
 //
 // findAndPrint
 //
-// Prints each building that contains the given name.
+// Prints each building that contains the given name. Predictions for
+// the stops around all of them are asked to be prefetched first, so
+// one call to the bus tracker can bring those printed together, and
+// the user's next search -- often for a nearby building -- finds the
+// rest waiting.
 //
-void Buildings::findAndPrint(string name, Nodes& nodes, const BusStops& busStops, CURL *curl)
+void Buildings::findAndPrint(const string& name, Nodes& nodes, const BusStops& busStops, PredictionSource* predictions)
 {
   // 
   // find every building that contains this name:
   //
-  for (Building& B : this->MapBuildings)
+  vector<Building*> found;
+
   {
-    if (B.Name.find(name) != string::npos) { // contains name:
-      B.print(nodes, busStops,  curl);
-    }
+    LatencyTimer timer(LAT_BUILDING_SEARCH);
+
+    for (size_t b = this->findNamed(name); b < this->MapBuildings.size(); b = this->findNamed(name, b + 1))
+      found.push_back(&this->MapBuildings[b]);   // contains name
+  }
+
+  if (predictions != nullptr) {
+    vector<pair<double, double>> locations;
+
+    for (Building* B : found)
+      locations.push_back(B->getLocation(nodes));
+
+    busStops.prefetchNear(locations, PREFETCH_NEAREST, predictions);
   }
+
+  //
+  // formatted into one buffer, written once:
+  //
+  OutputBuffer out;
+
+  for (Building* B : found)
+    formatBuildingText(B->describe(nodes, busStops, predictions, true), out);
+
+  out.writeTo(cout);
 }
 
 //
 // accessors / getters
 //
-int Buildings::getNumMapBuildings() {
+int Buildings::getNumMapBuildings() const {
   return (int) this->MapBuildings.size();
 }
@@ -11,16 +11,17 @@
 #pragma once
 #include "busstop.h"
 #include "busstops.h"
-#include "curl_util.h"
-#include <curl/curl.h>
 
 #include <iostream>
 #include <string>
 #include <vector>
+#include <memory>
+#include <string_view>
 
 #include "node.h"
 #include "nodes.h"
 #include "building.h"
+#include "arena.h"
 #include "tinyxml2.h"
 
 using namespace std;
@@ -32,9 +33,28 @@ using namespace tinyxml2;
 //
 class Buildings
 {
+private:
+  //
+  // arenas for load-time data: one for building names and addresses,
+  // kept together so name searches scan contiguous memory, and one
+  // for the node id vectors. Shared, so copies of the collection stay
+  // valid; freed in one shot with the last copy.
+  //
+  shared_ptr<Arena> Strings;
+  shared_ptr<Arena> Storage;
+
+  //
+  // the name index (see indexNames): every name, each followed by a
+  // '\0', and where each building's name starts, plus the end:
+  //
+  string NameText;
+  vector<size_t> NameStarts;
+
 public:
   vector<Building> MapBuildings;
 
+  Buildings();
+
   //
   // readMapBuildings
   //
@@ -43,6 +63,42 @@ public:
   //
   void readMapBuildings(XMLDocument& xmldoc);
 
+  //
+  // indexNodes
+  //
+  // Looks up each building's nodes once, so their positions are
+  // then read by index (see Nodes). Must be redone if the nodes are
+  // reloaded or reordered.
+  //
+  void indexNodes(const Nodes& nodes);
+
+  //
+  // computeLocations
+  //
+  // Computes each building's location (see Building::getLocation)
+  // once, so later calls just return it. Like indexNodes, must be
+  // redone if the nodes are reloaded.
+  //
+  void computeLocations(const Nodes& nodes);
+
+  //
+  // indexNames
+  //
+  // Copies the names into one block of text, so finding the
+  // buildings whose names contain a string (findNamed) is a single
+  // search through contiguous memory rather than one per building.
+  //
+  void indexNames();
+
+  //
+  // findNamed
+  //
+  // The index of the first building at or after from whose name
+  // contains name, or getNumMapBuildings() if there's none. Uses the
+  // name index if it is up to date, otherwise checks each building.
+  //
+  size_t findNamed(string_view name, size_t from = 0) const;
+
   //
   // print
   //
@@ -55,12 +111,12 @@ public:
   //
   // Prints each building that contains the given name.
   //
-  void findAndPrint(string name, Nodes& nodes, const BusStops& busStops, CURL *curl);
+  void findAndPrint(const string& name, Nodes& nodes, const BusStops& busStops, PredictionSource* predictions);
 
   //
   // accessors / getters
   //
-  int getNumMapBuildings();
+  int getNumMapBuildings() const;
 
 };
 
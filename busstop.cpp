@@ -15,14 +15,14 @@
 
 #include "busstop.h"
 #include "busstops.h"
-#include <curl/curl.h>
+#include <utility>
 
 
-BusStop::BusStop(int stopID, int busRoute, const std::string& stopName, const std::string& directionOfTravel, const std::string& corner,
+BusStop::BusStop(int stopID, int busRoute, std::string stopName, std::string directionOfTravel, std::string corner,
                  double latitude, double longitude)
-    : StopID(stopID), BusRoute(busRoute), StopName(stopName), 
-      DirectionOfTravel(directionOfTravel), Corner(corner), 
-      Latitude(latitude), Longitude(longitude) {}
+    : StopID(stopID), BusRoute(busRoute), StopName(std::move(stopName)), 
+      DirectionOfTravel(std::move(directionOfTravel)), Corner(std::move(corner)), 
+      Latitude(toE7(latitude)), Longitude(toE7(longitude)) {}
 
 
 bool BusStop::print()
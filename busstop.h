@@ -13,7 +13,8 @@
 */
 #pragma once
 #include <string>
-#include <curl/curl.h>
+#include "coord.h"
+#include "counters.h"
 
 
 class BusStop {
@@ -24,22 +25,28 @@ BusStop() = default; // Default constructor
     std::string StopName;
     std::string DirectionOfTravel;
     std::string Corner;
-    double Latitude;
-    double Longitude;
+    CoordE7 Latitude;     // 1e-7 degrees, see coord.h
+    CoordE7 Longitude;
 
-    BusStop(int stopID, int busRoute, const std::string& stopName, 
-            const std::string& directionOfTravel, const std::string& corner,
+#ifdef NAV_INSTRUMENT
+    InstanceCounter<CTR_BUSSTOPS_CREATED, CTR_BUSSTOPS_COPIED, CTR_BUSSTOPS_MOVED> Counted;
+#endif
+
+    // strings are taken by value and moved into place, so callers
+    // that pass temporaries (or std::move) never copy them
+    BusStop(int stopID, int busRoute, std::string stopName, 
+            std::string directionOfTravel, std::string corner,
             double latitude, double longitude);
 
 
-    //getters
+    //getters (by reference: callers that only compare or print don't copy)
     int getID() const { return StopID; }
     int getRoute() const { return BusRoute; }
-    std::string getName() const { return StopName; }
-    std::string getDirection() const { return DirectionOfTravel; }
-    std::string getCorner() const { return Corner; }
-    double getLatitude() const { return Latitude; }
-    double getLongitude() const { return Longitude; }
+    const std::string& getName() const { return StopName; }
+    const std::string& getDirection() const { return DirectionOfTravel; }
+    const std::string& getCorner() const { return Corner; }
+    double getLatitude() const { return fromE7(Latitude); }
+    double getLongitude() const { return fromE7(Longitude); }
 
     bool print();
 };
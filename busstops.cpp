@@ -9,17 +9,31 @@
    Date: November 30, 2023
 
    The BusStops class provides essential functionality for managing and accessing information about bus stops. It
-   utilizes the BusStop class to represent individual bus stops and relies on external libraries such as libcurl
-   and nlohmann::json for web requests and JSON parsing.
+   utilizes the BusStop class to represent individual bus stops, a PredictionSource (see predictions.h) for bus
+   arrival predictions, and nlohmann::json for JSON parsing.
 
    Functions included in this implementation:
    - readFromCSV(const std::string& filename): Reads bus stop data from a CSV file and populates the stops vector.
+     The file is memory-mapped and split in place (see csv.h); malformed rows are skipped and reported with
+     their line numbers.
+   - readFromGTFS(const GtfsFeed& feed): Converts a GTFS feed's stops into the same form, so the agency feed can
+     be used directly instead of a hand-converted CSV file.
    - print() const: Prints details of all bus stops, sorted by stop ID.
+   - project(const LocalProjection& projection): Projects the stops into the map's plane, so the searches below can
+     choose candidates without trigonometry. The stops are kept grouped by direction, as arrays the search kernels
+     of distpolicy.h scan.
+   - setDistancePolicy(DistancePolicy policy): Chooses how findClosestStop measures.
    - findClosestStop(double lat, double lon, const std::string& direction) const: Finds the closest bus stop based
      on given coordinates and travel direction.
+   - findClosestStops(double lat, double lon, const std::string& direction, int k) const: The k closest, nearest
+     first (used to prefetch predictions for stops a user is likely to look at next).
+   - prefetchNear(const std::vector<std::pair<double, double>>& locations, int k, PredictionSource* source) const:
+     Hints the k closest stops each way around each location to the prediction source, the closest ones first.
    - getNumBusStops() const: Retrieves the total number of bus stops in the collection.
-   - getPredictionsForStop(const BusStop& stop, CURL *curl) const: Retrieves and formats bus arrival predictions for
-     a specific bus stop using web requests and JSON parsing.
+   - getArrivals(const BusStop& stop, PredictionSource* source) const: Retrieves the bus arrival predictions for
+     a specific bus stop from the prediction source, parsing the JSON reply into a list.
+   - getArrivals(const std::vector<const BusStop*>& stops, PredictionSource* source) const: The same for several
+     stops, one fetchMany call per route.
 
 */
 
@@ -32,53 +46,118 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <algorithm>
+#include <numeric>
 #include "dist.h"
-#include "curl_util.h" 
-#include <curl/curl.h>
+#include "distpolicy.h"
+#include "csv.h"
+#include "outbuf.h"
+#include "latency.h"
 #include "json.hpp"
 
 
 
 using json = nlohmann::json;
 
+// Malformed CSV rows reported individually before just counting them
+static const int MAX_REPORTED_ERRORS = 20;
+
 
 void BusStops::readFromCSV(const std::string& filename) {
-    std::ifstream file(filename);
-    
-    if (!file.is_open()) {
+    MappedFile file;
+
+    if (!file.open(filename)) {
         std::cerr << "Error opening file: " << filename << std::endl;
         return;
     }
-    
-    std::string line;
 
-    while (getline(file, line)) {
-        std::stringstream ss(line);
-        std::string field;
-        std::vector<std::string> fields;
+    std::string_view text = file.view();
+
+    // New stops aren't projected (see project())
+    projection = LocalProjection();
+
+    // One row per line in practice, so the line count sizes the vector
+    stops.reserve(stops.size() + std::count(text.begin(), text.end(), '\n') + 1);
+
+    CsvReader csv(text);
+    std::vector<std::string_view> fields;  // views into the mapped file
+    int malformed = 0;
+
+    // Reports a bad row with its line number; past a few, just counts them
+    auto reject = [&](const std::string& why) {
+        if (++malformed <= MAX_REPORTED_ERRORS) {
+            std::cerr << filename << ":" << csv.getLine() << ": " << why << std::endl;
+        }
+    };
 
-        while (getline(ss, field, ',')) {
-            fields.push_back(field);
+    while (csv.next(fields)) {
+        if (!csv.getError().empty()) {
+            reject(csv.getError());
+            continue;
         }
 
         // Assuming the fields are: ID, Route, Name, Direction, Corner, Latitude, Longitude
-        if (fields.size() == 7) {
-            int stopID = std::stoi(fields[0]);
-            int route = std::stoi(fields[1]);
-            std::string name = fields[2];
-            std::string direction = fields[3];
-            std::string corner = fields[4];
-            double latitude = std::stod(fields[5]);
-            double longitude = std::stod(fields[6]);
+        if (fields.size() != 7) {
+            reject("expected 7 fields, found " + std::to_string(fields.size()));
+            continue;
+        }
+
+        int stopID, route;
+        double latitude, longitude;
+
+        if (!parseField(fields[0], stopID) || !parseField(fields[1], route)) {
+            reject("stop id and route must be integers");
+            continue;
+        }
+
+        if (!parseField(fields[5], latitude) || !parseField(fields[6], longitude)) {
+            reject("latitude and longitude must be numbers");
+            continue;
+        }
+
+        stops.emplace_back(stopID, route, std::string(fields[2]), std::string(fields[3]),
+                           std::string(fields[4]), latitude, longitude);
+    }
+
+    if (malformed > MAX_REPORTED_ERRORS) {
+        std::cerr << filename << ": " << (malformed - MAX_REPORTED_ERRORS)
+                  << " more malformed rows not shown" << std::endl;
+    }
+
+    group();
+}
+
+
+
+// Returns the field as an integer, or fallback if it isn't one
+static int intOr(std::string_view field, int fallback) {
+    int value;
+    return parseField(field, value) ? value : fallback;
+}
+
+void BusStops::readFromGTFS(const GtfsFeed& feed) {
+    // New stops aren't projected (see project())
+    projection = LocalProjection();
+
+    // One BusStop per (stop, route, direction), like the rows of the CSV format
+    stops.reserve(stops.size() + feed.StopRouteRoute.size());
 
-            BusStop stop(stopID, route, name, direction, corner, latitude, longitude);
-            stops.push_back(stop);
-        } else {
-            std::cerr << "Error: Incorrect number of fields in line: " << line << std::endl;
+    for (int s = 0; s < feed.getNumStops(); s++) {
+        // The stop number riders see (and the bus tracker expects) is
+        // stop_code when given; many agencies just use stop_id
+        int stopID = intOr(feed.StopCode[s], intOr(feed.StopIDs.get(s), s));
+
+        for (uint32_t k = feed.StopRouteStart[s]; k < feed.StopRouteStart[s + 1]; k++) {
+            int route = feed.StopRouteRoute[k];
+            int routeNumber = intOr(feed.RouteShortName[route], intOr(feed.RouteIDs.get(route), 0));
+
+            stops.emplace_back(stopID, routeNumber, std::string(feed.StopName[s]),
+                               feed.DirectionNames[feed.StopRouteDirection[k]],
+                               std::string(feed.StopDesc[s]), fromE7(feed.StopLat[s]), fromE7(feed.StopLon[s]));
         }
     }
 
-    file.close();
+    group();
 }
 
 
@@ -133,40 +212,236 @@ void BusStops::readFromCSV(const std::string& filename) {
 // }
 
 void BusStops::print() const {
-    // Create a copy of the stops vector to avoid modifying the original data
-    std::vector<BusStop> sortedStops = stops;
+    // Sort a permutation of indices by stop ID rather than a copy of the stops
+    std::vector<int> order(stops.size());
+    std::iota(order.begin(), order.end(), 0);
 
-    // Sort the vector based on stop ID
-    std::sort(sortedStops.begin(), sortedStops.end(),
-        [](const BusStop& a, const BusStop& b) {
-            return a.getID() < b.getID();
+    std::sort(order.begin(), order.end(),
+        [this](int a, int b) {
+            return stops[a].getID() < stops[b].getID();
         });
 
-    // Print the sorted bus stops
-    for (const auto& stop : sortedStops) {
-        std::cout << stop.getID() << ": bus " << stop.getRoute() 
-                  << ", " << stop.getName() << ", " << stop.getDirection()
-                  << ", " << stop.getCorner() << ", location (" 
-                  << stop.getLatitude() << ", " << stop.getLongitude() << ")"
-                  << std::endl;
+    // Print the bus stops in sorted order, formatted into one buffer (see outbuf.h) and written at once
+    OutputBuffer out;
+
+    for (int i : order) {
+        const BusStop& stop = stops[i];
+        out.appendInt(stop.getID());
+        out.append(": bus ");
+        out.appendInt(stop.getRoute());
+        out.append(", ");
+        out.append(stop.getName());
+        out.append(", ");
+        out.append(stop.getDirection());
+        out.append(", ");
+        out.append(stop.getCorner());
+        out.append(", location (");
+        out.appendGeneral(stop.getLatitude());
+        out.append(", ");
+        out.appendGeneral(stop.getLongitude());
+        out.append(")\n");
     }
+
+    out.writeTo(std::cout);
 }
 
-std::pair<BusStop, double> BusStops::findClosestStop(double lat, double lon, const std::string& direction) const {
-    double minDistance = std::numeric_limits<double>::max();
-    BusStop closestStop; // Will hold the closest bus stop
+void BusStops::group() {
+    directions.clear();
 
-    for (const auto& stop : stops) {
-        if (stop.getDirection() == direction) { // Assuming BusStop has a getDirection() method
-            double distance = distBetween2Points(lat, lon, stop.getLatitude(), stop.getLongitude());
-            if (distance < minDistance) {
-                minDistance = distance;
-                closestStop = stop;
+    for (size_t i = 0; i < stops.size(); i++) {
+        const BusStop& stop = stops[i];
+        auto set = std::find_if(directions.begin(), directions.end(),
+                                [&](const DirectionSet& d) { return d.direction == stop.getDirection(); });
+
+        if (set == directions.end()) {
+            directions.emplace_back();
+            set = directions.end() - 1;
+            set->direction = stop.getDirection();
+        }
+
+        double x = 0.0, y = 0.0;
+
+        if (projection.isValid()) {
+            projection.project(stop.getLatitude(), stop.getLongitude(), x, y);
+        }
+
+        set->stops.push_back((int) i);
+        set->lat.push_back(stop.getLatitude());
+        set->lon.push_back(stop.getLongitude());
+        set->x.push_back(x);
+        set->y.push_back(y);
+    }
+}
+
+PointSet BusStops::DirectionSet::points() const {
+    PointSet points;
+    points.Lat = lat.data();
+    points.Lon = lon.data();
+    points.X = x.data();
+    points.Y = y.data();
+    points.Count = stops.size();
+    return points;
+}
+
+const BusStops::DirectionSet* BusStops::directionSet(const std::string& direction) const {
+    for (const auto& set : directions) {
+        if (set.direction == direction) {
+            return &set;
+        }
+    }
+
+    return nullptr;
+}
+
+// Stops outside the map's box (a GTFS feed for the whole city, say)
+// widen the projection to take them in, so the error bound the
+// searches rely on holds for every stop. If that leaves the bound
+// too loose to be worth it, the stops aren't projected, and are
+// measured by haversine.
+void BusStops::project(const LocalProjection& projection) {
+    const double MAX_ERROR = 0.01;
+
+    this->projection = projection;
+
+    if (projection.isValid()) {
+        double minLat, maxLat, minLon, maxLon;
+        bool widened = false;
+
+        projection.getBounds(minLat, maxLat, minLon, maxLon);
+
+        for (const BusStop& stop : stops) {
+            if (!projection.covers(stop.getLatitude(), stop.getLongitude())) {
+                minLat = std::min(minLat, stop.getLatitude());
+                maxLat = std::max(maxLat, stop.getLatitude());
+                minLon = std::min(minLon, stop.getLongitude());
+                maxLon = std::max(maxLon, stop.getLongitude());
+                widened = true;
+            }
+        }
+
+        if (widened) {
+            this->projection = LocalProjection(minLat, maxLat, minLon, maxLon);
+
+            if (this->projection.getError() > MAX_ERROR) {
+                this->projection = LocalProjection();
+            }
+        }
+    }
+
+    group();
+}
+
+void BusStops::setDistancePolicy(DistancePolicy policy) {
+    this->policy = policy;
+}
+
+DistancePolicy BusStops::getDistancePolicy() const {
+    return policy;
+}
+
+
+// By the policy set, through the runtime dispatcher (see distpolicy.h);
+// the default (Exact) picks by planar distance and measures only the
+// stops that could be nearest by haversine
+std::pair<const BusStop*, double> BusStops::findClosestStop(double lat, double lon, const std::string& direction) const {
+    LatencyTimer timer(LAT_NEAREST_STOP);
+
+    const DirectionSet* set = directionSet(direction);
+
+    if (set == nullptr) { // none this way
+        return {nullptr, std::numeric_limits<double>::max()};
+    }
+
+    double miles;
+    size_t i = nearestBy(policy, set->points(), lat, lon, projection, miles);
+
+    return {&stops[set->stops[i]], miles};
+}
+
+
+std::vector<std::pair<const BusStop*, double>> BusStops::findClosestStops(double lat, double lon, const std::string& direction, int k) const {
+    std::vector<std::pair<const BusStop*, double>> closest;
+    size_t want = (size_t) std::max(k, 0);
+
+    const DirectionSet* set = directionSet(direction);
+
+    if (set == nullptr) {
+        return closest;
+    }
+
+    PointSet points = set->points();
+    QueryPoint q;
+    q.Lat = lat;
+    q.Lon = lon;
+
+    // Nearest first; equally near stops in the order they were read
+    auto nearer = [](const std::pair<const BusStop*, double>& a, const std::pair<const BusStop*, double>& b) {
+        return a.second < b.second || (a.second == b.second && a.first < b.first);
+    };
+
+    HaversineDistance haversine(q);
+
+    if (!projection.covers(lat, lon)) {
+        for (size_t i = 0; i < points.Count; i++) {
+            closest.emplace_back(&stops[set->stops[i]], haversine.key(points, i));
+        }
+    }
+    else if (want > 0) {
+        // The k nearest in the plane bound how far the k nearest by
+        // haversine can be; only stops within that are measured
+        projection.project(lat, lon, q.X, q.Y);
+
+        SquaredPlanarDistance planar(q);
+        std::vector<std::pair<const BusStop*, double>> candidates;
+
+        for (size_t i = 0; i < points.Count; i++) {
+            candidates.emplace_back(&stops[set->stops[i]], planar.key(points, i));
+        }
+
+        size_t kth = std::min(want, candidates.size()) - 1;
+        std::nth_element(candidates.begin(), candidates.begin() + kth, candidates.end(), nearer);
+
+        double limit = planarLimit(std::sqrt(candidates[kth].second), projection.getError());
+
+        for (size_t i = 0; i < points.Count; i++) {
+            if (planar.key(points, i) <= limit * limit) {
+                closest.emplace_back(&stops[set->stops[i]], haversine.key(points, i));
             }
         }
     }
 
-    return {closestStop, minDistance};
+    // Only the first k need to be in order
+    size_t n = std::min(closest.size(), want);
+
+    std::partial_sort(closest.begin(), closest.begin() + n, closest.end(), nearer);
+    closest.resize(n);
+
+    return closest;
+}
+
+
+void BusStops::prefetchNear(const std::vector<std::pair<double, double>>& locations, int k, PredictionSource* source) const {
+    if (source == nullptr) {
+        return;
+    }
+
+    std::vector<std::vector<std::pair<const BusStop*, double>>> around;
+
+    for (const auto& location : locations) {
+        for (const char* direction : { "Southbound", "Northbound" }) {
+            around.push_back(findClosestStops(location.first, location.second, direction, k));
+        }
+    }
+
+    // Closest first: those are about to be asked for, and the first call
+    // for them can bring the rest along (see prefetch.h)
+    for (int rank = 0; rank < k; rank++) {
+        for (const auto& stops : around) {
+            if (rank < (int) stops.size()) {
+                source->prefetch(stops[rank].first->getRoute(), stops[rank].first->getID());
+            }
+        }
+    }
 }
 
 
@@ -175,47 +450,117 @@ int BusStops::getNumBusStops() const {
 }
 
 
-std::string BusStops::getPredictionsForStop(const BusStop& stop, CURL *curl) const {
-    if (curl == nullptr) {
-        return "  <<bus predictions unavailable, CURL not initialized>>";
+const BusStop* BusStops::findByID(int stopID) const {
+    for (const auto& stop : stops) {
+        if (stop.getID() == stopID) {
+            return &stop;
+        }
     }
 
-    std::string response;
+    return nullptr;
+}
+
 
-    std::string apiKey = "32ZEDddQBfkQW87Kkamfbm8tS"; 
-    std::string route = std::to_string(stop.getRoute());
-    std::string stopId = std::to_string(stop.getID());
-    std::string url = "http://www.ctabustracker.com/bustime/api/v2/getpredictions?key=" + apiKey +
-                      "&rt=" + route + "&stpid=" + stopId + "&format=json";
+Arrivals BusStops::getArrivals(const BusStop& stop, PredictionSource* source) const {
+    LatencyTimer timer(LAT_PREDICTIONS);
+    Arrivals arrivals;
 
-    bool success = callWebServer(curl, url, response);
+    if (source == nullptr) {
+        arrivals.Result = Arrivals::Status::NoSource;
+        return arrivals;
+    }
+
+    std::string response;
+
+    // The live source, a recording, or a stub server; see predictions.h
+    bool success = source->fetch(stop.getRoute(), stop.getID(), response);
 
     if (!success) {
-        return "  <<bus predictions unavailable, call failed>>";
+        arrivals.Result = Arrivals::Status::CallFailed;
+        return arrivals;
+    }
+
+    return parseArrivals(response);
+}
+
+
+std::vector<Arrivals> BusStops::getArrivals(const std::vector<const BusStop*>& wanted, PredictionSource* source) const {
+    LatencyTimer timer(LAT_PREDICTIONS);
+    std::vector<Arrivals> arrivals(wanted.size());
+
+    if (source == nullptr) {
+        for (Arrivals& a : arrivals) {
+            a.Result = Arrivals::Status::NoSource;
+        }
+        return arrivals;
     }
 
+    // One fetchMany per route, for each stop once, in the order first wanted
+    std::vector<int> routes;
+
+    for (const BusStop* stop : wanted) {
+        if (std::find(routes.begin(), routes.end(), stop->getRoute()) == routes.end()) {
+            routes.push_back(stop->getRoute());
+        }
+    }
+
+    for (int route : routes) {
+        std::vector<int> stopIDs;
+
+        for (const BusStop* stop : wanted) {
+            if (stop->getRoute() == route && std::find(stopIDs.begin(), stopIDs.end(), stop->getID()) == stopIDs.end()) {
+                stopIDs.push_back(stop->getID());
+            }
+        }
+
+        std::vector<std::string> responses;
+        std::vector<bool> ok;
+
+        source->fetchMany(route, stopIDs, responses, ok, PredictionSource::Priority::Interactive);
+
+        for (size_t i = 0; i < wanted.size(); i++) {
+            if (wanted[i]->getRoute() != route) {
+                continue;
+            }
+
+            size_t j = std::find(stopIDs.begin(), stopIDs.end(), wanted[i]->getID()) - stopIDs.begin();
+
+            if (ok[j]) {
+                arrivals[i] = parseArrivals(responses[j]);
+            } else {
+                arrivals[i].Result = Arrivals::Status::CallFailed;
+            }
+        }
+    }
+
+    return arrivals;
+}
+
+
+Arrivals BusStops::parseArrivals(const std::string& response) {
+    Arrivals arrivals;
+
     try {
         auto jsondata = json::parse(response); // Parse the response into a JSON object
         auto predictions = jsondata["bustime-response"]["prd"]; // Access the predictions list
 
-        std::string formattedPredictions;
         for (auto& pred : predictions) {
-            std::string vid = pred.value("vid", "");
-            std::string rt = pred.value("rt", "");
-            std::string rtdir = pred.value("rtdir", "");
-            std::string prdctdn = pred.value("prdctdn", "");
-
-            if (!prdctdn.empty()) {
-                formattedPredictions += "  vehicle #" + vid + " on route " + rt + " travelling " + rtdir + " to arrive in " + prdctdn + " mins\n";
+            Arrival arrival;
+            arrival.Vehicle = pred.value("vid", "");
+            arrival.Route = pred.value("rt", "");
+            arrival.Direction = pred.value("rtdir", "");
+            arrival.Minutes = pred.value("prdctdn", "");
+
+            if (!arrival.Minutes.empty()) {
+                arrivals.List.push_back(std::move(arrival));
             }
         }
 
-        if (formattedPredictions.empty()) {
-            return "  <<no predictions available>>";
-        }
-
-        return formattedPredictions;
-    } catch (json::parse_error& e) {
-        return "  <<error parsing predictions>>";
+        arrivals.Result = Arrivals::Status::OK;
+    } catch (json::exception& e) {
+        arrivals.Result = Arrivals::Status::ParseError;
+        arrivals.List.clear();
     }
-}
\ No newline at end of file
+
+    return arrivals;
+}
@@ -9,17 +9,36 @@
    Date: November 30, 2023
 
    The BusStops class encapsulates essential functionality for managing and accessing information about bus stops.
-   It uses the BusStop class to represent individual bus stops and relies on external libraries such as libcurl for
-   web requests.
+   It uses the BusStop class to represent individual bus stops and a PredictionSource for bus arrival predictions.
 
    Member functions defined in this class:
-   - readFromCSV(const std::string& filename): Reads bus stop data from a CSV file and populates the stops vector.
+   - readFromCSV(const std::string& filename): Reads bus stop data from a CSV file (RFC 4180 quoting allowed) and
+     populates the stops vector, reporting malformed rows by line number.
+   - readFromGTFS(const GtfsFeed& feed): Populates the stops vector from a GTFS feed, one entry per stop for
+     each route and direction that serves it.
+   - project(const LocalProjection& projection): Projects the stops into the map's plane (see projection.h), after
+     which the searches below pick candidates by planar distance and measure only those by haversine; results and
+     reported distances are the same as before. The projection is widened to cover stops outside the map (or
+     dropped, if that would make it too inexact). Reading more stops drops the projection.
+   - setDistancePolicy(DistancePolicy policy): How findClosestStop measures (see distpolicy.h): exactly, by
+     default, or by one of the faster approximations; getDistancePolicy() returns it.
    - findClosestStop(double lat, double lon, const std::string& direction) const: Finds the closest bus stop based
-     on given coordinates and travel direction.
+     on given coordinates and travel direction; returns a pointer into the collection (nullptr if there are no
+     stops in that direction) rather than a copy.
+   - findClosestStopBy<Policy>(double lat, double lon, const std::string& direction) const: The same, by a
+     distance policy fixed at compile time, for callers that know which one they want.
+   - findClosestStops(double lat, double lon, const std::string& direction, int k) const: The k closest bus stops
+     in that direction, nearest first.
+   - prefetchNear(const std::vector<std::pair<double, double>>& locations, int k, PredictionSource* source) const:
+     Asks the source to prefetch predictions for the k closest stops each way around each location.
    - print() const: Prints details of all bus stops in a sorted order by stop ID.
    - getNumBusStops() const: Returns the total number of bus stops in the collection.
-   - getPredictionsForStop(const BusStop& stop, CURL *curl) const: Retrieves and formats bus arrival predictions for
-     a specific bus stop using web requests.
+   - getArrivals(const BusStop& stop, PredictionSource* source) const: Retrieves the bus arrival predictions for
+     a specific bus stop from a prediction source (live web requests or a recording, see predictions.h), as a
+     list; formatting them is up to the output layer (see format.h).
+   - getArrivals(const std::vector<const BusStop*>& stops, PredictionSource* source) const: The same for several
+     stops at once, with one call to the source's fetchMany per route, so a source that batches (the live API
+     takes up to 10 stops a call) answers stops on the same route together.
 
    The BusStops class serves as a central component for managing and accessing public transportation information,
    making it a crucial part of applications related to bus route planning and tracking.
@@ -29,23 +48,99 @@
 #include <vector>
 #include "busstop.h"
 #include "dist.h"
+#include "gtfs.h"
 #include <limits>
 #include <algorithm>
-#include <curl/curl.h>
+#include "predictions.h"
+#include "projection.h"
+#include "distpolicy.h"
+
+
+// A bus due at a stop, as the bus tracker predicts it
+struct Arrival {
+    std::string Vehicle;    // vid
+    std::string Route;      // rt
+    std::string Direction;  // rtdir
+    std::string Minutes;    // prdctdn: minutes away, or "DUE"
+};
+
+// The predictions for a stop, or why there aren't any
+struct Arrivals {
+    enum class Status { OK, NoSource, CallFailed, ParseError };
+
+    Status Result = Status::NoSource;
+    std::vector<Arrival> List;  // may be empty even if OK
+};
 
 
 class BusStops {
 private:
+    // The stops going one way, as parallel arrays for the search kernels
+    // (see distpolicy.h), in the order they were read
+    struct DirectionSet {
+        std::string direction;
+        std::vector<int> stops;                // indexes into BusStops::stops
+        std::vector<double> lat, lon;
+        std::vector<double> x, y;              // projected, see project()
+
+        PointSet points() const;
+    };
+
     std::vector<BusStop> stops;
+    std::vector<DirectionSet> directions;
+    LocalProjection projection;                // see project()
+    DistancePolicy policy = DistancePolicy::Exact;
+
+    void group();  // rebuilds directions from stops
+    static Arrivals parseArrivals(const std::string& response);  // a getpredictions reply
+    const DirectionSet* directionSet(const std::string& direction) const;
 
 public:
     void readFromCSV(const std::string& filename);
-    std::pair<BusStop, double> findClosestStop(double lat, double lon, const std::string& direction) const;
+    void readFromGTFS(const GtfsFeed& feed);
+    void project(const LocalProjection& projection);
+
+    void setDistancePolicy(DistancePolicy policy);
+    DistancePolicy getDistancePolicy() const;
+
+    std::pair<const BusStop*, double> findClosestStop(double lat, double lon, const std::string& direction) const;
+
+    // findClosestStop by a policy chosen at compile time; the planar ones
+    // need the stops projected and (lat, lon) inside the projection
+    template <class Policy>
+    std::pair<const BusStop*, double> findClosestStopBy(double lat, double lon, const std::string& direction) const {
+        const DirectionSet* set = directionSet(direction);
+
+        if (set == nullptr) {
+            return {nullptr, std::numeric_limits<double>::max()};
+        }
+
+        QueryPoint q;
+        q.Lat = lat;
+        q.Lon = lon;
+
+        if (Policy::PLANAR) {
+            projection.project(lat, lon, q.X, q.Y);
+        }
+
+        double miles;
+        size_t i = nearest<Policy>(set->points(), q, miles);
+
+        return {&stops[set->stops[i]], miles};
+    }
+
+    std::vector<std::pair<const BusStop*, double>> findClosestStops(double lat, double lon, const std::string& direction, int k) const;
+    void prefetchNear(const std::vector<std::pair<double, double>>& locations, int k, PredictionSource* source) const;
 
     void print() const;
 
     int getNumBusStops() const; // Returns the number of bus stops
 
-std::string getPredictionsForStop(const BusStop& stop, CURL *curl) const; 
+    const BusStop* findByID(int stopID) const; // nullptr if no such stop
+
+    Arrivals getArrivals(const BusStop& stop, PredictionSource* source) const;
+
+    // the same for several stops, asked for a route at a time (see fetchMany in predictions.h)
+    std::vector<Arrivals> getArrivals(const std::vector<const BusStop*>& stops, PredictionSource* source) const;
     
 };
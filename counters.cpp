@@ -0,0 +1,222 @@
+/*counters.cpp*/
+
+//
+// Opt-in instrumentation counters; see counters.h. Everything here
+// is compiled only when NAV_INSTRUMENT is defined.
+//
+
+#include "counters.h"
+
+#ifdef NAV_INSTRUMENT
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+
+using namespace std;
+
+
+static const int NUM_SHARDS = 64;
+
+static const char* CounterNames[NUM_COUNTERS] = {
+  "nodes created",
+  "node lookups",
+  "buildings created",
+  "buildings copied",
+  "buildings moved",
+  "bus stops created",
+  "bus stops copied",
+  "bus stops moved",
+  "heap allocations",
+  "heap bytes allocated"
+};
+
+
+//
+// Shard
+//
+// One thread's (or a few threads') counters, on cache lines of
+// their own.
+//
+struct alignas(64) Shard
+{
+  atomic<uint64_t> Counts[NUM_COUNTERS];
+};
+
+static Shard Shards[NUM_SHARDS];   // zero-initialized (static storage)
+static atomic<unsigned> NextShard(0);
+
+
+static Shard& myShard()
+{
+  thread_local unsigned index = NextShard.fetch_add(1, memory_order_relaxed) % NUM_SHARDS;
+
+  return Shards[index];
+}
+
+
+void counterAdd(Counter c, uint64_t n)
+{
+  myShard().Counts[c].fetch_add(n, memory_order_relaxed);
+}
+
+
+uint64_t counterGet(Counter c)
+{
+  uint64_t sum = 0;
+
+  for (int s = 0; s < NUM_SHARDS; s++)
+    sum += Shards[s].Counts[c].load(memory_order_relaxed);
+
+  return sum;
+}
+
+
+void counterReport(ostream& out)
+{
+  out << "** instrumentation counters **" << endl;
+
+  for (int c = 0; c < NUM_COUNTERS; c++)
+    out << "  " << left << setw(24) << CounterNames[c] << right << setw(14)
+      << counterGet((Counter) c) << endl;
+}
+
+
+//
+// Report at exit: a static object's destructor runs after main
+// returns (or exit is called).
+//
+namespace
+{
+  struct ReportAtExit
+  {
+    ~ReportAtExit() { counterReport(cerr); }
+  };
+
+  ReportAtExit reportAtExit;
+}
+
+
+//
+// Allocation counting: replace the global operator new / delete.
+// The library's sized deletes forward to these, but its aligned
+// (std::align_val_t) variants don't, so those are replaced too.
+//
+void* operator new(size_t size)
+{
+  counterAdd(CTR_ALLOCATIONS, 1);
+  counterAdd(CTR_ALLOCATED_BYTES, size);
+
+  void* p = malloc(size == 0 ? 1 : size);
+
+  if (p == nullptr)
+    throw bad_alloc();
+
+  return p;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+  counterAdd(CTR_ALLOCATIONS, 1);
+  counterAdd(CTR_ALLOCATED_BYTES, size);
+
+  return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const nothrow_t& tag) noexcept
+{
+  return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  free(p);
+}
+
+
+//
+// alignedAlloc
+//
+// aligned_alloc wants the size to be a multiple of the alignment.
+//
+static void* alignedAlloc(size_t size, align_val_t align) noexcept
+{
+  size_t alignment = (size_t) align;
+  size_t rounded = (size + alignment - 1) / alignment * alignment;
+
+  return aligned_alloc(alignment, rounded == 0 ? alignment : rounded);
+}
+
+void* operator new(size_t size, align_val_t align)
+{
+  counterAdd(CTR_ALLOCATIONS, 1);
+  counterAdd(CTR_ALLOCATED_BYTES, size);
+
+  void* p = alignedAlloc(size, align);
+
+  if (p == nullptr)
+    throw bad_alloc();
+
+  return p;
+}
+
+void* operator new[](size_t size, align_val_t align)
+{
+  return operator new(size, align);
+}
+
+void* operator new(size_t size, align_val_t align, const nothrow_t&) noexcept
+{
+  counterAdd(CTR_ALLOCATIONS, 1);
+  counterAdd(CTR_ALLOCATED_BYTES, size);
+
+  return alignedAlloc(size, align);
+}
+
+void* operator new[](size_t size, align_val_t align, const nothrow_t& tag) noexcept
+{
+  return operator new(size, align, tag);
+}
+
+void operator delete(void* p, align_val_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, align_val_t) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t, align_val_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, size_t, align_val_t) noexcept
+{
+  free(p);
+}
+
+#endif
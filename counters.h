@@ -0,0 +1,90 @@
+/*counters.h*/
+
+//
+// Opt-in instrumentation counters: how many nodes are created, how
+// many buildings and bus stops are created, copied and moved, how
+// many node lookups are done, and how many heap allocations are
+// made. (Nodes are plain data, copied with memcpy, so their copies
+// aren't counted.)
+//
+// Counting is compiled in only when NAV_INSTRUMENT is defined (the
+// CMake option of the same name). Otherwise NAV_COUNT(...) expands
+// to nothing and InstanceCounter is not used, so a normal build
+// pays nothing at all.
+//
+// When enabled, each thread adds into its own cache-line-aligned
+// shard of relaxed atomics, so counting from many threads does not
+// bounce a shared cache line; the shards are summed when read. A
+// report is printed to stderr at exit.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+
+//
+// Counter
+//
+enum Counter
+{
+  CTR_NODES_CREATED,
+  CTR_NODE_LOOKUPS,
+  CTR_BUILDINGS_CREATED,
+  CTR_BUILDINGS_COPIED,
+  CTR_BUILDINGS_MOVED,
+  CTR_BUSSTOPS_CREATED,
+  CTR_BUSSTOPS_COPIED,
+  CTR_BUSSTOPS_MOVED,
+  CTR_ALLOCATIONS,
+  CTR_ALLOCATED_BYTES,
+  NUM_COUNTERS
+};
+
+
+#ifdef NAV_INSTRUMENT
+
+//
+// counterAdd / counterGet / counterReport
+//
+// Add to this thread's shard; sum over all shards; print every
+// counter to the given stream.
+//
+void counterAdd(Counter c, uint64_t n);
+uint64_t counterGet(Counter c);
+void counterReport(ostream& out);
+
+#define NAV_COUNT(c) counterAdd((c), 1)
+#define NAV_COUNT_N(c, n) counterAdd((c), (n))
+
+
+//
+// InstanceCounter
+//
+// Add one as a data member to a class to count how many objects are
+// created, copied and moved; the class's own implicit copy and
+// move operations call these. Only present in instrumented builds:
+//
+//   #ifdef NAV_INSTRUMENT
+//     InstanceCounter<CTR_BUILDINGS_CREATED, CTR_BUILDINGS_COPIED, CTR_BUILDINGS_MOVED> Counted;
+//   #endif
+//
+template <Counter CREATED, Counter COPIED, Counter MOVED>
+struct InstanceCounter
+{
+  InstanceCounter() { counterAdd(CREATED, 1); }
+  InstanceCounter(const InstanceCounter&) { counterAdd(COPIED, 1); }
+  InstanceCounter(InstanceCounter&&) noexcept { counterAdd(MOVED, 1); }
+  InstanceCounter& operator=(const InstanceCounter&) { counterAdd(COPIED, 1); return *this; }
+  InstanceCounter& operator=(InstanceCounter&&) noexcept { counterAdd(MOVED, 1); return *this; }
+};
+
+#else
+
+#define NAV_COUNT(c) ((void) 0)
+#define NAV_COUNT_N(c, n) ((void) 0)
+
+#endif
@@ -0,0 +1,325 @@
+/*csv.cpp*/
+
+//
+// Reading CSV files without copying them: the file is memory-mapped
+// and split into fields in place, as string_views into the mapping.
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "csv.h"
+
+using namespace std;
+
+
+//
+// MappedFile
+//
+MappedFile::MappedFile()
+  : Data(nullptr), Size(0)
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+  if (this->Data != nullptr)
+    munmap((void*) this->Data, this->Size);
+}
+
+
+bool MappedFile::open(const string& filename)
+{
+  if (this->Data != nullptr) {
+    munmap((void*) this->Data, this->Size);
+    this->Data = nullptr;
+    this->Size = 0;
+  }
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    ::close(fd);
+    return false;
+  }
+
+  if (info.st_size == 0) {  // mmap rejects a 0-length mapping
+    ::close(fd);
+    return true;
+  }
+
+  void* p = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (p == MAP_FAILED)
+    return false;
+
+  madvise(p, (size_t) info.st_size, MADV_SEQUENTIAL);
+
+  this->Data = (const char*) p;
+  this->Size = (size_t) info.st_size;
+
+  return true;
+}
+
+
+//
+// CsvReader
+//
+CsvReader::CsvReader(string_view text, size_t firstLine)
+  : Text(text), Pos(0), Line(firstLine), RowLine(0)
+{
+  if (firstLine == 1 && this->Text.substr(0, 3) == "\xEF\xBB\xBF")  // UTF-8 byte order mark
+    this->Pos = 3;
+}
+
+
+//
+// next
+//
+bool CsvReader::next(vector<string_view>& fields)
+{
+  const size_t N = this->Text.size();
+  size_t unescaped = 0;
+
+  fields.clear();
+  this->Error.clear();
+
+  //
+  // skip blank lines:
+  //
+  while (this->Pos < N)
+  {
+    if (this->Text[this->Pos] == '\n') {
+      this->Pos++;
+      this->Line++;
+    }
+    else if (this->Text[this->Pos] == '\r' && this->Pos + 1 < N && this->Text[this->Pos + 1] == '\n') {
+      this->Pos += 2;
+      this->Line++;
+    }
+    else
+      break;
+  }
+
+  if (this->Pos >= N)
+    return false;
+
+  this->RowLine = this->Line;
+
+  while (true)
+  {
+    if (this->Pos < N && this->Text[this->Pos] == '"')
+    {
+      //
+      // quoted field: find the closing quote, stepping over "" pairs:
+      //
+      size_t start = this->Pos + 1;
+      size_t p = start;
+      size_t end = string_view::npos;
+      bool escaped = false;
+
+      while (p < N)
+      {
+        size_t q = this->Text.find('"', p);
+
+        if (q == string_view::npos)
+          break;
+
+        if (q + 1 < N && this->Text[q + 1] == '"') {
+          escaped = true;
+          p = q + 2;
+          continue;
+        }
+
+        end = q;
+        break;
+      }
+
+      if (end == string_view::npos) {
+        this->Error = "unterminated quoted field " + to_string(fields.size() + 1);
+        end = N;
+      }
+
+      string_view raw = this->Text.substr(start, end - start);
+
+      this->Line += count(raw.begin(), raw.end(), '\n');
+
+      if (escaped)
+      {
+        if (unescaped == this->Unescaped.size())
+          this->Unescaped.emplace_back();
+
+        string& buffer = this->Unescaped[unescaped++];
+        buffer.clear();
+
+        for (size_t i = 0; i < raw.size(); i++) {
+          buffer += raw[i];
+          if (raw[i] == '"')
+            i++;  // skip the second quote of the pair
+        }
+
+        fields.push_back(buffer);
+      }
+      else
+        fields.push_back(raw);
+
+      this->Pos = min(end + 1, N);
+
+      //
+      // only a delimiter may follow the closing quote; skip anything
+      // else up to the next one:
+      //
+      if (this->Pos < N && this->Text[this->Pos] != ',' && this->Text[this->Pos] != '\n'
+        && !(this->Text[this->Pos] == '\r' && this->Pos + 1 < N && this->Text[this->Pos + 1] == '\n'))
+      {
+        if (this->Error.empty())
+          this->Error = "unexpected text after closing quote in field " + to_string(fields.size());
+
+        size_t q = this->Text.find_first_of(",\n", this->Pos);
+        this->Pos = (q == string_view::npos) ? N : q;
+      }
+    }
+    else
+    {
+      //
+      // unquoted field: runs to the next comma or end of line:
+      //
+      size_t q = this->Text.find_first_of(",\n", this->Pos);
+      if (q == string_view::npos)
+        q = N;
+
+      string_view field = this->Text.substr(this->Pos, q - this->Pos);
+
+      if (!field.empty() && field.back() == '\r' && (q == N || this->Text[q] == '\n'))
+        field.remove_suffix(1);
+
+      fields.push_back(field);
+
+      this->Pos = q;
+    }
+
+    //
+    // after a field: another field, the end of the row, or the end
+    // of the text:
+    //
+    if (this->Pos >= N)
+      return true;
+
+    if (this->Text[this->Pos] == ',') {
+      this->Pos++;
+      continue;
+    }
+
+    if (this->Text[this->Pos] == '\r')
+      this->Pos++;
+
+    this->Pos++;  // the '\n'
+    this->Line++;
+
+    return true;
+  }
+}
+
+
+//
+// CsvStream
+//
+CsvStream::CsvStream()
+  : Line(1)
+{
+}
+
+
+//
+// rowEnd
+//
+// Scans text for line breaks outside quotes, starting inside a
+// quoted field if quoted is true. Returns the position just past
+// the first such line break (or the last, if last is true), or
+// npos if there is none.
+//
+static size_t rowEnd(string_view text, bool quoted, bool last)
+{
+  size_t end = string_view::npos;
+
+  for (size_t i = 0; i < text.size(); i++)
+  {
+    char c = text[i];
+
+    if (c == '"')
+      quoted = !quoted;  // a "" escape toggles twice
+    else if (c == '\n' && !quoted) {
+      end = i + 1;
+      if (!last)
+        break;
+    }
+  }
+
+  return end;
+}
+
+
+void CsvStream::parse(string_view text, const RowFunction& onRow)
+{
+  CsvReader csv(text, this->Line);
+
+  while (csv.next(this->Fields))
+    onRow(this->Fields, csv.getLine(), csv.getError());
+
+  this->Line += count(text.begin(), text.end(), '\n');
+}
+
+
+void CsvStream::feed(string_view piece, const RowFunction& onRow)
+{
+  //
+  // first complete the row carried over from the last piece:
+  //
+  if (!this->Carry.empty())
+  {
+    bool quoted = count(this->Carry.begin(), this->Carry.end(), '"') % 2 != 0;
+    size_t end = rowEnd(piece, quoted, false);
+
+    if (end == string_view::npos) {  // still not complete
+      this->Carry.append(piece);
+      return;
+    }
+
+    this->Carry.append(piece.substr(0, end));
+    this->parse(this->Carry, onRow);
+    this->Carry.clear();
+
+    piece.remove_prefix(end);
+  }
+
+  //
+  // then parse straight out of the caller's buffer, and copy only
+  // the partial row at the end:
+  //
+  size_t end = rowEnd(piece, false, true);
+
+  if (end == string_view::npos)
+    end = 0;
+
+  this->parse(piece.substr(0, end), onRow);
+  this->Carry.assign(piece.substr(end));
+}
+
+
+void CsvStream::finish(const RowFunction& onRow)
+{
+  this->parse(this->Carry, onRow);
+  this->Carry.clear();
+}
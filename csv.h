@@ -0,0 +1,187 @@
+/*csv.h*/
+
+//
+// Reading CSV files without copying them: the file is memory-mapped
+// and split into fields in place, as string_views into the mapping.
+//
+// Quoting follows RFC 4180: a field may be enclosed in double quotes,
+// and then may contain commas, line breaks, and doubled quotes ("")
+// standing for one quote. Lines may end in \n or \r\n, and a UTF-8
+// byte order mark at the start of the file is skipped.
+//
+// References:
+//
+// RFC 4180, Common Format and MIME Type for CSV Files:
+//   https://www.rfc-editor.org/rfc/rfc4180
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <charconv>
+#include <cstddef>
+
+using namespace std;
+
+
+//
+// MappedFile
+//
+// A read-only memory mapping of a whole file, unmapped when the
+// object is destroyed.
+//
+class MappedFile
+{
+private:
+  const char* Data;
+  size_t Size;
+
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  //
+  // open
+  //
+  // Maps the given file, returning false (with errno set) if it
+  // cannot be opened or mapped. An empty file opens as an empty
+  // view.
+  //
+  bool open(const string& filename);
+
+  string_view view() const { return string_view(this->Data, this->Size); }
+};
+
+
+//
+// CsvReader
+//
+// Iterates over the rows of CSV text:
+//
+//   CsvReader csv(file.view());
+//   vector<string_view> fields;
+//
+//   while (csv.next(fields)) {
+//     if (!csv.getError().empty())
+//       cerr << filename << ":" << csv.getLine() << ": " << csv.getError() << endl;
+//     ...
+//   }
+//
+// Unquoted fields, and quoted fields without doubled quotes, are
+// views into the text itself; a quoted field with "" escapes is
+// unescaped into storage owned by the reader, valid until the next
+// call to next(). Blank lines are skipped.
+//
+class CsvReader
+{
+private:
+  string_view Text;
+  size_t Pos;
+  size_t Line;         // line the next row starts on
+  size_t RowLine;      // line the current row started on
+  string Error;
+  deque<string> Unescaped;   // one buffer per field that needed it;
+                             // a deque, so growing it moves no strings
+
+public:
+  //
+  // constructor
+  //
+  // firstLine is the line number of the first row of text, for text
+  // that is a later piece of a file (see CsvStream).
+  //
+  explicit CsvReader(string_view text, size_t firstLine = 1);
+
+  //
+  // next
+  //
+  // Splits the next row into fields, returning false at the end of
+  // the text. If the row is malformed (an unterminated quoted field,
+  // or text after a closing quote), getError() describes the problem
+  // and the fields hold what could be recovered; otherwise getError()
+  // is empty.
+  //
+  bool next(vector<string_view>& fields);
+
+  //
+  // accessors / getters
+  //
+  size_t getLine() const { return this->RowLine; }  // 1-based
+  const string& getError() const { return this->Error; }
+};
+
+
+//
+// CsvStream
+//
+// Parses CSV text that arrives in pieces, e.g. as it is decompressed,
+// without holding the whole file: each piece is cut after its last
+// complete row (a line break outside quotes), the complete rows are
+// parsed in place, and only the partial row at the end is carried
+// over to the next piece.
+//
+//   CsvStream csv;
+//   auto onRow = [&](const vector<string_view>& fields, size_t line,
+//     const string& error) { ... };
+//
+//   while (...)
+//     csv.feed(piece, onRow);
+//   csv.finish(onRow);
+//
+// The fields passed to onRow are only valid during the call.
+//
+class CsvStream
+{
+public:
+  using RowFunction = function<void(const vector<string_view>& fields, size_t line, const string& error)>;
+
+private:
+  string Carry;       // partial row left over from the last piece
+  size_t Line;        // line the carried row starts on
+  vector<string_view> Fields;
+
+  void parse(string_view text, const RowFunction& onRow);
+
+public:
+  CsvStream();
+
+  void feed(string_view piece, const RowFunction& onRow);
+  void finish(const RowFunction& onRow);
+};
+
+
+//
+// parseField
+//
+// Parses an entire field as a number with from_chars, allowing
+// surrounding spaces; returns false if the field is empty or has
+// anything else in it.
+//
+template <typename T>
+bool parseField(string_view field, T& value)
+{
+  while (!field.empty() && field.front() == ' ')
+    field.remove_prefix(1);
+  while (!field.empty() && field.back() == ' ')
+    field.remove_suffix(1);
+
+  if (field.empty())
+    return false;
+
+  //
+  // from_chars does not accept a leading '+':
+  //
+  if (field.front() == '+' && field.size() > 1 && field[1] != '-')
+    field.remove_prefix(1);
+
+  auto result = from_chars(field.data(), field.data() + field.size(), value);
+
+  return result.ec == errc() && result.ptr == field.data() + field.size();
+}
@@ -27,29 +27,9 @@ using namespace std;
 //
 // Reference: chatGPT using haversine formula
 //
-// static constexpr double M_PI = 3.141592653589;
-
-static double toRadians(double degrees)
-{
-  return (degrees * 3.141592653589 / 180.0);
-}
-
+// The formula itself is haversineMiles, inline in dist.h.
+//
 double distBetween2Points(double lat1, double lon1, double lat2, double lon2)
 {
-  const double R = 6371; // Earth's radius in kilometers
-
-  double dLat = toRadians(lat2 - lat1);
-  double dLon = toRadians(lon2 - lon1);
-
-  double a = sin(dLat / 2) * sin(dLat / 2) +
-    cos(toRadians(lat1)) * cos(toRadians(lat2)) *
-    sin(dLon / 2) * sin(dLon / 2);
-
-  double c = 2 * atan2(sqrt(a), sqrt(1 - a));
-
-  double dist_in_km = R * c;
-
-  double dist_in_miles = dist_in_km * 0.6213711922;
-
-  return dist_in_miles;
+  return haversineMiles(lat1, lon1, lat2, lon2);
 }
@@ -11,6 +11,8 @@
 
 #pragma once
 
+#include <cmath>
+
 
 //
 // DistBetween2Points
@@ -24,3 +26,27 @@
 //
 double distBetween2Points(double lat1, double lon1, double lat2, double lon2);
 
+
+//
+// haversineMiles
+//
+// The same formula as distBetween2Points, inline, for search loops
+// that measure many points (see distpolicy.h); the two give the
+// same results to the last bit.
+//
+inline double haversineMiles(double lat1, double lon1, double lat2, double lon2)
+{
+  const double R = 6371; // Earth's radius in kilometers
+  const double PI = 3.141592653589;
+
+  double dLat = (lat2 - lat1) * PI / 180.0;
+  double dLon = (lon2 - lon1) * PI / 180.0;
+
+  double a = std::sin(dLat / 2) * std::sin(dLat / 2) +
+    std::cos(lat1 * PI / 180.0) * std::cos(lat2 * PI / 180.0) *
+    std::sin(dLon / 2) * std::sin(dLon / 2);
+
+  double c = 2 * std::atan2(std::sqrt(a), std::sqrt(1 - a));
+
+  return R * c * 0.6213711922;
+}
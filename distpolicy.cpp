@@ -0,0 +1,77 @@
+/*distpolicy.cpp*/
+
+//
+// Choosing a distance policy at run time. See distpolicy.h.
+//
+
+#include <string>
+
+#include "distpolicy.h"
+
+using namespace std;
+
+
+static const struct { DistancePolicy Policy; const char* Name; } POLICY_NAMES[] = {
+  { DistancePolicy::Exact, "exact" },
+  { DistancePolicy::Haversine, "haversine" },
+  { DistancePolicy::Equirectangular, "equirectangular" },
+  { DistancePolicy::Planar, "planar" },
+  { DistancePolicy::SquaredPlanar, "squared-planar" },
+};
+
+
+bool parseDistancePolicy(const string& name, DistancePolicy& policy)
+{
+  for (const auto& entry : POLICY_NAMES)
+  {
+    if (name == entry.Name) {
+      policy = entry.Policy;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+const char* distancePolicyName(DistancePolicy policy)
+{
+  for (const auto& entry : POLICY_NAMES)
+    if (entry.Policy == policy)
+      return entry.Name;
+
+  return "?";
+}
+
+
+size_t nearestBy(DistancePolicy policy, const PointSet& points, double lat, double lon,
+  const LocalProjection& projection, double& miles)
+{
+  QueryPoint q;
+  q.Lat = lat;
+  q.Lon = lon;
+
+  bool planar = (policy == DistancePolicy::Exact || policy == DistancePolicy::Planar
+    || policy == DistancePolicy::SquaredPlanar);
+
+  if (planar && !projection.covers(lat, lon))
+    policy = DistancePolicy::Haversine;
+  else if (planar)
+    projection.project(lat, lon, q.X, q.Y);
+
+  switch (policy)
+  {
+    case DistancePolicy::Exact:
+      return nearestExact(points, q, projection.getError(), miles);
+    case DistancePolicy::Haversine:
+      return nearest<HaversineDistance>(points, q, miles);
+    case DistancePolicy::Equirectangular:
+      return nearest<EquirectangularDistance>(points, q, miles);
+    case DistancePolicy::Planar:
+      return nearest<PlanarDistance>(points, q, miles);
+    case DistancePolicy::SquaredPlanar:
+      return nearest<SquaredPlanarDistance>(points, q, miles);
+  }
+
+  return nearest<HaversineDistance>(points, q, miles);
+}
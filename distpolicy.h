@@ -0,0 +1,300 @@
+/*distpolicy.h*/
+
+//
+// Distance policies for the nearest-point searches. A search kernel
+// is a template on its policy, so the distance it compares is fixed
+// at compile time and inlined into the loop over the points: no call
+// or branch per point, and nothing to stop the compiler unrolling
+// or vectorizing the loop. The policies, fastest last:
+//
+//   HaversineDistance        great-circle miles (dist.h); exact, but
+//                            trigonometry for every point
+//   EquirectangularDistance  degrees scaled by the cosine of the
+//                            pair's mean latitude; one cosine a point
+//   PlanarDistance           straight-line miles in the map's local
+//                            projection (projection.h); a square root
+//                            a point
+//   SquaredPlanarDistance    squared meters in the projection, which
+//                            order points as PlanarDistance does; for
+//                            comparisons only -- the square root is
+//                            taken once, for the winner
+//
+// The approximate policies can pick a different point than haversine
+// when two are within a fraction of a percent of each other (see
+// LocalProjection::getError). nearestExact picks by squared planar
+// distance and checks the few points that could be nearer by
+// haversine, so it costs about what SquaredPlanarDistance does and
+// finds what HaversineDistance would: it is what the searches use
+// unless told otherwise.
+//
+// Code that knows its policy calls the kernels directly; the CLI,
+// which learns it at run time (--distance), goes through nearestBy.
+//
+
+#pragma once
+
+#include <string>
+#include <limits>
+#include <cmath>
+
+#include "dist.h"
+#include "projection.h"
+
+using namespace std;
+
+
+//
+// PointSet
+//
+// The points a kernel searches, as parallel arrays: positions, and
+// -- for the planar policies -- the same points projected.
+//
+struct PointSet
+{
+  const double* Lat = nullptr;
+  const double* Lon = nullptr;
+  const double* X = nullptr;
+  const double* Y = nullptr;
+  size_t Count = 0;
+};
+
+
+//
+// QueryPoint
+//
+// What the points are measured from; X and Y only matter to the
+// planar policies.
+//
+struct QueryPoint
+{
+  double Lat = 0.0;
+  double Lon = 0.0;
+  double X = 0.0;
+  double Y = 0.0;
+};
+
+
+//
+// The policies: key(points, i) is what the kernel compares -- the
+// smaller the nearer -- and miles(key) turns the winning key into
+// miles. PLANAR says whether the policy needs projected points.
+//
+class HaversineDistance
+{
+private:
+  QueryPoint Q;
+
+public:
+  static constexpr bool PLANAR = false;
+
+  explicit HaversineDistance(const QueryPoint& q) : Q(q) { }
+
+  double key(const PointSet& points, size_t i) const
+  {
+    return haversineMiles(this->Q.Lat, this->Q.Lon, points.Lat[i], points.Lon[i]);
+  }
+
+  double miles(double key) const { return key; }
+};
+
+
+class EquirectangularDistance
+{
+private:
+  QueryPoint Q;
+
+public:
+  static constexpr bool PLANAR = false;
+
+  // on the sphere of dist.cpp
+  static constexpr double MILES_PER_DEGREE = 6371.0 * 3.141592653589 / 180.0 * 0.6213711922;
+
+  explicit EquirectangularDistance(const QueryPoint& q) : Q(q) { }
+
+  double key(const PointSet& points, size_t i) const
+  {
+    double midLat = (this->Q.Lat + points.Lat[i]) * (0.5 * 3.141592653589 / 180.0);
+    double dx = (points.Lon[i] - this->Q.Lon) * std::cos(midLat);
+    double dy = points.Lat[i] - this->Q.Lat;
+
+    return std::sqrt(dx * dx + dy * dy) * MILES_PER_DEGREE;
+  }
+
+  double miles(double key) const { return key; }
+};
+
+
+class PlanarDistance
+{
+private:
+  QueryPoint Q;
+
+public:
+  static constexpr bool PLANAR = true;
+
+  explicit PlanarDistance(const QueryPoint& q) : Q(q) { }
+
+  double key(const PointSet& points, size_t i) const
+  {
+    return planarMiles(this->Q.X, this->Q.Y, points.X[i], points.Y[i]);
+  }
+
+  double miles(double key) const { return key; }
+};
+
+
+class SquaredPlanarDistance
+{
+private:
+  QueryPoint Q;
+
+public:
+  static constexpr bool PLANAR = true;
+
+  explicit SquaredPlanarDistance(const QueryPoint& q) : Q(q) { }
+
+  double key(const PointSet& points, size_t i) const
+  {
+    double dx = points.X[i] - this->Q.X, dy = points.Y[i] - this->Q.Y;
+
+    return dx * dx + dy * dy;
+  }
+
+  double miles(double key) const
+  {
+    return std::sqrt(key) * LocalProjection::MILES_PER_METER;
+  }
+};
+
+
+//
+// nearestIndex
+//
+// The kernel: the index of the point with the smallest key (the
+// first such), or points.Count if there are no points; bestKey is
+// set to its key.
+//
+template <class Policy>
+size_t nearestIndex(const PointSet& points, const Policy& policy, double& bestKey)
+{
+  size_t best = points.Count;
+  bestKey = numeric_limits<double>::max();
+
+  for (size_t i = 0; i < points.Count; i++)
+  {
+    double key = policy.key(points, i);
+
+    if (key < bestKey) {
+      bestKey = key;
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+
+//
+// nearest
+//
+// nearestIndex by the given policy, with the distance to the point
+// found in miles (numeric_limits<double>::max() if there's none).
+//
+template <class Policy>
+size_t nearest(const PointSet& points, const QueryPoint& q, double& miles)
+{
+  Policy policy(q);
+  double key;
+  size_t best = nearestIndex(points, policy, key);
+
+  miles = (best < points.Count) ? policy.miles(key) : numeric_limits<double>::max();
+  return best;
+}
+
+
+//
+// planarLimit
+//
+// How much farther in the plane than the nearest point (meters) a
+// point may be and still be nearer by haversine: the plane is within
+// the projection's error of haversine either way, plus a micrometer
+// of rounding.
+//
+inline double planarLimit(double planarMeters, double error)
+{
+  return planarMeters * (1.0 + error) / (1.0 - error) + 1e-6;
+}
+
+
+//
+// nearestExact
+//
+// The point nearest by haversine, with its distance in miles: the
+// nearest in the plane (squared, no square roots), then the nearest
+// by haversine of the points that could still be nearer than that
+// one. The points and q must be covered by the projection whose
+// error is given.
+//
+inline size_t nearestExact(const PointSet& points, const QueryPoint& q, double error, double& miles)
+{
+  SquaredPlanarDistance planar(q);
+  HaversineDistance haversine(q);
+
+  double bestSquared;
+  miles = numeric_limits<double>::max();
+
+  if (nearestIndex(points, planar, bestSquared) == points.Count)
+    return points.Count;
+
+  double limit = planarLimit(sqrt(bestSquared), error);
+  double limitSquared = limit * limit;
+  size_t best = points.Count;
+
+  for (size_t i = 0; i < points.Count; i++)
+  {
+    if (planar.key(points, i) > limitSquared)
+      continue;
+
+    double d = haversine.key(points, i);
+
+    if (d < miles) {
+      miles = d;
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+
+//
+// DistancePolicy
+//
+// The policies, for choosing one at run time.
+//
+enum class DistancePolicy { Exact, Haversine, Equirectangular, Planar, SquaredPlanar };
+
+
+//
+// parseDistancePolicy
+//
+// "exact", "haversine", "equirectangular", "planar" or
+// "squared-planar"; returns false if name is none of these.
+//
+bool parseDistancePolicy(const string& name, DistancePolicy& policy);
+
+//
+// distancePolicyName
+//
+const char* distancePolicyName(DistancePolicy policy);
+
+//
+// nearestBy
+//
+// The runtime dispatcher: nearest by the given policy from (lat,
+// lon). The projection is the one the points' X and Y came from;
+// where it doesn't cover (lat, lon), the planar policies and Exact
+// fall back to haversine.
+//
+size_t nearestBy(DistancePolicy policy, const PointSet& points, double lat, double lon,
+  const LocalProjection& projection, double& miles);
@@ -0,0 +1,828 @@
+/*format.cpp*/
+
+//
+// The output layer: query results as text, JSON or CSV. See
+// format.h.
+//
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+
+#include "format.h"
+#include "building.h"
+
+using namespace std;
+
+
+//
+// JsonObject
+//
+// Writes the punctuation of a JSON object; the caller writes each
+// value after naming its key. Keys must be given in alphabetical
+// order, the order the output has always had.
+//
+class JsonObject
+{
+private:
+  OutputBuffer& Out;
+  bool First = true;
+
+public:
+  explicit JsonObject(OutputBuffer& out) : Out(out) { out.append('{'); }
+
+  OutputBuffer& key(string_view name)
+  {
+    if (!this->First)
+      this->Out.append(',');
+    this->First = false;
+
+    this->Out.append('"');
+    this->Out.append(name);
+    this->Out.append("\":");
+    return this->Out;
+  }
+
+  void close() { this->Out.append('}'); }
+};
+
+
+bool parseOutputFormat(const string& name, OutputFormat& format)
+{
+  if (name == "text")
+    format = OutputFormat::Text;
+  else if (name == "json")
+    format = OutputFormat::Json;
+  else if (name == "csv")
+    format = OutputFormat::Csv;
+  else
+    return false;
+
+  return true;
+}
+
+
+void formatClock(int seconds, OutputBuffer& out)
+{
+  int fields[3] = { seconds / 3600, seconds / 60 % 60, seconds % 60 };
+
+  for (int i = 0; i < 3; i++) {
+    if (i > 0)
+      out.append(':');
+    if (fields[i] < 10)
+      out.append('0');
+    out.appendInt(fields[i]);
+  }
+}
+
+
+void formatArrivalsText(const Arrivals& arrivals, OutputBuffer& out)
+{
+  switch (arrivals.Result)
+  {
+    case Arrivals::Status::NoSource:
+      out.append("  <<bus predictions unavailable, no prediction source>>");
+      return;
+
+    case Arrivals::Status::CallFailed:
+      out.append("  <<bus predictions unavailable, call failed>>");
+      return;
+
+    case Arrivals::Status::ParseError:
+      out.append("  <<error parsing predictions>>");
+      return;
+
+    case Arrivals::Status::OK:
+      break;
+  }
+
+  if (arrivals.List.empty()) {
+    out.append("  <<no predictions available>>");
+    return;
+  }
+
+  for (const Arrival& a : arrivals.List) {
+    out.append("  vehicle #");
+    out.append(a.Vehicle);
+    out.append(" on route ");
+    out.append(a.Route);
+    out.append(" travelling ");
+    out.append(a.Direction);
+    out.append(" to arrive in ");
+    out.append(a.Minutes);
+    out.append(" mins\n");
+  }
+}
+
+
+//
+// the name of a building, a stop, or a route in the feed:
+//
+static string_view placeName(const GtfsFeed& feed, int stop, const Building* building)
+{
+  return (stop < 0) ? building->Name : feed.StopName[stop];
+}
+
+static string_view routeName(const GtfsFeed& feed, int trip)
+{
+  int route = feed.TripRoute[trip];
+
+  return feed.RouteShortName[route].empty() ? feed.RouteIDs.get(route) : feed.RouteShortName[route];
+}
+
+
+// ===================================================================
+// text
+// ===================================================================
+
+static void stopText(const StopResult& stop, OutputBuffer& out)
+{
+  out.append("  ");
+  out.appendInt(stop.Stop->getID());
+  out.append(": ");
+  out.append(stop.Stop->getName());
+  out.append(", bus #");
+  out.appendInt(stop.Stop->getRoute());
+  out.append(", ");
+  out.append(stop.Stop->getCorner());
+  out.append(", ");
+  out.appendGeneral(stop.Miles);
+  out.append(" miles\n");
+
+  if (stop.Fetched) {
+    formatArrivalsText(stop.Predictions, out);
+    out.append('\n');
+  }
+}
+
+
+void formatBuildingText(const BuildingResult& result, OutputBuffer& out)
+{
+  const Building& B = *result.B;
+
+  out.append(B.Name);
+  out.append("\nAddress: ");
+  out.append(B.StreetAddress);
+  out.append("\nBuilding ID: ");
+  out.appendInt(B.ID);
+  out.append("\n# perimeter nodes: ");
+  out.appendInt((long long) B.NodeIDs.size());
+  out.append("\nLocation: (");
+  out.appendGeneral(result.Lat);
+  out.append(", ");
+  out.appendGeneral(result.Lon);
+  out.append(")\n");
+
+  out.append("Closest southbound bus stop:\n");
+  if (result.Southbound.Stop == nullptr)
+    out.append("  <<no southbound bus stops>>\n");
+  else
+    stopText(result.Southbound, out);
+
+  out.append("Closest northbound bus stop:\n");
+  if (result.Northbound.Stop == nullptr)
+    out.append("  <<no northbound bus stops>>\n");
+  else
+    stopText(result.Northbound, out);
+}
+
+
+//
+// queryText
+//
+// The query, written back as it would be typed.
+//
+static void queryText(const Query& q, OutputBuffer& out)
+{
+  switch (q.Type)
+  {
+    case QueryType::Building:
+      out.append("building ");
+      out.append(q.Name);
+      break;
+
+    case QueryType::Nearest:
+      out.append("nearest ");
+      out.appendGeneral(q.Lat, 10);
+      out.append(' ');
+      out.appendGeneral(q.Lon, 10);
+      out.append(' ');
+      out.append(q.Direction);
+      break;
+
+    case QueryType::Predict:
+      out.append("predict ");
+      out.appendInt(q.StopID);
+      break;
+
+    case QueryType::Route:
+    case QueryType::Transit:
+      out.append(q.Type == QueryType::Route ? "route " : "transit ");
+      out.append(q.Name);
+      out.append(" | ");
+      out.append(q.ToName);
+      if (q.Type == QueryType::Transit && q.Time >= 0) {
+        out.append(" @ ");
+        formatClock(q.Time, out);
+      }
+      break;
+  }
+}
+
+
+static void journeyText(const QueryResult& r, const TransitRouter::Journey& J, OutputBuffer& out)
+{
+  const GtfsFeed& feed = *r.Feed;
+
+  out.append("Journey: ");
+  formatClock(J.Depart, out);
+  out.append(" to ");
+  formatClock(J.Arrive, out);
+  out.append(", ");
+  out.appendFixed((J.Arrive - r.Depart) / 60.0, 1);
+  out.append(" minutes, ");
+  out.appendInt(J.Rides);
+  out.append(J.Rides == 1 ? " bus\n" : " buses\n");
+
+  for (const TransitRouter::Leg& L : J.Legs)
+  {
+    out.append("  ");
+    formatClock(L.Depart, out);
+    out.append('-');
+    formatClock(L.Arrive, out);
+
+    if (L.Walk) {
+      out.append(" walk ");
+      out.appendGeneral(L.Miles, 3);
+      out.append(" miles");
+    }
+    else {
+      out.append(" bus ");
+      out.append(routeName(feed, L.Trip));
+      out.append(" towards ");
+      out.append(feed.TripHeadsign[L.Trip]);
+    }
+
+    out.append(" from ");
+    out.append(placeName(feed, L.FromStop, r.From));
+    out.append(" to ");
+    out.append(placeName(feed, L.ToStop, r.To));
+    out.append('\n');
+  }
+}
+
+
+static void resultText(const QueryResult& r, OutputBuffer& out)
+{
+  out.append("> ");
+  queryText(r.Q, out);
+  out.append('\n');
+
+  if (!r.Error.empty()) {
+    out.append("**ERROR: ");
+    out.append(r.Error);
+    out.append('\n');
+  }
+  else switch (r.Q.Type)
+  {
+    case QueryType::Building:
+      if (r.Buildings.empty())
+        out.append("no buildings found\n");
+      for (const BuildingResult& b : r.Buildings)
+        formatBuildingText(b, out);
+      break;
+
+    case QueryType::Nearest:
+    case QueryType::Predict:
+      if (r.Stop.Stop == nullptr) {
+        out.append("no ");
+        out.append(r.Q.Direction);
+        out.append(" bus stops\n");
+        break;
+      }
+      if (r.Q.Type == QueryType::Nearest)
+        stopText(r.Stop, out);
+      else {
+        out.append("  ");
+        out.appendInt(r.Stop.Stop->getID());
+        out.append(": ");
+        out.append(r.Stop.Stop->getName());
+        out.append(", bus #");
+        out.appendInt(r.Stop.Stop->getRoute());
+        out.append(", ");
+        out.append(r.Stop.Stop->getDirection());
+        out.append(", ");
+        out.append(r.Stop.Stop->getCorner());
+        out.append('\n');
+        formatArrivalsText(r.Stop.Predictions, out);
+        out.append('\n');
+      }
+      break;
+
+    case QueryType::Route:
+      out.append(r.From->Name);
+      out.append(" to ");
+      out.append(r.To->Name);
+      if (r.Route.Found) {
+        out.append(": ");
+        out.appendGeneral(r.Route.Distance);
+        out.append(" miles walking, ");
+        out.appendInt((long long) r.Route.NodeIDs.size());
+        out.append(" nodes\n");
+      }
+      else
+        out.append(": no walking route\n");
+      break;
+
+    case QueryType::Transit:
+      out.append(r.From->Name);
+      out.append(" to ");
+      out.append(r.To->Name);
+      out.append(", leaving ");
+      formatClock(r.Depart, out);
+      out.append('\n');
+      for (const TransitRouter::Journey& J : r.Journeys)
+        journeyText(r, J, out);
+      break;
+  }
+
+  out.append('\n');
+}
+
+
+// ===================================================================
+// JSON
+// ===================================================================
+
+static void stopJson(const StopResult& stop, bool withPredictions, OutputBuffer& out)
+{
+  thread_local OutputBuffer text;
+  const BusStop& s = *stop.Stop;
+  JsonObject j(out);
+
+  j.key("corner").appendJsonString(s.getCorner());
+  j.key("direction").appendJsonString(s.getDirection());
+  j.key("id").appendInt(s.getID());
+  j.key("lat").appendDouble(s.getLatitude());
+  j.key("lon").appendDouble(s.getLongitude());
+  j.key("miles").appendDouble(stop.Miles);
+  j.key("name").appendJsonString(s.getName());
+
+  if (withPredictions && stop.Fetched) {
+    text.clear();
+    formatArrivalsText(stop.Predictions, text);
+    j.key("predictions").appendJsonString(text.view());
+  }
+
+  j.key("route").appendInt(s.getRoute());
+  j.close();
+}
+
+
+static void buildingJson(const BuildingResult& b, OutputBuffer& out)
+{
+  JsonObject j(out);
+
+  j.key("address").appendJsonString(b.B->StreetAddress);
+  j.key("id").appendInt(b.B->ID);
+  j.key("lat").appendDouble(b.Lat);
+  j.key("lon").appendDouble(b.Lon);
+  j.key("name").appendJsonString(b.B->Name);
+  j.key("perimeter_nodes").appendInt((long long) b.B->NodeIDs.size());
+
+  if (b.Southbound.Stop != nullptr || b.Northbound.Stop != nullptr)
+  {
+    JsonObject stops(j.key("stops"));
+
+    if (b.Northbound.Stop != nullptr)
+      stopJson(b.Northbound, true, stops.key("northbound"));
+    if (b.Southbound.Stop != nullptr)
+      stopJson(b.Southbound, true, stops.key("southbound"));
+
+    stops.close();
+  }
+
+  j.close();
+}
+
+
+static void clockJson(int seconds, OutputBuffer& out)
+{
+  out.append('"');
+  formatClock(seconds, out);
+  out.append('"');
+}
+
+
+static void legJson(const QueryResult& r, const TransitRouter::Leg& L, OutputBuffer& out)
+{
+  const GtfsFeed& feed = *r.Feed;
+  JsonObject j(out);
+
+  clockJson(L.Arrive, j.key("arrive"));
+  clockJson(L.Depart, j.key("depart"));
+  j.key("from").appendJsonString(placeName(feed, L.FromStop, r.From));
+
+  if (L.FromStop >= 0)
+    j.key("from_stop").appendJsonString(feed.StopIDs.get(L.FromStop));
+  if (!L.Walk)
+    j.key("headsign").appendJsonString(feed.TripHeadsign[L.Trip]);
+  if (L.Walk)
+    j.key("miles").appendDouble(L.Miles);
+
+  j.key("mode").appendJsonString(L.Walk ? "walk" : "bus");
+
+  if (!L.Walk)
+    j.key("route").appendJsonString(routeName(feed, L.Trip));
+
+  j.key("to").appendJsonString(placeName(feed, L.ToStop, r.To));
+
+  if (L.ToStop >= 0)
+    j.key("to_stop").appendJsonString(feed.StopIDs.get(L.ToStop));
+  if (!L.Walk)
+    j.key("trip").appendJsonString(feed.TripIDs.get(L.Trip));
+
+  j.close();
+}
+
+
+static void journeyJson(const QueryResult& r, const TransitRouter::Journey& J, OutputBuffer& out)
+{
+  JsonObject j(out);
+
+  clockJson(J.Arrive, j.key("arrive"));
+  j.key("buses").appendInt(J.Rides);
+  clockJson(J.Depart, j.key("depart"));
+
+  OutputBuffer& legs = j.key("legs");
+  legs.append('[');
+  for (size_t i = 0; i < J.Legs.size(); i++) {
+    if (i > 0)
+      legs.append(',');
+    legJson(r, J.Legs[i], legs);
+  }
+  legs.append(']');
+
+  j.key("minutes").appendDouble((J.Arrive - r.Depart) / 60.0);
+  j.key("transfers").appendInt(max(J.Rides - 1, 0));
+  j.close();
+}
+
+
+static void resultJson(const QueryResult& r, OutputBuffer& out)
+{
+  JsonObject j(out);
+
+  switch (r.Q.Type)
+  {
+    case QueryType::Building:
+    {
+      OutputBuffer& list = j.key("buildings");
+      list.append('[');
+      for (size_t i = 0; i < r.Buildings.size(); i++) {
+        if (i > 0)
+          list.append(',');
+        buildingJson(r.Buildings[i], list);
+      }
+      list.append(']');
+
+      j.key("name").appendJsonString(r.Q.Name);
+      j.key("query").appendJsonString("building");
+      break;
+    }
+
+    case QueryType::Nearest:
+      j.key("direction").appendJsonString(r.Q.Direction);
+      j.key("lat").appendDouble(r.Q.Lat);
+      j.key("lon").appendDouble(r.Q.Lon);
+      j.key("query").appendJsonString("nearest");
+      if (r.Stop.Stop == nullptr)
+        j.key("stop").append("null");
+      else
+        stopJson(r.Stop, false, j.key("stop"));
+      break;
+
+    case QueryType::Predict:
+      if (!r.Error.empty())
+        j.key("error").appendJsonString(r.Error);
+      else {
+        thread_local OutputBuffer text;
+        text.clear();
+        formatArrivalsText(r.Stop.Predictions, text);
+        j.key("predictions").appendJsonString(text.view());
+      }
+      j.key("query").appendJsonString("predict");
+      if (r.Error.empty())
+        stopJson(r.Stop, false, j.key("stop"));
+      j.key("stopid").appendInt(r.Q.StopID);
+      break;
+
+    case QueryType::Route:
+      if (!r.Error.empty()) {
+        j.key("error").appendJsonString(r.Error);
+        j.key("query").appendJsonString("route");
+        break;
+      }
+      j.key("found").append(r.Route.Found ? "true" : "false");
+      j.key("from").appendJsonString(r.From->Name);
+      if (r.Route.Found) {
+        j.key("miles").appendDouble(r.Route.Distance);
+        OutputBuffer& path = j.key("path");
+        path.append('[');
+        for (size_t i = 0; i < r.Route.NodeIDs.size(); i++) {
+          if (i > 0)
+            path.append(',');
+          path.appendInt(r.Route.NodeIDs[i]);
+        }
+        path.append(']');
+      }
+      j.key("query").appendJsonString("route");
+      j.key("to").appendJsonString(r.To->Name);
+      break;
+
+    case QueryType::Transit:
+      if (!r.Error.empty()) {
+        j.key("error").appendJsonString(r.Error);
+        j.key("query").appendJsonString("transit");
+        break;
+      }
+      clockJson(r.Depart, j.key("depart"));
+      j.key("from").appendJsonString(r.From->Name);
+      {
+        OutputBuffer& list = j.key("journeys");
+        list.append('[');
+        for (size_t i = 0; i < r.Journeys.size(); i++) {
+          if (i > 0)
+            list.append(',');
+          journeyJson(r, r.Journeys[i], list);
+        }
+        list.append(']');
+      }
+      j.key("query").appendJsonString("transit");
+      j.key("to").appendJsonString(r.To->Name);
+      break;
+  }
+
+  j.close();
+  out.append('\n');
+}
+
+
+// ===================================================================
+// CSV
+// ===================================================================
+
+//
+// the columns, in order:
+//
+enum CsvColumn
+{
+  CSV_QUERY, CSV_INPUT, CSV_FROM, CSV_TO, CSV_DIRECTION, CSV_STOP_ID, CSV_STOP_NAME, CSV_ROUTE,
+  CSV_CORNER, CSV_MILES, CSV_DEPART, CSV_ARRIVE, CSV_MINUTES, CSV_BUSES, CSV_PREDICTIONS, CSV_ERROR,
+  NUM_CSV_COLUMNS
+};
+
+static const char* const CsvHeader =
+  "query,input,from,to,direction,stop_id,stop_name,route,corner,miles,depart,arrive,minutes,buses,predictions,error\n";
+
+
+//
+// CsvRow
+//
+// Writes one row, a column at a time in order; columns skipped are
+// left empty.
+//
+class CsvRow
+{
+private:
+  OutputBuffer& Out;
+  int Column = 0;   // the column being written: one ',' before each after the first
+
+public:
+  explicit CsvRow(OutputBuffer& out) : Out(out) { }
+
+  OutputBuffer& column(CsvColumn c)
+  {
+    for (; this->Column < (int) c; this->Column++)
+      this->Out.append(',');
+    return this->Out;   // the caller writes the value
+  }
+
+  void end()
+  {
+    for (; this->Column < NUM_CSV_COLUMNS - 1; this->Column++)
+      this->Out.append(',');
+    this->Out.append('\n');
+  }
+};
+
+
+void formatCsvHeader(OutputBuffer& out)
+{
+  out.append(CsvHeader);
+}
+
+
+static void queryCsv(const QueryResult& r, CsvRow& row)
+{
+  static const char* const names[] = { "building", "nearest", "predict", "route", "transit" };
+  thread_local OutputBuffer input;
+
+  input.clear();
+  queryText(r.Q, input);
+
+  string_view text = input.view();
+  text.remove_prefix(text.find(' ') + 1);   // the query without its keyword
+
+  row.column(CSV_QUERY).append(names[(int) r.Q.Type]);
+  row.column(CSV_INPUT).appendCsvField(text);
+}
+
+
+static void stopCsv(const StopResult& stop, CsvRow& row)
+{
+  if (stop.Stop == nullptr)
+    return;
+
+  row.column(CSV_DIRECTION).appendCsvField(stop.Stop->getDirection());
+  row.column(CSV_STOP_ID).appendInt(stop.Stop->getID());
+  row.column(CSV_STOP_NAME).appendCsvField(stop.Stop->getName());
+  row.column(CSV_ROUTE).appendInt(stop.Stop->getRoute());
+  row.column(CSV_CORNER).appendCsvField(stop.Stop->getCorner());
+  row.column(CSV_MILES).appendDouble(stop.Miles);
+
+  if (!stop.Fetched)
+    return;
+
+  //
+  // minutes away and vehicle of each bus due, e.g. "5 min #1234; 17 min #1250",
+  // or why there are none:
+  //
+  thread_local OutputBuffer text;
+  text.clear();
+
+  if (stop.Predictions.Result != Arrivals::Status::OK || stop.Predictions.List.empty()) {
+    formatArrivalsText(stop.Predictions, text);
+    string_view message = text.view();
+    message.remove_prefix(min(message.size(), (size_t) 4));   // "  <<"
+    message.remove_suffix(min(message.size(), (size_t) 2));   // ">>"
+    row.column(CSV_PREDICTIONS).appendCsvField(message);
+    return;
+  }
+
+  for (size_t i = 0; i < stop.Predictions.List.size(); i++) {
+    const Arrival& a = stop.Predictions.List[i];
+    if (i > 0)
+      text.append("; ");
+    text.append(a.Minutes);
+    text.append(" min #");
+    text.append(a.Vehicle);
+  }
+
+  row.column(CSV_PREDICTIONS).appendCsvField(text.view());
+}
+
+
+static void resultCsv(const QueryResult& r, OutputBuffer& out)
+{
+  if (!r.Error.empty()) {
+    CsvRow row(out);
+    queryCsv(r, row);
+    row.column(CSV_ERROR).appendCsvField(r.Error);
+    row.end();
+    return;
+  }
+
+  switch (r.Q.Type)
+  {
+    case QueryType::Building:
+    {
+      if (r.Buildings.empty()) {
+        CsvRow row(out);
+        queryCsv(r, row);
+        row.end();
+      }
+
+      //
+      // a row per stop, or one for a building with none:
+      //
+      for (const BuildingResult& b : r.Buildings)
+      {
+        bool none = (b.Southbound.Stop == nullptr && b.Northbound.Stop == nullptr);
+
+        for (const StopResult* stop : { &b.Southbound, &b.Northbound })
+        {
+          if (stop->Stop == nullptr && !(none && stop == &b.Southbound))
+            continue;
+
+          CsvRow row(out);
+          queryCsv(r, row);
+          row.column(CSV_FROM).appendCsvField(b.B->Name);
+          stopCsv(*stop, row);
+          row.end();
+        }
+      }
+      break;
+    }
+
+    case QueryType::Nearest:
+    case QueryType::Predict:
+    {
+      CsvRow row(out);
+      queryCsv(r, row);
+      stopCsv(r.Stop, row);
+      row.end();
+      break;
+    }
+
+    case QueryType::Route:
+    {
+      CsvRow row(out);
+      queryCsv(r, row);
+      row.column(CSV_FROM).appendCsvField(r.From->Name);
+      row.column(CSV_TO).appendCsvField(r.To->Name);
+      if (r.Route.Found)
+        row.column(CSV_MILES).appendDouble(r.Route.Distance);
+      else
+        row.column(CSV_ERROR).append("no walking route");
+      row.end();
+      break;
+    }
+
+    case QueryType::Transit:
+      for (const TransitRouter::Journey& J : r.Journeys)
+      {
+        CsvRow row(out);
+        queryCsv(r, row);
+        row.column(CSV_FROM).appendCsvField(r.From->Name);
+        row.column(CSV_TO).appendCsvField(r.To->Name);
+
+        //
+        // the buses taken, e.g. "201 > 206":
+        //
+        thread_local OutputBuffer routes;
+        routes.clear();
+        for (const TransitRouter::Leg& L : J.Legs)
+          if (!L.Walk) {
+            if (!routes.empty())
+              routes.append(" > ");
+            routes.append(routeName(*r.Feed, L.Trip));
+          }
+
+        row.column(CSV_ROUTE).appendCsvField(routes.view());
+        formatClock(J.Depart, row.column(CSV_DEPART));
+        formatClock(J.Arrive, row.column(CSV_ARRIVE));
+        row.column(CSV_MINUTES).appendDouble((J.Arrive - r.Depart) / 60.0);
+        row.column(CSV_BUSES).appendInt(J.Rides);
+        row.end();
+      }
+      break;
+  }
+}
+
+
+// ===================================================================
+
+void formatResult(const QueryResult& result, OutputFormat format, OutputBuffer& out)
+{
+  switch (format)
+  {
+    case OutputFormat::Text: resultText(result, out); break;
+    case OutputFormat::Json: resultJson(result, out); break;
+    case OutputFormat::Csv:  resultCsv(result, out); break;
+  }
+}
+
+
+void formatQueryError(const string& line, const string& error, OutputFormat format, OutputBuffer& out)
+{
+  switch (format)
+  {
+    case OutputFormat::Text:
+      out.append("> ");
+      out.append(line);
+      out.append("\n**ERROR: ");
+      out.append(error);
+      out.append("\n\n");
+      break;
+
+    case OutputFormat::Json:
+    {
+      JsonObject j(out);
+      j.key("error").appendJsonString(error);
+      j.key("query").appendJsonString(line);
+      j.close();
+      out.append('\n');
+      break;
+    }
+
+    case OutputFormat::Csv:
+    {
+      CsvRow row(out);
+      row.column(CSV_QUERY).appendCsvField(line);
+      row.column(CSV_ERROR).appendCsvField(error);
+      row.end();
+      break;
+    }
+  }
+}
@@ -0,0 +1,80 @@
+/*format.h*/
+
+//
+// The output layer: query results (see query.h and results.h)
+// written as text, JSON or CSV into an OutputBuffer (see outbuf.h),
+// which the caller writes out once per query.
+//
+//   text   as the interactive CLI prints them, for people
+//   json   one object per line, as the batch and server front ends
+//          have always produced -- keys in alphabetical order --
+//          for programs
+//   csv    one row per stop, journey or error, under the header
+//          from formatCsvHeader, for spreadsheets
+//
+
+#pragma once
+
+#include <string>
+
+#include "outbuf.h"
+#include "query.h"
+#include "results.h"
+
+using namespace std;
+
+
+enum class OutputFormat { Text, Json, Csv };
+
+
+//
+// parseOutputFormat
+//
+// "text", "json" or "csv"; returns false if name is none of these.
+//
+bool parseOutputFormat(const string& name, OutputFormat& format);
+
+//
+// formatResult
+//
+// Appends the result in the given format; JSON results are one
+// line ending in '\n'.
+//
+void formatResult(const QueryResult& result, OutputFormat format, OutputBuffer& out);
+
+//
+// formatQueryError
+//
+// Appends the error for a query line that could not be parsed.
+//
+void formatQueryError(const string& line, const string& error, OutputFormat format, OutputBuffer& out);
+
+//
+// formatCsvHeader
+//
+// Appends the header line that CSV results go under.
+//
+void formatCsvHeader(OutputBuffer& out);
+
+//
+// formatBuildingText
+//
+// Appends a building as the CLI prints it: name, address, ID,
+// location, and the nearest bus stop each way with the buses due.
+//
+void formatBuildingText(const BuildingResult& result, OutputBuffer& out);
+
+//
+// formatArrivalsText
+//
+// Appends a line per bus due, or a <<message>> (without a newline)
+// saying why there are none.
+//
+void formatArrivalsText(const Arrivals& arrivals, OutputBuffer& out);
+
+//
+// formatClock
+//
+// Appends seconds after midnight as HH:MM:SS (hours may pass 24).
+//
+void formatClock(int seconds, OutputBuffer& out);
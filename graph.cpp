@@ -0,0 +1,702 @@
+/*graph.cpp*/
+
+//
+// The walking graph of the Open Street Map: footways, paths and
+// streets, reduced to their junctions, with an edge for each chain
+// of nodes between two, weighted by distance in miles.
+//
+// References:
+//
+// OpenStreetMap highway tags:
+//   https://wiki.openstreetmap.org/wiki/Key:highway
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+#include "graph.h"
+#include "dist.h"
+#include "osm.h"
+#include "latency.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// isWalkable
+//
+// Returns true if the way is a highway=... that people can walk
+// along; motorways and trunk roads are excluded, as are ways
+// explicitly marked foot=no.
+//
+static bool isWalkable(XMLElement* way)
+{
+  const char* highway = osmFindKeyValue(way, "highway");
+
+  if (highway == nullptr)
+    return false;
+
+  for (const char* excluded : { "motorway", "motorway_link", "trunk", "trunk_link",
+    "construction", "proposed" })
+  {
+    if (strcmp(highway, excluded) == 0)
+      return false;
+  }
+
+  if (osmContainsKeyValue(way, "foot", "no"))
+    return false;
+
+  return true;
+}
+
+
+Graph::Graph()
+  : Storage(make_shared<Arena>(1024 * 1024)), IndexOf(Storage->resource())
+{
+}
+
+
+//
+// readMapGraph
+//
+// Given an XML document and the map's nodes, builds the graph
+// from every walkable way. Segments between consecutive nodes are
+// collected first and deduplicated per point (ways drawn over each
+// other); then, from each junction, every chain of shape nodes is
+// walked to the junction at its other end and becomes one edge of
+// the reduced graph, which is bucketed by source vertex into CSR
+// form.
+//
+void Graph::readMapGraph(XMLDocument& xmldoc, const Nodes& nodes, bool collapse)
+{
+  XMLElement* osm = xmldoc.FirstChildElement("osm");
+  assert(osm != nullptr);
+
+  vector<pair<int, int>> segments;
+  vector<char> entrances;
+
+  //
+  // find the walkable ways and count their node refs first: an
+  // upper bound on both the points and the segments, so nothing
+  // below reallocates or rehashes while the graph is built:
+  //
+  vector<XMLElement*> ways;
+  size_t refs = 0;
+
+  for (XMLElement* way = osm->FirstChildElement("way"); way != nullptr; way = way->NextSiblingElement("way"))
+  {
+    if (!isWalkable(way))
+      continue;
+
+    ways.push_back(way);
+
+    for (XMLElement* nd = way->FirstChildElement("nd"); nd != nullptr; nd = nd->NextSiblingElement("nd"))
+      refs++;
+  }
+
+  segments.reserve(refs);
+  entrances.reserve(refs);
+  this->IndexOf.reserve(refs);
+  this->PointIDs.reserve(refs);
+  this->Lat.reserve(refs);
+  this->Lon.reserve(refs);
+  this->PointX.reserve(refs);
+  this->PointY.reserve(refs);
+
+  this->Projection = nodes.getProjection();
+
+  //
+  // each way as a list of node indexes (-1 for a node not in the
+  // map, clipped at the map edge), each list ended by -2:
+  //
+  vector<int> wayNodes;
+  wayNodes.reserve(refs + ways.size());
+
+  vector<int> pointOf(nodes.getNumMapNodes(), -1);   // node index => point
+
+  for (XMLElement* way : ways)
+  {
+    for (XMLElement* nd = way->FirstChildElement("nd"); nd != nullptr; nd = nd->NextSiblingElement("nd"))
+    {
+      const XMLAttribute* ndref = nd->FindAttribute("ref");
+      assert(ndref != nullptr);
+
+      int index = nodes.indexOf(ndref->Int64Value());
+
+      wayNodes.push_back(index);
+
+      if (index >= 0)
+        pointOf[index] = 0;   // in the graph
+    }
+
+    wayNodes.push_back(-2);
+  }
+
+  //
+  // the points are numbered in the order of the nodes, so that if
+  // the nodes are in spatial order (see Nodes::sortSpatially), so
+  // are the points, and so are the vertices taken from them:
+  //
+  for (int index = 0; index < (int) pointOf.size(); index++)
+  {
+    if (pointOf[index] < 0)
+      continue;
+
+    const Node& node = nodes.getNode(index);
+    int p = (int) this->PointIDs.size();
+
+    pointOf[index] = p;
+    this->IndexOf.emplace(node.getID(), p);
+    this->PointIDs.push_back(node.getID());
+    this->Lat.push_back(node.getLat());
+    this->Lon.push_back(node.getLon());
+    entrances.push_back(node.getIsEntrance());
+
+    double x, y;
+    this->Projection.project(node.getLat(), node.getLon(), x, y);
+    this->PointX.push_back(x);
+    this->PointY.push_back(y);
+  }
+
+  int prev = -1;
+
+  for (int index : wayNodes)
+  {
+    if (index == -2) {   // end of a way
+      prev = -1;
+      continue;
+    }
+
+    int p = (index >= 0) ? pointOf[index] : -1;
+
+    if (prev >= 0 && p >= 0 && prev != p)
+      segments.emplace_back(prev, p);
+
+    prev = p;
+  }
+
+  //
+  // the neighbors of each point, in CSR form, without duplicates:
+  //
+  int N = (int) this->PointIDs.size();
+
+  vector<int> first(N + 1, 0);
+  vector<int> neighbors(2 * segments.size());
+
+  for (auto& s : segments) {
+    first[s.first + 1]++;
+    first[s.second + 1]++;
+  }
+
+  for (int p = 0; p < N; p++)
+    first[p + 1] += first[p];
+
+  {
+    vector<int> next(first.begin(), first.end() - 1);
+
+    for (auto& s : segments) {
+      neighbors[next[s.first]++] = s.second;
+      neighbors[next[s.second]++] = s.first;
+    }
+  }
+
+  int kept = 0;
+
+  for (int p = 0; p < N; p++)
+  {
+    auto begin = neighbors.begin() + first[p];
+    auto end = neighbors.begin() + first[p + 1];
+
+    sort(begin, end);
+    end = unique(begin, end);
+
+    first[p] = kept;
+    kept = (int) (copy(begin, end, neighbors.begin() + kept) - neighbors.begin());
+  }
+
+  first[N] = kept;
+  neighbors.resize(kept);
+
+  this->NumSegments = kept / 2;
+
+  //
+  // the junctions -- where ways meet or end, and entrances -- become
+  // vertices; the rest are shape nodes, each between two others:
+  //
+  this->PointVertex.assign(N, -1);
+  this->PointChain.assign(N, -1);
+  this->PointSlot.assign(N, -1);
+
+  auto addVertex = [&](int p) {
+    this->PointVertex[p] = (int) this->VertexPoints.size();
+    this->VertexPoints.push_back(p);
+    this->VertexX.push_back(this->PointX[p]);
+    this->VertexY.push_back(this->PointY[p]);
+  };
+
+  for (int p = 0; p < N; p++)
+    if (!collapse || first[p + 1] - first[p] != 2 || entrances[p])
+      addVertex(p);
+
+  //
+  // walks from junction p along neighbors[s] to the next junction,
+  // recording the chain; walked marks the segments (in the direction
+  // walked) that have been, so each chain is walked from one end:
+  //
+  vector<char> walked(neighbors.size(), 0);
+
+  auto segmentOf = [&](int p, int q) {
+    return (int) (find(neighbors.begin() + first[p], neighbors.begin() + first[p + 1], q) - neighbors.begin());
+  };
+
+  auto walkChain = [&](int p, int s) {
+    Chain chain = { this->PointVertex[p], -1, (int) this->ChainPoints.size(), 0, 0.0 };
+    int c = (int) this->ChainList.size();
+
+    int prev = p;
+    int at = neighbors[s];
+    double miles = distBetween2Points(this->Lat[prev], this->Lon[prev], this->Lat[at], this->Lon[at]);
+
+    walked[s] = 1;
+
+    while (this->PointVertex[at] < 0)
+    {
+      this->PointChain[at] = c;
+      this->PointSlot[at] = (int) this->ChainPoints.size();
+      this->ChainPoints.push_back(at);
+      this->ChainMiles.push_back(miles);
+
+      int next = neighbors[first[at]] != prev ? neighbors[first[at]] : neighbors[first[at] + 1];
+
+      prev = at;
+      at = next;
+      miles += distBetween2Points(this->Lat[prev], this->Lon[prev], this->Lat[at], this->Lon[at]);
+    }
+
+    walked[segmentOf(at, prev)] = 1;
+
+    chain.To = this->PointVertex[at];
+    chain.Count = (int) this->ChainPoints.size() - chain.First;
+    chain.Miles = miles;
+    this->ChainList.push_back(chain);
+  };
+
+  int junctions = (int) this->VertexPoints.size();
+
+  for (int v = 0; v < junctions; v++)
+  {
+    int p = this->VertexPoints[v];
+
+    for (int s = first[p]; s < first[p + 1]; s++)
+      if (!walked[s])
+        walkChain(p, s);
+  }
+
+  //
+  // what's left are rings of shape nodes with no junction at all
+  // (a closed footway on its own); one point of each becomes a
+  // vertex, with the ring a chain from it back to itself:
+  //
+  for (int p = 0; p < N; p++)
+  {
+    if (this->PointVertex[p] >= 0 || this->PointChain[p] >= 0)
+      continue;
+
+    addVertex(p);
+    walkChain(p, first[p]);
+  }
+
+  //
+  // build CSR over the vertices, each chain an edge in both
+  // directions; loops are left out, since they never shorten a
+  // path (they are still there for their shape nodes):
+  //
+  int V = (int) this->VertexPoints.size();
+
+  this->Offsets.assign(V + 1, 0);
+
+  for (const Chain& chain : this->ChainList) {
+    if (chain.From == chain.To)
+      continue;
+    this->Offsets[chain.From + 1]++;
+    this->Offsets[chain.To + 1]++;
+  }
+
+  for (int v = 0; v < V; v++)
+    this->Offsets[v + 1] += this->Offsets[v];
+
+  this->Targets.resize(this->Offsets[V]);
+  this->Weights.resize(this->Offsets[V]);
+  this->Chains.resize(this->Offsets[V]);
+
+  vector<int> next(this->Offsets.begin(), this->Offsets.end() - 1);
+
+  for (int c = 0; c < (int) this->ChainList.size(); c++)
+  {
+    const Chain& chain = this->ChainList[c];
+
+    if (chain.From == chain.To)
+      continue;
+
+    int e = next[chain.From]++;
+    this->Targets[e] = chain.To;
+    this->Weights[e] = chain.Miles;
+    this->Chains[e] = c;
+
+    e = next[chain.To]++;
+    this->Targets[e] = chain.From;
+    this->Weights[e] = chain.Miles;
+    this->Chains[e] = c;
+  }
+}
+
+
+//
+// nearestVertex
+//
+// Returns the point closest to (lat, lon), or -1 if the graph is
+// empty.
+//
+int Graph::nearestVertex(double lat, double lon, DistancePolicy policy) const
+{
+  PointSet points;
+  points.Lat = this->Lat.data();
+  points.Lon = this->Lon.data();
+  points.X = this->PointX.data();
+  points.Y = this->PointY.data();
+  points.Count = this->PointIDs.size();
+
+  double miles;
+  size_t best = nearestBy(policy, points, lat, lon, this->Projection, miles);
+
+  return (best < points.Count) ? (int) best : -1;
+}
+
+
+//
+// vertexForBuilding
+//
+// Picks the point to route from / to for a building: one of its
+// own nodes if any are on a walkable way, preferring entrances,
+// otherwise the point nearest its center.
+//
+int Graph::vertexForBuilding(const Building& B, const Nodes& nodes) const
+{
+  int fallback = -1;
+
+  for (long long id : B.NodeIDs)
+  {
+    int p = this->indexOf(id);
+    if (p < 0)
+      continue;
+
+    double lat, lon;
+    bool entrance = false;
+    nodes.find(id, lat, lon, entrance);
+
+    if (entrance)
+      return p;
+
+    if (fallback < 0)
+      fallback = p;
+  }
+
+  if (fallback >= 0)
+    return fallback;
+
+  auto location = B.getLocation(nodes);
+
+  return this->nearestVertex(location.first, location.second);
+}
+
+
+//
+// accessesOf
+//
+// The ways from a point into the reduced graph: a vertex is its
+// own, 0 miles away; a shape node can go either way along its
+// chain, to the junction at each end. Returns how many (1 or 2).
+//
+int Graph::accessesOf(int point, Access access[2]) const
+{
+  int v = this->PointVertex[point];
+
+  if (v >= 0) {
+    access[0] = { v, 0.0, true };
+    return 1;
+  }
+
+  const Chain& chain = this->ChainList[this->PointChain[point]];
+  double along = this->ChainMiles[this->PointSlot[point]];
+
+  access[0] = { chain.From, along, false };
+  access[1] = { chain.To, chain.Miles - along, true };
+  return 2;
+}
+
+
+//
+// appendChain
+//
+// Appends the ids of ChainPoints[fromSlot..toSlot], inclusive, in
+// that order (backwards if toSlot < fromSlot); nothing if the range
+// is outside the chain, as it is at either end.
+//
+void Graph::appendChain(int chain, int fromSlot, int toSlot, vector<long long>& nodeIDs) const
+{
+  const Chain& c = this->ChainList[chain];
+  int step = (fromSlot <= toSlot) ? 1 : -1;
+
+  if (fromSlot < c.First || fromSlot >= c.First + c.Count ||
+      toSlot < c.First || toSlot >= c.First + c.Count)
+    return;
+
+  for (int slot = fromSlot; ; slot += step) {
+    nodeIDs.push_back(this->PointIDs[this->ChainPoints[slot]]);
+    if (slot == toSlot)
+      break;
+  }
+}
+
+
+//
+// appendAccess
+//
+// Appends the nodes between a point and the vertex it reaches the
+// graph by: from the point up to (not including) the vertex when
+// leaving, from just after the vertex to the point when arriving.
+// Nothing for a point that is a vertex itself.
+//
+void Graph::appendAccess(int point, const Access& access, bool leaving, vector<long long>& nodeIDs) const
+{
+  if (this->PointVertex[point] >= 0)
+    return;
+
+  int c = this->PointChain[point];
+  int slot = this->PointSlot[point];
+  const Chain& chain = this->ChainList[c];
+  int end = access.Forward ? chain.First + chain.Count - 1 : chain.First;
+
+  if (leaving) {
+    nodeIDs.push_back(this->PointIDs[point]);
+    if (slot != end)
+      this->appendChain(c, slot + (access.Forward ? 1 : -1), end, nodeIDs);
+  }
+  else {
+    if (slot != end)
+      this->appendChain(c, end, slot + (access.Forward ? 1 : -1), nodeIDs);
+    nodeIDs.push_back(this->PointIDs[point]);
+  }
+}
+
+
+//
+// shortestPath
+//
+// A* search over the reduced graph, from the one or two vertices
+// "from" can reach (see accessesOf) to those "to" can be reached
+// by. Edge weights are great-circle distances, so the (scaled
+// down) straight-line distance to "to" never overestimates, and
+// once the smallest key left is no less than the best path found
+// so far, that path is the shortest. Two shape nodes on the same
+// chain may also be joined directly along it.
+//
+Path Graph::shortestPath(int from, int to) const
+{
+  LatencyTimer timer(LAT_ROUTE);
+  Path result;
+
+  int N = (int) this->PointIDs.size();
+
+  if (from < 0 || to < 0 || from >= N || to >= N)
+    return result;
+
+  if (from == to) {
+    result.Found = true;
+    result.NodeIDs.push_back(this->PointIDs[from]);
+    return result;
+  }
+
+  const double INF = numeric_limits<double>::max();
+
+  Access starts[2], ends[2];
+  int numStarts = this->accessesOf(from, starts);
+  int numEnds = this->accessesOf(to, ends);
+
+  double best = INF;
+  int bestEnd = -1;       // which of ends, or 2 if along a shared chain
+
+  bool sameChain = this->PointVertex[from] < 0 && this->PointVertex[to] < 0 &&
+    this->PointChain[from] == this->PointChain[to];
+
+  if (sameChain) {
+    best = fabs(this->ChainMiles[this->PointSlot[to]] - this->ChainMiles[this->PointSlot[from]]);
+    bestEnd = 2;
+  }
+
+  int V = (int) this->VertexPoints.size();
+
+  vector<double> dist(V, INF);
+  vector<int> pred(V, -1);       // the edge each vertex was reached by
+
+  typedef pair<double, int> Entry;  // (dist + heuristic, vertex)
+  priority_queue<Entry, vector<Entry>, greater<Entry>> pq;
+
+  //
+  // the plane overstates distances by up to the projection's
+  // error; scaled down by that much, it never does, so the
+  // heuristic stays admissible (and consistent, edges being at
+  // least the haversine distance between their ends):
+  //
+  double toX = this->PointX[to];
+  double toY = this->PointY[to];
+  double scale = 1.0 - this->Projection.getError();
+
+  auto heuristic = [&](int v) {
+    return planarMiles(this->VertexX[v], this->VertexY[v], toX, toY) * scale;
+  };
+
+  for (int i = 0; i < numStarts; i++) {
+    const Access& a = starts[i];
+    if (a.Miles < dist[a.V]) {
+      dist[a.V] = a.Miles;
+      pq.push(Entry(a.Miles + heuristic(a.V), a.V));
+    }
+  }
+
+  while (!pq.empty())
+  {
+    Entry top = pq.top();
+    pq.pop();
+
+    if (top.first >= best)  // nothing left can do better
+      break;
+
+    int u = top.second;
+
+    if (top.first > dist[u] + heuristic(u) + 1e-12)  // stale entry
+      continue;
+
+    for (int i = 0; i < numEnds; i++) {
+      if (ends[i].V == u && dist[u] + ends[i].Miles < best) {
+        best = dist[u] + ends[i].Miles;
+        bestEnd = i;
+      }
+    }
+
+    for (int e = this->Offsets[u]; e < this->Offsets[u + 1]; e++)
+    {
+      int v = this->Targets[e];
+      double d = dist[u] + this->Weights[e];
+
+      if (d < dist[v]) {
+        dist[v] = d;
+        pred[v] = e;
+        pq.push(Entry(d + heuristic(v), v));
+      }
+    }
+  }
+
+  if (best == INF)
+    return result;
+
+  result.Found = true;
+  result.Distance = best;
+
+  if (bestEnd == 2) {
+    int c = this->PointChain[from];
+    this->appendChain(c, this->PointSlot[from], this->PointSlot[to], result.NodeIDs);
+    return result;
+  }
+
+  //
+  // the edges taken, back from the end to a start:
+  //
+  vector<int> edges;
+  int v = ends[bestEnd].V;
+
+  while (pred[v] != -1) {
+    int e = pred[v];
+    edges.push_back(e);
+    const Chain& chain = this->ChainList[this->Chains[e]];
+    v = (chain.To == v) ? chain.From : chain.To;
+  }
+
+  reverse(edges.begin(), edges.end());
+
+  //
+  // the start reached v: the shorter, if both did (a loop):
+  //
+  int start = -1;
+
+  for (int i = 0; i < numStarts; i++)
+    if (starts[i].V == v && (start < 0 || starts[i].Miles < starts[start].Miles))
+      start = i;
+
+  //
+  // and expand to every node walked past:
+  //
+  this->appendAccess(from, starts[start], true, result.NodeIDs);
+  result.NodeIDs.push_back(this->PointIDs[this->VertexPoints[v]]);
+
+  for (int e : edges)
+  {
+    const Chain& chain = this->ChainList[this->Chains[e]];
+    int last = chain.First + chain.Count - 1;
+
+    if (chain.Count > 0) {
+      if (chain.From == v)
+        this->appendChain(this->Chains[e], chain.First, last, result.NodeIDs);
+      else
+        this->appendChain(this->Chains[e], last, chain.First, result.NodeIDs);
+    }
+
+    v = this->Targets[e];
+    result.NodeIDs.push_back(this->PointIDs[this->VertexPoints[v]]);
+  }
+
+  this->appendAccess(to, ends[bestEnd], false, result.NodeIDs);
+
+  return result;
+}
+
+
+//
+// accessors / getters
+//
+int Graph::getNumPoints() const {
+  return (int) this->PointIDs.size();
+}
+
+int Graph::getNumSegments() const {
+  return this->NumSegments;
+}
+
+int Graph::getNumVertices() const {
+  return (int) this->VertexPoints.size();
+}
+
+int Graph::getNumEdges() const {
+  return (int) this->Targets.size() / 2;
+}
+
+int Graph::indexOf(long long nodeid) const {
+  auto ptr = this->IndexOf.find(nodeid);
+
+  if (ptr == this->IndexOf.end())
+    return -1;
+  else
+    return ptr->second;
+}
+
+long long Graph::getNodeID(int point) const {
+  return this->PointIDs[point];
+}
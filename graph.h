@@ -0,0 +1,180 @@
+/*graph.h*/
+
+//
+// The walking graph of the Open Street Map: footways, paths and
+// streets, reduced to their junctions, with an edge for each chain
+// of nodes between two, weighted by distance in miles.
+//
+// References:
+//
+// OpenStreetMap highway tags:
+//   https://wiki.openstreetmap.org/wiki/Key:highway
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <memory_resource>
+
+#include "nodes.h"
+#include "building.h"
+#include "arena.h"
+#include "projection.h"
+#include "distpolicy.h"
+#include "tinyxml2.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// Path
+//
+// Result of a shortest path search: the total distance in miles
+// and the OSM node ids along the path, from start to end. An empty
+// path (Found == false) means the endpoints are not connected.
+//
+struct Path
+{
+  bool Found = false;
+  double Distance = 0.0;
+  vector<long long> NodeIDs;
+};
+
+
+//
+// Graph
+//
+// Every node of a walkable way is a point of the graph (indexed
+// 0..N-1), but most are only shape nodes partway along a footway
+// or street. Routing runs on a reduced graph whose vertices are
+// the junctions -- points where ways meet or end, and entrances --
+// with an edge per chain of shape nodes between two junctions,
+// weighted by the chain's length in miles. The shape nodes are kept
+// per chain, in order, and only put back into the final path.
+//
+// Adjacency is kept in compressed sparse row form: the edges out of
+// vertex v are Targets/Weights/Chains in the range
+// [Offsets[v], Offsets[v+1]).
+//
+class Graph
+{
+private:
+  //
+  // Chain
+  //
+  // The shape nodes between two junctions, From and To (the same
+  // junction for a loop): ChainPoints[First..First+Count) in order
+  // from From, each ChainMiles along from it.
+  //
+  struct Chain
+  {
+    int From;
+    int To;
+    int First;
+    int Count;
+    double Miles;
+  };
+
+  vector<long long> PointIDs;    // point => OSM node id
+  vector<double> Lat;            // point => position
+  vector<double> Lon;
+  vector<double> PointX;         // point => projected, see projection.h
+  vector<double> PointY;
+  vector<int> PointVertex;       // point => vertex, -1 if a shape node
+  vector<int> PointChain;        // shape node => its chain
+  vector<int> PointSlot;         // shape node => index into ChainPoints
+
+  shared_ptr<Arena> Storage;     // for the hash table's entries
+  pmr::unordered_map<long long, int> IndexOf;  // OSM node id => point
+
+  vector<int> VertexPoints;      // vertex => point
+  vector<double> VertexX;        // vertex => projected, for the A* heuristic
+  vector<double> VertexY;
+
+  LocalProjection Projection;    // the map's, from Nodes
+
+  vector<int> Offsets;
+  vector<int> Targets;
+  vector<double> Weights;
+  vector<int> Chains;            // edge => the chain it runs along
+
+  vector<Chain> ChainList;
+  vector<int> ChainPoints;
+  vector<double> ChainMiles;
+
+  int NumSegments = 0;           // edges before chains were collapsed
+
+  //
+  // a way into or out of the reduced graph from a point: to vertex
+  // V, Miles away along the chain, in the chain's direction or not:
+  //
+  struct Access
+  {
+    int V;
+    double Miles;
+    bool Forward;
+  };
+
+  int accessesOf(int point, Access access[2]) const;
+  void appendChain(int chain, int fromSlot, int toSlot, vector<long long>& nodeIDs) const;
+  void appendAccess(int point, const Access& access, bool leaving, vector<long long>& nodeIDs) const;
+
+public:
+  Graph();
+
+  //
+  // readMapGraph
+  //
+  // Given an XML document and the map's nodes, builds the graph
+  // from every walkable way (see isWalkable in graph.cpp). Chains
+  // of shape nodes are collapsed into single edges unless collapse
+  // is false, in which case every point is a vertex (for comparing
+  // the two, see navbench).
+  //
+  void readMapGraph(XMLDocument& xmldoc, const Nodes& nodes, bool collapse = true);
+
+  //
+  // nearestVertex
+  //
+  // Returns the point closest to (lat, lon), or -1 if the graph is
+  // empty. Within the map, candidates are found in the plane and
+  // only the few that could be nearest are measured by haversine;
+  // another policy (see distpolicy.h) trades that exactness for
+  // speed.
+  //
+  int nearestVertex(double lat, double lon, DistancePolicy policy = DistancePolicy::Exact) const;
+
+  //
+  // vertexForBuilding
+  //
+  // Picks the point to route from / to for a building: one of its
+  // own nodes if any are on a walkable way (entrances usually are),
+  // otherwise the point nearest its center. Returns -1 if none.
+  //
+  int vertexForBuilding(const Building& B, const Nodes& nodes) const;
+
+  //
+  // shortestPath
+  //
+  // A* search from point "from" to point "to", using straight-line
+  // distance in the plane, scaled down by the projection's error
+  // bound, as the heuristic. Edges are weighed by haversine, so
+  // the distance is the same as if that had been the heuristic. The
+  // path lists every node walked past, shape nodes included.
+  //
+  Path shortestPath(int from, int to) const;
+
+  //
+  // accessors / getters
+  //
+  int getNumPoints() const;     // every node of a walkable way
+  int getNumSegments() const;   // between consecutive points
+  int getNumVertices() const;   // junctions
+  int getNumEdges() const;      // chains between junctions
+  int indexOf(long long nodeid) const;  // the point, -1 if none
+  long long getNodeID(int point) const;
+};
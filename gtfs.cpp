@@ -0,0 +1,765 @@
+/*gtfs.cpp*/
+
+//
+// A GTFS (General Transit Feed Specification) static feed: the stops,
+// routes, trips and timetable (stop_times) published by a transit
+// agency, read from a directory of .txt files or from the feed's zip
+// file.
+//
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <filesystem>
+#include <functional>
+#include <cmath>
+
+#include "gtfs.h"
+#include "csv.h"
+#include "zipfile.h"
+
+using namespace std;
+
+
+//
+// StringPool
+//
+int StringPool::intern(string_view s)
+{
+  auto ptr = this->Index.find(s);
+
+  if (ptr != this->Index.end())
+    return ptr->second;
+
+  string_view stored = this->Storage.store(s);
+  int i = (int) this->Strings.size();
+
+  this->Strings.push_back(stored);
+  this->Index.emplace(stored, i);
+
+  return i;
+}
+
+
+int StringPool::find(string_view s) const
+{
+  auto ptr = this->Index.find(s);
+
+  return (ptr == this->Index.end()) ? -1 : ptr->second;
+}
+
+
+//
+// gtfsIsFeed
+//
+bool gtfsIsFeed(const string& path)
+{
+  error_code ec;
+
+  if (filesystem::is_directory(path, ec))
+    return true;
+
+  return path.size() > 4 && path.compare(path.size() - 4, 4, ".zip") == 0;
+}
+
+
+//
+// parseTime
+//
+// Parses a GTFS time, H:MM:SS or HH:MM:SS, into seconds after
+// midnight; hours may run past 24 for trips that end after midnight.
+//
+static bool parseTime(string_view s, int32_t& seconds)
+{
+  while (!s.empty() && s.front() == ' ')
+    s.remove_prefix(1);
+  while (!s.empty() && s.back() == ' ')
+    s.remove_suffix(1);
+
+  size_t c1 = s.find(':');
+  size_t c2 = (c1 == string_view::npos) ? c1 : s.find(':', c1 + 1);
+
+  if (c2 == string_view::npos || c2 - c1 != 3 || s.size() - c2 != 3)
+    return false;
+
+  int h, m, sec;
+
+  if (!parseField(s.substr(0, c1), h) || !parseField(s.substr(c1 + 1, 2), m)
+    || !parseField(s.substr(c2 + 1, 2), sec))
+    return false;
+
+  if (h < 0 || m < 0 || m > 59 || sec < 0 || sec > 59)
+    return false;
+
+  seconds = h * 3600 + m * 60 + sec;
+  return true;
+}
+
+
+//
+// GtfsLoader
+//
+// Reads the feed's files out of a directory or zip archive, and
+// fills in a GtfsFeed table by table.
+//
+class GtfsLoader
+{
+private:
+  static const int MAX_REPORTED_ERRORS = 20;  // per file
+
+  GtfsFeed& Feed;
+  string Directory;   // if reading from a directory
+  ZipArchive Zip;     // otherwise
+  bool IsZip = false;
+
+  //
+  // columns of stop_times, kept only while loading:
+  //
+  vector<int32_t> RowTrip;
+  vector<int32_t> RowSequence;
+  vector<int32_t> RowStop;
+  vector<int32_t> RowArrival;     // -1 if not given
+  vector<int32_t> RowDeparture;   // -1 if not given
+
+public:
+  GtfsLoader(GtfsFeed& feed) : Feed(feed) { }
+
+  bool open(const string& path, string& error);
+
+  //
+  // readTable
+  //
+  // Streams the named file, looks up the wanted columns in its header
+  // row, and calls onRow with each later row's values for those
+  // columns, in the order given ("" for a column the file lacks).
+  // onRow returns an error message for a bad row, or "".
+  //
+  bool readTable(const string& name, const vector<const char*>& columns,
+    const vector<const char*>& required,
+    const function<string(const vector<string_view>& values)>& onRow, string& error);
+
+  bool readStops(string& error);
+  bool readRoutes(string& error);
+  bool readTrips(string& error);
+  bool readStopTimes(string& error);
+
+  void buildTimetable();
+  void linkStopsToRoutes();
+
+  int directionName(string_view name);
+};
+
+
+bool GtfsLoader::open(const string& path, string& error)
+{
+  error_code ec;
+
+  if (filesystem::is_directory(path, ec)) {
+    this->Directory = path;
+    this->IsZip = false;
+    return true;
+  }
+
+  this->IsZip = true;
+  return this->Zip.open(path, error);
+}
+
+
+bool GtfsLoader::readTable(const string& name, const vector<const char*>& columns,
+  const vector<const char*>& required,
+  const function<string(const vector<string_view>& values)>& onRow, string& error)
+{
+  vector<int> index;              // column => field position, or -1
+  vector<string_view> values(columns.size());
+  bool header = true;
+  int reported = 0;
+  string headerError;
+
+  auto report = [&](size_t line, const string& why) {
+    this->Feed.RowErrors++;
+    if (++reported <= MAX_REPORTED_ERRORS)
+      cerr << name << ":" << line << ": " << why << endl;
+  };
+
+  CsvStream::RowFunction handleRow =
+    [&](const vector<string_view>& fields, size_t line, const string& csvError)
+  {
+    if (!headerError.empty())
+      return;
+
+    if (header)
+    {
+      header = false;
+
+      for (const char* column : columns)
+      {
+        int at = -1;
+
+        for (int i = 0; i < (int) fields.size(); i++) {
+          string_view f = fields[i];
+          while (!f.empty() && f.back() == ' ')
+            f.remove_suffix(1);
+          while (!f.empty() && f.front() == ' ')
+            f.remove_prefix(1);
+          if (f == column)
+            at = i;
+        }
+
+        index.push_back(at);
+      }
+
+      for (const char* column : required)
+      {
+        auto pos = find_if(columns.begin(), columns.end(),
+          [&](const char* c) { return string_view(c) == column; });
+
+        if (index[pos - columns.begin()] < 0) {
+          headerError = name + ": missing required column '" + column + "'";
+          return;
+        }
+      }
+
+      return;
+    }
+
+    if (!csvError.empty()) {
+      report(line, csvError);
+      return;
+    }
+
+    for (size_t c = 0; c < columns.size(); c++) {
+      int at = index[c];
+      values[c] = (at >= 0 && at < (int) fields.size()) ? fields[at] : string_view();
+    }
+
+    string why = onRow(values);
+
+    if (!why.empty())
+      report(line, why);
+  };
+
+  CsvStream csv;
+  auto onBlock = [&](string_view block) { csv.feed(block, handleRow); };
+
+  if (this->IsZip)
+  {
+    const ZipArchive::Member* member = this->Zip.find(name);
+
+    if (member == nullptr) {
+      error = "feed has no " + name;
+      return false;
+    }
+
+    if (!this->Zip.read(*member, onBlock, error))
+      return false;
+  }
+  else
+  {
+    MappedFile file;
+
+    if (!file.open((filesystem::path(this->Directory) / name).string())) {
+      error = "unable to open " + name;
+      return false;
+    }
+
+    onBlock(file.view());
+  }
+
+  csv.finish(handleRow);
+
+  if (header) {
+    error = name + " is empty";
+    return false;
+  }
+
+  if (!headerError.empty()) {
+    error = headerError;
+    return false;
+  }
+
+  if (reported > MAX_REPORTED_ERRORS)
+    cerr << name << ": " << (reported - MAX_REPORTED_ERRORS) << " more malformed rows not shown" << endl;
+
+  return true;
+}
+
+
+//
+// stops.txt
+//
+bool GtfsLoader::readStops(string& error)
+{
+  GtfsFeed& F = this->Feed;
+  vector<string_view> parents;   // parent_station ids, resolved at the end
+
+  bool ok = this->readTable("stops.txt",
+    { "stop_id", "stop_name", "stop_code", "stop_desc", "stop_lat", "stop_lon",
+      "location_type", "parent_station" },
+    { "stop_id" },
+    [&](const vector<string_view>& v) -> string
+  {
+    if (v[0].empty())
+      return "missing stop_id";
+
+    if (F.StopIDs.find(v[0]) >= 0)
+      return "duplicate stop_id '" + string(v[0]) + "'";
+
+    double lat = 0.0, lon = 0.0;
+    int type = 0;
+
+    if (!v[6].empty() && !parseField(v[6], type))
+      return "location_type must be an integer";
+
+    //
+    // coordinates are optional only for generic nodes and boarding
+    // areas (location_type 3 and 4):
+    //
+    if ((!parseField(v[4], lat) || !parseField(v[5], lon)) && type < 3)
+      return "stop_lat and stop_lon must be numbers";
+
+    if (fabs(lat) > 90.0 || fabs(lon) > 180.0)
+      return "stop_lat and stop_lon must be within +/-90 and +/-180 degrees";
+
+    F.StopIDs.intern(v[0]);
+    F.StopName.push_back(F.Text.store(v[1]));
+    F.StopCode.push_back(F.Text.store(v[2]));
+    F.StopDesc.push_back(F.Text.store(v[3]));
+    F.StopLat.push_back(toE7(lat));
+    F.StopLon.push_back(toE7(lon));
+    F.StopLocationType.push_back((int8_t) type);
+    parents.push_back(F.Text.store(v[7]));
+
+    return "";
+  }, error);
+
+  if (!ok)
+    return false;
+
+  F.StopParent.resize(F.getNumStops());
+
+  for (int s = 0; s < F.getNumStops(); s++)
+    F.StopParent[s] = parents[s].empty() ? -1 : F.StopIDs.find(parents[s]);
+
+  return true;
+}
+
+
+//
+// routes.txt
+//
+bool GtfsLoader::readRoutes(string& error)
+{
+  GtfsFeed& F = this->Feed;
+
+  return this->readTable("routes.txt",
+    { "route_id", "route_short_name", "route_long_name", "route_type" },
+    { "route_id" },
+    [&](const vector<string_view>& v) -> string
+  {
+    if (v[0].empty())
+      return "missing route_id";
+
+    if (F.RouteIDs.find(v[0]) >= 0)
+      return "duplicate route_id '" + string(v[0]) + "'";
+
+    int type = 3;
+
+    if (!v[3].empty() && !parseField(v[3], type))
+      return "route_type must be an integer";
+
+    F.RouteIDs.intern(v[0]);
+    F.RouteShortName.push_back(F.Text.store(v[1]));
+    F.RouteLongName.push_back(F.Text.store(v[2]));
+    F.RouteType.push_back((int16_t) type);
+
+    return "";
+  }, error);
+}
+
+
+//
+// trips.txt
+//
+// The "direction" column is not standard GTFS, but some agencies
+// (the CTA among them) give the direction of travel there by name,
+// e.g. "Northbound"; it is used if present.
+//
+bool GtfsLoader::readTrips(string& error)
+{
+  GtfsFeed& F = this->Feed;
+
+  return this->readTable("trips.txt",
+    { "trip_id", "route_id", "service_id", "direction_id", "trip_headsign", "direction" },
+    { "trip_id", "route_id" },
+    [&](const vector<string_view>& v) -> string
+  {
+    if (v[0].empty())
+      return "missing trip_id";
+
+    if (F.TripIDs.find(v[0]) >= 0)
+      return "duplicate trip_id '" + string(v[0]) + "'";
+
+    int route = F.RouteIDs.find(v[1]);
+
+    if (route < 0)
+      return "unknown route_id '" + string(v[1]) + "'";
+
+    int direction = -1;
+
+    if (!v[3].empty() && (!parseField(v[3], direction) || direction < 0 || direction > 1))
+      return "direction_id must be 0 or 1";
+
+    F.TripIDs.intern(v[0]);
+    F.TripRoute.push_back(route);
+    F.TripService.push_back(F.ServiceIDs.intern(v[2]));
+    F.TripDirection.push_back((int8_t) direction);
+    F.TripDirectionName.push_back(v[5].empty() ? -1 : this->directionName(v[5]));
+    F.TripHeadsign.push_back(F.Text.store(v[4]));
+
+    return "";
+  }, error);
+}
+
+
+//
+// stop_times.txt
+//
+// Rows are appended to the loading columns as they stream in; the
+// compact, trip-grouped form is built afterwards (buildTimetable).
+//
+bool GtfsLoader::readStopTimes(string& error)
+{
+  GtfsFeed& F = this->Feed;
+
+  //
+  // a trip's rows are normally consecutive, so remember the last
+  // trip looked up:
+  //
+  int lastTrip = -1;
+
+  return this->readTable("stop_times.txt",
+    { "trip_id", "stop_sequence", "stop_id", "arrival_time", "departure_time" },
+    { "trip_id", "stop_sequence", "stop_id" },
+    [&](const vector<string_view>& v) -> string
+  {
+    int trip = (lastTrip >= 0 && F.TripIDs.get(lastTrip) == v[0]) ? lastTrip : F.TripIDs.find(v[0]);
+
+    if (trip < 0)
+      return "unknown trip_id '" + string(v[0]) + "'";
+
+    lastTrip = trip;
+
+    int stop = F.StopIDs.find(v[2]);
+
+    if (stop < 0)
+      return "unknown stop_id '" + string(v[2]) + "'";
+
+    int sequence;
+
+    if (!parseField(v[1], sequence) || sequence < 0)
+      return "stop_sequence must be a non-negative integer";
+
+    int32_t arrival = -1, departure = -1;
+
+    if (!v[3].empty() && !parseTime(v[3], arrival))
+      return "arrival_time must be H:MM:SS";
+
+    if (!v[4].empty() && !parseTime(v[4], departure))
+      return "departure_time must be H:MM:SS";
+
+    this->RowTrip.push_back(trip);
+    this->RowSequence.push_back(sequence);
+    this->RowStop.push_back(stop);
+    this->RowArrival.push_back(arrival);
+    this->RowDeparture.push_back(departure);
+
+    return "";
+  }, error);
+}
+
+
+//
+// buildTimetable
+//
+// Groups the stop_times rows by trip (a stable counting sort, skipped
+// when the file is already in trip order, as feeds usually are),
+// orders each trip by stop_sequence, fills in the times GTFS allows
+// to be left blank between timepoints, and stores the compact form.
+//
+void GtfsLoader::buildTimetable()
+{
+  GtfsFeed& F = this->Feed;
+
+  int T = F.getNumTrips();
+  size_t N = this->RowTrip.size();
+
+  F.TripStart.assign(T + 1, 0);
+
+  for (size_t i = 0; i < N; i++)
+    F.TripStart[this->RowTrip[i] + 1]++;
+
+  for (int t = 0; t < T; t++)
+    F.TripStart[t + 1] += F.TripStart[t];
+
+  bool grouped = true;
+
+  for (size_t i = 1; i < N && grouped; i++)
+    grouped = this->RowTrip[i - 1] <= this->RowTrip[i];
+
+  vector<uint32_t> order;
+
+  if (!grouped)
+  {
+    order.resize(N);
+    vector<uint32_t> next(F.TripStart.begin(), F.TripStart.end() - 1);
+
+    for (size_t i = 0; i < N; i++)
+      order[next[this->RowTrip[i]]++] = (uint32_t) i;
+  }
+
+  auto row = [&](size_t k) -> uint32_t { return grouped ? (uint32_t) k : order[k]; };
+
+  F.StopTimeStop.resize(N);
+  F.StopTimeArrival.resize(N);
+  F.StopTimeDwell.resize(N);
+
+  vector<uint32_t> tripRows;   // rows of one trip, sorted by sequence
+  vector<int32_t> departures;
+
+  for (int t = 0; t < T; t++)
+  {
+    uint32_t begin = F.TripStart[t], end = F.TripStart[t + 1];
+
+    tripRows.clear();
+    for (uint32_t k = begin; k < end; k++)
+      tripRows.push_back(row(k));
+
+    auto bySequence = [&](uint32_t a, uint32_t b) { return this->RowSequence[a] < this->RowSequence[b]; };
+
+    if (!is_sorted(tripRows.begin(), tripRows.end(), bySequence))
+      stable_sort(tripRows.begin(), tripRows.end(), bySequence);
+
+    //
+    // arrival defaults to departure and vice versa; stops with
+    // neither get times interpolated linearly between the nearest
+    // timepoints before and after (by stop count, as there is no
+    // shape distance here):
+    //
+    departures.assign(tripRows.size(), -1);
+
+    for (size_t j = 0; j < tripRows.size(); j++)
+    {
+      uint32_t r = tripRows[j];
+      int32_t arr = this->RowArrival[r], dep = this->RowDeparture[r];
+
+      if (arr < 0) arr = dep;
+      if (dep < 0) dep = arr;
+
+      F.StopTimeStop[begin + j] = this->RowStop[r];
+      F.StopTimeArrival[begin + j] = arr;
+      departures[j] = dep;
+    }
+
+    size_t prev = SIZE_MAX;
+
+    for (size_t j = 0; j < tripRows.size(); j++)
+    {
+      if (F.StopTimeArrival[begin + j] < 0)
+        continue;
+
+      if (prev != SIZE_MAX && j - prev > 1)
+      {
+        int32_t t0 = departures[prev], t1 = F.StopTimeArrival[begin + j];
+
+        for (size_t k = prev + 1; k < j; k++) {
+          int32_t tk = t0 + (int32_t) ((long long) (t1 - t0) * (long long) (k - prev) / (long long) (j - prev));
+          F.StopTimeArrival[begin + k] = tk;
+          departures[k] = tk;
+        }
+      }
+
+      prev = j;
+    }
+
+    //
+    // leading / trailing stops without times (not valid GTFS) take
+    // the nearest known time:
+    //
+    size_t first = SIZE_MAX, last = SIZE_MAX;
+
+    for (size_t j = 0; j < tripRows.size(); j++) {
+      if (F.StopTimeArrival[begin + j] >= 0) {
+        if (first == SIZE_MAX)
+          first = j;
+        last = j;
+      }
+    }
+
+    for (size_t j = 0; j < tripRows.size(); j++) {
+      if (first == SIZE_MAX) {
+        F.StopTimeArrival[begin + j] = departures[j] = 0;
+      }
+      else if (j < first) {
+        F.StopTimeArrival[begin + j] = departures[j] = F.StopTimeArrival[begin + first];
+      }
+      else if (j > last) {
+        F.StopTimeArrival[begin + j] = departures[j] = departures[last];
+      }
+    }
+
+    for (size_t j = 0; j < tripRows.size(); j++) {
+      int32_t dwell = departures[j] - F.StopTimeArrival[begin + j];
+      F.StopTimeDwell[begin + j] = (uint16_t) max(0, min(dwell, 65535));
+    }
+  }
+
+  //
+  // the loading columns are no longer needed:
+  //
+  vector<int32_t>().swap(this->RowTrip);
+  vector<int32_t>().swap(this->RowSequence);
+  vector<int32_t>().swap(this->RowStop);
+  vector<int32_t>().swap(this->RowArrival);
+  vector<int32_t>().swap(this->RowDeparture);
+}
+
+
+//
+// directionName
+//
+int GtfsLoader::directionName(string_view name)
+{
+  vector<string>& names = this->Feed.DirectionNames;
+
+  for (int i = 0; i < (int) names.size(); i++)
+    if (names[i] == name)
+      return i;
+
+  names.push_back(string(name));
+  return (int) names.size() - 1;
+}
+
+
+//
+// linkStopsToRoutes
+//
+// Names each trip's direction of travel -- from trips.txt if given,
+// otherwise the compass direction from its first stop to its last --
+// and records, for each stop, every (route, direction) whose trips
+// stop there.
+//
+void GtfsLoader::linkStopsToRoutes()
+{
+  GtfsFeed& F = this->Feed;
+
+  int S = F.getNumStops();
+  int T = F.getNumTrips();
+
+  for (int t = 0; t < T; t++)
+  {
+    if (F.TripDirectionName[t] >= 0)
+      continue;
+
+    uint32_t begin = F.TripStart[t], end = F.TripStart[t + 1];
+
+    if (end - begin < 2) {
+      F.TripDirectionName[t] = this->directionName("");
+      continue;
+    }
+
+    int a = F.StopTimeStop[begin], b = F.StopTimeStop[end - 1];
+    double dy = fromE7(F.StopLat[b]) - fromE7(F.StopLat[a]);
+    double dx = (fromE7(F.StopLon[b]) - fromE7(F.StopLon[a])) * cos(fromE7(F.StopLat[a]) * M_PI / 180.0);
+
+    const char* name;
+
+    if (fabs(dy) >= fabs(dx))
+      name = (dy >= 0) ? "Northbound" : "Southbound";
+    else
+      name = (dx >= 0) ? "Eastbound" : "Westbound";
+
+    F.TripDirectionName[t] = this->directionName(name);
+  }
+
+  //
+  // a stop is served by a handful of routes, so each stop's list is
+  // kept short and searched linearly:
+  //
+  vector<vector<pair<int, int>>> served(S);
+
+  for (int t = 0; t < T; t++)
+  {
+    pair<int, int> key(F.TripRoute[t], F.TripDirectionName[t]);
+
+    for (uint32_t k = F.TripStart[t]; k < F.TripStart[t + 1]; k++)
+    {
+      auto& list = served[F.StopTimeStop[k]];
+
+      if (find(list.begin(), list.end(), key) == list.end())
+        list.push_back(key);
+    }
+  }
+
+  F.StopRouteStart.assign(S + 1, 0);
+
+  for (int s = 0; s < S; s++)
+    F.StopRouteStart[s + 1] = F.StopRouteStart[s] + (uint32_t) served[s].size();
+
+  F.StopRouteRoute.reserve(F.StopRouteStart[S]);
+  F.StopRouteDirection.reserve(F.StopRouteStart[S]);
+
+  for (int s = 0; s < S; s++)
+  {
+    sort(served[s].begin(), served[s].end());
+
+    for (auto& rd : served[s]) {
+      F.StopRouteRoute.push_back(rd.first);
+      F.StopRouteDirection.push_back(rd.second);
+    }
+  }
+}
+
+
+//
+// load
+//
+bool GtfsFeed::load(const string& path, string& error)
+{
+  GtfsLoader loader(*this);
+
+  if (!loader.open(path, error))
+    return false;
+
+  if (!loader.readStops(error) || !loader.readRoutes(error)
+    || !loader.readTrips(error) || !loader.readStopTimes(error))
+  {
+    error = path + ": " + error;
+    return false;
+  }
+
+  loader.buildTimetable();
+  loader.linkStopsToRoutes();
+
+  return true;
+}
+
+
+//
+// getMemoryBytes
+//
+size_t GtfsFeed::getMemoryBytes() const
+{
+  auto bytes = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+
+  return bytes(this->StopName) + bytes(this->StopCode) + bytes(this->StopDesc)
+    + bytes(this->StopLat) + bytes(this->StopLon) + bytes(this->StopLocationType)
+    + bytes(this->StopParent) + bytes(this->RouteShortName) + bytes(this->RouteLongName)
+    + bytes(this->RouteType) + bytes(this->TripRoute) + bytes(this->TripService)
+    + bytes(this->TripDirection) + bytes(this->TripDirectionName) + bytes(this->TripHeadsign)
+    + bytes(this->TripStart) + bytes(this->StopTimeStop) + bytes(this->StopTimeArrival)
+    + bytes(this->StopTimeDwell) + bytes(this->StopRouteStart) + bytes(this->StopRouteRoute)
+    + bytes(this->StopRouteDirection) + this->Text.getBytesUsed();
+}
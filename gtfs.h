@@ -0,0 +1,178 @@
+/*gtfs.h*/
+
+//
+// A GTFS (General Transit Feed Specification) static feed: the stops,
+// routes, trips and timetable (stop_times) published by a transit
+// agency, read from a directory of .txt files or from the feed's zip
+// file.
+//
+// The tables are stored by column, one vector per field, and every
+// GTFS id (stop_id, route_id, trip_id, service_id) is interned: rows
+// refer to each other by index, never by string. Row i of a table is
+// the entity whose interned id is i.
+//
+// stop_times.txt is by far the largest file (millions of rows for a
+// metro area), so it is streamed -- parsed a block at a time as it
+// is read or inflated -- and stored compactly: grouped by trip in
+// stop_sequence order (compressed sparse row form, like the walking
+// graph), with a 4-byte stop index, 4-byte arrival time in seconds
+// after midnight, and 2-byte dwell (departure - arrival) per row.
+//
+// References:
+//
+// GTFS Schedule reference:
+//   https://gtfs.org/schedule/reference/
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "arena.h"
+#include "coord.h"
+
+using namespace std;
+
+
+//
+// StringPool
+//
+// Interns strings: each distinct string is stored once, in an arena,
+// and numbered 0, 1, 2, ... in order of first appearance.
+//
+class StringPool
+{
+private:
+  Arena Storage;
+  unordered_map<string_view, int> Index;
+  vector<string_view> Strings;
+
+public:
+  //
+  // intern
+  //
+  // Returns the number of the string, adding it if new.
+  //
+  int intern(string_view s);
+
+  //
+  // find
+  //
+  // Returns the number of the string, or -1 if it was never interned.
+  //
+  int find(string_view s) const;
+
+  string_view get(int i) const { return this->Strings[i]; }
+  int size() const { return (int) this->Strings.size(); }
+};
+
+
+//
+// GtfsFeed
+//
+class GtfsFeed
+{
+public:
+  //
+  // stops.txt
+  //
+  StringPool StopIDs;
+  vector<string_view> StopName;
+  vector<string_view> StopCode;       // "" if none
+  vector<string_view> StopDesc;       // "" if none
+  vector<CoordE7> StopLat;            // 1e-7 degrees, see coord.h
+  vector<CoordE7> StopLon;
+  vector<int8_t> StopLocationType;    // 0 = stop / platform, 1 = station, ...
+  vector<int> StopParent;             // station's stop index, or -1
+
+  //
+  // routes.txt
+  //
+  StringPool RouteIDs;
+  vector<string_view> RouteShortName;
+  vector<string_view> RouteLongName;
+  vector<int16_t> RouteType;          // 3 = bus
+
+  //
+  // trips.txt
+  //
+  StringPool TripIDs;
+  StringPool ServiceIDs;
+  vector<int> TripRoute;              // route index
+  vector<int> TripService;            // service index
+  vector<int8_t> TripDirection;       // direction_id 0 / 1, or -1 if not given
+  vector<int> TripDirectionName;      // index into DirectionNames
+  vector<string_view> TripHeadsign;
+
+  //
+  // stop_times.txt: the stops of trip t are rows [TripStart[t],
+  // TripStart[t+1]) in stop_sequence order:
+  //
+  vector<uint32_t> TripStart;
+  vector<int32_t> StopTimeStop;       // stop index
+  vector<int32_t> StopTimeArrival;    // seconds after midnight (may be >= 24h)
+  vector<uint16_t> StopTimeDwell;     // departure - arrival, in seconds
+
+  //
+  // derived: the routes (and direction of travel) serving each stop,
+  // rows [StopRouteStart[s], StopRouteStart[s+1]):
+  //
+  vector<string> DirectionNames;      // "Northbound", ...
+  vector<uint32_t> StopRouteStart;
+  vector<int> StopRouteRoute;         // route index
+  vector<int> StopRouteDirection;     // index into DirectionNames
+
+private:
+  Arena Text;                         // names, codes, headsigns
+  long long RowErrors = 0;
+
+  friend class GtfsLoader;
+
+public:
+  GtfsFeed() = default;
+  GtfsFeed(const GtfsFeed&) = delete;
+  GtfsFeed& operator=(const GtfsFeed&) = delete;
+
+  //
+  // load
+  //
+  // Reads the feed from a directory or a .zip file. Malformed rows
+  // are reported to stderr with their file and line number and
+  // skipped; returns false and sets error only if a required file or
+  // column is missing or unreadable.
+  //
+  bool load(const string& path, string& error);
+
+  //
+  // accessors / getters
+  //
+  int getNumStops() const { return this->StopIDs.size(); }
+  int getNumRoutes() const { return this->RouteIDs.size(); }
+  int getNumTrips() const { return this->TripIDs.size(); }
+  long long getNumStopTimes() const { return (long long) this->StopTimeStop.size(); }
+  long long getNumRowErrors() const { return this->RowErrors; }
+
+  int departure(uint32_t row) const {
+    return this->StopTimeArrival[row] + this->StopTimeDwell[row];
+  }
+
+  //
+  // getMemoryBytes
+  //
+  // Approximate bytes held by the tables.
+  //
+  size_t getMemoryBytes() const;
+};
+
+
+//
+// gtfsIsFeed
+//
+// True if the path names a GTFS feed (a directory or a .zip file)
+// rather than a bus stop CSV file.
+//
+bool gtfsIsFeed(const string& path);
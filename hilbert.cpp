@@ -0,0 +1,62 @@
+/*hilbert.cpp*/
+
+//
+// Positions along a Hilbert curve through a (lat, lon) bounding
+// box. See hilbert.h.
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "hilbert.h"
+
+using namespace std;
+
+
+static const uint32_t GRID = 1u << 16;   // cells per side
+
+
+HilbertCurve::HilbertCurve(double minLat, double maxLat, double minLon, double maxLon)
+  : MinLat(minLat), MinLon(minLon)
+{
+  this->LatScale = (maxLat > minLat) ? (GRID - 1) / (maxLat - minLat) : 0.0;
+  this->LonScale = (maxLon > minLon) ? (GRID - 1) / (maxLon - minLon) : 0.0;
+}
+
+
+//
+// key
+//
+// The usual conversion of cell (x, y) to distance d along the curve:
+// one quadrant at a time from the top, rotating / flipping the cell
+// into the orientation the curve has in that quadrant.
+//
+uint32_t HilbertCurve::key(double lat, double lon) const
+{
+  auto cell = [](double v) {
+    return (uint32_t) clamp(v, 0.0, (double) (GRID - 1));
+  };
+
+  uint32_t x = cell((lon - this->MinLon) * this->LonScale);
+  uint32_t y = cell((lat - this->MinLat) * this->LatScale);
+  uint32_t d = 0;
+
+  for (uint32_t s = GRID / 2; s > 0; s /= 2)
+  {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+
+    d += s * s * ((3 * rx) ^ ry);
+
+    if (ry == 0) {
+      if (rx == 1) {
+        x = GRID - 1 - x;
+        y = GRID - 1 - y;
+      }
+      swap(x, y);
+    }
+  }
+
+  return d;
+}
@@ -0,0 +1,39 @@
+/*hilbert.h*/
+
+//
+// Positions along a Hilbert curve through a (lat, lon) bounding
+// box. The curve visits every cell of a 65536 x 65536 grid over the
+// box once, never jumping, so points close together on the curve
+// are close together on the map; sorting by curve position lays
+// data out so that nearby points share cache lines and pages.
+//
+// Reference:
+//   https://en.wikipedia.org/wiki/Hilbert_curve
+//
+
+#pragma once
+
+#include <cstdint>
+
+using namespace std;
+
+
+class HilbertCurve
+{
+private:
+  double MinLat;
+  double MinLon;
+  double LatScale;   // degrees => grid cells
+  double LonScale;
+
+public:
+  HilbertCurve(double minLat, double maxLat, double minLon, double maxLon);
+
+  //
+  // key
+  //
+  // The position along the curve of the grid cell holding (lat,
+  // lon); positions outside the box are clamped to its edge.
+  //
+  uint32_t key(double lat, double lon) const;
+};
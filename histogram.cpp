@@ -0,0 +1,191 @@
+/*histogram.cpp*/
+
+//
+// Latency histogram in the style of an HDR histogram, safe to
+// record into from many threads at once. See histogram.h.
+//
+
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#include "histogram.h"
+#include "outbuf.h"
+
+using namespace std;
+
+
+//
+// bucketOf
+//
+// Below 2 * SUB_BUCKETS, the value itself; above, the range of the
+// value's highest bit, then its next SUB_BUCKET_BITS bits.
+//
+int LatencyHistogram::bucketOf(uint64_t value)
+{
+  if (value < 2 * SUB_BUCKETS)
+    return (int) value;
+
+  if (value >= (1ULL << MAX_BITS))
+    value = (1ULL << MAX_BITS) - 1;
+
+  int top = 63 - __builtin_clzll(value);         // >= SUB_BUCKET_BITS + 1
+  int shift = top - SUB_BUCKET_BITS;
+  int sub = (int) (value >> shift) - SUB_BUCKETS;  // 0 .. SUB_BUCKETS - 1
+
+  return 2 * SUB_BUCKETS + (top - SUB_BUCKET_BITS - 1) * SUB_BUCKETS + sub;
+}
+
+
+uint64_t LatencyHistogram::bucketLimit(int bucket)
+{
+  if (bucket < 2 * SUB_BUCKETS)
+    return (uint64_t) bucket;
+
+  int range = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS;
+  int sub = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS;
+  int shift = range + 1;
+
+  return ((uint64_t) (SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+
+LatencyHistogram::LatencyHistogram()
+  : Count(0), Total(0), Max(0)
+{
+  for (int i = 0; i < NUM_BUCKETS; i++)
+    this->Buckets[i].store(0, memory_order_relaxed);
+}
+
+
+//
+// record
+//
+void LatencyHistogram::record(uint64_t value)
+{
+  this->Buckets[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+  this->Count.fetch_add(1, memory_order_relaxed);
+  this->Total.fetch_add(value, memory_order_relaxed);
+
+  uint64_t prev = this->Max.load(memory_order_relaxed);
+
+  while (value > prev && !this->Max.compare_exchange_weak(prev, value, memory_order_relaxed))
+    ;
+}
+
+
+//
+// recordUnshared
+//
+// No other thread writes, so plain loads and stores will do; they
+// stay atomic so that readers see whole values.
+//
+void LatencyHistogram::recordUnshared(uint64_t value)
+{
+  atomic<uint64_t>& bucket = this->Buckets[bucketOf(value)];
+
+  bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  this->Count.store(this->Count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  this->Total.store(this->Total.load(memory_order_relaxed) + value, memory_order_relaxed);
+
+  if (value > this->Max.load(memory_order_relaxed))
+    this->Max.store(value, memory_order_relaxed);
+}
+
+
+//
+// merge
+//
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  for (int i = 0; i < NUM_BUCKETS; i++)
+  {
+    uint64_t n = other.Buckets[i].load(memory_order_relaxed);
+
+    if (n > 0)
+      this->Buckets[i].fetch_add(n, memory_order_relaxed);
+  }
+
+  this->Count.fetch_add(other.Count.load(memory_order_relaxed), memory_order_relaxed);
+  this->Total.fetch_add(other.Total.load(memory_order_relaxed), memory_order_relaxed);
+
+  uint64_t value = other.Max.load(memory_order_relaxed);
+  uint64_t prev = this->Max.load(memory_order_relaxed);
+
+  while (value > prev && !this->Max.compare_exchange_weak(prev, value, memory_order_relaxed))
+    ;
+}
+
+
+//
+// percentile
+//
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+  uint64_t total = this->Count.load(memory_order_relaxed);
+
+  if (total == 0)
+    return 0;
+
+  //
+  // the (0-based) rank of the smallest latency with at least the
+  // fraction at or below it: e.g. the median of 2 is the first
+  //
+  double rank = ceil(fraction * (double) total) - 1.0;
+  uint64_t target = (rank <= 0.0) ? 0 : min((uint64_t) rank, total - 1);
+
+  uint64_t seen = 0;
+
+  for (int i = 0; i < NUM_BUCKETS; i++)
+  {
+    seen += this->Buckets[i].load(memory_order_relaxed);
+
+    if (seen > target)
+      return min(bucketLimit(i), this->getMax());
+  }
+
+  return this->getMax();
+}
+
+
+uint64_t LatencyHistogram::getCount() const {
+  return this->Count.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const {
+  return this->Max.load(memory_order_relaxed);
+}
+
+double LatencyHistogram::getMean() const {
+  uint64_t n = this->getCount();
+  return (n == 0) ? 0.0 : (double) this->Total.load(memory_order_relaxed) / n;
+}
+
+
+//
+// toJson
+//
+string LatencyHistogram::toJson(const char* unit, double perUnit, int decimals) const
+{
+  OutputBuffer out;
+
+  auto field = [&](const char* name, double value, int places) {
+    out.append(",\"");
+    out.append(name);
+    out.append('_');
+    out.append(unit);
+    out.append("\":");
+    out.appendFixed(value / perUnit, places);
+  };
+
+  out.append("{\"count\":");
+  out.appendInt((long long) this->getCount());
+  field("mean", this->getMean(), max(decimals, 1));
+  field("p50", (double) this->percentile(0.50), decimals);
+  field("p99", (double) this->percentile(0.99), decimals);
+  field("p999", (double) this->percentile(0.999), decimals);
+  field("max", (double) this->getMax(), decimals);
+  out.append('}');
+
+  return string(out.view());
+}
@@ -0,0 +1,102 @@
+/*histogram.h*/
+
+//
+// Latency histogram in the style of an HDR histogram: buckets a
+// power of 2 wide, each split into equal sub-buckets, so every
+// value is kept to within about 3% however large it is. Safe to
+// record into from many threads at once.
+//
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+
+//
+// LatencyHistogram
+//
+// Values below 2 * SUB_BUCKETS are counted exactly; above, each
+// range [2^k, 2^(k+1)) is split into SUB_BUCKETS equal buckets, so
+// a percentile, reported as the highest value of its bucket, is
+// high by at most 1 part in SUB_BUCKETS. Values are whatever unit
+// the caller records in -- the server's endpoints microseconds, the
+// query kinds of latency.h nanoseconds -- and toJson is told which.
+// Recording is a few relaxed atomic adds.
+//
+class LatencyHistogram
+{
+public:
+  static const int SUB_BUCKET_BITS = 5;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int MAX_BITS = 40;   // larger values count as 2^40 - 1
+  static const int NUM_BUCKETS = 2 * SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+  //
+  // bucketOf / bucketLimit
+  //
+  // The bucket a value falls in; the highest value in a bucket.
+  //
+  static int bucketOf(uint64_t value);
+  static uint64_t bucketLimit(int bucket);
+
+private:
+  atomic<uint64_t> Buckets[NUM_BUCKETS];
+  atomic<uint64_t> Count;
+  atomic<uint64_t> Total;
+  atomic<uint64_t> Max;
+
+public:
+  LatencyHistogram();
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  //
+  // record
+  //
+  // Adds one latency; any thread may call it.
+  //
+  void record(uint64_t value);
+
+  //
+  // recordUnshared
+  //
+  // The same, cheaper, for a histogram only one thread records
+  // into (others may still read or merge it).
+  //
+  void recordUnshared(uint64_t value);
+
+  //
+  // merge
+  //
+  // Adds everything recorded in other to this.
+  //
+  void merge(const LatencyHistogram& other);
+
+  //
+  // percentile
+  //
+  // Returns the latency at or below which the given fraction (0..1)
+  // of recorded latencies fall; 0 if empty.
+  //
+  uint64_t percentile(double fraction) const;
+
+  uint64_t getCount() const;
+  uint64_t getMax() const;
+  double getMean() const;
+
+  //
+  // toJson
+  //
+  // Returns {"count":..,"mean_U":..,"p50_U":..,"p99_U":..,
+  // "p999_U":..,"max_U":..} as a string, U being the given unit, with
+  // the recorded values divided by perUnit (1000 for nanoseconds
+  // reported as "us", say) and to the given number of decimal places
+  // -- the mean to at least 1.
+  //
+  string toJson(const char* unit, double perUnit = 1.0, int decimals = 0) const;
+};
@@ -0,0 +1,251 @@
+/*latency.cpp*/
+
+//
+// Per-thread latency histograms for each kind of query, merged when
+// read. See latency.h.
+//
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "latency.h"
+#include "outbuf.h"
+
+using namespace std;
+
+
+static const char* LatencyNames[NUM_LATENCY_KINDS] = {
+  "building search",
+  "nearest stop",
+  "predictions",
+  "bus tracker call",
+  "walking route",
+  "transit route"
+};
+
+static const char* LatencyKeys[NUM_LATENCY_KINDS] = {
+  "building_search",
+  "nearest_stop",
+  "predictions",
+  "bus_tracker",
+  "route",
+  "transit"
+};
+
+
+//
+// Shard
+//
+// One thread's histograms.
+//
+struct Shard
+{
+  LatencyHistogram Kinds[NUM_LATENCY_KINDS];
+};
+
+
+//
+// Registry
+//
+// Every shard made, and those whose threads have exited. Made once
+// and never destroyed, since threads may exit (and give back their
+// shards) during static destruction.
+//
+struct Registry
+{
+  mutex Mutex;
+  vector<unique_ptr<Shard>> All;
+  vector<Shard*> Free;
+};
+
+static Registry& registry()
+{
+  static Registry* r = new Registry;
+
+  return *r;
+}
+
+
+//
+// ThreadShard
+//
+// This thread's shard, taken on first use and given back for
+// another thread when this one exits.
+//
+struct ThreadShard
+{
+  Shard* Mine = nullptr;
+
+  ~ThreadShard()
+  {
+    if (this->Mine != nullptr) {
+      Registry& r = registry();
+      lock_guard<mutex> lock(r.Mutex);
+      r.Free.push_back(this->Mine);
+    }
+  }
+};
+
+static thread_local ThreadShard ThisThread;
+
+
+static Shard& myShard()
+{
+  if (ThisThread.Mine == nullptr)
+  {
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.Mutex);
+
+    if (!r.Free.empty()) {
+      ThisThread.Mine = r.Free.back();
+      r.Free.pop_back();
+    }
+    else {
+      r.All.push_back(make_unique<Shard>());
+      ThisThread.Mine = r.All.back().get();
+    }
+  }
+
+  return *ThisThread.Mine;
+}
+
+
+static atomic<bool> Recording(true);
+
+
+void latencyRecord(LatencyKind kind, uint64_t nanos)
+{
+  myShard().Kinds[kind].recordUnshared(nanos);
+}
+
+
+void setLatencyRecording(bool on)
+{
+  Recording.store(on, memory_order_relaxed);
+}
+
+bool latencyRecording()
+{
+  return Recording.load(memory_order_relaxed);
+}
+
+
+void latencyMerged(LatencyKind kind, LatencyHistogram& into)
+{
+  Registry& r = registry();
+  lock_guard<mutex> lock(r.Mutex);
+
+  for (const auto& shard : r.All)
+    into.merge(shard->Kinds[kind]);
+}
+
+
+const char* latencyName(LatencyKind kind)
+{
+  return LatencyNames[kind];
+}
+
+
+//
+// appendMicros
+//
+// Nanoseconds as microseconds, to the given # of decimal places.
+//
+static void appendMicros(OutputBuffer& out, double nanos, int decimals)
+{
+  out.appendFixed(nanos / 1000.0, decimals);
+}
+
+
+void printLatencyTable(ostream& stream, const string& title,
+  const vector<pair<string, const LatencyHistogram*>>& rows)
+{
+  OutputBuffer out;
+
+  const size_t NAME_WIDTH = 20;
+  const size_t WIDTH = 10;
+  const char* HEADINGS[] = { "count", "mean", "p50", "p99", "p99.9", "max" };
+
+  out.append(title);
+  out.append('\n');
+  out.append("  query");
+  out.append(string(NAME_WIDTH - 5, ' '));
+  for (const char* heading : HEADINGS)
+    out.appendColumn(WIDTH, [&](OutputBuffer& cell) { cell.append(heading); });
+  out.append('\n');
+
+  bool any = false;
+
+  for (const auto& row : rows)
+  {
+    const string& name = row.first;
+    const LatencyHistogram& h = *row.second;
+
+    if (h.getCount() == 0)
+      continue;
+
+    any = true;
+
+    out.append("  ");
+    out.append(name);
+    if (name.size() < NAME_WIDTH)
+      out.append(string(NAME_WIDTH - name.size(), ' '));
+
+    out.appendColumn(WIDTH, [&](OutputBuffer& c) { c.appendInt((long long) h.getCount()); });
+    out.appendColumn(WIDTH, [&](OutputBuffer& c) { appendMicros(c, h.getMean(), 1); });
+    for (double fraction : { 0.50, 0.99, 0.999 })
+      out.appendColumn(WIDTH, [&](OutputBuffer& c) { appendMicros(c, (double) h.percentile(fraction), 1); });
+    out.appendColumn(WIDTH, [&](OutputBuffer& c) { appendMicros(c, (double) h.getMax(), 1); });
+    out.append('\n');
+  }
+
+  if (!any)
+    out.append("  (none recorded)\n");
+
+  out.writeTo(stream);
+}
+
+
+void latencyReport(ostream& out)
+{
+  vector<unique_ptr<LatencyHistogram>> merged;   // large for the stack
+  vector<pair<string, const LatencyHistogram*>> rows;
+
+  for (int k = 0; k < NUM_LATENCY_KINDS; k++)
+  {
+    merged.push_back(make_unique<LatencyHistogram>());
+    latencyMerged((LatencyKind) k, *merged.back());
+    rows.push_back({ LatencyNames[k], merged.back().get() });
+  }
+
+  printLatencyTable(out, "query latency (us):", rows);
+}
+
+
+string latencyJson()
+{
+  OutputBuffer out;
+
+  out.append('{');
+
+  for (int k = 0; k < NUM_LATENCY_KINDS; k++)
+  {
+    auto merged = make_unique<LatencyHistogram>();
+    latencyMerged((LatencyKind) k, *merged);
+
+    if (k > 0)
+      out.append(',');
+
+    out.append('"');
+    out.append(LatencyKeys[k]);
+    out.append("\":");
+    out.append(merged->toJson("us", 1000.0, 3));   // recorded in nanoseconds
+  }
+
+  out.append('}');
+
+  return string(out.view());
+}
@@ -0,0 +1,136 @@
+/*latency.h*/
+
+//
+// Latency of each kind of query -- building searches, nearest stop
+// searches, prediction lookups and the bus tracker calls behind
+// them, walking and transit routes -- recorded as they run, in
+// nanoseconds, into histograms (see histogram.h):
+//
+//   {
+//     LatencyTimer timer(LAT_NEAREST_STOP);
+//     ...
+//   }
+//
+//   latencyReport(cout);
+//
+// Each thread records into histograms of its own, so recording
+// never waits on or bounces a cache line with another thread; the
+// threads' histograms are merged when read. A thread's histograms
+// outlive it, and are taken over by the next thread started.
+//
+// Recording costs two clock reads and a few stores; navbench
+// measures it against the searches it times.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#include "histogram.h"
+
+using namespace std;
+
+
+//
+// LatencyKind
+//
+enum LatencyKind
+{
+  LAT_BUILDING_SEARCH,   // buildings whose names contain a name
+  LAT_NEAREST_STOP,      // BusStops::findClosestStop
+  LAT_PREDICTIONS,       // BusStops::getArrivals, from cache or not
+  LAT_BUS_TRACKER,       // calls to the bus tracker's web server
+  LAT_ROUTE,             // Graph::shortestPath
+  LAT_TRANSIT,           // TransitRouter::route
+  NUM_LATENCY_KINDS
+};
+
+
+//
+// latencyRecord
+//
+// Adds one latency of the given kind, in nanoseconds, to this
+// thread's histogram.
+//
+void latencyRecord(LatencyKind kind, uint64_t nanos);
+
+//
+// setLatencyRecording / latencyRecording
+//
+// Turns recording on (the default) or off; whether it is on.
+//
+void setLatencyRecording(bool on);
+bool latencyRecording();
+
+//
+// latencyMerged
+//
+// Merges every thread's histogram of the given kind into the given
+// (normally empty) histogram.
+//
+void latencyMerged(LatencyKind kind, LatencyHistogram& into);
+
+const char* latencyName(LatencyKind kind);
+
+//
+// latencyReport
+//
+// A row per kind recorded: count, then mean, p50, p99, p99.9 and
+// max in microseconds.
+//
+void latencyReport(ostream& out);
+
+//
+// printLatencyTable
+//
+// The same table for any histograms of nanoseconds: the title, then
+// a row per (name, histogram) with anything recorded.
+//
+void printLatencyTable(ostream& out, const string& title,
+  const vector<pair<string, const LatencyHistogram*>>& rows);
+
+//
+// latencyJson
+//
+// {"building_search":{"count":..,"mean_us":..,"p50_us":..,
+// "p99_us":..,"p999_us":..,"max_us":..},...}, every kind.
+//
+string latencyJson();
+
+
+//
+// LatencyTimer
+//
+// Records the time from construction to destruction as a latency
+// of the given kind, if recording was on when constructed.
+//
+class LatencyTimer
+{
+private:
+  LatencyKind Kind;
+  bool On;
+  chrono::steady_clock::time_point Start;
+
+public:
+  explicit LatencyTimer(LatencyKind kind)
+    : Kind(kind), On(latencyRecording())
+  {
+    if (this->On)
+      this->Start = chrono::steady_clock::now();
+  }
+
+  ~LatencyTimer()
+  {
+    if (this->On)
+      latencyRecord(this->Kind,
+        (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - this->Start).count());
+  }
+
+  LatencyTimer(const LatencyTimer&) = delete;
+  LatencyTimer& operator=(const LatencyTimer&) = delete;
+};
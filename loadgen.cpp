@@ -0,0 +1,262 @@
+/*loadgen.cpp*/
+
+//
+// Load generator for the HTTP query server (see server.h).
+//
+// Opens C keep-alive connections to the server, each on its own
+// thread, and sends GET requests back-to-back for the given number
+// of seconds, cycling through a list of request paths. Reports
+// throughput and the latency distribution, plus a per-second
+// timeline (requests, max latency) so stalls stand out.
+//
+// Usage:
+//
+//   navload [--port N] [--connections C] [--duration S]
+//           [--paths filename] [--timeline]
+//
+// The paths file holds one request path per line, e.g.
+//
+//   /building?name=Mudd
+//   /nearest?lat=42.05&lon=-87.67&dir=Northbound
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "histogram.h"
+
+using namespace std;
+
+
+static const int MAX_SECONDS = 3600;
+
+
+//
+// Timeline
+//
+// Per-second request count and max latency.
+//
+struct Timeline
+{
+  atomic<uint64_t> Requests[MAX_SECONDS];
+  atomic<uint64_t> MaxMicros[MAX_SECONDS];
+
+  Timeline() {
+    for (int i = 0; i < MAX_SECONDS; i++) {
+      Requests[i].store(0);
+      MaxMicros[i].store(0);
+    }
+  }
+
+  void record(int second, uint64_t micros) {
+    if (second < 0 || second >= MAX_SECONDS)
+      return;
+    Requests[second].fetch_add(1, memory_order_relaxed);
+    uint64_t prev = MaxMicros[second].load(memory_order_relaxed);
+    while (micros > prev && !MaxMicros[second].compare_exchange_weak(prev, micros, memory_order_relaxed))
+      ;
+  }
+};
+
+
+static int connectTo(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t) port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  return fd;
+}
+
+
+//
+// roundTrip
+//
+// Sends one request and reads the full response (headers, then
+// Content-Length bytes of body). Returns false on any error.
+// Bytes past the end of the response stay in pending.
+//
+static bool roundTrip(int fd, const string& request, string& pending)
+{
+  size_t sent = 0;
+
+  while (sent < request.size()) {
+    ssize_t n = write(fd, request.data() + sent, request.size() - sent);
+    if (n <= 0)
+      return false;
+    sent += (size_t) n;
+  }
+
+  char buf[16 * 1024];
+  size_t headerEnd;
+
+  while ((headerEnd = pending.find("\r\n\r\n")) == string::npos) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return false;
+    pending.append(buf, (size_t) n);
+  }
+
+  size_t lenPos = pending.find("Content-Length: ");
+  if (lenPos == string::npos || lenPos > headerEnd)
+    return false;
+
+  size_t bodyLen = strtoul(pending.c_str() + lenPos + 16, nullptr, 10);
+  size_t total = headerEnd + 4 + bodyLen;
+
+  while (pending.size() < total) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return false;
+    pending.append(buf, (size_t) n);
+  }
+
+  bool ok = pending.compare(0, 12, "HTTP/1.1 200") == 0;
+
+  pending.erase(0, total);
+
+  return ok;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int port = 8080;
+  int connections = 8;
+  int duration = 10;
+  bool timeline = false;
+  string pathsFilename;
+
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+
+    if (arg == "--port" && i + 1 < argc)
+      port = atoi(argv[++i]);
+    else if (arg == "--connections" && i + 1 < argc)
+      connections = max(1, atoi(argv[++i]));
+    else if (arg == "--duration" && i + 1 < argc)
+      duration = min(MAX_SECONDS, max(1, atoi(argv[++i])));
+    else if (arg == "--paths" && i + 1 < argc)
+      pathsFilename = argv[++i];
+    else if (arg == "--timeline")
+      timeline = true;
+    else {
+      cerr << "usage: navload [--port N] [--connections C] [--duration S] [--paths filename] [--timeline]" << endl;
+      return 1;
+    }
+  }
+
+  vector<string> paths;
+
+  if (!pathsFilename.empty()) {
+    ifstream file(pathsFilename);
+    string line;
+    while (getline(file, line))
+      if (!line.empty())
+        paths.push_back(line);
+  }
+
+  if (paths.empty()) {
+    paths.push_back("/building?name=Hall");
+    paths.push_back("/nearest?lat=42.0565&lon=-87.6753&dir=Northbound");
+    paths.push_back("/nearest?lat=42.0565&lon=-87.6753&dir=Southbound");
+    paths.push_back("/building?name=Mudd");
+  }
+
+  LatencyHistogram histogram;
+  Timeline* perSecond = new Timeline();
+  atomic<uint64_t> errors(0);
+
+  auto start = chrono::steady_clock::now();
+  auto deadline = start + chrono::seconds(duration);
+
+  auto client = [&](int c) {
+    int fd = connectTo(port);
+    if (fd < 0) {
+      errors++;
+      return;
+    }
+
+    string pending;
+    size_t next = (size_t) c;
+
+    while (chrono::steady_clock::now() < deadline)
+    {
+      const string& path = paths[next++ % paths.size()];
+      string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+      auto t0 = chrono::steady_clock::now();
+      bool ok = roundTrip(fd, request, pending);
+      auto t1 = chrono::steady_clock::now();
+
+      if (!ok) {
+        errors++;
+        close(fd);
+        fd = connectTo(port);
+        pending.clear();
+        if (fd < 0)
+          return;
+        continue;
+      }
+
+      uint64_t micros = (uint64_t) chrono::duration_cast<chrono::microseconds>(t1 - t0).count();
+      histogram.record(micros);
+
+      int second = (int) chrono::duration_cast<chrono::seconds>(t1 - start).count();
+      perSecond->record(second, micros);
+    }
+
+    close(fd);
+  };
+
+  vector<thread> threads;
+  for (int c = 0; c < connections; c++)
+    threads.push_back(thread(client, c));
+  for (thread& t : threads)
+    t.join();
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << "requests: " << histogram.getCount() << endl;
+  cout << "errors: " << errors.load() << endl;
+  cout << "throughput: " << (uint64_t) (histogram.getCount() / seconds) << " req/s" << endl;
+  cout << "latency: " << histogram.toJson("us") << endl;
+
+  if (timeline) {
+    cout << "second, requests, max_us" << endl;
+    for (int s = 0; s < duration; s++)
+      cout << s << ", " << perSecond->Requests[s].load() << ", " << perSecond->MaxMicros[s].load() << endl;
+  }
+
+  delete perSecond;
+  return 0;
+}
@@ -20,8 +20,14 @@
 #include "nodes.h"
 #include "osm.h"
 #include "tinyxml2.h"
-#include "curl_util.h"
-#include <curl/curl.h>
+#include "predictions.h"
+#include "prefetch.h"
+#include "batch.h"
+#include "server.h"
+#include "mapdata.h"
+#include "distpolicy.h"
+#include "latency.h"
+#include "querylog.h"
 
 
 using namespace std;
@@ -31,29 +37,89 @@ using namespace tinyxml2;
 //
 // main
 //
-int main()
+// With no arguments, runs interactively; --prediction-source spec
+// takes bus predictions from somewhere other than the live bus
+// tracker (see predictions.h), --distance policy measures the
+// way to the nearest bus stops other than exactly (see
+// distpolicy.h), and --profile-load file profiles loading (see
+// profiler.h), writing a table to stderr and a Chrome trace to
+// file. Interactively, predictions are cached and prefetched for
+// the stops around each building searched for (see prefetch.h),
+// and % prints how long each kind of search has taken so far (see
+// latency.h); --log-queries file appends each search to a query
+// log (see querylog.h), which navreplay replays. With --batch, runs
+// the queries in a file non-interactively (see batch.h); with
+// --serve, answers queries over HTTP (see server.h).
+//
+int main(int argc, char* argv[])
 {
-  XMLDocument xmldoc;
-  Nodes nodes;
-  Buildings buildings;
-  BusStops busStops;
+  if (argc > 1 && string(argv[1]) == "--batch")
+  {
+    BatchOptions options;
+
+    if (!parseBatchArgs(argc, argv, options))
+      return 1;
+
+    return runBatch(options);
+  }
+
+  if (argc > 1 && string(argv[1]) == "--serve")
+  {
+    ServerOptions options;
+
+    if (!parseServerArgs(argc, argv, options))
+      return 1;
+
+    return runServer(options);
+  }
+
+  MapData data;
+  Nodes& nodes = data.nodes;
+  Buildings& buildings = data.buildings;
+  BusStops& busStops = data.busStops;
 
   /////apiiii
 
-CURL* curl = curl_easy_init();
- if (curl == nullptr) {
+ string spec = "live";
+ DistancePolicy distance = DistancePolicy::Exact;
+ string profileFilename;
+ string logFilename;
+
+ for (int i = 1; i + 1 < argc; i += 2) {
+   string arg = argv[i];
+
+   if (arg == "--prediction-source")
+     spec = argv[i + 1];
+   else if (arg == "--profile-load")
+     profileFilename = argv[i + 1];
+   else if (arg == "--log-queries")
+     logFilename = argv[i + 1];
+   else if (arg == "--distance" && !parseDistancePolicy(argv[i + 1], distance)) {
+     cout << "**ERROR: unknown distance policy '" << argv[i + 1] << "'" << endl;
+     return 0;
+   }
+ }
+
+ string error;
+ unique_ptr<PredictionSource> source = makePredictionSource(spec, error);
+ if (source == nullptr) {
  cout << "**ERROR:" << endl;
- cout << "**ERROR: unable to initialize curl library" << endl;
+ cout << "**ERROR: " << error << endl;
  cout << "**ERROR:" << endl;
  return 0;
  }
 
+ PredictionCache predictions(std::move(source));
+
+ QueryLog queryLog;
+ if (!logFilename.empty() && !queryLog.open(logFilename, error)) {
+ cout << "**ERROR: " << error << endl;
+ return 0;
+ }
+
 
   /////
 
-    // Now load the bus stops data from a CSV file
-    busStops.readFromCSV("bus-stops.txt");
-    
   cout << "** NU open street map **" << endl;
 
   string filename;
@@ -63,23 +129,37 @@ CURL* curl = curl_easy_init();
   getline(cin, filename);
 
   //
-  // 1. load XML-based map file 
+  // 1-3. load the bus stops data from a CSV file and the XML-based
+  //      map file: the nodes, which are the various known positions
+  //      on the map, in spatial order, so nearby nodes share memory;
+  //      the university buildings, with their nodes looked up, their
+  //      locations found and their names indexed; and the bus stops
+  //      in the map's plane, for fast nearest stop searches. Parts
+  //      that don't depend on each other run at once (see startup.h);
+  //      the walking graph isn't needed here.
   //
-  if (!osmLoadMapFile(filename, xmldoc))
+  LoadOptions load;
+  LoadProfiler profiler;
+  load.Graph = false;
+
+  if (!profileFilename.empty())
+    load.Profiler = &profiler;
+
+  bool loaded = loadMapData(filename, "bus-stops.txt", data, load);
+
+  if (load.Profiler != nullptr) {
+    profiler.printTable(cerr);
+    if (!profiler.writeChromeTrace(profileFilename))
+      cerr << "**ERROR: unable to write trace file '" << profileFilename << "'" << endl;
+  }
+
+  if (!loaded)
   {
     // failed, error message already output
     return 0;
   }
-  
-  //
-  // 2. read the nodes, which are the various known positions on the map:
-  //
-  nodes.readMapNodes(xmldoc);
 
-  //
-  // 3. read the university buildings:
-  //
-  buildings.readMapBuildings(xmldoc);
+  busStops.setDistancePolicy(distance);
 
   //
   // 4. stats
@@ -96,7 +176,7 @@ CURL* curl = curl_easy_init();
     string name;
 
     cout << endl;
-    cout << "Enter building name (partial or complete), or * to list, or @ for bus stops, or $ to end> " << endl;
+    cout << "Enter building name (partial or complete), or * to list, or @ for bus stops, or % for search times, or $ to end> " << endl;
 
     getline(cin, name);
 
@@ -110,28 +190,43 @@ CURL* curl = curl_easy_init();
     else if (name == "@") {
       busStops.print(); 
     }
+
+    else if (name == "%") {
+      latencyReport(cout);
+    }
     
     else {
-      buildings.findAndPrint(name, nodes, busStops, curl);
+      buildings.findAndPrint(name, nodes, busStops, &predictions);
+
+      if (queryLog.isOpen()) {
+        Query query;
+        query.Type = QueryType::Building;
+        query.Name = name;
+        queryLog.append(query, true);
+        queryLog.flush();
+      }
     }
 
   }//while
 
   //
-  // done:
+  // NOTE: node / building / bus stop creation and copy counts are
+  // reported at exit by instrumented builds (NAV_INSTRUMENT, see
+  // counters.h).
   //
-  // cout << endl;
-  // cout << "** Done **" << endl;
-  // cout << "# of calls to getID(): " << Node::getCallsToGetID() << endl;
-  // cout << "# of Nodes created: " << Node::getCreated() << endl;
-  // cout << "# of Nodes copied: " << Node::getCopied() << endl;
-  // cout << endl;
-
 
   //
  // done:
  //
- curl_easy_cleanup(curl);
+ PredictionCache::Stats stats = predictions.getStats();
+ if (stats.Fetches > 0) {
+   cout << endl;
+   cout << "predictions: " << stats.Fetches << " fetched, " << stats.Hits << " from cache ("
+     << (int) (100 * stats.hitRate()) << "%); " << stats.PrefetchRequests << " prefetched, "
+     << stats.PrefetchUsed << " used (" << (int) (100 * stats.prefetchHitRate()) << "%), "
+     << stats.PrefetchWasted << " wasted" << endl;
+ }
+
  cout << endl;
  cout << "** Done **" << endl;
  cout << endl;
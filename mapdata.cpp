@@ -0,0 +1,331 @@
+/*mapdata.cpp*/
+
+//
+// Everything loaded at startup -- nodes, buildings, bus stops and
+// the walking graph -- bundled together so that the batch and
+// server front ends can share one loader and one set of queries.
+//
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include "mapdata.h"
+#include "osm.h"
+#include "startup.h"
+#include "taskpool.h"
+#include "tinyxml2.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// loadMapData
+//
+// Loads the bus stops from the given CSV file or GTFS feed and the
+// nodes, buildings and walking graph from the given OSM file, as a
+// graph of phases run on the shared task pool (see startup.h):
+//
+//   bus stops --------+----------------------------> stop index
+//     `-> transit router (GTFS)                    /
+//   xml parse -+-> nodes --+----------------------'
+//              |           `-> node order -+-> building nodes -> centroids
+//              +-> buildings --------------'
+//              |     `-> name index
+//              `-> walking graph (after node order)
+//
+// The XML document is read by several phases at once, so it is
+// flushed first (see osmFlushStrings); it is only needed while
+// loading, and is freed on return. Profiled, the phases run one at a
+// time instead.
+//
+bool loadMapData(const string& mapFilename, const string& stopFilename, MapData& data,
+  const LoadOptions& options)
+{
+  StartupGraph startup;
+  XMLDocument xmldoc;
+  shared_ptr<GtfsFeed> feed;
+  bool gtfs = gtfsIsFeed(stopFilename);
+
+  int stops = startup.add("bus stops", {}, [&]() {
+    if (!gtfs) {
+      data.busStops.readFromCSV(stopFilename);
+      return true;
+    }
+
+    feed = make_shared<GtfsFeed>();
+    string error;
+
+    if (!feed->load(stopFilename, error)) {
+      cout << "**ERROR: " << error << endl;
+      return false;
+    }
+
+    data.busStops.readFromGTFS(*feed);
+    data.transit = feed;
+    return true;
+  });
+
+  if (gtfs)
+    startup.add("transit router", { stops }, [&]() {
+      data.router = make_shared<TransitRouter>(feed);
+      return true;
+    });
+
+  int xml = startup.add("xml parse", {}, [&]() {
+    if (!osmLoadMapFile(mapFilename, xmldoc))
+      return false;   // error message already output
+
+    osmFlushStrings(xmldoc);
+    return true;
+  });
+
+  //
+  // nodes in spatial order before anything keeps their indexes:
+  //
+  int nodes = startup.add("nodes", { xml }, [&]() {
+    data.nodes.readMapNodes(xmldoc);
+    return true;
+  });
+
+  int order = startup.add("node order", { nodes }, [&]() {
+    data.nodes.sortSpatially();
+    return true;
+  });
+
+  int buildings = startup.add("buildings", { xml }, [&]() {
+    data.buildings.readMapBuildings(xmldoc);
+    return true;
+  });
+
+  int indexed = startup.add("building nodes", { buildings, order }, [&]() {
+    data.buildings.indexNodes(data.nodes);
+    return true;
+  });
+
+  startup.add("centroids", { indexed }, [&]() {
+    data.buildings.computeLocations(data.nodes);
+    return true;
+  });
+
+  startup.add("name index", { buildings }, [&]() {
+    data.buildings.indexNames();
+    return true;
+  });
+
+  startup.add("stop index", { stops, nodes }, [&]() {
+    data.busStops.project(data.nodes.getProjection());
+    return true;
+  });
+
+  if (options.Graph)
+    startup.add("walking graph", { xml, order }, [&]() {
+      data.graph.readMapGraph(xmldoc, data.nodes);
+      return true;
+    });
+
+  startup.setProfiler(options.Profiler);
+
+  bool ok = startup.run(TaskPool::shared());
+
+  if (options.Report != nullptr)
+    startup.report(*options.Report);
+
+  return ok;
+}
+
+
+MapStore::MapStore(const string& mapFilename, const string& stopFilename)
+  : MapFilename(mapFilename), StopFilename(stopFilename), Version(0)
+{
+}
+
+MapStore::~MapStore()
+{
+  this->stop();
+}
+
+
+//
+// fileTime
+//
+// Modification time of the file, or the minimum time if the file
+// cannot be read (e.g. it is being replaced). For a directory (a
+// GTFS feed), the latest time of the files in it.
+//
+static filesystem::file_time_type fileTime(const string& filename)
+{
+  error_code ec;
+  auto t = filesystem::last_write_time(filename, ec);
+
+  if (ec)
+    return filesystem::file_time_type::min();
+
+  if (filesystem::is_directory(filename, ec))
+  {
+    for (const auto& entry : filesystem::directory_iterator(filename, ec))
+      t = max(t, fileTime(entry.path().string()));
+  }
+
+  return t;
+}
+
+
+//
+// load
+//
+bool MapStore::load()
+{
+  this->MapTime = fileTime(this->MapFilename);
+  this->StopTime = fileTime(this->StopFilename);
+
+  shared_ptr<MapData> data = make_shared<MapData>();
+
+  if (!loadMapData(this->MapFilename, this->StopFilename, *data))
+    return false;
+
+  atomic_store(&this->Current, shared_ptr<const MapData>(data));
+  this->Version = 1;
+
+  return true;
+}
+
+
+void MapStore::start(int watchMillis)
+{
+  this->WatchMillis = watchMillis;
+  this->Reloader = thread(&MapStore::reloaderLoop, this);
+}
+
+
+void MapStore::stop()
+{
+  {
+    lock_guard<mutex> lock(this->ReloadMutex);
+    this->Stopping = true;
+  }
+  this->ReloadWake.notify_all();
+
+  if (this->Reloader.joinable())
+    this->Reloader.join();
+}
+
+
+void MapStore::requestReload()
+{
+  {
+    lock_guard<mutex> lock(this->ReloadMutex);
+    this->ReloadRequested = true;
+  }
+  this->ReloadWake.notify_all();
+}
+
+
+shared_ptr<const MapData> MapStore::snapshot() const
+{
+  return atomic_load(&this->Current);
+}
+
+
+uint64_t MapStore::getVersion() const
+{
+  return this->Version.load();
+}
+
+
+//
+// filesChanged
+//
+bool MapStore::filesChanged()
+{
+  return fileTime(this->MapFilename) != this->MapTime
+    || fileTime(this->StopFilename) != this->StopTime;
+}
+
+
+//
+// reloadNow
+//
+// Loads a new snapshot and publishes it, then lets go of the old
+// one: freed here if no query is using it, else by the last query
+// to finish with it. Nothing waits on the queries, so one held up
+// (by a slow bus tracker call, say) can't hold up stopping or the
+// next reload. If the new map fails to load, the old one stays
+// current.
+//
+bool MapStore::reloadNow()
+{
+  auto start = chrono::steady_clock::now();
+
+  filesystem::file_time_type mapTime = fileTime(this->MapFilename);
+  filesystem::file_time_type stopTime = fileTime(this->StopFilename);
+
+  shared_ptr<MapData> data = make_shared<MapData>();
+
+  if (!loadMapData(this->MapFilename, this->StopFilename, *data)) {
+    cerr << "**ERROR: reload failed, keeping the current map" << endl;
+    return false;
+  }
+
+  shared_ptr<const MapData> old = atomic_exchange(&this->Current, shared_ptr<const MapData>(data));
+
+  this->MapTime = mapTime;
+  this->StopTime = stopTime;
+  this->Version++;
+
+  auto loaded = chrono::steady_clock::now();
+
+  //
+  // the old snapshot can't gain readers now, so a count of 1 means
+  // ours is the last reference:
+  //
+  bool lastReader = old.use_count() == 1;
+
+  old.reset();   // frees it, or leaves that to the last query holding it
+
+  auto freed = chrono::steady_clock::now();
+
+  cerr << "** reloaded map (version " << this->Version.load() << ") in "
+    << chrono::duration_cast<chrono::milliseconds>(loaded - start).count() << " ms, ";
+
+  if (lastReader)
+    cerr << "old map freed in " << chrono::duration_cast<chrono::milliseconds>(freed - loaded).count() << " ms **" << endl;
+  else
+    cerr << "old map left to the queries still using it **" << endl;
+
+  return true;
+}
+
+
+void MapStore::reloaderLoop()
+{
+  while (true)
+  {
+    bool reload = false;
+
+    {
+      unique_lock<mutex> lock(this->ReloadMutex);
+
+      auto wake = [this] { return this->Stopping || this->ReloadRequested; };
+
+      if (this->WatchMillis > 0)
+        this->ReloadWake.wait_for(lock, chrono::milliseconds(this->WatchMillis), wake);
+      else
+        this->ReloadWake.wait(lock, wake);
+
+      if (this->Stopping)
+        return;
+
+      reload = this->ReloadRequested;
+      this->ReloadRequested = false;
+    }
+
+    if (!reload && this->WatchMillis > 0)
+      reload = this->filesChanged();
+
+    if (reload)
+      this->reloadNow();
+  }
+}
@@ -0,0 +1,160 @@
+/*mapdata.h*/
+
+//
+// Everything loaded at startup -- nodes, buildings, bus stops and
+// the walking graph -- bundled together so that the batch and
+// server front ends can share one loader and one set of queries.
+//
+// A MapStore publishes the loaded data as an immutable snapshot that
+// can be replaced while queries are running (see MapStore below).
+//
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+
+#include "nodes.h"
+#include "buildings.h"
+#include "busstops.h"
+#include "graph.h"
+#include "gtfs.h"
+#include "raptor.h"
+#include "profiler.h"
+
+using namespace std;
+
+
+//
+// MapData
+//
+struct MapData
+{
+  Nodes nodes;
+  Buildings buildings;
+  BusStops busStops;
+  Graph graph;
+  shared_ptr<const GtfsFeed> transit;   // if the stops came from a GTFS feed
+  shared_ptr<const TransitRouter> router;   // over transit, if any
+};
+
+
+//
+// LoadOptions
+//
+struct LoadOptions
+{
+  bool Graph = true;            // build the walking graph?
+  ostream* Report = nullptr;    // if given, the startup phase times go here
+  LoadProfiler* Profiler = nullptr;   // if given, profile the phases (see profiler.h)
+};
+
+
+//
+// loadMapData
+//
+// Loads the bus stops from the given CSV file or GTFS feed (a
+// directory or .zip, see gtfs.h) and the nodes, buildings and
+// walking graph from the given OSM file, with the nodes in spatial
+// order (see Nodes::sortSpatially) and the buildings' locations and
+// names indexed. Independent parts of the work run at the same time
+// (see startup.h). Returns true if successful, false if the map or
+// the stops could not be loaded (an error message has already been
+// output).
+//
+bool loadMapData(const string& mapFilename, const string& stopFilename, MapData& data,
+  const LoadOptions& options = LoadOptions());
+
+
+//
+// MapStore
+//
+// Holds the current MapData snapshot behind a shared_ptr that is
+// read and replaced atomically, RCU style: a query takes the current
+// snapshot with snapshot() and uses it to the end, while a reload
+// builds a complete new MapData off to the side and then swaps the
+// pointer. Queries in flight finish on the old snapshot, and the
+// last of them to let go frees it (a few milliseconds for a campus
+// map); if none is using it, the reload thread frees it at once.
+//
+// Reloads run on a background thread, started by start(). They can
+// be requested explicitly (requestReload) or, with a watch interval,
+// happen whenever the map or stop file's modification time changes.
+//
+class MapStore
+{
+private:
+  string MapFilename;
+  string StopFilename;
+
+  shared_ptr<const MapData> Current;   // only via atomic_load / atomic_store
+  atomic<uint64_t> Version;
+
+  thread Reloader;
+  mutex ReloadMutex;
+  condition_variable ReloadWake;
+  bool ReloadRequested = false;
+  bool Stopping = false;
+  int WatchMillis = 0;
+
+  filesystem::file_time_type MapTime;
+  filesystem::file_time_type StopTime;
+
+  void reloaderLoop();
+  bool filesChanged();
+  bool reloadNow();
+
+public:
+  MapStore(const string& mapFilename, const string& stopFilename);
+  ~MapStore();
+
+  //
+  // load
+  //
+  // Performs the initial load on the calling thread. Returns false
+  // if the map could not be loaded.
+  //
+  bool load();
+
+  //
+  // start
+  //
+  // Starts the background reload thread. If watchMillis > 0, the
+  // files are checked for changes that often.
+  //
+  void start(int watchMillis);
+
+  //
+  // stop
+  //
+  // Stops the reload thread, waiting for a reload in progress.
+  //
+  void stop();
+
+  //
+  // requestReload
+  //
+  // Asks the reload thread to reload now; returns immediately.
+  //
+  void requestReload();
+
+  //
+  // snapshot
+  //
+  // Returns the current data; never nullptr after a successful load.
+  //
+  shared_ptr<const MapData> snapshot() const;
+
+  //
+  // getVersion
+  //
+  // Starts at 1 after load(), incremented by each successful reload.
+  //
+  uint64_t getVersion() const;
+};
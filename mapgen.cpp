@@ -0,0 +1,927 @@
+/*mapgen.cpp*/
+
+//
+// Synthetic map generator for scale testing.
+//
+// Writes an Open Street Map XML file and a matching bus-stop CSV
+// file (in the 7-column format read by BusStops::readFromCSV) of
+// configurable size, and optionally a GTFS feed of bus routes and
+// timetables over the same street grid. The map is a grid of streets and footways,
+// with each street segment broken into a chain of shape nodes the
+// way real OSM footways are. Buildings sit inside the grid cells,
+// each with a closed perimeter, 1 or 2 entrance nodes, and a short
+// footway joining the main entrance to the nearest intersection,
+// so the footway network is connected.
+//
+// Output is deterministic for a given seed and set of sizes. The
+// XML is written in two passes over the same random stream (nodes
+// first, then ways), so memory use does not grow with map size.
+//
+// Usage:
+//
+//   mapgen [--seed N] [--nodes N] [--buildings N] [--stops N]
+//          [--osm filename] [--csv filename]
+//          [--center lat,lon] [--gtfs directory] [--headway minutes]
+//
+// Example: a 10M node, 100K building map:
+//
+//   mapgen --nodes 10000000 --buildings 100000 --stops 5000
+//          --osm big.osm --csv big-stops.txt
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <filesystem>
+
+using namespace std;
+
+
+//
+// OSM IDs are scrambled with a multiplicative bijection so that ID
+// order has little to do with position, as in real extracts:
+//
+static const long long NODE_ID_BASE = 100000000LL;
+static const long long WAY_ID_BASE  = 500000000LL;
+static const long long ID_SCRAMBLE  = 2654435761LL;  // odd => bijection mod 2^k
+
+static const double METERS_PER_DEG_LAT = 111320.0;
+
+
+//
+// Word lists used to build names, tags and addresses:
+//
+static const char* NamePrefixes[] = {
+  "Mudd", "Tech", "Kresge", "Harris", "Annenberg", "Lunt", "Swift", "Crowe",
+  "Deering", "Norris", "Pick-Staiger", "Cook", "Hogan", "Kellogg", "Ford",
+  "Allen", "Seabury", "Locy", "Parkes", "Scott", "Fisk", "Searle", "Levy",
+  "Rebecca Crown", "Segal", "Jacobs", "Frances Searle", "Shanley", "Ryan",
+  "Wieboldt", "Silverman", "Donnelley", "Patten", "Bienen", "Abbott"
+};
+
+static const char* NameSuffixes[] = {
+  "Hall", "Library", "Center", "Building", "Auditorium", "Laboratory",
+  "Annex", "Pavilion", "Institute", "Gymnasium", "House", "Observatory"
+};
+
+static const char* StreetNames[] = {
+  "Sheridan Road", "Tech Drive", "Campus Drive", "Foster Street",
+  "Clark Street", "Chicago Avenue", "Orrington Avenue", "Church Street",
+  "Davis Street", "Noyes Street", "Hinman Avenue", "Emerson Street",
+  "Library Place", "University Place", "Haven Street", "Lincoln Street",
+  "Central Street", "Ridge Avenue", "Maple Avenue", "Simpson Street"
+};
+
+static const char* BuildingKinds[] = {
+  "yes", "residential", "commercial", "dormitory", "house", "garage"
+};
+
+static const char* FootwayKinds[] = {
+  "footway", "footway", "footway", "path", "pedestrian", "steps"
+};
+
+static const char* RoadKinds[] = {
+  "residential", "residential", "service", "tertiary", "secondary"
+};
+
+static const char* Amenities[] = {
+  "bench", "bicycle_parking", "waste_basket", "drinking_water",
+  "vending_machine", "post_box", "atm", "cafe"
+};
+
+static const int BusRoutes[] = { 201, 206, 213, 93, 97, 22, 36, 205 };
+
+#define COUNT_OF(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+
+//
+// Options
+//
+// Command-line options, with defaults that produce a map roughly
+// the size of the real campus extract.
+//
+struct Options
+{
+  unsigned long long Seed = 211;
+  long long NumNodes = 100000;
+  long long NumBuildings = 1000;
+  long long NumStops = 200;
+  string OsmFilename = "synthetic.osm";
+  string CsvFilename = "synthetic-stops.txt";
+  string GtfsDirectory;      // no feed if empty
+  int HeadwayMinutes = 10;
+  double CenterLat = 42.0565;
+  double CenterLon = -87.6753;
+};
+
+
+//
+// Writer
+//
+// Buffered output, flushed with fwrite in large blocks; iostream
+// formatting is far too slow for multi-gigabyte outputs.
+//
+class Writer
+{
+private:
+  FILE* Out;
+  string Buffer;
+
+public:
+  Writer(FILE* out) : Out(out) {
+    this->Buffer.reserve(1 << 20);
+  }
+
+  ~Writer() {
+    this->flush();
+  }
+
+  void write(const char* s, size_t n) {
+    this->Buffer.append(s, n);
+    if (this->Buffer.size() >= (1 << 20))
+      this->flush();
+  }
+
+  void write(const string& s) {
+    this->write(s.data(), s.size());
+  }
+
+  void writef(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  void flush() {
+    if (!this->Buffer.empty()) {
+      fwrite(this->Buffer.data(), 1, this->Buffer.size(), this->Out);
+      this->Buffer.clear();
+    }
+  }
+};
+
+void Writer::writef(const char* fmt, ...)
+{
+  char line[512];
+
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+
+  if (n > 0)
+    this->write(line, (size_t) min(n, (int) sizeof(line) - 1));
+}
+
+
+//
+// xmlEscape
+//
+// Escapes the 5 XML special characters in attribute values.
+//
+static string xmlEscape(const string& s)
+{
+  string result;
+  result.reserve(s.size());
+
+  for (char c : s) {
+    switch (c) {
+      case '&':  result += "&amp;"; break;
+      case '<':  result += "&lt;"; break;
+      case '>':  result += "&gt;"; break;
+      case '"':  result += "&quot;"; break;
+      case '\'': result += "&apos;"; break;
+      default:   result += c;
+    }
+  }
+
+  return result;
+}
+
+
+//
+// MapGenerator
+//
+// Lays out a G x G grid of cells. Grid lines are streets (every 4th
+// line) or footways; each segment between intersections is a way
+// of its own with ShapeNodesPerSegment intermediate nodes. Cells
+// hold buildings and street furniture.
+//
+// generate() is called twice with the same seed: once emitting
+// only <node> elements, once emitting only <way> elements. Every
+// random draw happens in both passes so the two agree.
+//
+class MapGenerator
+{
+private:
+  Options Opts;
+  long long GridSize;             // cells per side
+  long long ShapeNodesPerSegment;
+  long long FurniturePerCell;
+  double CellMeters;
+  double DegPerMeterLat;
+  double DegPerMeterLon;
+
+  mt19937_64 Rng;
+  bool EmitNodes;
+  bool EmitWays;
+  Writer* Out;
+
+  long long NextNode;  // sequence numbers, scrambled into IDs
+  long long NextWay;
+
+  long long NodesWritten;
+  long long WaysWritten;
+  long long BuildingsWritten;
+
+  long long nodeID(long long seq) const {
+    return NODE_ID_BASE + ((seq * ID_SCRAMBLE) & ((1LL << 40) - 1));
+  }
+
+  long long wayID(long long seq) const {
+    return WAY_ID_BASE + ((seq * ID_SCRAMBLE) & ((1LL << 40) - 1));
+  }
+
+  double uniform(double lo, double hi) {
+    return uniform_real_distribution<double>(lo, hi)(this->Rng);
+  }
+
+  long long pick(long long n) {
+    return uniform_int_distribution<long long>(0, n - 1)(this->Rng);
+  }
+
+  bool chance(double p) {
+    return this->uniform(0.0, 1.0) < p;
+  }
+
+  //
+  // position of grid point (row, col) with an offset in meters:
+  //
+  double latOf(double rowMeters) const {
+    double half = this->GridSize * this->CellMeters / 2.0;
+    return this->Opts.CenterLat + (rowMeters - half) * this->DegPerMeterLat;
+  }
+
+  double lonOf(double colMeters) const {
+    double half = this->GridSize * this->CellMeters / 2.0;
+    return this->Opts.CenterLon + (colMeters - half) * this->DegPerMeterLon;
+  }
+
+  //
+  // Intersections are numbered first, so their IDs can be computed
+  // from (row, col) in any pass:
+  //
+  long long intersectionSeq(long long row, long long col) const {
+    return row * (this->GridSize + 1) + col;
+  }
+
+  //
+  // newNode
+  //
+  // Allocates the next node id and, in the node pass, writes it
+  // along with any tags (given as k, v pairs).
+  //
+  long long newNode(double lat, double lon, const vector<pair<string, string>>& tags);
+
+  void emitWay(const vector<long long>& refs, const vector<pair<string, string>>& tags);
+
+  void emitIntersections();
+  void emitSegment(long long r1, long long c1, long long r2, long long c2, bool street);
+  void emitCell(long long row, long long col);
+
+public:
+  MapGenerator(const Options& opts);
+
+  void generate(Writer& out, bool nodes, bool ways);
+
+  long long getNumNodes() const { return this->NodesWritten; }
+  long long getNumWays() const { return this->WaysWritten; }
+  long long getNumBuildings() const { return this->BuildingsWritten; }
+  long long getGridSize() const { return this->GridSize; }
+
+  double cellMeters() const { return this->CellMeters; }
+  double degPerMeterLat() const { return this->DegPerMeterLat; }
+  double degPerMeterLon() const { return this->DegPerMeterLon; }
+};
+
+
+MapGenerator::MapGenerator(const Options& opts)
+  : Opts(opts), Rng(opts.Seed), EmitNodes(false), EmitWays(false), Out(nullptr),
+    NextNode(0), NextWay(0), NodesWritten(0), WaysWritten(0), BuildingsWritten(0)
+{
+  //
+  // roughly 4 of every 5 cells hold a building:
+  //
+  long long cells = max(1LL, (this->Opts.NumBuildings * 5 + 3) / 4);
+  this->GridSize = (long long) ceil(sqrt((double) cells));
+
+  //
+  // budget the requested node count: intersections, ~10 nodes per
+  // building (perimeter + closing ref + entrances), then the rest
+  // split between footway shape nodes and street furniture:
+  //
+  long long g = this->GridSize;
+  long long intersections = (g + 1) * (g + 1);
+  long long segments = 2 * g * (g + 1);
+  long long buildingNodes = this->Opts.NumBuildings * 10;
+  long long remaining = max(0LL, this->Opts.NumNodes - intersections - buildingNodes);
+
+  this->ShapeNodesPerSegment = (remaining * 3 / 4) / max(1LL, segments);
+  this->FurniturePerCell = (remaining - this->ShapeNodesPerSegment * segments) / max(1LL, g * g);
+
+  this->CellMeters = 90.0;
+  this->DegPerMeterLat = 1.0 / METERS_PER_DEG_LAT;
+  this->DegPerMeterLon = 1.0 / (METERS_PER_DEG_LAT * cos(this->Opts.CenterLat * M_PI / 180.0));
+}
+
+
+long long MapGenerator::newNode(double lat, double lon, const vector<pair<string, string>>& tags)
+{
+  long long id = this->nodeID(this->NextNode++);
+
+  if (this->EmitNodes) {
+    if (tags.empty()) {
+      this->Out->writef("  <node id=\"%lld\" lat=\"%.7f\" lon=\"%.7f\"/>\n", id, lat, lon);
+    }
+    else {
+      this->Out->writef("  <node id=\"%lld\" lat=\"%.7f\" lon=\"%.7f\">\n", id, lat, lon);
+      for (auto& kv : tags)
+        this->Out->write("    <tag k=\"" + xmlEscape(kv.first) + "\" v=\"" + xmlEscape(kv.second) + "\"/>\n");
+      this->Out->write("  </node>\n", 10);
+    }
+    this->NodesWritten++;
+  }
+
+  return id;
+}
+
+
+void MapGenerator::emitWay(const vector<long long>& refs, const vector<pair<string, string>>& tags)
+{
+  long long id = this->wayID(this->NextWay++);
+
+  if (this->EmitWays) {
+    this->Out->writef("  <way id=\"%lld\">\n", id);
+    for (long long ref : refs)
+      this->Out->writef("    <nd ref=\"%lld\"/>\n", ref);
+    for (auto& kv : tags)
+      this->Out->write("    <tag k=\"" + xmlEscape(kv.first) + "\" v=\"" + xmlEscape(kv.second) + "\"/>\n");
+    this->Out->write("  </way>\n", 9);
+    this->WaysWritten++;
+  }
+}
+
+
+void MapGenerator::emitIntersections()
+{
+  long long g = this->GridSize;
+
+  for (long long r = 0; r <= g; r++) {
+    for (long long c = 0; c <= g; c++) {
+      vector<pair<string, string>> tags;
+
+      // a few crossings and traffic signals, as in real data:
+      if (this->chance(0.05))
+        tags.push_back({"highway", this->chance(0.5) ? "crossing" : "traffic_signals"});
+
+      this->newNode(this->latOf(r * this->CellMeters), this->lonOf(c * this->CellMeters), tags);
+    }
+  }
+}
+
+
+//
+// emitSegment
+//
+// One way from intersection (r1, c1) to (r2, c2), with jittered
+// shape nodes in between.
+//
+void MapGenerator::emitSegment(long long r1, long long c1, long long r2, long long c2, bool street)
+{
+  vector<long long> refs;
+  refs.reserve(this->ShapeNodesPerSegment + 2);
+
+  refs.push_back(this->nodeID(this->intersectionSeq(r1, c1)));
+
+  double n = (double) (this->ShapeNodesPerSegment + 1);
+
+  for (long long i = 1; i <= this->ShapeNodesPerSegment; i++) {
+    double t = i / n;
+    double rowM = (r1 + (r2 - r1) * t) * this->CellMeters + this->uniform(-1.5, 1.5);
+    double colM = (c1 + (c2 - c1) * t) * this->CellMeters + this->uniform(-1.5, 1.5);
+
+    refs.push_back(this->newNode(this->latOf(rowM), this->lonOf(colM), {}));
+  }
+
+  refs.push_back(this->nodeID(this->intersectionSeq(r2, c2)));
+
+  vector<pair<string, string>> tags;
+
+  if (street) {
+    tags.push_back({"highway", RoadKinds[this->pick(COUNT_OF(RoadKinds))]});
+    long long line = (r1 == r2) ? r1 : c1;
+    tags.push_back({"name", StreetNames[line % COUNT_OF(StreetNames)]});
+    if (this->chance(0.3))
+      tags.push_back({"sidewalk", "both"});
+  }
+  else {
+    tags.push_back({"highway", FootwayKinds[this->pick(COUNT_OF(FootwayKinds))]});
+    if (this->chance(0.4))
+      tags.push_back({"surface", this->chance(0.5) ? "paved" : "concrete"});
+  }
+
+  this->emitWay(refs, tags);
+}
+
+
+//
+// emitCell
+//
+// Fills one grid cell: maybe a building (perimeter, entrances and a
+// footway to the cell's lower-left intersection), plus furniture.
+//
+void MapGenerator::emitCell(long long row, long long col)
+{
+  double baseRow = row * this->CellMeters;
+  double baseCol = col * this->CellMeters;
+
+  bool hasBuilding = (this->BuildingsWritten < this->Opts.NumBuildings) && this->chance(0.8);
+
+  //
+  // count buildings in both passes, emitted or not, so the two
+  // passes make the same decisions:
+  //
+  if (hasBuilding)
+    this->BuildingsWritten++;
+
+  if (hasBuilding)
+  {
+    //
+    // perimeter: an irregular polygon of 4..12 corners around the
+    // cell center, at least 10m back from the streets:
+    //
+    int corners = 4 + (int) this->pick(9);
+    double cy = baseRow + this->CellMeters / 2.0 + this->uniform(-5, 5);
+    double cx = baseCol + this->CellMeters / 2.0 + this->uniform(-5, 5);
+    double radius = this->uniform(12.0, this->CellMeters / 2.0 - 10.0);
+
+    vector<long long> perimeter;
+    vector<double> ys, xs;
+
+    for (int i = 0; i < corners; i++) {
+      double angle = 2.0 * M_PI * i / corners + this->uniform(-0.2, 0.2);
+      double r = radius * this->uniform(0.75, 1.0);
+      double y = cy + r * sin(angle);
+      double x = cx + r * cos(angle);
+
+      ys.push_back(y);
+      xs.push_back(x);
+      perimeter.push_back(this->newNode(this->latOf(y), this->lonOf(x), {}));
+    }
+
+    //
+    // entrances: the main one on the perimeter edge facing the
+    // lower-left corner, sometimes a second:
+    //
+    int mainCorner = 0;
+    for (int i = 1; i < corners; i++)
+      if (ys[i] + xs[i] < ys[mainCorner] + xs[mainCorner])
+        mainCorner = i;
+
+    int numEntrances = this->chance(0.3) ? 2 : 1;
+    long long mainEntrance = 0;
+
+    for (int e = 0; e < numEntrances; e++) {
+      int i = (e == 0) ? mainCorner : (int) this->pick(corners);
+      int j = (i + 1) % corners;
+      double y = (ys[i] + ys[j]) / 2.0;
+      double x = (xs[i] + xs[j]) / 2.0;
+
+      const char* kind = (e == 0) ? "main" : (this->chance(0.8) ? "yes" : "service");
+      long long id = this->newNode(this->latOf(y), this->lonOf(x), {{"entrance", kind}});
+
+      if (e == 0)
+        mainEntrance = id;
+
+      perimeter.insert(perimeter.begin() + j, id);
+      ys.insert(ys.begin() + j, y);
+      xs.insert(xs.begin() + j, x);
+      corners++;
+    }
+
+    perimeter.push_back(perimeter.front());  // closed way, as in OSM
+
+    //
+    // tags: ~70% university buildings, names missing ~10% of the
+    // time and addresses ~20%:
+    //
+    vector<pair<string, string>> tags;
+    bool university = this->chance(0.7);
+
+    tags.push_back({"building", university ? "university" : BuildingKinds[this->pick(COUNT_OF(BuildingKinds))]});
+
+    if (this->chance(0.9)) {
+      string name = string(NamePrefixes[this->pick(COUNT_OF(NamePrefixes))]) + " "
+        + NameSuffixes[this->pick(COUNT_OF(NameSuffixes))];
+      if (this->chance(0.05))
+        name += " & Annex";
+      tags.push_back({"name", name});
+    }
+
+    if (this->chance(0.8)) {
+      tags.push_back({"addr:housenumber", to_string(600 + 10 * this->pick(200))});
+      tags.push_back({"addr:street", StreetNames[(row + col) % COUNT_OF(StreetNames)]});
+    }
+
+    if (university && this->chance(0.3))
+      tags.push_back({"operator", "Northwestern University"});
+
+    if (this->chance(0.5))
+      tags.push_back({"building:levels", to_string(1 + this->pick(8))});
+
+    this->emitWay(perimeter, tags);
+
+    //
+    // footway from the main entrance to the nearest intersection:
+    //
+    vector<long long> path;
+    path.push_back(mainEntrance);
+
+    double ey = ys[0], ex = xs[0];
+    for (size_t i = 0; i < perimeter.size() - 1; i++)
+      if (perimeter[i] == mainEntrance) { ey = ys[i]; ex = xs[i]; }
+
+    path.push_back(this->newNode(this->latOf((ey + baseRow) / 2.0), this->lonOf((ex + baseCol) / 2.0), {}));
+    path.push_back(this->nodeID(this->intersectionSeq(row, col)));
+
+    this->emitWay(path, {{"highway", "footway"}, {"footway", "access_aisle"}});
+  }
+
+  //
+  // street furniture, tagged with assorted amenities:
+  //
+  for (long long i = 0; i < this->FurniturePerCell; i++) {
+    double y = baseRow + this->uniform(3, this->CellMeters - 3);
+    double x = baseCol + this->uniform(3, this->CellMeters - 3);
+
+    vector<pair<string, string>> tags;
+    if (this->chance(0.25))
+      tags.push_back({"amenity", Amenities[this->pick(COUNT_OF(Amenities))]});
+
+    this->newNode(this->latOf(y), this->lonOf(x), tags);
+  }
+}
+
+
+void MapGenerator::generate(Writer& out, bool nodes, bool ways)
+{
+  this->Rng.seed(this->Opts.Seed);
+  this->Out = &out;
+  this->EmitNodes = nodes;
+  this->EmitWays = ways;
+  this->NextNode = 0;
+  this->NextWay = 0;
+  this->BuildingsWritten = 0;
+
+  long long g = this->GridSize;
+
+  this->emitIntersections();
+
+  for (long long r = 0; r <= g; r++) {
+    for (long long c = 0; c <= g; c++) {
+      if (c < g)
+        this->emitSegment(r, c, r, c + 1, r % 4 == 0);
+      if (r < g)
+        this->emitSegment(r, c, r + 1, c, c % 4 == 0);
+    }
+  }
+
+  for (long long r = 0; r < g; r++)
+    for (long long c = 0; c < g; c++)
+      this->emitCell(r, c);
+}
+
+
+//
+// writeStops
+//
+// Bus stops come in northbound / southbound pairs along the north-
+// south streets (every 4th grid column), one on each side of the
+// street. Format per line:
+//
+//   ID,Route,Name,Direction,Corner,Latitude,Longitude
+//
+static void writeStops(const Options& opts, const MapGenerator& gen, Writer& out)
+{
+  mt19937_64 rng(opts.Seed ^ 0x5eedb05ULL);
+
+  long long g = gen.getGridSize();
+  long long streets = max(1LL, g / 4 + 1);
+  long long pairs = (opts.NumStops + 1) / 2;
+  long long written = 0;
+
+  double half = g * gen.cellMeters() / 2.0;
+
+  for (long long i = 0; i < pairs && written < opts.NumStops; i++)
+  {
+    long long street = i % streets;
+    long long col = street * 4;
+    long long row = (i / streets) % (g + 1);
+
+    int route = BusRoutes[street % COUNT_OF(BusRoutes)];
+    string cross = StreetNames[(row + 7) % COUNT_OF(StreetNames)];
+    string along = StreetNames[col % COUNT_OF(StreetNames)];
+    string name = along + " & " + cross;
+
+    double rowM = row * gen.cellMeters() + uniform_real_distribution<double>(-8, 8)(rng);
+    double colM = col * gen.cellMeters();
+
+    for (int side = 0; side < 2 && written < opts.NumStops; side++)
+    {
+      double offset = (side == 0) ? 6.0 : -6.0;
+      double lat = opts.CenterLat + (rowM - half) * gen.degPerMeterLat();
+      double lon = opts.CenterLon + (colM + offset - half) * gen.degPerMeterLon();
+
+      out.writef("%lld,%d,%s,%s,%s,%.7f,%.7f\n",
+        10000 + 2 * i + side, route, name.c_str(),
+        side == 0 ? "Northbound" : "Southbound",
+        side == 0 ? "NE corner" : "SW corner",
+        lat, lon);
+
+      written++;
+    }
+  }
+}
+
+
+//
+// writeGtfs
+//
+// A GTFS feed for a bus network over the grid: a north-south route
+// along every 4th column (the streets the CSV stops are on) with a
+// stop every 3rd block, and an east-west route along every 8th row
+// with a stop every 3rd block, so north-south and east-west routes
+// cross and riders can transfer. Each direction has its own stops,
+// on opposite sides of the street. Buses run every HeadwayMinutes
+// from 5:00 to 25:00 (1 AM the next day) at 20 km/h, dwelling 15
+// seconds at each stop; each route's schedule is offset by a few
+// minutes so departures are not all in step.
+//
+static bool writeGtfs(const Options& opts, const MapGenerator& gen, long long& numStopTimes)
+{
+  error_code ec;
+  filesystem::create_directories(opts.GtfsDirectory, ec);
+
+  auto open = [&](const char* name) -> FILE* {
+    string filename = (filesystem::path(opts.GtfsDirectory) / name).string();
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (f == nullptr)
+      cerr << "**ERROR: unable to open '" << filename << "' for writing" << endl;
+    return f;
+  };
+
+  const char* names[] = { "agency.txt", "calendar.txt", "stops.txt", "routes.txt", "trips.txt", "stop_times.txt" };
+  FILE* files[6];
+
+  for (int i = 0; i < 6; i++) {
+    files[i] = open(names[i]);
+    if (files[i] == nullptr) {
+      for (int j = 0; j < i; j++)
+        fclose(files[j]);
+      return false;
+    }
+  }
+
+  {
+    Writer agency(files[0]), calendar(files[1]), stops(files[2]), routes(files[3]),
+      trips(files[4]), times(files[5]);
+
+    agency.write("agency_id,agency_name,agency_url,agency_timezone\n");
+    agency.write("SYN,Synthetic Transit,https://example.com,America/Chicago\n");
+
+    calendar.write("service_id,monday,tuesday,wednesday,thursday,friday,saturday,sunday,start_date,end_date\n");
+    calendar.write("ALL,1,1,1,1,1,1,1,20240101,20341231\n");
+
+    stops.write("stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon\n");
+    routes.write("route_id,route_short_name,route_long_name,route_type\n");
+    trips.write("route_id,service_id,trip_id,direction_id,trip_headsign\n");
+    times.write("trip_id,arrival_time,departure_time,stop_id,stop_sequence\n");
+
+    mt19937_64 rng(opts.Seed ^ 0x67f5ULL);
+
+    long long g = gen.getGridSize();
+    double half = g * gen.cellMeters() / 2.0;
+    double cell = gen.cellMeters();
+
+    const double METERS_PER_SECOND = 20000.0 / 3600.0;
+    const int DWELL = 15;
+    const int FIRST = 5 * 3600, LAST = 25 * 3600;
+    const int HEADWAY = max(1, opts.HeadwayMinutes) * 60;
+
+    long long nextStop = 100000;
+    long long nextTrip = 0;
+    int routeNumber = 0;
+
+    //
+    // one route along a line of the grid: northSouth routes run along
+    // column "line", east-west routes along row "line":
+    //
+    auto writeRoute = [&](bool northSouth, long long line)
+    {
+      int number = (northSouth ? 100 : 300) + routeNumber++;
+      string street = StreetNames[line % COUNT_OF(StreetNames)];
+
+      routes.writef("R%d,%d,%s %s,3\n", number, number, street.c_str(),
+        northSouth ? "North-South" : "East-West");
+
+      for (int dir = 0; dir < 2; dir++)
+      {
+        //
+        // stops in the order the bus visits them; direction 0 runs
+        // north / east, on that side of the street:
+        //
+        vector<long long> ids;
+        vector<double> positions;   // meters along the route
+
+        for (long long k = 0; k <= g; k += 3)
+        {
+          long long at = (dir == 0) ? k : (g / 3) * 3 - k;
+          double along = at * cell;
+          double offset = (dir == 0) ? 6.0 : -6.0;
+
+          double rowM = northSouth ? along : line * cell + offset;
+          double colM = northSouth ? line * cell + offset : along;
+
+          string cross = StreetNames[(at + (northSouth ? 7 : 3)) % COUNT_OF(StreetNames)];
+          long long id = nextStop++;
+
+          stops.writef("%lld,%lld,%s & %s,\"%s\",%.7f,%.7f\n", id, id, street.c_str(), cross.c_str(),
+            northSouth ? (dir == 0 ? "Northbound, NE corner" : "Southbound, SW corner")
+                       : (dir == 0 ? "Eastbound, SE corner" : "Westbound, NW corner"),
+            opts.CenterLat + (rowM - half) * gen.degPerMeterLat(),
+            opts.CenterLon + (colM - half) * gen.degPerMeterLon());
+
+          ids.push_back(id);
+          positions.push_back(along);
+        }
+
+        int start = FIRST + (int) uniform_int_distribution<int>(0, HEADWAY - 1)(rng);
+
+        for (int depart = start; depart < LAST; depart += HEADWAY)
+        {
+          long long trip = nextTrip++;
+
+          trips.writef("R%d,ALL,T%lld,%d,%s\n", number, trip, dir,
+            northSouth ? (dir == 0 ? "North" : "South") : (dir == 0 ? "East" : "West"));
+
+          double t = depart;
+
+          for (size_t i = 0; i < ids.size(); i++)
+          {
+            if (i > 0)
+              t += fabs(positions[i] - positions[i - 1]) / METERS_PER_SECOND + DWELL;
+
+            int arrive = (int) t;
+            int leave = (i == 0 || i + 1 == ids.size()) ? arrive : arrive + DWELL;
+
+            times.writef("T%lld,%d:%02d:%02d,%d:%02d:%02d,%lld,%d\n", trip,
+              arrive / 3600, arrive / 60 % 60, arrive % 60,
+              leave / 3600, leave / 60 % 60, leave % 60,
+              ids[i], (int) i + 1);
+
+            numStopTimes++;
+          }
+        }
+      }
+    };
+
+    for (long long col = 0; col <= g; col += 4)
+      writeRoute(true, col);
+
+    for (long long row = 0; row <= g; row += 8)
+      writeRoute(false, row);
+  }
+
+  for (int i = 0; i < 6; i++)
+    fclose(files[i]);
+
+  return true;
+}
+
+
+//
+// parseArgs
+//
+static bool parseArgs(int argc, char* argv[], Options& opts)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+
+    if (i + 1 >= argc) {
+      cerr << "**ERROR: missing value for '" << arg << "'" << endl;
+      return false;
+    }
+
+    string value = argv[++i];
+
+    if (arg == "--seed")
+      opts.Seed = strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--nodes")
+      opts.NumNodes = atoll(value.c_str());
+    else if (arg == "--buildings")
+      opts.NumBuildings = atoll(value.c_str());
+    else if (arg == "--stops")
+      opts.NumStops = atoll(value.c_str());
+    else if (arg == "--osm")
+      opts.OsmFilename = value;
+    else if (arg == "--csv")
+      opts.CsvFilename = value;
+    else if (arg == "--gtfs")
+      opts.GtfsDirectory = value;
+    else if (arg == "--headway")
+      opts.HeadwayMinutes = atoi(value.c_str());
+    else if (arg == "--center") {
+      if (sscanf(value.c_str(), "%lf,%lf", &opts.CenterLat, &opts.CenterLon) != 2) {
+        cerr << "**ERROR: --center expects lat,lon" << endl;
+        return false;
+      }
+    }
+    else {
+      cerr << "**ERROR: unknown option '" << arg << "'" << endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+  Options opts;
+
+  if (!parseArgs(argc, argv, opts)) {
+    cerr << "usage: mapgen [--seed N] [--nodes N] [--buildings N] [--stops N]" << endl;
+    cerr << "              [--osm filename] [--csv filename] [--center lat,lon]" << endl;
+    cerr << "              [--gtfs directory] [--headway minutes]" << endl;
+    return 1;
+  }
+
+  FILE* osmFile = fopen(opts.OsmFilename.c_str(), "wb");
+  if (osmFile == nullptr) {
+    cerr << "**ERROR: unable to open '" << opts.OsmFilename << "' for writing" << endl;
+    return 1;
+  }
+
+  MapGenerator gen(opts);
+
+  {
+    Writer out(osmFile);
+
+    out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    out.write("<osm version=\"0.6\" generator=\"mapgen\">\n");
+    out.writef("  <bounds minlat=\"%.7f\" minlon=\"%.7f\" maxlat=\"%.7f\" maxlon=\"%.7f\"/>\n",
+      opts.CenterLat - gen.getGridSize() * gen.cellMeters() / 2.0 * gen.degPerMeterLat(),
+      opts.CenterLon - gen.getGridSize() * gen.cellMeters() / 2.0 * gen.degPerMeterLon(),
+      opts.CenterLat + gen.getGridSize() * gen.cellMeters() / 2.0 * gen.degPerMeterLat(),
+      opts.CenterLon + gen.getGridSize() * gen.cellMeters() / 2.0 * gen.degPerMeterLon());
+
+    gen.generate(out, true, false);   // pass 1: nodes
+    gen.generate(out, false, true);   // pass 2: ways
+
+    out.write("</osm>\n");
+  }
+
+  fclose(osmFile);
+
+  FILE* csvFile = fopen(opts.CsvFilename.c_str(), "wb");
+  if (csvFile == nullptr) {
+    cerr << "**ERROR: unable to open '" << opts.CsvFilename << "' for writing" << endl;
+    return 1;
+  }
+
+  {
+    Writer out(csvFile);
+    writeStops(opts, gen, out);
+  }
+
+  fclose(csvFile);
+
+  long long numStopTimes = 0;
+
+  if (!opts.GtfsDirectory.empty() && !writeGtfs(opts, gen, numStopTimes))
+    return 1;
+
+  cout << "# of nodes: " << gen.getNumNodes() << endl;
+  cout << "# of ways: " << gen.getNumWays() << endl;
+  cout << "# of buildings: " << gen.getNumBuildings() << endl;
+  cout << "# of bus stops: " << opts.NumStops << endl;
+
+  if (!opts.GtfsDirectory.empty())
+    cout << "# of GTFS stop times: " << numStopTimes << endl;
+
+  return 0;
+}
@@ -10,6 +10,11 @@
 
 #pragma once
 
+#include <type_traits>
+
+#include "coord.h"
+
+
 //
 // Node:
 //
@@ -18,45 +23,42 @@
 // in particular whether this node denotes the entrance to a 
 // building.
 //
+// The position is stored as fixed-point 1e-7 degrees (see coord.h),
+// so a node takes 24 bytes rather than 32; getLat / getLon convert.
+//
+// Node is a plain, trivially copyable value (a POD), so nodes can
+// be stored in flat arrays and copied with memcpy. Statistics on
+// how many nodes are created and looked up are kept by the opt-in
+// counters in counters.h, not by the class itself.
+//
 class Node
 {
 private:
   long long ID;
-  double Lat;
-  double Lon;
-  bool   IsEntrance;
-
-  //
-  // These are static / class / singleton variables
-  // so that we can collect some statistics on how
-  // many times getID( ) is called, how many nodes
-  // are created, and how many are copied:
-  //
-  inline static int CallsToGetID = 0;
-  inline static int Created = 0;
-  inline static int Copied = 0;
+  CoordE7 Lat;
+  CoordE7 Lon;
+  bool    IsEntrance;
 
 public:
   //
-  // constructor
+  // constructors: the default leaves the node uninitialized, like
+  // an int, so arrays of nodes cost nothing to create:
   //
+  Node() = default;
   Node(long long id, double lat, double lon, bool entrance);
-  
-  //
-  // copy constructor:
-  //
-  Node(const Node& other);
 
   //
   // accessors / getters
   //
-  long long getID() const;
-  double getLat() const;
-  double getLon() const;
-  bool getIsEntrance() const;
-
-  static int getCallsToGetID();
-  static int getCreated();
-  static int getCopied();
+  long long getID() const { return this->ID; }
+  double getLat() const { return fromE7(this->Lat); }
+  double getLon() const { return fromE7(this->Lon); }
+  CoordE7 getLatE7() const { return this->Lat; }
+  CoordE7 getLonE7() const { return this->Lon; }
+  bool getIsEntrance() const { return this->IsEntrance; }
 
 };
+
+static_assert(sizeof(Node) == 24, "Node should pack into 24 bytes");
+static_assert(std::is_trivially_copyable<Node>::value, "Node must be trivially copyable");
+static_assert(std::is_trivial<Node>::value && std::is_standard_layout<Node>::value, "Node must be a POD");
@@ -24,13 +24,16 @@
 
 #include <iostream>
 #include <string>
-#include <map>
+#include <vector>
 #include <utility>
 #include <algorithm>
 #include <cassert>
 
 #include "nodes.h"
 #include "osm.h"
+#include "counters.h"
+#include "hilbert.h"
+#include "taskpool.h"
 #include "tinyxml2.h"
 
 using namespace std;
@@ -51,6 +54,20 @@ void Nodes::readMapNodes(XMLDocument& xmldoc)
   XMLElement* osm = xmldoc.FirstChildElement("osm");
   assert(osm != nullptr);
 
+  //
+  // count the nodes first, so the vector is allocated once at
+  // its final size:
+  //
+  size_t count = 0;
+
+  for (XMLElement* e = osm->FirstChildElement("node"); e != nullptr; e = e->NextSiblingElement("node"))
+    count++;
+
+  this->MapNodes.clear();
+  this->MapNodes.reserve(count);
+  this->ByID.clear();
+  this->Spatial = false;
+
   //
   // Parse the XML document node by node: 
   //
@@ -86,29 +103,104 @@ void Nodes::readMapNodes(XMLDocument& xmldoc)
 
     //
     // Add node to vector:
-    // 
-    // The most concise way is using map's [] operator, but
-    // this requires a default constructor, which is bad design;
-    //
-    // Node N(id, latitude, longitude, entrance);
-    // this->MapNodes[id] = N;
-    // 
-    // The insert() function is better, but creates an object 
-    // then copies into the map:
     //
-    // Node N(id, latitude, longitude, entrance);
-    // this->MapNodes.insert(make_pair(id, N));
+    // push_back(Node(...)) would create a temporary and then copy
+    // it into the vector; emplace_back() creates the node in place,
+    // and with the space reserved above never has to move it:
     //
-    // The most efficient approach is to use emplace(), which
-    // creates just one object "emplace":
-    //
-    this->MapNodes.emplace(id, Node(id, latitude, longitude, entrance));
+    this->MapNodes.emplace_back(id, latitude, longitude, entrance);
+
+    NAV_COUNT(CTR_NODES_CREATED);
 
     //
     // next node element in the XML doc:
     //
     node = node->NextSiblingElement("node");
   }
+
+  //
+  // the map's bounding box, and the projection around it:
+  //
+  if (!this->MapNodes.empty())
+  {
+    this->MinLat = this->MaxLat = this->MapNodes[0].getLat();
+    this->MinLon = this->MaxLon = this->MapNodes[0].getLon();
+
+    for (const Node& N : this->MapNodes) {
+      this->MinLat = min(this->MinLat, N.getLat());
+      this->MaxLat = max(this->MaxLat, N.getLat());
+      this->MinLon = min(this->MinLon, N.getLon());
+      this->MaxLon = max(this->MaxLon, N.getLon());
+    }
+
+    this->Projection = LocalProjection(this->MinLat, this->MaxLat, this->MinLon, this->MaxLon);
+  }
+  else
+    this->Projection = LocalProjection();
+
+  //
+  // OSM files list each node once, in id order, so this usually just
+  // checks; otherwise sort if need be, and keep the first of any
+  // duplicate ids -- which may repeat in order, too:
+  //
+  auto byID = [](const Node& a, const Node& b) { return a.getID() < b.getID(); };
+  auto notAfter = [](const Node& a, const Node& b) { return a.getID() >= b.getID(); };
+
+  if (adjacent_find(this->MapNodes.begin(), this->MapNodes.end(), notAfter) != this->MapNodes.end())
+  {
+    if (!is_sorted(this->MapNodes.begin(), this->MapNodes.end(), byID))
+      stable_sort(this->MapNodes.begin(), this->MapNodes.end(), byID);
+
+    auto last = unique(this->MapNodes.begin(), this->MapNodes.end(),
+      [](const Node& a, const Node& b) { return a.getID() == b.getID(); });
+
+    this->MapNodes.erase(last, this->MapNodes.end());
+  }
+}
+
+//
+// sortSpatially
+//
+// Sorts the nodes by their position along a Hilbert curve over the
+// bounding box of the map (found by readMapNodes), ties by id, then
+// indexes the ids.
+//
+void Nodes::sortSpatially()
+{
+  if (this->Spatial || this->MapNodes.empty())
+    return;
+
+  HilbertCurve curve(this->MinLat, this->MaxLat, this->MinLon, this->MaxLon);
+
+  //
+  // sort (key, index) pairs rather than the nodes themselves, then
+  // gather the nodes into their new places; the keys and the gather
+  // run on the shared task pool (see taskpool.h):
+  //
+  TaskPool& pool = TaskPool::shared();
+  vector<pair<uint32_t, int>> order(this->MapNodes.size());
+
+  pool.parallelFor(0, order.size(), 0, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++)
+      order[i] = { curve.key(this->MapNodes[i].getLat(), this->MapNodes[i].getLon()), (int) i };
+  });
+
+  sort(order.begin(), order.end());   // ties: index, which is id order
+
+  vector<Node> sorted(this->MapNodes.size());
+
+  this->ByID.resize(this->MapNodes.size());
+
+  pool.parallelFor(0, order.size(), 0, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++) {
+      const Node& N = this->MapNodes[order[i].second];
+      sorted[i] = N;
+      this->ByID[order[i].second] = { N.getID(), (int) i };   // still in id order
+    }
+  });
+
+  this->MapNodes.swap(sorted);
+  this->Spatial = true;
 }
 
 //
@@ -120,53 +212,40 @@ void Nodes::readMapNodes(XMLDocument& xmldoc)
 //
 bool Nodes::find(long long id, double& lat, double& lon, bool& isEntrance) const
 {
-  auto ptr = this->MapNodes.find(id);
+  int index = this->indexOf(id);
 
-  if (ptr == this->MapNodes.end()) {  // not found:
+  if (index < 0)
     return false;
-  }
-  else {  // found:
-    lat = ptr->second.getLat();
-    lon = ptr->second.getLon();
-    isEntrance = ptr->second.getIsEntrance();
 
-    return true;
-  }
+  const Node& N = this->MapNodes[index];
 
-  //
-  // linear search:
-  //
-  /*
-  for (Node& N : this->MapNodes)
-  {
-    if (N.getID() == id) {
-      lat = N.getLat();
-      lon = N.getLon();
-      isEntrance = N.getIsEntrance();
+  lat = N.getLat();
+  lon = N.getLon();
+  isEntrance = N.getIsEntrance();
 
-      return true;
-    }
-  }
-  */
+  return true;
+}
+
+//
+// indexOf
+//
+// Binary search, of the nodes themselves while they are in id
+// order, of the id table once they are not.
+//
+int Nodes::indexOf(long long id) const
+{
+  NAV_COUNT(CTR_NODE_LOOKUPS);
 
-  //
-  // binary search:
-  //
-  /*
   int low = 0; 
   int high = (int)this->MapNodes.size() - 1;
 
   while (low <= high) {
     int mid = low + ((high - low) / 2);
 
-    long long nodeid = this->MapNodes[mid].getID();
+    long long nodeid = this->Spatial ? this->ByID[mid].ID : this->MapNodes[mid].getID();
 
     if (id == nodeid) { // found!
-      lat = this->MapNodes[mid].getLat();
-      lon = this->MapNodes[mid].getLon();
-      isEntrance = this->MapNodes[mid].getIsEntrance();
-
-      return true;
+      return this->Spatial ? this->ByID[mid].Index : mid;
     }
     else if (id < nodeid) { // search left:
       high = mid - 1;
@@ -179,13 +258,12 @@ bool Nodes::find(long long id, double& lat, double& lon, bool& isEntrance) const
   //
   // if get here, not found:
   //
-  return false;
-  */
+  return -1;
 }
 
 //
 // accessors / getters
 //
-int Nodes::getNumMapNodes() {
+int Nodes::getNumMapNodes() const {
   return (int) this->MapNodes.size();
 }
@@ -24,9 +24,10 @@
 
 #pragma once
 
-#include <map>
+#include <vector>
 
 #include "node.h"
+#include "projection.h"
 #include "tinyxml2.h"
 
 using namespace std;
@@ -36,10 +37,38 @@ using namespace tinyxml2;
 //
 // Keeps track of all the nodes in the map.
 //
+// The nodes are kept in one flat vector sorted by id and found by
+// binary search: the vector is sized by a counting pass over the
+// XML before any node is stored, so loading makes exactly one
+// allocation, and each node takes 24 bytes instead of a tree node.
+//
+// After sortSpatially() the vector is in Hilbert curve order
+// instead (see hilbert.h), so that nodes near each other on the map
+// are near each other in memory, and ids are looked up through a
+// separate (id, index) table. Either way a node's index -- its place
+// in the vector -- is what other structures keep (see
+// Buildings::indexNodes and Graph::readMapGraph), so they must be
+// built after the order is settled.
+//
+// The nodes' bounding box also gives the map its local planar
+// projection (see projection.h), which the graph and bus stops use
+// for fast distances.
+//
 class Nodes
 {
 private:
-  map<long long, Node> MapNodes;
+  struct IndexEntry
+  {
+    long long ID;
+    int Index;
+  };
+
+  vector<Node> MapNodes;
+  vector<IndexEntry> ByID;   // sorted by id, if MapNodes isn't
+  bool Spatial = false;
+  double MinLat = 0.0, MaxLat = 0.0;   // the map's bounding box
+  double MinLon = 0.0, MaxLon = 0.0;
+  LocalProjection Projection;          // around it
 
 public:
   //
@@ -53,6 +82,14 @@ public:
   //
   void readMapNodes(XMLDocument& xmldoc);
 
+  //
+  // sortSpatially
+  //
+  // Renumbers the nodes in Hilbert curve order over the map's
+  // bounding box, and builds the id lookup table.
+  //
+  void sortSpatially();
+
   //
   // find
   // 
@@ -62,10 +99,19 @@ public:
   //
   bool find(long long id, double& lat, double& lon, bool& isEntrance) const;
 
+  //
+  // indexOf
+  //
+  // The index of the node with the given id, or -1 if none.
+  //
+  int indexOf(long long id) const;
+
   //
   // accessors / getters
   //
-  int getNumMapNodes();
+  int getNumMapNodes() const;
+  const Node& getNode(int index) const { return this->MapNodes[index]; }
+  bool isSpatial() const { return this->Spatial; }
+  const LocalProjection& getProjection() const { return this->Projection; }
 
 };
-
@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include <string>
+#include <cstring>
 #include <cassert>
 
 #include "osm.h"
@@ -87,24 +88,22 @@ bool osmLoadMapFile(string filename, XMLDocument& xmldoc)
 //
 //   <tag k="entrance" v="yes"/>
 //
-bool osmContainsKeyValue(XMLElement* e, string key, string value)
+bool osmContainsKeyValue(XMLElement* e, const char* key, const char* value)
 {
   XMLElement* tag = e->FirstChildElement("tag");
 
   while (tag != nullptr)
   {
-    const XMLAttribute* keyAttribute = tag->FindAttribute("k");
-    const XMLAttribute* valueAttribute = tag->FindAttribute("v");
+    const char* elemkey = tag->Attribute("k");
+    const char* elemvalue = tag->Attribute("v");
 
-    if (keyAttribute != nullptr && valueAttribute != nullptr)
+    //
+    // compare in place, without copying the attributes into strings:
+    //
+    if (elemkey != nullptr && elemvalue != nullptr &&
+      strcmp(elemkey, key) == 0 && strcmp(elemvalue, value) == 0)  // found it:
     {
-      string elemkey(keyAttribute->Value());
-      string elemvalue(valueAttribute->Value());
-
-      if (elemkey == key && elemvalue == value)  // found it:
-      {
-        return true;
-      }
+      return true;
     }
 
     //
@@ -136,25 +135,36 @@ bool osmContainsKeyValue(XMLElement* e, string key, string value)
 // 
 // If the key is not found, the empty string "" is returned.
 //
-string osmGetKeyValue(XMLElement* e, string key)
+string osmGetKeyValue(XMLElement* e, const char* key)
+{
+  const char* value = osmFindKeyValue(e, key);
+
+  //
+  // if not found, return "":
+  //
+  return (value == nullptr) ? "" : value;
+}
+
+
+//
+// osmFindKeyValue
+//
+// Like osmGetKeyValue, but allocation-free: returns a pointer to
+// the value inside the XML document, or nullptr if the key is not
+// found.
+//
+const char* osmFindKeyValue(XMLElement* e, const char* key)
 {
   XMLElement* tag = e->FirstChildElement("tag");
 
   while (tag != nullptr)
   {
-    const XMLAttribute* keyAttribute = tag->FindAttribute("k");
-    const XMLAttribute* valueAttribute = tag->FindAttribute("v");
+    const char* elemkey = tag->Attribute("k");
+    const char* elemvalue = tag->Attribute("v");
 
-    if (keyAttribute != nullptr && valueAttribute != nullptr)
+    if (elemkey != nullptr && elemvalue != nullptr && strcmp(elemkey, key) == 0)  // found it:
     {
-      string elemkey(keyAttribute->Value());
-      
-      if (elemkey == key)  // found it:
-      {
-        string elemvalue(valueAttribute->Value());
-
-        return elemvalue;
-      }
+      return elemvalue;
     }
 
     //
@@ -166,5 +176,44 @@ string osmGetKeyValue(XMLElement* e, string key)
   //
   // if get here, not found:
   //
-  return "";
+  return nullptr;
+}
+
+
+//
+// osmFlushStrings
+//
+// Walks the whole document, depth first without recursion, reading
+// each node's value and each element's attributes.
+//
+void osmFlushStrings(XMLDocument& xmldoc)
+{
+  XMLNode* node = xmldoc.FirstChild();
+
+  while (node != nullptr)
+  {
+    node->Value();
+
+    if (XMLElement* e = node->ToElement()) {
+      for (const XMLAttribute* a = e->FirstAttribute(); a != nullptr; a = a->Next()) {
+        a->Name();
+        a->Value();
+      }
+    }
+
+    //
+    // next: the first child, else the next sibling of the nearest
+    // node (this one or an ancestor) that has one:
+    //
+    if (node->FirstChild() != nullptr) {
+      node = node->FirstChild();
+      continue;
+    }
+
+    while (node != nullptr && node->NextSibling() == nullptr)
+      node = node->Parent();
+
+    if (node != nullptr)
+      node = node->NextSibling();
+  }
 }
@@ -34,5 +34,25 @@ using namespace tinyxml2;
 // Helper functions:
 //
 bool osmLoadMapFile(string filename, XMLDocument& xmldoc);
-bool osmContainsKeyValue(XMLElement* e, string key, string value);
-string osmGetKeyValue(XMLElement* e, string key);
+bool osmContainsKeyValue(XMLElement* e, const char* key, const char* value);
+string osmGetKeyValue(XMLElement* e, const char* key);
+
+//
+// osmFindKeyValue
+//
+// Like osmGetKeyValue, but allocation-free: returns a pointer to
+// the value inside the XML document, or nullptr if the key is not
+// found. Valid as long as the document.
+//
+const char* osmFindKeyValue(XMLElement* e, const char* key);
+
+//
+// osmFlushStrings
+//
+// TinyXML finishes each name, value and text (terminating it and
+// expanding entities) in place the first time it is read, so even
+// reading a document changes it. This reads every one of them once,
+// after which the document really is read-only and can be read from
+// several threads at once.
+//
+void osmFlushStrings(XMLDocument& xmldoc);
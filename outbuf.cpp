@@ -0,0 +1,260 @@
+/*outbuf.cpp*/
+
+//
+// A reusable output buffer, numbers by std::to_chars. See outbuf.h.
+//
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+#include "outbuf.h"
+
+using namespace std;
+
+
+void OutputBuffer::appendInt(long long value)
+{
+  char buffer[24];
+  auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+
+  this->Text.append(buffer, result.ptr);
+}
+
+
+//
+// appendDouble
+//
+// to_chars gives the shortest digits that read back as the value;
+// they are laid out the way JSON output always has been here: plain
+// decimals while the decimal point is within 15 digits of the first
+// digit (and 4 zeros of it, for small values), an exponent of at
+// least 2 digits otherwise.
+//
+void OutputBuffer::appendDouble(double value)
+{
+  if (!isfinite(value)) {
+    this->append("null");
+    return;
+  }
+
+  char buffer[32];
+  auto result = to_chars(buffer, buffer + sizeof(buffer), value, chars_format::scientific);
+
+  //
+  // buffer holds [-]d[.ddd]e(+|-)xx; pull out the digits and the
+  // exponent:
+  //
+  const char* p = buffer;
+
+  if (*p == '-') {
+    this->append('-');
+    p++;
+  }
+
+  char digits[24];
+  int k = 0;
+
+  for (; *p != 'e'; p++)
+    if (*p != '.')
+      digits[k++] = *p;
+
+  int exponent = 0;
+  from_chars(p + (p[1] == '+' ? 2 : 1), result.ptr, exponent);
+
+  int n = exponent + 1;   // the decimal point comes after n digits
+
+  if (k <= n && n <= 15) {
+    this->Text.append(digits, k);
+    this->Text.append(n - k, '0');
+    this->append(".0");
+  }
+  else if (0 < n && n <= 15) {
+    this->Text.append(digits, n);
+    this->append('.');
+    this->Text.append(digits + n, k - n);
+  }
+  else if (-4 < n && n <= 0) {
+    this->append("0.");
+    this->Text.append(-n, '0');
+    this->Text.append(digits, k);
+  }
+  else {
+    this->append(digits[0]);
+    if (k > 1) {
+      this->append('.');
+      this->Text.append(digits + 1, k - 1);
+    }
+
+    int e = n - 1;
+    this->append(e < 0 ? "e-" : "e+");
+    e = abs(e);
+    if (e < 10)
+      this->append('0');
+    this->appendInt(e);
+  }
+}
+
+
+void OutputBuffer::appendGeneral(double value, int precision)
+{
+  char buffer[64];
+  auto result = to_chars(buffer, buffer + sizeof(buffer), value, chars_format::general, precision);
+
+  this->Text.append(buffer, result.ptr);
+}
+
+
+void OutputBuffer::appendFixed(double value, int decimals)
+{
+  char buffer[64];
+  auto result = to_chars(buffer, buffer + sizeof(buffer), value, chars_format::fixed, decimals);
+
+  if (result.ec == errc())
+    this->Text.append(buffer, result.ptr);
+  else
+    this->appendGeneral(value);  // too large to write out in full
+}
+
+
+//
+// utf8Length
+//
+// The length of the valid UTF-8 sequence at s[i], or 0 if there
+// isn't one; bad is set to where it went wrong (the first byte that
+// doesn't belong, or the end of s).
+//
+static size_t utf8Length(string_view s, size_t i, size_t& bad)
+{
+  unsigned char c = (unsigned char) s[i];
+  size_t length;
+  unsigned char low = 0x80, high = 0xBF;   // bounds on the 2nd byte
+
+  if (c >= 0xC2 && c <= 0xDF)
+    length = 2;
+  else if (c >= 0xE0 && c <= 0xEF) {
+    length = 3;
+    if (c == 0xE0) low = 0xA0;
+    if (c == 0xED) high = 0x9F;   // no surrogates
+  }
+  else if (c >= 0xF0 && c <= 0xF4) {
+    length = 4;
+    if (c == 0xF0) low = 0x90;
+    if (c == 0xF4) high = 0x8F;   // nothing past U+10FFFF
+  }
+  else {
+    bad = i + 1;   // not a lead byte: skip it
+    return 0;
+  }
+
+  for (size_t j = 1; j < length; j++)
+  {
+    if (i + j >= s.size()) {
+      bad = s.size();
+      return 0;
+    }
+
+    unsigned char b = (unsigned char) s[i + j];
+
+    if (b < (j == 1 ? low : 0x80) || b > (j == 1 ? high : 0xBF)) {
+      bad = i + j;   // may start a sequence of its own
+      return 0;
+    }
+  }
+
+  return length;
+}
+
+
+void OutputBuffer::appendJsonString(string_view s)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  this->append('"');
+
+  size_t i = 0;
+
+  while (i < s.size())
+  {
+    unsigned char c = (unsigned char) s[i];
+
+    if (c >= 0x80)
+    {
+      size_t bad = 0;
+      size_t length = utf8Length(s, i, bad);
+
+      if (length > 0) {
+        this->Text.append(s.data() + i, length);
+        i += length;
+      }
+      else {
+        this->append("\xEF\xBF\xBD");   // U+FFFD
+        i = bad;
+      }
+      continue;
+    }
+
+    switch (c)
+    {
+      case '"':  this->append("\\\""); break;
+      case '\\': this->append("\\\\"); break;
+      case '\b': this->append("\\b"); break;
+      case '\f': this->append("\\f"); break;
+      case '\n': this->append("\\n"); break;
+      case '\r': this->append("\\r"); break;
+      case '\t': this->append("\\t"); break;
+      default:
+        if (c < 0x20) {
+          this->append("\\u00");
+          this->append(hex[c >> 4]);
+          this->append(hex[c & 0xF]);
+        }
+        else
+          this->append((char) c);
+    }
+
+    i++;
+  }
+
+  this->append('"');
+}
+
+
+void OutputBuffer::appendCsvField(string_view s)
+{
+  if (s.find_first_of(",\"\r\n") == string_view::npos) {
+    this->append(s);
+    return;
+  }
+
+  this->append('"');
+
+  for (char c : s) {
+    if (c == '"')
+      this->append('"');
+    this->append(c);
+  }
+
+  this->append('"');
+}
+
+
+bool OutputBuffer::writeTo(FILE* out)
+{
+  size_t written = fwrite(this->Text.data(), 1, this->Text.size(), out);
+  bool ok = (written == this->Text.size());
+
+  this->clear();
+  return ok;
+}
+
+
+void OutputBuffer::writeTo(ostream& out)
+{
+  out.write(this->Text.data(), (streamsize) this->Text.size());
+  out.flush();
+
+  this->clear();
+}
@@ -0,0 +1,96 @@
+/*outbuf.h*/
+
+//
+// A reusable buffer that output is formatted into before being
+// written in one call. Numbers are converted with std::to_chars --
+// no locale, no stream state, no allocation -- and clear() keeps the
+// capacity, so a buffer reused from query to query soon stops
+// allocating at all.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+
+class OutputBuffer
+{
+private:
+  string Text;
+
+public:
+  void clear() { this->Text.clear(); }
+
+  size_t size() const { return this->Text.size(); }
+  bool empty() const { return this->Text.empty(); }
+  string_view view() const { return this->Text; }
+
+  void append(char c) { this->Text.push_back(c); }
+  void append(string_view s) { this->Text.append(s.data(), s.size()); }
+
+  void appendInt(long long value);
+
+  //
+  // appendDouble
+  //
+  // The shortest text that reads back as the same value, as JSON
+  // has it: always with a '.' or an exponent (5.0, 1e-05), and null
+  // if the value isn't finite.
+  //
+  void appendDouble(double value);
+
+  //
+  // appendGeneral
+  //
+  // As printf's %g (and iostream's default) would: 6 significant
+  // digits unless told otherwise, trailing zeros dropped.
+  //
+  void appendGeneral(double value, int precision = 6);
+
+  void appendFixed(double value, int decimals);
+
+  //
+  // appendJsonString
+  //
+  // s in double quotes, with quotes, backslashes and control
+  // characters escaped; invalid UTF-8 becomes U+FFFD.
+  //
+  void appendJsonString(string_view s);
+
+  //
+  // appendCsvField
+  //
+  // s, quoted (RFC 4180) if it holds a comma, quote or line break.
+  //
+  void appendCsvField(string_view s);
+
+  //
+  // appendColumn
+  //
+  // Right-aligns what append writes, given a buffer of its own, in a
+  // column of the given width.
+  //
+  template <class Append>
+  void appendColumn(size_t width, Append append)
+  {
+    OutputBuffer cell;
+    append(cell);
+
+    if (cell.size() < width)
+      this->Text.append(width - cell.size(), ' ');
+    this->Text.append(cell.Text);
+  }
+
+  //
+  // writeTo
+  //
+  // Writes the contents out in one call, and clears the buffer.
+  //
+  bool writeTo(FILE* out);
+  void writeTo(ostream& out);
+};
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Two-stage profile-guided optimization build.
+#
+#   1. build instrumented binaries (preset pgo-generate),
+#   2. run the recorded query workload (pgo-workload.txt) through
+#      navbench against a map, writing profiles to _pgo_profiles/,
+#   3. rebuild with the profiles (preset pgo-use).
+#
+# Both stages share the build/pgo directory, since GCC names each
+# profile after the object file that produced it.
+#
+# Usage: ./pgo.sh [mapfile stopfile]
+#
+# With no arguments a synthetic map is generated with mapgen.
+# Extra cmake configure arguments can be passed in NAV_CMAKE_ARGS.
+#
+set -e
+
+cd "$(dirname "$0")"
+
+PROFILE_DIR="$PWD/_pgo_profiles"
+rm -rf "$PROFILE_DIR"
+
+cmake --preset pgo-generate -DNAV_PGO_DIR="$PROFILE_DIR" $NAV_CMAKE_ARGS
+cmake --build --preset pgo-generate -j
+
+if [ $# -ge 2 ]; then
+  MAP="$1"
+  STOPS="$2"
+else
+  MAP=build/pgo/pgo-map.osm
+  STOPS=build/pgo/pgo-stops.txt
+  build/pgo/mapgen --nodes 200000 --buildings 2000 --stops 400 --osm "$MAP" --csv "$STOPS"
+fi
+
+build/pgo/navbench "$MAP" "$STOPS" --queries pgo-workload.txt --repeat 3
+
+#
+# clang writes raw profiles that must be merged first:
+#
+if ls "$PROFILE_DIR"/*.profraw >/dev/null 2>&1; then
+  llvm-profdata merge -output="$PROFILE_DIR/merged.profdata" "$PROFILE_DIR"/*.profraw
+fi
+
+cmake --preset pgo-use -DNAV_PGO_DIR="$PROFILE_DIR" $NAV_CMAKE_ARGS
+cmake --build --preset pgo-use -j
+
+echo
+echo "** PGO build done: build/pgo **"
@@ -0,0 +1,528 @@
+/*predictions.cpp*/
+
+//
+// Where bus arrival predictions come from: the live CTA Bus Tracker,
+// or a recording of it. See predictions.h.
+//
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef NAV_HAVE_CURL
+#include "curl_util.h"
+#endif
+
+#include "predictions.h"
+#include "scheduler.h"
+#include "latency.h"
+#include "json.hpp"
+
+using namespace std;
+
+using json = nlohmann::json;
+
+
+const char* const LivePredictionSource::DEFAULT_URL = "http://www.ctabustracker.com/bustime/api/v2";
+
+
+//
+// stopOf
+//
+// The stpid of a prediction or error, which the API sends as a
+// string; "" if there is none.
+//
+static string stopOf(const json& item)
+{
+  auto ptr = item.find("stpid");
+
+  if (ptr == item.end())
+    return "";
+  else if (ptr->is_string())
+    return ptr->get<string>();
+  else if (ptr->is_number_integer())
+    return to_string(ptr->get<long long>());
+  else
+    return "";
+}
+
+
+//
+// splitReply
+//
+// Splits the reply to one call about stopIDs[first..last) into a
+// reply per stop, each as the API would have sent it for that stop
+// alone; a lone stop gets the reply as is. An error that isn't about
+// any one stop (a bad key, the daily limit used up) fails them all.
+//
+static void splitReply(const string& reply, const vector<int>& stopIDs, size_t first, size_t last,
+  vector<string>& responses, vector<bool>& ok)
+{
+  try
+  {
+    json body = json::parse(reply).at("bustime-response");
+
+    if (body.count("error") > 0 && body.count("prd") == 0)
+      for (const json& error : body["error"])
+        if (stopOf(error).empty())
+          return;
+
+    if (last - first == 1) {
+      responses[first] = reply;
+      ok[first] = true;
+      return;
+    }
+
+    json noPredictions = json::array();
+
+    for (size_t i = first; i < last; i++)
+    {
+      string id = to_string(stopIDs[i]);
+      json prd = json::array(), errors = json::array();
+
+      for (const json& p : body.value("prd", noPredictions))
+        if (stopOf(p) == id)
+          prd.push_back(p);
+
+      for (const json& e : body.value("error", noPredictions))
+        if (stopOf(e) == id)
+          errors.push_back(e);
+
+      json one;
+
+      if (!prd.empty())
+        one["bustime-response"]["prd"] = prd;
+      else if (!errors.empty())
+        one["bustime-response"]["error"] = errors;
+      else
+        one["bustime-response"]["error"] = json::array({ { { "stpid", id }, { "msg", "No arrival times" } } });
+
+      responses[i] = one.dump();
+      ok[i] = true;
+    }
+  }
+  catch (json::exception&)
+  {
+    //
+    // not what the API sends; a lone stop gets it anyway, to report
+    // as unparseable, as it always has:
+    //
+    if (last - first == 1) {
+      responses[first] = reply;
+      ok[first] = true;
+    }
+  }
+}
+
+
+//
+// PredictionSource
+//
+void PredictionSource::fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+  vector<bool>& ok, Priority priority)
+{
+  (void) priority;
+
+  responses.assign(stopIDs.size(), "");
+  ok.assign(stopIDs.size(), false);
+
+  for (size_t i = 0; i < stopIDs.size(); i++)
+    ok[i] = this->fetch(route, stopIDs[i], responses[i]);
+}
+
+
+//
+// LivePredictionSource
+//
+LivePredictionSource::LivePredictionSource(const string& baseURL)
+  : BaseURL(baseURL), ApiKey("32ZEDddQBfkQW87Kkamfbm8tS")
+{
+  const char* key = getenv("CTA_BUSTRACKER_KEY");
+
+  if (key != nullptr && *key != '\0')
+    this->ApiKey = key;
+
+  while (!this->BaseURL.empty() && this->BaseURL.back() == '/')
+    this->BaseURL.pop_back();
+
+#ifdef NAV_HAVE_CURL
+  //
+  // curl_global_init is not thread-safe, so do it once, before any
+  // handle is created:
+  //
+  static once_flag initialized;
+  call_once(initialized, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+#endif
+}
+
+
+LivePredictionSource::~LivePredictionSource()
+{
+#ifdef NAV_HAVE_CURL
+  for (void* h : this->Idle)
+    curl_easy_cleanup((CURL*) h);
+#endif
+}
+
+
+void* LivePredictionSource::borrowHandle()
+{
+#ifdef NAV_HAVE_CURL
+  {
+    lock_guard<mutex> lock(this->PoolMutex);
+
+    if (!this->Idle.empty()) {
+      void* curl = this->Idle.back();
+      this->Idle.pop_back();
+      return curl;
+    }
+  }
+
+  return curl_easy_init();
+#else
+  return nullptr;
+#endif
+}
+
+
+void LivePredictionSource::returnHandle(void* handle)
+{
+  lock_guard<mutex> lock(this->PoolMutex);
+  this->Idle.push_back(handle);
+}
+
+
+bool LivePredictionSource::fetch(int route, int stopID, string& response)
+{
+  vector<string> responses;
+  vector<bool> ok;
+
+  this->fetchMany(route, { stopID }, responses, ok, Priority::Interactive);
+
+  if (ok[0])
+    response = responses[0];
+
+  return ok[0];
+}
+
+
+void LivePredictionSource::fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+  vector<bool>& ok, Priority priority)
+{
+  (void) priority;
+
+  responses.assign(stopIDs.size(), "");
+  ok.assign(stopIDs.size(), false);
+
+#ifdef NAV_HAVE_CURL
+  for (size_t first = 0; first < stopIDs.size(); first += MAX_STOPS_PER_CALL)
+  {
+    size_t last = min(stopIDs.size(), first + MAX_STOPS_PER_CALL);
+    string stops;
+
+    for (size_t i = first; i < last; i++)
+      stops += (i > first ? "," : "") + to_string(stopIDs[i]);
+
+    string url = this->BaseURL + "/getpredictions?key=" + this->ApiKey +
+      "&rt=" + to_string(route) + "&stpid=" + stops + "&format=json";
+
+    CURL* curl = (CURL*) this->borrowHandle();
+
+    if (curl == nullptr)
+      return;
+
+    string reply;
+    bool success;
+
+    {
+      LatencyTimer timer(LAT_BUS_TRACKER);
+      success = callWebServer(curl, url, reply);
+    }
+
+    this->returnHandle(curl);
+
+    if (success)
+      splitReply(reply, stopIDs, first, last, responses, ok);
+  }
+#else
+  (void) route;
+#endif
+}
+
+
+//
+// RecordingPredictionSource
+//
+RecordingPredictionSource::RecordingPredictionSource(unique_ptr<PredictionSource> inner, const string& filename)
+  : Inner(std::move(inner)), File(filename, ios::out | ios::trunc)
+{
+}
+
+
+void RecordingPredictionSource::record(int route, int stopID, bool ok, double ms, const string& response)
+{
+  json line;
+  line["rt"] = route;
+  line["stpid"] = stopID;
+  line["ok"] = ok;
+  line["ms"] = ms;
+  line["response"] = ok ? response : "";
+
+  string text = line.dump(-1, ' ', false, json::error_handler_t::replace);
+
+  {
+    lock_guard<mutex> lock(this->FileMutex);
+    this->File << text << '\n';
+    this->File.flush();  // keep what was recorded if the run is cut short
+  }
+}
+
+
+bool RecordingPredictionSource::fetch(int route, int stopID, string& response)
+{
+  auto start = chrono::steady_clock::now();
+
+  bool ok = this->Inner->fetch(route, stopID, response);
+
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  this->record(route, stopID, ok, ms, response);
+
+  return ok;
+}
+
+
+void RecordingPredictionSource::fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+  vector<bool>& ok, Priority priority)
+{
+  auto start = chrono::steady_clock::now();
+
+  this->Inner->fetchMany(route, stopIDs, responses, ok, priority);
+
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  for (size_t i = 0; i < stopIDs.size(); i++)
+    this->record(route, stopIDs[i], ok[i], ms, responses[i]);
+}
+
+
+//
+// ReplayPredictionSource
+//
+ReplayPredictionSource::ReplayPredictionSource(double latencyScale)
+  : LatencyScale(latencyScale)
+{
+}
+
+
+bool ReplayPredictionSource::load(const string& filename, string& error)
+{
+  ifstream file(filename);
+
+  if (!file.is_open()) {
+    error = "unable to open recording '" + filename + "'";
+    return false;
+  }
+
+  string text;
+  int lineNumber = 0;
+
+  while (getline(file, text))
+  {
+    lineNumber++;
+
+    if (text.find_first_not_of(" \t\r") == string::npos)
+      continue;
+
+    try
+    {
+      json line = json::parse(text);
+
+      Reply reply;
+      reply.OK = line.value("ok", true);
+      reply.Millis = line.value("ms", 0.0);
+      reply.Response = line.value("response", "");
+
+      Replies& replies = this->Recorded[key(line.at("rt").get<int>(), line.at("stpid").get<int>())];
+      replies.List.push_back(std::move(reply));
+    }
+    catch (json::exception& e)
+    {
+      error = filename + ":" + to_string(lineNumber) + ": " + e.what();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+size_t ReplayPredictionSource::getNumReplies() const
+{
+  size_t n = 0;
+
+  for (const auto& r : this->Recorded)
+    n += r.second.List.size();
+
+  return n;
+}
+
+
+bool ReplayPredictionSource::fetch(int route, int stopID, string& response)
+{
+  auto ptr = this->Recorded.find(key(route, stopID));
+
+  if (ptr == this->Recorded.end())
+    return false;
+
+  Replies& replies = ptr->second;
+  const Reply& reply = replies.List[replies.Next.fetch_add(1, memory_order_relaxed) % replies.List.size()];
+
+  if (this->LatencyScale > 0.0 && reply.Millis > 0.0)
+    this_thread::sleep_for(chrono::duration<double, milli>(reply.Millis * this->LatencyScale));
+
+  if (!reply.OK)
+    return false;
+
+  response = reply.Response;
+  return true;
+}
+
+
+void ReplayPredictionSource::fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+  vector<bool>& ok, Priority priority)
+{
+  (void) priority;
+
+  responses.assign(stopIDs.size(), "");
+  ok.assign(stopIDs.size(), false);
+
+  double slowest = 0.0;
+
+  for (size_t i = 0; i < stopIDs.size(); i++)
+  {
+    auto ptr = this->Recorded.find(key(route, stopIDs[i]));
+
+    if (ptr == this->Recorded.end())
+      continue;
+
+    Replies& replies = ptr->second;
+    const Reply& reply = replies.List[replies.Next.fetch_add(1, memory_order_relaxed) % replies.List.size()];
+
+    slowest = max(slowest, reply.Millis);
+
+    if (reply.OK) {
+      responses[i] = reply.Response;
+      ok[i] = true;
+    }
+  }
+
+  if (this->LatencyScale > 0.0 && slowest > 0.0)
+    this_thread::sleep_for(chrono::duration<double, milli>(slowest * this->LatencyScale));
+}
+
+
+//
+// mergePredictionReplies
+//
+string mergePredictionReplies(const vector<int>& stopIDs, const vector<string>& responses, const vector<bool>& ok)
+{
+  json prd = json::array(), errors = json::array();
+
+  for (size_t i = 0; i < stopIDs.size(); i++)
+  {
+    string id = to_string(stopIDs[i]);
+    bool answered = false;
+
+    if (ok[i])
+    {
+      try
+      {
+        json body = json::parse(responses[i]).at("bustime-response");
+
+        for (const json& p : body.value("prd", json::array())) {
+          prd.push_back(p);
+          answered = true;
+        }
+
+        for (json e : body.value("error", json::array())) {
+          if (stopOf(e).empty())
+            e["stpid"] = id;
+          errors.push_back(e);
+          answered = true;
+        }
+      }
+      catch (json::exception&)
+      {
+      }
+    }
+
+    if (!answered)
+      errors.push_back({ { "stpid", id }, { "msg", "No data found for parameter" } });
+  }
+
+  json reply;
+  reply["bustime-response"] = json::object();
+
+  if (!prd.empty())
+    reply["bustime-response"]["prd"] = prd;
+  if (!errors.empty())
+    reply["bustime-response"]["error"] = errors;
+
+  return reply.dump() + "\n";
+}
+
+
+//
+// makePredictionSource
+//
+unique_ptr<PredictionSource> makePredictionSource(const string& spec, string& error)
+{
+  size_t colon = spec.find(':');
+  string kind = spec.substr(0, colon);
+  string arg = (colon == string::npos) ? "" : spec.substr(colon + 1);
+
+  if (kind == "live")
+  {
+    return make_unique<PredictionScheduler>(
+      make_unique<LivePredictionSource>(arg.empty() ? LivePredictionSource::DEFAULT_URL : arg));
+  }
+  else if (kind == "record" && !arg.empty())
+  {
+    size_t comma = arg.find(',');
+    string filename = arg.substr(0, comma);
+    string inner = (comma == string::npos) ? "live" : arg.substr(comma + 1);
+
+    unique_ptr<PredictionSource> source = makePredictionSource(inner, error);
+
+    if (source == nullptr)
+      return nullptr;
+
+    auto recording = make_unique<RecordingPredictionSource>(std::move(source), filename);
+
+    if (!recording->isOpen()) {
+      error = "unable to write recording '" + filename + "'";
+      return nullptr;
+    }
+
+    return recording;
+  }
+  else if ((kind == "replay" || kind == "replay-fast") && !arg.empty())
+  {
+    auto source = make_unique<ReplayPredictionSource>(kind == "replay" ? 1.0 : 0.0);
+
+    if (!source->load(arg, error))
+      return nullptr;
+
+    return source;
+  }
+
+  error = "unknown prediction source '" + spec + "' (expected live[:URL], record:FILE[,source], replay:FILE or replay-fast:FILE)";
+  return nullptr;
+}
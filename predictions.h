@@ -0,0 +1,248 @@
+/*predictions.h*/
+
+//
+// Where bus arrival predictions come from. A PredictionSource
+// answers "which buses are due at this stop on this route?" with the
+// raw JSON reply of the CTA Bus Tracker getpredictions call; the
+// reply is parsed into Arrivals by BusStops::getArrivals, and
+// formatted with the rest of a query's results (see format.h).
+//
+// Sources:
+//
+//   live             calls the CTA Bus Tracker over HTTP (libcurl)
+//   live:URL         the same API at another base URL, e.g. a stub
+//                    server: live:http://127.0.0.1:8081/bustime/api/v2
+//   record:FILE      calls the live API and writes every reply, and
+//                    how long it took, to FILE
+//   record:FILE,SPEC the same, recording the source SPEC instead
+//   replay:FILE      answers from a recording, taking as long as the
+//                    original call did
+//   replay-fast:FILE answers from a recording immediately
+//
+// Recordings are JSON lines, one per call:
+//
+//   {"rt":201,"stpid":1834,"ok":true,"ms":87.5,"response":"..."}
+//
+// A call about several stops is recorded as a line per stop, each
+// with the latency of the whole call.
+//
+// A recording with several calls for the same route and stop replays
+// them in order, starting over after the last; a call that was never
+// recorded fails, as an unreachable server would.
+//
+// The API answers for up to MAX_STOPS_PER_CALL stops in one call
+// (stpid=1834,1835,...); fetchMany uses this, splitting the reply
+// into one per stop. Live sources are reached through a scheduler
+// (see scheduler.h) that batches calls, keeps them within the API's
+// rate limit and daily quota, and backs off when calls fail.
+//
+// The API key is the one the project has always used, unless the
+// environment variable CTA_BUSTRACKER_KEY is set. Builds without
+// libcurl (NAV_HAVE_CURL not defined) can still replay; their live
+// calls always fail.
+//
+// References:
+//
+// CTA Bus Tracker API:
+//   https://www.transitchicago.com/developers/bustracker/
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <unordered_map>
+#include <cstdint>
+
+using namespace std;
+
+
+//
+// PredictionSource
+//
+// fetch may be called from several threads at once.
+//
+class PredictionSource
+{
+public:
+  //
+  // who is waiting for a reply: a user, or nobody yet (prefetching)
+  //
+  enum class Priority { Interactive, Background };
+
+  virtual ~PredictionSource() = default;
+
+  //
+  // fetch
+  //
+  // Sets response to the getpredictions reply for the given route
+  // and stop, and returns true; returns false if there was no reply.
+  //
+  virtual bool fetch(int route, int stopID, string& response) = 0;
+
+  //
+  // prefetch
+  //
+  // A hint that the reply for this route and stop will probably be
+  // wanted soon. Returns at once; sources without a cache (see
+  // prefetch.h) ignore it.
+  //
+  virtual void prefetch(int route, int stopID) { (void) route; (void) stopID; }
+
+  //
+  // fetchMany
+  //
+  // The replies for several stops on one route: ok[i] and
+  // responses[i] are for stopIDs[i]. Asks for up to getMaxBatch()
+  // stops per call; the default calls fetch once per stop.
+  //
+  virtual void fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+    vector<bool>& ok, Priority priority);
+
+  virtual int getMaxBatch() const { return 1; }
+
+  //
+  // statsJson
+  //
+  // The source's metrics as a JSON object on one line, or "" if it
+  // keeps none.
+  //
+  virtual string statsJson() const { return ""; }
+};
+
+
+//
+// LivePredictionSource
+//
+// Each call borrows a curl handle from a pool (handles are not
+// thread-safe, but are worth reusing for their connections).
+//
+class LivePredictionSource : public PredictionSource
+{
+private:
+  string BaseURL;
+  string ApiKey;
+
+  mutex PoolMutex;
+  vector<void*> Idle;   // CURL handles
+
+  void* borrowHandle();
+  void returnHandle(void* handle);
+
+public:
+  static const char* const DEFAULT_URL;
+  static const int MAX_STOPS_PER_CALL = 10;
+
+  explicit LivePredictionSource(const string& baseURL = DEFAULT_URL);
+  ~LivePredictionSource() override;
+
+  bool fetch(int route, int stopID, string& response) override;
+  void fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+    vector<bool>& ok, Priority priority) override;
+
+  int getMaxBatch() const override { return MAX_STOPS_PER_CALL; }
+};
+
+
+//
+// RecordingPredictionSource
+//
+// Passes each call on to another source, and appends the reply and
+// its latency to the recording file.
+//
+class RecordingPredictionSource : public PredictionSource
+{
+private:
+  unique_ptr<PredictionSource> Inner;
+  ofstream File;
+  mutex FileMutex;
+
+  void record(int route, int stopID, bool ok, double ms, const string& response);
+
+public:
+  RecordingPredictionSource(unique_ptr<PredictionSource> inner, const string& filename);
+
+  bool isOpen() const { return this->File.is_open(); }
+
+  bool fetch(int route, int stopID, string& response) override;
+  void fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+    vector<bool>& ok, Priority priority) override;
+
+  int getMaxBatch() const override { return this->Inner->getMaxBatch(); }
+  string statsJson() const override { return this->Inner->statsJson(); }
+};
+
+
+//
+// ReplayPredictionSource
+//
+// Answers from a recording, sleeping for the recorded latency times
+// LatencyScale (0 => no delay). Several stops are answered together,
+// as the API does, taking as long as the slowest of them.
+//
+class ReplayPredictionSource : public PredictionSource
+{
+private:
+  struct Reply
+  {
+    bool OK;
+    double Millis;
+    string Response;
+  };
+
+  struct Replies
+  {
+    vector<Reply> List;
+    atomic<size_t> Next{0};
+  };
+
+  unordered_map<uint64_t, Replies> Recorded;   // by (route, stop)
+  double LatencyScale;
+
+  static uint64_t key(int route, int stopID) {
+    return ((uint64_t) (uint32_t) route << 32) | (uint32_t) stopID;
+  }
+
+public:
+  explicit ReplayPredictionSource(double latencyScale = 1.0);
+
+  //
+  // load
+  //
+  // Reads a recording. Returns false and sets error (with the line
+  // number) if the file cannot be read or a line is malformed.
+  //
+  bool load(const string& filename, string& error);
+
+  size_t getNumReplies() const;
+
+  bool fetch(int route, int stopID, string& response) override;
+  void fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+    vector<bool>& ok, Priority priority) override;
+
+  int getMaxBatch() const override { return LivePredictionSource::MAX_STOPS_PER_CALL; }
+};
+
+
+//
+// mergePredictionReplies
+//
+// Combines single-stop replies into the reply the API gives for one
+// call about all of those stops: every prediction, then an error for
+// each stop without any (a failed call counts as "No data found").
+//
+string mergePredictionReplies(const vector<int>& stopIDs, const vector<string>& responses, const vector<bool>& ok);
+
+
+//
+// makePredictionSource
+//
+// Creates the source described by spec (see the top of this file).
+// Returns nullptr and sets error if the spec is unknown or its file
+// cannot be opened.
+//
+unique_ptr<PredictionSource> makePredictionSource(const string& spec, string& error);
@@ -0,0 +1,385 @@
+/*prefetch.cpp*/
+
+//
+// A cache in front of a PredictionSource, filled ahead of time by
+// background threads. See prefetch.h.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+#include "prefetch.h"
+
+using namespace std;
+
+
+//
+// a hot stop is refreshed when its reply has less than this left:
+//
+static const chrono::seconds REFRESH_MARGIN(5);
+
+//
+// ... and stops being hot once nobody has asked for this long:
+//
+static const chrono::minutes HOT_FOR(10);
+
+//
+// how often idle workers look for hot stops to refresh:
+//
+static const chrono::seconds IDLE_CHECK(1);
+
+
+PredictionCache::PredictionCache(unique_ptr<PredictionSource> inner, const Options& options)
+  : Inner(std::move(inner)), Opts(options),
+    MaxAge(chrono::duration_cast<Clock::duration>(chrono::duration<double>(options.MaxAgeSeconds)))
+{
+  for (int i = 0; i < max(1, this->Opts.Threads); i++)
+    this->Workers.push_back(thread(&PredictionCache::workerLoop, this));
+}
+
+
+PredictionCache::PredictionCache(unique_ptr<PredictionSource> inner)
+  : PredictionCache(std::move(inner), Options())
+{
+}
+
+
+PredictionCache::~PredictionCache()
+{
+  {
+    lock_guard<mutex> lock(this->Mutex);
+    this->Stopping = true;
+  }
+  this->Wake.notify_all();
+
+  for (thread& t : this->Workers)
+    t.join();
+}
+
+
+//
+// store
+//
+// Records the result of a call to the source; the caller holds the
+// lock. A failed call leaves the entry as it was.
+//
+void PredictionCache::store(Entry& e, bool ok, const string& reply, bool prefetched)
+{
+  e.Pending = false;
+
+  if (!ok) {
+    this->Counts.Failures++;
+    return;
+  }
+
+  if (e.Valid && e.Prefetched && !e.Used)
+    this->Counts.PrefetchWasted++;
+
+  e.Valid = true;
+  e.Prefetched = prefetched;
+  e.Used = !prefetched;
+  e.Fetched = Clock::now();
+  e.Reply = reply;
+}
+
+
+//
+// takeQueued
+//
+// Takes prefetches for the given route off the queue and adds them
+// to keys, until keys holds as many stops as the source takes in one
+// call; the caller holds the lock.
+//
+void PredictionCache::takeQueued(int route, vector<uint64_t>& keys)
+{
+  size_t most = (size_t) max(1, this->Inner->getMaxBatch());
+
+  for (auto it = this->Queue.begin(); it != this->Queue.end() && keys.size() < most; )
+  {
+    uint64_t k = *it;
+
+    if ((int) (k >> 32) != route || k == keys[0]) {
+      ++it;
+      continue;
+    }
+
+    it = this->Queue.erase(it);
+    this->Queued.erase(k);
+
+    auto ptr = this->Entries.find(k);
+
+    if (ptr != this->Entries.end() && ptr->second.Pending)
+      continue;  // a fetch got there first
+
+    keys.push_back(k);
+  }
+}
+
+
+//
+// callSource
+//
+// Fetches keys -- all on one route -- in one call to the source,
+// and stores the replies: the first as prefetched or not, the rest
+// as prefetched. Returns the first's outcome, setting firstReply.
+// The lock is held on entry and exit, but not during the call.
+//
+bool PredictionCache::callSource(unique_lock<mutex>& lock, const vector<uint64_t>& keys, bool firstPrefetched,
+  Priority priority, string& firstReply)
+{
+  vector<int> stopIDs;
+  vector<Entry*> entries;
+
+  for (uint64_t k : keys) {
+    Entry& e = this->Entries[k];  // references survive rehashing
+    e.Pending = true;
+    entries.push_back(&e);
+    stopIDs.push_back((int) (uint32_t) k);
+  }
+
+  lock.unlock();
+
+  vector<string> replies;
+  vector<bool> ok;
+
+  this->Inner->fetchMany((int) (keys[0] >> 32), stopIDs, replies, ok, priority);
+
+  lock.lock();
+
+  for (size_t i = 0; i < keys.size(); i++)
+    this->store(*entries[i], ok[i], replies[i], i > 0 || firstPrefetched);
+
+  this->Arrived.notify_all();
+
+  if (ok[0])
+    firstReply = std::move(replies[0]);
+
+  return ok[0];
+}
+
+
+//
+// fetch
+//
+bool PredictionCache::fetch(int route, int stopID, string& response)
+{
+  unique_lock<mutex> lock(this->Mutex);
+
+  Entry& e = this->Entries[key(route, stopID)];  // references survive rehashing
+
+  this->Counts.Fetches++;
+  e.Asked++;
+  e.LastAsked = Clock::now();
+
+  if (e.Pending) {
+    this->Counts.JoinedInFlight++;
+    this->Arrived.wait(lock, [&] { return !e.Pending; });
+  }
+
+  if (this->fresh(e, Clock::now(), Clock::duration::zero()))
+  {
+    this->Counts.Hits++;
+
+    if (e.Prefetched && !e.Used)
+      this->Counts.PrefetchUsed++;
+
+    e.Used = true;
+    response = e.Reply;
+    return true;
+  }
+
+  this->Counts.Misses++;
+
+  //
+  // the call may as well bring the prefetches waiting for this
+  // route -- this stop's among them:
+  //
+  uint64_t k = key(route, stopID);
+  vector<uint64_t> keys = { k };
+
+  if (this->Queued.erase(k) > 0)
+    this->Queue.erase(find(this->Queue.begin(), this->Queue.end(), k));
+
+  this->takeQueued(route, keys);
+  this->Counts.PrefetchRequests += keys.size() - 1;
+
+  string reply;
+  bool ok = this->callSource(lock, keys, false, Priority::Interactive, reply);
+
+  if (ok)
+    response = reply;
+
+  return ok;
+}
+
+
+//
+// prefetch
+//
+void PredictionCache::prefetch(int route, int stopID)
+{
+  uint64_t k = key(route, stopID);
+
+  {
+    lock_guard<mutex> lock(this->Mutex);
+
+    auto ptr = this->Entries.find(k);
+
+    //
+    // nothing to do if it's on its way, or still good for at least
+    // half its life:
+    //
+    if (ptr != this->Entries.end()
+      && (ptr->second.Pending || this->fresh(ptr->second, Clock::now(), this->MaxAge / 2))) {
+      this->Counts.PrefetchSkipped++;
+      return;
+    }
+
+    if (this->Queued.count(k) > 0) {
+      this->Counts.PrefetchSkipped++;
+      return;
+    }
+
+    if ((int) this->Queue.size() >= this->Opts.MaxQueued) {
+      this->Counts.PrefetchDropped++;
+      return;
+    }
+
+    this->Queue.push_back(k);
+    this->Queued.insert(k);
+  }
+
+  this->Wake.notify_one();
+}
+
+
+//
+// queueHotStops
+//
+// Queues the most-asked-about stops whose replies are about to
+// expire (or have); the caller holds the lock.
+//
+void PredictionCache::queueHotStops(Clock::time_point now)
+{
+  vector<pair<uint64_t, uint64_t>> hot;   // (times asked, key)
+
+  for (const auto& entry : this->Entries)
+  {
+    const Entry& e = entry.second;
+
+    if (e.Asked >= 2 && now - e.LastAsked < HOT_FOR)
+      hot.emplace_back(e.Asked, entry.first);
+  }
+
+  size_t n = min(hot.size(), (size_t) max(this->Opts.HotStops, 0));
+
+  partial_sort(hot.begin(), hot.begin() + n, hot.end(), greater<pair<uint64_t, uint64_t>>());
+
+  for (size_t i = 0; i < n; i++)
+  {
+    uint64_t k = hot[i].second;
+    const Entry& e = this->Entries[k];
+
+    if (e.Pending || this->Queued.count(k) > 0 || this->fresh(e, now, REFRESH_MARGIN))
+      continue;
+
+    this->Queue.push_back(k);
+    this->Queued.insert(k);
+  }
+}
+
+
+//
+// workerLoop
+//
+void PredictionCache::workerLoop()
+{
+  unique_lock<mutex> lock(this->Mutex);
+
+  while (true)
+  {
+    this->Wake.wait_for(lock, IDLE_CHECK, [this] { return this->Stopping || !this->Queue.empty(); });
+
+    if (this->Stopping)
+      break;
+
+    if (this->Queue.empty())
+      this->queueHotStops(Clock::now());
+
+    if (this->Queue.empty())
+      continue;
+
+    uint64_t k = this->Queue.front();
+    this->Queue.pop_front();
+    this->Queued.erase(k);
+
+    if (this->Entries[k].Pending)
+      continue;  // a fetch got there first
+
+    vector<uint64_t> keys = { k };
+
+    this->takeQueued((int) (k >> 32), keys);
+    this->Counts.PrefetchRequests += keys.size();
+
+    string reply;
+    this->callSource(lock, keys, true, Priority::Background, reply);
+  }
+}
+
+
+//
+// getStats
+//
+PredictionCache::Stats PredictionCache::getStats() const
+{
+  lock_guard<mutex> lock(this->Mutex);
+
+  Stats stats = this->Counts;
+  Clock::time_point now = Clock::now();
+
+  for (const auto& entry : this->Entries)
+  {
+    const Entry& e = entry.second;
+
+    if (e.Valid && e.Prefetched && !e.Used && !this->fresh(e, now, Clock::duration::zero()))
+      stats.PrefetchWasted++;
+  }
+
+  return stats;
+}
+
+
+//
+// statsJson
+//
+string PredictionCache::statsJson() const
+{
+  Stats s = this->getStats();
+  ostringstream json;
+
+  json << fixed << setprecision(4)
+    << "{\"fetches\":" << s.Fetches
+    << ",\"hits\":" << s.Hits
+    << ",\"joined_in_flight\":" << s.JoinedInFlight
+    << ",\"misses\":" << s.Misses
+    << ",\"hit_rate\":" << s.hitRate()
+    << ",\"prefetch_requests\":" << s.PrefetchRequests
+    << ",\"prefetch_used\":" << s.PrefetchUsed
+    << ",\"prefetch_wasted\":" << s.PrefetchWasted
+    << ",\"prefetch_hit_rate\":" << s.prefetchHitRate()
+    << ",\"prefetch_skipped\":" << s.PrefetchSkipped
+    << ",\"prefetch_dropped\":" << s.PrefetchDropped
+    << ",\"failures\":" << s.Failures;
+
+  string source = this->Inner->statsJson();
+
+  if (!source.empty())
+    json << ",\"source\":" << source;
+
+  json << "}";
+
+  return json.str();
+}
@@ -0,0 +1,147 @@
+/*prefetch.h*/
+
+//
+// A cache in front of a PredictionSource, filled ahead of time by
+// background threads.
+//
+// After a building search, the stops a user is likely to ask about
+// next -- the few nearest in each direction -- are handed to
+// prefetch(), and fetched on a background thread while the user
+// reads the results. The stops asked about most often are also kept
+// fresh, refreshed shortly before their replies expire. A later
+// fetch() for any of them is answered from the cache at once; if the
+// prefetch is still in flight, fetch() waits for it rather than
+// sending a second request.
+//
+// Bus Tracker predictions are recomputed about once a minute, so a
+// reply is served from the cache for MaxAgeSeconds (30 by default).
+//
+// Calls to the source carry as many stops as it takes at once (see
+// fetchMany in predictions.h): a worker sends the queued prefetches
+// for one route together, and a fetch that has to call the source
+// takes the queued prefetches for its route along.
+//
+// Metrics, for tuning how much to prefetch:
+//
+//   hit rate             fetches answered from the cache
+//   prefetch hit rate    prefetched replies later used by a fetch
+//   wasted               prefetched replies replaced or expired
+//                        without ever being used
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+#include "predictions.h"
+
+using namespace std;
+
+
+class PredictionCache : public PredictionSource
+{
+public:
+  struct Options
+  {
+    double MaxAgeSeconds = 30.0;   // how long a reply is served
+    int Threads = 2;               // background fetchers
+    int HotStops = 8;              // most-asked-about stops kept fresh
+    int MaxQueued = 256;           // prefetches beyond this are dropped
+  };
+
+  struct Stats
+  {
+    uint64_t Fetches = 0;          // calls to fetch()
+    uint64_t Hits = 0;             // ... answered from the cache
+    uint64_t JoinedInFlight = 0;   // ... that waited for a call in flight
+    uint64_t Misses = 0;           // ... that went to the source
+    uint64_t PrefetchRequests = 0; // prefetches sent to the source
+    uint64_t PrefetchUsed = 0;     // ... whose reply a fetch then used
+    uint64_t PrefetchWasted = 0;   // ... replaced or expired unused
+    uint64_t PrefetchSkipped = 0;  // hints already fresh or queued
+    uint64_t PrefetchDropped = 0;  // hints dropped, queue full
+    uint64_t Failures = 0;         // source calls that got no reply
+
+    double hitRate() const { return Fetches == 0 ? 0.0 : (double) Hits / Fetches; }
+    double prefetchHitRate() const { return PrefetchRequests == 0 ? 0.0 : (double) PrefetchUsed / PrefetchRequests; }
+  };
+
+private:
+  using Clock = chrono::steady_clock;
+
+  struct Entry
+  {
+    bool Valid = false;            // holds a reply
+    bool Pending = false;          // a call to the source is in flight
+    bool Prefetched = false;       // the reply came from a prefetch
+    bool Used = false;             // ... and a fetch has used it
+    Clock::time_point Fetched;
+    string Reply;
+    uint64_t Asked = 0;            // calls to fetch(), for HotStops
+    Clock::time_point LastAsked;
+  };
+
+  unique_ptr<PredictionSource> Inner;
+  Options Opts;
+  Clock::duration MaxAge;
+
+  mutable mutex Mutex;
+  condition_variable Wake;         // workers: work queued, or stopping
+  condition_variable Arrived;      // fetchers: a pending call finished
+  unordered_map<uint64_t, Entry> Entries;   // by (route, stop)
+  deque<uint64_t> Queue;
+  unordered_set<uint64_t> Queued;
+  bool Stopping = false;
+  Stats Counts;
+
+  vector<thread> Workers;
+
+  static uint64_t key(int route, int stopID) {
+    return ((uint64_t) (uint32_t) route << 32) | (uint32_t) stopID;
+  }
+
+  bool fresh(const Entry& e, Clock::time_point now, Clock::duration margin) const {
+    return e.Valid && now - e.Fetched + margin < this->MaxAge;
+  }
+
+  void store(Entry& e, bool ok, const string& reply, bool prefetched);
+  void takeQueued(int route, vector<uint64_t>& keys);
+  bool callSource(unique_lock<mutex>& lock, const vector<uint64_t>& keys, bool firstPrefetched,
+    Priority priority, string& firstReply);
+  void queueHotStops(Clock::time_point now);
+  void workerLoop();
+
+public:
+  PredictionCache(unique_ptr<PredictionSource> inner, const Options& options);
+  explicit PredictionCache(unique_ptr<PredictionSource> inner);
+  ~PredictionCache() override;
+
+  bool fetch(int route, int stopID, string& response) override;
+  void prefetch(int route, int stopID) override;
+
+  //
+  // getStats
+  //
+  // A snapshot of the metrics. Prefetched replies that have expired
+  // unused count as wasted.
+  //
+  Stats getStats() const;
+
+  //
+  // statsJson
+  //
+  // The metrics as a JSON object, on one line, with the source's
+  // own (if it keeps any) as "source".
+  //
+  string statsJson() const override;
+};
@@ -0,0 +1,314 @@
+/*profiler.cpp*/
+
+//
+// A load profiler: per-phase time, memory and allocations, as a table
+// or a Chrome trace. See profiler.h.
+//
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "profiler.h"
+#include "counters.h"
+#include "outbuf.h"
+
+using namespace std;
+
+
+//
+// cpuMs
+//
+// CPU time used by the process so far, user and system, all threads.
+//
+static double cpuMs()
+{
+#ifdef __linux__
+  rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+      + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+
+  return 0.0;
+#else
+  return 1000.0 * clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+//
+// residentKB
+//
+// The process's resident memory now, and at its peak so far; -1 if
+// unknown.
+//
+static void residentKB(long long& now, long long& peak)
+{
+  now = peak = -1;
+
+#ifdef __linux__
+  FILE* statm = fopen("/proc/self/statm", "r");
+
+  if (statm != nullptr) {
+    long long size, resident;
+
+    if (fscanf(statm, "%lld %lld", &size, &resident) == 2)
+      now = resident * (sysconf(_SC_PAGESIZE) / 1024);
+
+    fclose(statm);
+  }
+
+  rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    peak = max<long long>(usage.ru_maxrss, now);   // KB on Linux; counted apart from statm
+#endif
+}
+
+
+LoadProfiler::Sample LoadProfiler::Sample::now()
+{
+  Sample sample;
+
+  sample.Wall = chrono::steady_clock::now();
+  sample.CpuMs = cpuMs();
+  residentKB(sample.RssKB, sample.PeakRssKB);
+
+#ifdef NAV_INSTRUMENT
+  sample.Allocations = (long long) counterGet(CTR_ALLOCATIONS);
+  sample.AllocatedBytes = (long long) counterGet(CTR_ALLOCATED_BYTES);
+#endif
+
+  return sample;
+}
+
+
+LoadProfiler::LoadProfiler()
+  : Origin(chrono::steady_clock::now())
+{
+}
+
+
+double LoadProfiler::msSinceOrigin(chrono::steady_clock::time_point t) const
+{
+  return chrono::duration<double, milli>(t - this->Origin).count();
+}
+
+
+void LoadProfiler::record(const string& name, const Sample& start, const Sample& end)
+{
+  lock_guard<mutex> lock(this->Mutex);
+
+  thread::id self = this_thread::get_id();
+  auto known = find(this->Threads.begin(), this->Threads.end(), self);
+
+  Phase phase;
+  phase.Name = name;
+  phase.Thread = (int) (known - this->Threads.begin());
+  phase.Start = start;
+  phase.End = end;
+
+  if (known == this->Threads.end())
+    this->Threads.push_back(self);
+
+  this->Phases.push_back(phase);
+}
+
+
+vector<LoadProfiler::Phase> LoadProfiler::getPhases() const
+{
+  lock_guard<mutex> lock(this->Mutex);
+
+  return this->Phases;
+}
+
+
+//
+// appendMB
+//
+// KB as MB, or "-" if unknown.
+//
+static void appendMB(OutputBuffer& out, long long kb)
+{
+  if (kb < 0)
+    out.append("-");
+  else
+    out.appendFixed(kb / 1024.0, 1);
+}
+
+
+void LoadProfiler::printTable(ostream& stream) const
+{
+  vector<Phase> phases = this->getPhases();
+  OutputBuffer out;
+
+  const size_t NAME_WIDTH = 22;
+  const size_t WIDTHS[] = { 10, 10, 10, 10, 10, 10, 12 };
+  const char* HEADINGS[] = { "start ms", "wall ms", "cpu ms", "RSS MB", "+RSS MB", "peak MB", "allocs" };
+
+  out.append("load profile:\n");
+  out.append("  phase");
+  out.append(string(NAME_WIDTH - 5, ' '));
+  for (int c = 0; c < 7; c++)
+    out.appendColumn(WIDTHS[c], [&](OutputBuffer& cell) { cell.append(HEADINGS[c]); });
+  out.append('\n');
+
+  auto row = [&](const string& name, const Sample& start, const Sample& end) {
+    out.append("  ");
+    out.append(name);
+    if (name.size() < NAME_WIDTH)
+      out.append(string(NAME_WIDTH - name.size(), ' '));
+
+    out.appendColumn(WIDTHS[0], [&](OutputBuffer& c) { c.appendFixed(this->msSinceOrigin(start.Wall), 1); });
+    out.appendColumn(WIDTHS[1], [&](OutputBuffer& c) {
+      c.appendFixed(chrono::duration<double, milli>(end.Wall - start.Wall).count(), 1);
+    });
+    out.appendColumn(WIDTHS[2], [&](OutputBuffer& c) { c.appendFixed(end.CpuMs - start.CpuMs, 1); });
+    out.appendColumn(WIDTHS[3], [&](OutputBuffer& c) { appendMB(c, end.RssKB); });
+    out.appendColumn(WIDTHS[4], [&](OutputBuffer& c) {
+      if (start.RssKB < 0 || end.RssKB < 0)
+        c.append("-");
+      else {
+        if (end.RssKB >= start.RssKB)
+          c.append('+');
+        c.appendFixed((end.RssKB - start.RssKB) / 1024.0, 1);
+      }
+    });
+    out.appendColumn(WIDTHS[5], [&](OutputBuffer& c) { appendMB(c, end.PeakRssKB); });
+    out.appendColumn(WIDTHS[6], [&](OutputBuffer& c) {
+      if (start.Allocations < 0)
+        c.append("-");
+      else
+        c.appendInt(end.Allocations - start.Allocations);
+    });
+    out.append('\n');
+  };
+
+  if (phases.empty()) {
+    out.append("  (no phases)\n");
+    out.writeTo(stream);
+    return;
+  }
+
+  const Sample* first = &phases[0].Start;
+  const Sample* last = &phases[0].End;
+
+  for (const Phase& phase : phases)
+  {
+    row(phase.Name, phase.Start, phase.End);
+
+    if (phase.Start.Wall < first->Wall)
+      first = &phase.Start;
+    if (phase.End.Wall > last->Wall)
+      last = &phase.End;
+  }
+
+  row("total", *first, *last);
+
+  out.writeTo(stream);
+}
+
+
+//
+// chromeTrace
+//
+// A complete ("X") event per phase, its measurements as args, and a
+// counter ("C") event for resident memory at each phase's start and
+// end. Times are in microseconds since the profiler was made.
+//
+string LoadProfiler::chromeTrace() const
+{
+  vector<Phase> phases = this->getPhases();
+  OutputBuffer out;
+
+  out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"load\"}}");
+
+  for (const Phase& phase : phases)
+  {
+    double startUs = this->msSinceOrigin(phase.Start.Wall) * 1000.0;
+    double endUs = this->msSinceOrigin(phase.End.Wall) * 1000.0;
+
+    out.append(",\n{\"name\":");
+    out.appendJsonString(phase.Name);
+    out.append(",\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+    out.appendInt(phase.Thread);
+    out.append(",\"ts\":");
+    out.appendFixed(startUs, 3);
+    out.append(",\"dur\":");
+    out.appendFixed(endUs - startUs, 3);
+    out.append(",\"args\":{\"cpu_ms\":");
+    out.appendFixed(phase.End.CpuMs - phase.Start.CpuMs, 3);
+    out.append(",\"rss_kb\":");
+    out.appendInt(phase.End.RssKB);
+    out.append(",\"rss_delta_kb\":");
+    out.appendInt((phase.Start.RssKB < 0 || phase.End.RssKB < 0) ? 0 : phase.End.RssKB - phase.Start.RssKB);
+    out.append(",\"peak_rss_kb\":");
+    out.appendInt(phase.End.PeakRssKB);
+
+    if (phase.Start.Allocations >= 0) {
+      out.append(",\"allocations\":");
+      out.appendInt(phase.End.Allocations - phase.Start.Allocations);
+      out.append(",\"allocated_bytes\":");
+      out.appendInt(phase.End.AllocatedBytes - phase.Start.AllocatedBytes);
+    }
+
+    out.append("}}");
+
+    for (const Sample* sample : { &phase.Start, &phase.End })
+    {
+      if (sample->RssKB < 0)
+        continue;
+
+      out.append(",\n{\"name\":\"resident MB\",\"ph\":\"C\",\"pid\":1,\"ts\":");
+      out.appendFixed(this->msSinceOrigin(sample->Wall) * 1000.0, 3);
+      out.append(",\"args\":{\"MB\":");
+      out.appendFixed(sample->RssKB / 1024.0, 1);
+      out.append("}}");
+    }
+  }
+
+  out.append("\n]}\n");
+
+  return string(out.view());
+}
+
+
+bool LoadProfiler::writeChromeTrace(const string& filename) const
+{
+  ofstream file(filename, ios::binary);
+
+  if (!file)
+    return false;
+
+  file << this->chromeTrace();
+  return (bool) file;
+}
+
+
+ProfileScope::ProfileScope(LoadProfiler* profiler, const string& name)
+  : Profiler(profiler), Name(name)
+{
+  if (profiler != nullptr)
+    this->Start = LoadProfiler::Sample::now();
+}
+
+
+ProfileScope::~ProfileScope()
+{
+  if (this->Profiler != nullptr)
+    this->Profiler->record(this->Name, this->Start, LoadProfiler::Sample::now());
+}
@@ -0,0 +1,133 @@
+/*profiler.h*/
+
+//
+// A load profiler: for each phase of loading (see startup.h), the
+// wall-clock time, CPU time, resident memory before and after and at
+// its peak so far, and -- in instrumented builds (NAV_INSTRUMENT, see
+// counters.h) -- heap allocations, printed as a table or exported as
+// a Chrome trace (chrome://tracing, or https://ui.perfetto.dev) with
+// one bar per phase on the thread that ran it, and resident memory
+// as a counter track beneath.
+//
+//   LoadProfiler profiler;
+//   {
+//     ProfileScope scope(&profiler, "nodes");
+//     nodes.readMapNodes(xmldoc);
+//   }
+//   profiler.printTable(cerr);
+//   profiler.writeChromeTrace("load.json");
+//
+// CPU time, memory and allocations are the whole process's, so they
+// belong to one phase only if phases run one at a time; a
+// StartupGraph given a profiler runs them that way.
+//
+// On systems other than Linux, memory is reported as unknown (-1).
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+
+class LoadProfiler
+{
+public:
+  //
+  // Sample
+  //
+  // What the process has used up to a moment.
+  //
+  struct Sample
+  {
+    chrono::steady_clock::time_point Wall;
+    double CpuMs = 0.0;          // user + system, all threads
+    long long RssKB = -1;        // resident now
+    long long PeakRssKB = -1;    // resident at most, so far
+    long long Allocations = -1;  // -1 unless instrumented
+    long long AllocatedBytes = -1;
+
+    static Sample now();
+  };
+
+  //
+  // Phase
+  //
+  // A phase measured: Start and End as samples, Thread the order in
+  // which the thread that ran it first ran a phase (0, 1, ...).
+  //
+  struct Phase
+  {
+    string Name;
+    int Thread = 0;
+    Sample Start;
+    Sample End;
+  };
+
+private:
+  chrono::steady_clock::time_point Origin;
+  mutable mutex Mutex;
+  vector<Phase> Phases;
+  vector<thread::id> Threads;   // index => thread
+
+  double msSinceOrigin(chrono::steady_clock::time_point t) const;
+
+public:
+  LoadProfiler();
+
+  //
+  // record
+  //
+  // Adds a phase that ran on this thread; safe to call from any
+  // thread (ProfileScope calls it).
+  //
+  void record(const string& name, const Sample& start, const Sample& end);
+
+  vector<Phase> getPhases() const;
+
+  //
+  // printTable
+  //
+  // A row per phase: start, wall and CPU time (ms), resident memory
+  // after and its change (MB), peak (MB), and allocations; then the
+  // totals from the first start to the last end.
+  //
+  void printTable(ostream& out) const;
+
+  //
+  // writeChromeTrace
+  //
+  // Writes the phases in the Chrome trace event format (JSON);
+  // returns false if the file could not be written.
+  //
+  bool writeChromeTrace(const string& filename) const;
+  string chromeTrace() const;
+};
+
+
+//
+// ProfileScope
+//
+// Measures from construction to destruction as a phase of the given
+// profiler; does nothing if the profiler is nullptr.
+//
+class ProfileScope
+{
+private:
+  LoadProfiler* Profiler;
+  string Name;
+  LoadProfiler::Sample Start;
+
+public:
+  ProfileScope(LoadProfiler* profiler, const string& name);
+  ~ProfileScope();
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+};
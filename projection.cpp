@@ -0,0 +1,49 @@
+/*projection.cpp*/
+
+//
+// A local planar projection for fast campus-scale distances. See
+// projection.h.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "projection.h"
+
+using namespace std;
+
+
+//
+// the sphere distBetween2Points uses (dist.cpp), so that the plane
+// matches it at the center:
+//
+static const double PI = 3.141592653589;
+static const double METERS_PER_DEGREE = 6371000.0 * PI / 180.0;
+
+
+LocalProjection::LocalProjection(double minLat, double maxLat, double minLon, double maxLon)
+  : Valid(true),
+    Lat0((minLat + maxLat) / 2.0), Lon0((minLon + maxLon) / 2.0),
+    MinLat(minLat), MaxLat(maxLat), MinLon(minLon), MaxLon(maxLon)
+{
+  this->MetersPerDegLat = METERS_PER_DEGREE;
+  this->MetersPerDegLon = METERS_PER_DEGREE * cos(this->Lat0 * PI / 180.0);
+
+  //
+  // along a parallel, the plane is off by the ratio of the length
+  // of a degree of longitude there to its length at the center;
+  // that's largest at the north and south edges. The curvature of
+  // the sphere adds (d / R)^2 / 24 or so, for d the size of the box,
+  // and rounding a little more:
+  //
+  double c0 = cos(this->Lat0 * PI / 180.0);
+  double stretch = max(fabs(cos(minLat * PI / 180.0) / c0 - 1.0),
+    fabs(cos(maxLat * PI / 180.0) / c0 - 1.0));
+
+  double span = hypot((maxLat - minLat) * METERS_PER_DEGREE,
+    (maxLon - minLon) * METERS_PER_DEGREE * max(fabs(cos(minLat * PI / 180.0)), fabs(cos(maxLat * PI / 180.0))));
+  double curvature = (span / 6371000.0) * (span / 6371000.0);
+
+  this->Error = stretch + curvature + 1e-9;
+}
+
@@ -0,0 +1,102 @@
+/*projection.h*/
+
+//
+// A local planar projection: (lat, lon) to meters east and north of
+// the center of a bounding box, scaled as the sphere is at the
+// center's latitude (equirectangular). Over a campus or a city,
+// straight-line distances in the plane are within a small, known
+// fraction of the haversine great-circle distance (dist.h), and
+// they cost a subtraction and a square root instead of trigonometry.
+//
+// The planar distance between two points inside the box is within
+// a factor of (1 +/- getError()) of distBetween2Points; the error
+// comes from a degree of longitude being shorter north of the
+// center and longer south of it. Kernels use planar distances to
+// choose among candidates, or as A* estimates, and haversine for
+// the distances they report, so results are the same as haversine
+// alone would give. Outside the box (see covers) there is no such
+// bound, and they use haversine throughout.
+//
+
+#pragma once
+
+#include <cmath>
+
+using namespace std;
+
+
+class LocalProjection
+{
+private:
+  bool Valid = false;
+  double Lat0 = 0.0, Lon0 = 0.0;         // the center
+  double MetersPerDegLat = 0.0;
+  double MetersPerDegLon = 0.0;
+  double MinLat = 0.0, MaxLat = 0.0;     // where Error holds
+  double MinLon = 0.0, MaxLon = 0.0;
+  double Error = 0.0;
+
+public:
+  static constexpr double MILES_PER_METER = 0.6213711922 / 1000.0;
+
+  //
+  // constructors: the default projects nothing (isValid() is false
+  // and covers() nothing); otherwise the projection is centered on
+  // the given box and good within it.
+  //
+  LocalProjection() = default;
+  LocalProjection(double minLat, double maxLat, double minLon, double maxLon);
+
+  bool isValid() const { return this->Valid; }
+
+  bool covers(double lat, double lon) const
+  {
+    return this->Valid && lat >= this->MinLat && lat <= this->MaxLat
+      && lon >= this->MinLon && lon <= this->MaxLon;
+  }
+
+  //
+  // getBounds
+  //
+  // The box the projection was made for.
+  //
+  void getBounds(double& minLat, double& maxLat, double& minLon, double& maxLon) const
+  {
+    minLat = this->MinLat;
+    maxLat = this->MaxLat;
+    minLon = this->MinLon;
+    maxLon = this->MaxLon;
+  }
+
+  //
+  // project
+  //
+  // (lat, lon) => (x, y) in meters east and north of the center.
+  //
+  void project(double lat, double lon, double& x, double& y) const
+  {
+    x = (lon - this->Lon0) * this->MetersPerDegLon;
+    y = (lat - this->Lat0) * this->MetersPerDegLat;
+  }
+
+  //
+  // getError
+  //
+  // The relative error bound of planar distances between points the
+  // projection covers, e.g. 0.0005 for 0.05%.
+  //
+  double getError() const { return this->Error; }
+};
+
+
+//
+// planarMiles
+//
+// Straight-line distance in miles between two projected points.
+//
+inline double planarMiles(double x1, double y1, double x2, double y2)
+{
+  double dx = x2 - x1, dy = y2 - y1;
+
+  return sqrt(dx * dx + dy * dy) * LocalProjection::MILES_PER_METER;
+}
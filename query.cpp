@@ -0,0 +1,445 @@
+/*query.cpp*/
+
+//
+// Non-interactive queries against a loaded map: parsing a query
+// from one line of text, and running it to produce a QueryResult.
+// Shared by the batch and server front ends.
+//
+
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <ctime>
+
+#include "query.h"
+#include "format.h"
+#include "latency.h"
+
+using namespace std;
+
+
+//
+// # of stops in each direction whose predictions are prefetched
+// around each building a query finds:
+//
+static const int PREFETCH_NEAREST = 3;
+
+
+//
+// trim
+//
+// Returns s without leading and trailing whitespace.
+//
+static string trim(const string& s)
+{
+  size_t first = s.find_first_not_of(" \t\r\n");
+
+  if (first == string::npos)
+    return "";
+
+  size_t last = s.find_last_not_of(" \t\r\n");
+
+  return s.substr(first, last - first + 1);
+}
+
+
+//
+// parseClock
+//
+bool parseClock(const string& s, int& seconds)
+{
+  int h = 0, m = 0, sec = 0;
+  int used = 0, more = 0;
+
+  if (s.empty() || !isdigit((unsigned char) s[0]) || sscanf(s.c_str(), "%d:%d%n", &h, &m, &used) != 2)
+    return false;
+
+  if (s[used] == ':') {
+    if (sscanf(s.c_str() + used, ":%d%n", &sec, &more) != 1)
+      return false;
+    used += more;
+  }
+
+  if ((size_t) used != s.size())   // anything after the time
+    return false;
+
+  if (h < 0 || h > 47 || m < 0 || m > 59 || sec < 0 || sec > 59)
+    return false;
+
+  seconds = h * 3600 + m * 60 + sec;
+  return true;
+}
+
+
+//
+// parseQuery
+//
+bool parseQuery(const string& line, Query& query, string& error)
+{
+  string text = trim(line);
+  size_t space = text.find(' ');
+  string keyword = text.substr(0, space);
+  string rest = (space == string::npos) ? "" : trim(text.substr(space + 1));
+
+  if (keyword == "building")
+  {
+    if (rest.empty()) {
+      error = "building: missing name";
+      return false;
+    }
+
+    query.Type = QueryType::Building;
+    query.Name = rest;
+    return true;
+  }
+  else if (keyword == "nearest")
+  {
+    stringstream ss(rest);
+
+    if (!(ss >> query.Lat >> query.Lon >> query.Direction)) {
+      error = "nearest: expected <lat> <lon> <direction>";
+      return false;
+    }
+
+    query.Type = QueryType::Nearest;
+    return true;
+  }
+  else if (keyword == "predict")
+  {
+    char* end = nullptr;
+    long id = strtol(rest.c_str(), &end, 10);
+
+    if (rest.empty() || *end != '\0') {
+      error = "predict: expected <stopid>";
+      return false;
+    }
+
+    query.Type = QueryType::Predict;
+    query.StopID = (int) id;
+    return true;
+  }
+  else if (keyword == "route")
+  {
+    size_t bar = rest.find('|');
+
+    if (bar == string::npos || trim(rest.substr(0, bar)).empty() || trim(rest.substr(bar + 1)).empty()) {
+      error = "route: expected <from> | <to>";
+      return false;
+    }
+
+    query.Type = QueryType::Route;
+    query.Name = trim(rest.substr(0, bar));
+    query.ToName = trim(rest.substr(bar + 1));
+    return true;
+  }
+  else if (keyword == "transit")
+  {
+    size_t bar = rest.find('|');
+    size_t at = rest.find('@', (bar == string::npos) ? 0 : bar);
+
+    string to = (bar == string::npos) ? "" : trim(rest.substr(bar + 1, (at == string::npos) ? string::npos : at - bar - 1));
+
+    if (bar == string::npos || trim(rest.substr(0, bar)).empty() || to.empty()) {
+      error = "transit: expected <from> | <to> [@ HH:MM]";
+      return false;
+    }
+
+    query.Time = -1;
+
+    if (at != string::npos && !parseClock(trim(rest.substr(at + 1)), query.Time)) {
+      error = "transit: time must be HH:MM";
+      return false;
+    }
+
+    query.Type = QueryType::Transit;
+    query.Name = trim(rest.substr(0, bar));
+    query.ToName = to;
+    return true;
+  }
+
+  error = "unknown query '" + keyword + "'";
+  return false;
+}
+
+
+//
+// shortest
+//
+// The fewest digits that read back as the same double.
+//
+static string shortest(double value)
+{
+  char buf[32];
+
+  for (int digits = 15; digits <= 17; digits++) {
+    snprintf(buf, sizeof(buf), "%.*g", digits, value);
+    if (strtod(buf, nullptr) == value)
+      break;
+  }
+
+  return buf;
+}
+
+
+//
+// queryText
+//
+string queryText(const Query& query)
+{
+  char buf[64];
+
+  switch (query.Type)
+  {
+    case QueryType::Building:
+      return "building " + query.Name;
+
+    case QueryType::Nearest:
+      return "nearest " + shortest(query.Lat) + " " + shortest(query.Lon) + " " + query.Direction;
+
+    case QueryType::Predict:
+      return "predict " + to_string(query.StopID);
+
+    case QueryType::Route:
+      return "route " + query.Name + " | " + query.ToName;
+
+    case QueryType::Transit:
+      if (query.Time < 0)
+        return "transit " + query.Name + " | " + query.ToName;
+
+      snprintf(buf, sizeof(buf), "%02d:%02d:%02d", query.Time / 3600, query.Time / 60 % 60, query.Time % 60);
+      return "transit " + query.Name + " | " + query.ToName + " @ " + buf;
+  }
+
+  return "";
+}
+
+
+//
+// findBuilding
+//
+// Returns the first building whose name contains the given name,
+// failing that the first whose street address does, or nullptr if
+// none.
+//
+static const Building* findBuilding(const MapData& data, const string& name)
+{
+  size_t b = data.buildings.findNamed(name);
+
+  if (b < data.buildings.MapBuildings.size())
+    return &data.buildings.MapBuildings[b];
+
+  for (const Building& B : data.buildings.MapBuildings)
+  {
+    if (B.StreetAddress.find(name) != string::npos)
+      return &B;
+  }
+
+  return nullptr;
+}
+
+
+static void runBuilding(const MapData& data, PredictionSource* predictions, bool withPredictions,
+  QueryResult& result)
+{
+  const Buildings& buildings = data.buildings;
+
+  {
+    LatencyTimer timer(LAT_BUILDING_SEARCH);
+
+    for (size_t b = buildings.findNamed(result.Q.Name); b < buildings.MapBuildings.size();
+         b = buildings.findNamed(result.Q.Name, b + 1))
+    {
+      BuildingResult match;
+      match.B = &buildings.MapBuildings[b];
+      result.Buildings.push_back(match);
+    }
+  }
+
+  bool fetch = withPredictions && predictions != nullptr;
+
+  //
+  // the stops around every match, prefetched before any is fetched,
+  // so one call can bring them together (a no-op unless the source
+  // prefetches, see prefetch.h):
+  //
+  if (fetch)
+  {
+    vector<pair<double, double>> locations;
+
+    for (const BuildingResult& match : result.Buildings)
+      locations.push_back(match.B->getLocation(data.nodes));
+
+    data.busStops.prefetchNear(locations, PREFETCH_NEAREST, predictions);
+  }
+
+  for (BuildingResult& match : result.Buildings)
+    match = match.B->describe(data.nodes, data.busStops, predictions, false);
+
+  //
+  // then the buses due at every match's stops, asked for together so
+  // a source that batches sends one call per route, not per stop:
+  //
+  if (fetch)
+  {
+    vector<StopResult*> wanted;
+    vector<const BusStop*> stops;
+
+    for (BuildingResult& match : result.Buildings)
+      for (StopResult* stop : { &match.Southbound, &match.Northbound })
+        if (stop->Stop != nullptr) {
+          wanted.push_back(stop);
+          stops.push_back(stop->Stop);
+        }
+
+    vector<Arrivals> arrivals = data.busStops.getArrivals(stops, predictions);
+
+    for (size_t i = 0; i < wanted.size(); i++) {
+      wanted[i]->Fetched = true;
+      wanted[i]->Predictions = std::move(arrivals[i]);
+    }
+  }
+}
+
+
+static void runNearest(const MapData& data, QueryResult& result)
+{
+  auto closest = data.busStops.findClosestStop(result.Q.Lat, result.Q.Lon, result.Q.Direction);
+
+  result.Stop.Stop = closest.first;
+  result.Stop.Miles = closest.second;
+}
+
+
+static void runPredict(const MapData& data, PredictionSource* predictions, QueryResult& result)
+{
+  const BusStop* stop = data.busStops.findByID(result.Q.StopID);
+
+  if (stop == nullptr) {
+    result.Error = "no such stop";
+    return;
+  }
+
+  result.Stop.Stop = stop;
+  result.Stop.Fetched = true;
+  result.Stop.Predictions = data.busStops.getArrivals(*stop, predictions);
+}
+
+
+static void runRoute(const MapData& data, QueryResult& result)
+{
+  const Building* from = findBuilding(data, result.Q.Name);
+  const Building* to = findBuilding(data, result.Q.ToName);
+
+  if (from == nullptr || to == nullptr) {
+    result.Error = (from == nullptr) ? "no building matches 'from'" : "no building matches 'to'";
+    return;
+  }
+
+  result.From = from;
+  result.To = to;
+
+  int start = data.graph.vertexForBuilding(*from, data.nodes);
+  int end = data.graph.vertexForBuilding(*to, data.nodes);
+
+  result.Route = data.graph.shortestPath(start, end);
+}
+
+
+static void runTransit(const MapData& data, QueryResult& result)
+{
+  if (data.router == nullptr) {
+    result.Error = "no transit timetable loaded (the stop file is not a GTFS feed)";
+    return;
+  }
+
+  const Building* from = findBuilding(data, result.Q.Name);
+  const Building* to = findBuilding(data, result.Q.ToName);
+
+  if (from == nullptr || to == nullptr) {
+    result.Error = (from == nullptr) ? "no building matches 'from'" : "no building matches 'to'";
+    return;
+  }
+
+  int depart = result.Q.Time;
+
+  if (depart < 0) {
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    depart = local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+  }
+
+  auto start = from->getLocation(data.nodes);
+  auto end = to->getLocation(data.nodes);
+
+  result.From = from;
+  result.To = to;
+  result.Depart = depart;
+  result.Feed = &data.router->getFeed();
+  result.Journeys = data.router->route(start.first, start.second, end.first, end.second, depart);
+}
+
+
+//
+// runQuery
+//
+QueryResult runQuery(const Query& query, const MapData& data, PredictionSource* predictions,
+  bool withPredictions)
+{
+  QueryResult result;
+
+  result.Q = query;
+
+  switch (query.Type)
+  {
+    case QueryType::Building:
+      runBuilding(data, predictions, withPredictions, result);
+      break;
+
+    case QueryType::Nearest:
+      runNearest(data, result);
+      break;
+
+    case QueryType::Predict:
+      runPredict(data, predictions, result);
+      break;
+
+    case QueryType::Route:
+      runRoute(data, result);
+      break;
+
+    case QueryType::Transit:
+      runTransit(data, result);
+      break;
+  }
+
+  return result;
+}
+
+
+void runQuery(const Query& query, const MapData& data, PredictionSource* predictions,
+  bool withPredictions, string& output)
+{
+  thread_local OutputBuffer out;
+
+  formatResult(runQuery(query, data, predictions, withPredictions), OutputFormat::Json, out);
+
+  output += out.view();
+  out.clear();
+}
+
+
+//
+// queryError
+//
+void queryError(const string& line, const string& error, string& output)
+{
+  thread_local OutputBuffer out;
+
+  formatQueryError(line, error, OutputFormat::Json, out);
+
+  output += out.view();
+  out.clear();
+}
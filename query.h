@@ -0,0 +1,131 @@
+/*query.h*/
+
+//
+// Non-interactive queries against a loaded map: parsing a query
+// from one line of text, and running it to produce a QueryResult,
+// which the output layer (see format.h) writes as text, JSON or
+// CSV. Shared by the batch and server front ends.
+//
+// Query syntax, one per line:
+//
+//   building <name>              buildings whose name contains <name>,
+//                                with their nearest bus stops
+//   nearest <lat> <lon> <dir>    nearest bus stop travelling <dir>
+//                                (e.g. Northbound)
+//   predict <stopid>             bus arrival predictions for a stop
+//   route <from> | <to>          walking route between 2 buildings,
+//                                each given by (partial) name
+//   transit <from> | <to> [@ HH:MM]
+//                                fastest journeys by walking and bus
+//                                between 2 buildings, each given by
+//                                (partial) name or street address,
+//                                leaving at HH:MM (default: now);
+//                                needs a GTFS feed as the stop file
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "mapdata.h"
+#include "predictions.h"
+#include "results.h"
+
+using namespace std;
+
+
+enum class QueryType { Building, Nearest, Predict, Route, Transit };
+
+
+//
+// Query
+//
+// A parsed query; which fields are used depends on the type.
+//
+struct Query
+{
+  QueryType Type = QueryType::Building;
+  string Name;        // building: name; route, transit: from
+  string ToName;      // route, transit: to
+  string Direction;   // nearest
+  double Lat = 0.0;   // nearest
+  double Lon = 0.0;
+  int StopID = 0;     // predict
+  int Time = -1;      // transit: seconds after midnight, -1 = now
+};
+
+
+//
+// parseQuery
+//
+// Parses one line of query text. Returns true if successful; if
+// not, error is set to a description of the problem.
+//
+bool parseQuery(const string& line, Query& query, string& error);
+
+//
+// parseClock
+//
+// Parses HH:MM or HH:MM:SS (hours up to 47, for trips past
+// midnight) into seconds after midnight. Returns false if malformed.
+//
+bool parseClock(const string& s, int& seconds);
+
+//
+// queryText
+//
+// The query as one line of query text, which parseQuery reads back
+// as the same query.
+//
+string queryText(const Query& query);
+
+//
+// QueryResult
+//
+// What running a query found; which fields are set depends on the
+// type. Pointers are into the MapData the query ran against, which
+// must outlive the result.
+//
+struct QueryResult
+{
+  Query Q;
+  string Error;                        // set if the query failed
+
+  vector<BuildingResult> Buildings;    // building
+  StopResult Stop;                     // nearest, predict
+
+  const Building* From = nullptr;      // route, transit
+  const Building* To = nullptr;
+  Path Route;                          // route
+
+  int Depart = 0;                      // transit: seconds after midnight
+  vector<TransitRouter::Journey> Journeys;
+  const GtfsFeed* Feed = nullptr;
+};
+
+
+//
+// runQuery
+//
+// Runs the query. Building queries only fetch bus predictions if
+// withPredictions is true and predictions is not nullptr; the
+// source may be shared between threads.
+//
+QueryResult runQuery(const Query& query, const MapData& data, PredictionSource* predictions,
+  bool withPredictions);
+
+//
+// runQuery
+//
+// The same, appending the result to output as a single line of
+// JSON ending in '\n'.
+//
+void runQuery(const Query& query, const MapData& data, PredictionSource* predictions,
+  bool withPredictions, string& output);
+
+//
+// queryError
+//
+// Appends a JSON error line for the given query text to output.
+//
+void queryError(const string& line, const string& error, string& output);
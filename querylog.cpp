@@ -0,0 +1,331 @@
+/*querylog.cpp*/
+
+//
+// Query log: a compact binary log of queries as they were asked,
+// and reading it back. See querylog.h for the format.
+//
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+
+#include "querylog.h"
+
+using namespace std;
+
+
+static const char HEADER[8] = { 'N', 'A', 'V', 'Q', 'L', 'O', 'G', 1 };
+
+static const unsigned char PREDICTIONS_FLAG = 0x80;
+
+
+//
+// encoding:
+//
+static void putVarint(string& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back((char) (value | 0x80));
+    value >>= 7;
+  }
+
+  out.push_back((char) value);
+}
+
+static void putZigzag(string& out, int64_t value)
+{
+  putVarint(out, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static void putString(string& out, const string& s)
+{
+  putVarint(out, s.size());
+  out += s;
+}
+
+static void putDouble(string& out, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  for (int i = 0; i < 8; i++)
+    out.push_back((char) (bits >> (8 * i)));
+}
+
+
+//
+// Decoder
+//
+// Reads the encoding back from [P, End); a read past the end sets
+// Failed, and reads nothing further.
+//
+struct Decoder
+{
+  const unsigned char* P;
+  const unsigned char* End;
+  bool Failed = false;
+
+  Decoder(const unsigned char* p, const unsigned char* end) : P(p), End(end) { }
+
+  uint64_t varint()
+  {
+    uint64_t value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      if (this->P >= this->End)
+        break;
+
+      unsigned char b = *this->P++;
+      value |= (uint64_t) (b & 0x7F) << shift;
+
+      if ((b & 0x80) == 0)
+        return value;
+    }
+
+    this->Failed = true;
+    return 0;
+  }
+
+  int64_t zigzag()
+  {
+    uint64_t v = this->varint();
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+  }
+
+  unsigned char byte()
+  {
+    if (this->P >= this->End) {
+      this->Failed = true;
+      return 0;
+    }
+
+    return *this->P++;
+  }
+
+  string str()
+  {
+    uint64_t n = this->varint();
+
+    if (this->Failed || n > (uint64_t) (this->End - this->P)) {
+      this->Failed = true;
+      return "";
+    }
+
+    string s((const char*) this->P, (size_t) n);
+    this->P += n;
+    return s;
+  }
+
+  double f64()
+  {
+    if (this->End - this->P < 8) {
+      this->Failed = true;
+      return 0.0;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++)
+      bits |= (uint64_t) this->P[i] << (8 * i);
+    this->P += 8;
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+};
+
+
+//
+// QueryLog
+//
+QueryLog::~QueryLog()
+{
+  if (this->File != nullptr)
+    fclose(this->File);
+}
+
+
+bool QueryLog::open(const string& filename, string& error)
+{
+  //
+  // an existing log must be one; a new (or empty) one gets a header:
+  //
+  bool empty = true;
+
+  {
+    ifstream existing(filename, ios::binary);
+    char header[sizeof(HEADER)];
+
+    if (existing && existing.read(header, sizeof(header))) {
+      if (memcmp(header, HEADER, sizeof(HEADER)) != 0) {
+        error = "'" + filename + "' is not a query log";
+        return false;
+      }
+      empty = false;
+    }
+    else if (existing && existing.gcount() > 0) {
+      error = "'" + filename + "' is not a query log";
+      return false;
+    }
+  }
+
+  this->File = fopen(filename.c_str(), "ab");
+
+  if (this->File == nullptr) {
+    error = "unable to open query log '" + filename + "'";
+    return false;
+  }
+
+  if (empty)
+    fwrite(HEADER, 1, sizeof(HEADER), this->File);
+
+  return true;
+}
+
+
+void QueryLog::append(const Query& query, bool withPredictions)
+{
+  if (this->File == nullptr)
+    return;
+
+  int64_t micros = chrono::duration_cast<chrono::microseconds>(
+    chrono::system_clock::now().time_since_epoch()).count();
+
+  string record;
+
+  record.push_back((char) ((unsigned char) query.Type | (withPredictions ? PREDICTIONS_FLAG : 0)));
+  putVarint(record, (uint64_t) micros);
+
+  switch (query.Type)
+  {
+    case QueryType::Building:
+      putString(record, query.Name);
+      break;
+
+    case QueryType::Nearest:
+      putDouble(record, query.Lat);
+      putDouble(record, query.Lon);
+      putString(record, query.Direction);
+      break;
+
+    case QueryType::Predict:
+      putZigzag(record, query.StopID);
+      break;
+
+    case QueryType::Route:
+      putString(record, query.Name);
+      putString(record, query.ToName);
+      break;
+
+    case QueryType::Transit:
+      putString(record, query.Name);
+      putString(record, query.ToName);
+      putZigzag(record, query.Time);
+      break;
+  }
+
+  string length;
+  putVarint(length, record.size());
+
+  lock_guard<mutex> lock(this->Mutex);
+
+  fwrite(length.data(), 1, length.size(), this->File);
+  fwrite(record.data(), 1, record.size(), this->File);
+}
+
+
+void QueryLog::flush()
+{
+  lock_guard<mutex> lock(this->Mutex);
+
+  if (this->File != nullptr)
+    fflush(this->File);
+}
+
+
+//
+// readQueryLog
+//
+bool readQueryLog(const string& filename, vector<LoggedQuery>& queries, string& error)
+{
+  ifstream file(filename, ios::binary);
+
+  if (!file) {
+    error = "unable to open query log '" + filename + "'";
+    return false;
+  }
+
+  stringstream contents;
+  contents << file.rdbuf();
+  string text = contents.str();
+
+  if (text.size() < sizeof(HEADER) || memcmp(text.data(), HEADER, sizeof(HEADER)) != 0) {
+    error = "'" + filename + "' is not a query log";
+    return false;
+  }
+
+  const unsigned char* p = (const unsigned char*) text.data() + sizeof(HEADER);
+  const unsigned char* end = (const unsigned char*) text.data() + text.size();
+
+  while (p < end)
+  {
+    Decoder length(p, end);
+    uint64_t n = length.varint();
+
+    if (length.Failed || n > (uint64_t) (end - length.P))
+      break;   // cut short
+
+    Decoder d(length.P, length.P + n);
+    LoggedQuery logged;
+
+    unsigned char type = d.byte();
+    logged.Predictions = (type & PREDICTIONS_FLAG) != 0;
+    logged.Q.Type = (QueryType) (type & ~PREDICTIONS_FLAG);
+    logged.Micros = (int64_t) d.varint();
+
+    switch (logged.Q.Type)
+    {
+      case QueryType::Building:
+        logged.Q.Name = d.str();
+        break;
+
+      case QueryType::Nearest:
+        logged.Q.Lat = d.f64();
+        logged.Q.Lon = d.f64();
+        logged.Q.Direction = d.str();
+        break;
+
+      case QueryType::Predict:
+        logged.Q.StopID = (int) d.zigzag();
+        break;
+
+      case QueryType::Route:
+        logged.Q.Name = d.str();
+        logged.Q.ToName = d.str();
+        break;
+
+      case QueryType::Transit:
+        logged.Q.Name = d.str();
+        logged.Q.ToName = d.str();
+        logged.Q.Time = (int) d.zigzag();
+        break;
+
+      default:
+        d.Failed = true;   // a type this version doesn't know
+        break;
+    }
+
+    if (!d.Failed)
+      queries.push_back(logged);
+
+    p = length.P + n;
+  }
+
+  return true;
+}
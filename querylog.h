@@ -0,0 +1,114 @@
+/*querylog.h*/
+
+//
+// Query log: queries as they were asked -- at the interactive prompt
+// or of the server -- appended to a compact binary file with the
+// time each was asked, so real workloads can be replayed later
+// (see navreplay, replay.cpp).
+//
+//   QueryLog log;
+//   if (!log.open("queries.qlog", error)) ...
+//   log.append(query, withPredictions);
+//
+//   vector<LoggedQuery> queries;
+//   if (!readQueryLog("queries.qlog", queries, error)) ...
+//
+// The file is an 8-byte header, "NAVQLOG" and a version byte (1),
+// then one record per query:
+//
+//   varint   length of what follows
+//   byte     query type (see QueryType), | 0x80 if predictions were
+//            asked for
+//   varint   microseconds since the Unix epoch
+//   ...      the query's fields, by type:
+//              building   string name
+//              nearest    f64 lat, f64 lon, string direction
+//              predict    zigzag varint stop id
+//              route      string from, string to
+//              transit    string from, string to, zigzag varint
+//                         seconds after midnight (-1 = now)
+//
+// Varints are unsigned LEB128; strings a varint length then bytes;
+// f64 the IEEE bits, little-endian, so coordinates replay exactly.
+// Logs from several runs may be appended to one file. A record cut
+// short (the program was killed mid-write) ends the log; one of a
+// type not known here is skipped.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+
+#include "query.h"
+
+using namespace std;
+
+
+//
+// LoggedQuery
+//
+struct LoggedQuery
+{
+  Query Q;
+  bool Predictions = false;   // were predictions asked for?
+  int64_t Micros = 0;         // when, since the Unix epoch
+};
+
+
+//
+// QueryLog
+//
+// Appends queries to a log file; safe to call from many threads.
+//
+class QueryLog
+{
+private:
+  FILE* File = nullptr;
+  mutex Mutex;
+
+public:
+  QueryLog() = default;
+  ~QueryLog();
+
+  QueryLog(const QueryLog&) = delete;
+  QueryLog& operator=(const QueryLog&) = delete;
+
+  //
+  // open
+  //
+  // Opens the log for appending, starting it if new. Returns false
+  // (with error set) if it can't be opened or isn't a query log.
+  //
+  bool open(const string& filename, string& error);
+
+  bool isOpen() const { return this->File != nullptr; }
+
+  //
+  // append
+  //
+  // Logs the query as asked now. Written through a buffer; see
+  // flush.
+  //
+  void append(const Query& query, bool withPredictions);
+
+  //
+  // flush
+  //
+  // Writes out what's buffered, e.g. after each interactive query,
+  // so the log survives the program being killed.
+  //
+  void flush();
+};
+
+
+//
+// readQueryLog
+//
+// Reads every query in a log, in the order logged. Returns false
+// (with error set) if the file can't be read or isn't a query log.
+//
+bool readQueryLog(const string& filename, vector<LoggedQuery>& queries, string& error);
@@ -0,0 +1,669 @@
+/*raptor.cpp*/
+
+//
+// Schedule-based transit routing over a GTFS feed (RAPTOR); see
+// raptor.h.
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "raptor.h"
+#include "dist.h"
+#include "latency.h"
+
+using namespace std;
+
+
+TransitRouter::TransitRouter(shared_ptr<const GtfsFeed> feed, const Options& options)
+  : Feed(std::move(feed)), Opts(options)
+{
+  this->buildPatterns();
+  this->buildGrid();
+  this->buildTransfers();
+}
+
+
+TransitRouter::TransitRouter(shared_ptr<const GtfsFeed> feed)
+  : TransitRouter(std::move(feed), Options())
+{
+}
+
+
+int TransitRouter::walkSeconds(double miles) const
+{
+  return (int) ceil(miles / this->Opts.WalkMph * 3600.0);
+}
+
+
+//
+// buildPatterns
+//
+// Groups the trips by their sequence of stops, then splits each
+// group so that within a pattern, a later trip is never earlier at
+// any stop than the one before it (the search for the first trip
+// leaving a stop relies on this). Real timetables rarely need the
+// split; an express running the same stops as a local might.
+//
+void TransitRouter::buildPatterns()
+{
+  const GtfsFeed& F = *this->Feed;
+  const int numTrips = F.getNumTrips();
+
+  //
+  // a trip's stops are consecutive in StopTimeStop, so their bytes
+  // serve as the key without copying:
+  //
+  unordered_map<string_view, int> sequenceOf;
+  vector<vector<int>> sequences;
+
+  for (int t = 0; t < numTrips; t++)
+  {
+    uint32_t begin = F.TripStart[t], end = F.TripStart[t + 1];
+
+    if (end - begin < 2)
+      continue;  // nowhere to ride to
+
+    string_view key((const char*) &F.StopTimeStop[begin], (end - begin) * sizeof(int32_t));
+
+    auto result = sequenceOf.try_emplace(key, (int) sequences.size());
+    if (result.second)
+      sequences.emplace_back();
+
+    sequences[result.first->second].push_back(t);
+  }
+
+  this->PatternStopStart.assign(1, 0);
+  this->PatternTripStart.assign(1, 0);
+  this->PatternTimeStart.clear();
+
+  vector<vector<int>> patterns;
+
+  for (vector<int>& trips : sequences)
+  {
+    const uint32_t n = F.TripStart[trips[0] + 1] - F.TripStart[trips[0]];
+
+    auto firstDeparture = [&](int t) { return F.departure(F.TripStart[t]); };
+
+    stable_sort(trips.begin(), trips.end(), [&](int a, int b) {
+      return firstDeparture(a) < firstDeparture(b);
+    });
+
+    //
+    // each trip joins the first pattern whose last trip it doesn't
+    // overtake:
+    //
+    patterns.clear();
+
+    for (int t : trips)
+    {
+      size_t p = 0;
+
+      for ( ; p < patterns.size(); p++)
+      {
+        uint32_t a = F.TripStart[patterns[p].back()], b = F.TripStart[t];
+        bool overtakes = false;
+
+        for (uint32_t i = 0; i < n && !overtakes; i++)
+          overtakes = F.StopTimeArrival[b + i] < F.StopTimeArrival[a + i] || F.departure(b + i) < F.departure(a + i);
+
+        if (!overtakes)
+          break;
+      }
+
+      if (p == patterns.size())
+        patterns.emplace_back();
+
+      patterns[p].push_back(t);
+    }
+
+    for (const vector<int>& pattern : patterns)
+    {
+      const uint32_t first = F.TripStart[pattern[0]];
+
+      this->PatternStops.insert(this->PatternStops.end(), &F.StopTimeStop[first], &F.StopTimeStop[first] + n);
+      this->PatternTrips.insert(this->PatternTrips.end(), pattern.begin(), pattern.end());
+      this->PatternTimeStart.push_back((uint32_t) this->Departure.size());
+
+      for (uint32_t i = 0; i < n; i++)
+        for (int t : pattern)
+          this->Departure.push_back(F.departure(F.TripStart[t] + i));
+
+      this->PatternStopStart.push_back((uint32_t) this->PatternStops.size());
+      this->PatternTripStart.push_back((uint32_t) this->PatternTrips.size());
+    }
+  }
+
+  //
+  // invert: the patterns through each stop, by counting sort:
+  //
+  const int numStops = F.getNumStops();
+  const int numPatterns = this->getNumPatterns();
+
+  this->StopPatternStart.assign(numStops + 1, 0);
+
+  for (int32_t s : this->PatternStops)
+    this->StopPatternStart[s + 1]++;
+
+  for (int s = 0; s < numStops; s++)
+    this->StopPatternStart[s + 1] += this->StopPatternStart[s];
+
+  this->StopPatterns.resize(this->PatternStops.size());
+  this->StopPatternIndex.resize(this->PatternStops.size());
+
+  vector<uint32_t> next(this->StopPatternStart.begin(), this->StopPatternStart.end() - 1);
+
+  for (int p = 0; p < numPatterns; p++)
+  {
+    for (uint32_t r = this->PatternStopStart[p]; r < this->PatternStopStart[p + 1]; r++)
+    {
+      uint32_t slot = next[this->PatternStops[r]]++;
+
+      this->StopPatterns[slot] = p;
+      this->StopPatternIndex[slot] = (int32_t) (r - this->PatternStopStart[p]);
+    }
+  }
+}
+
+
+//
+// buildGrid
+//
+// Buckets the stops served by some pattern into cells roughly
+// MaxTransferMiles square, made larger if the feed is so spread out
+// that the grid would have many more cells than stops.
+//
+void TransitRouter::buildGrid()
+{
+  const GtfsFeed& F = *this->Feed;
+  const int numStops = F.getNumStops();
+
+  vector<int> served;
+
+  for (int s = 0; s < numStops; s++)
+    if (this->StopPatternStart[s + 1] > this->StopPatternStart[s])
+      served.push_back(s);
+
+  this->GridStart.assign(1, 0);
+  this->GridStops.clear();
+  this->GridRows = this->GridCols = 0;
+
+  if (served.empty())
+    return;
+
+  double minLat = fromE7(F.StopLat[served[0]]), maxLat = minLat;
+  double minLon = fromE7(F.StopLon[served[0]]), maxLon = minLon;
+
+  for (int s : served) {
+    minLat = min(minLat, fromE7(F.StopLat[s]));
+    maxLat = max(maxLat, fromE7(F.StopLat[s]));
+    minLon = min(minLon, fromE7(F.StopLon[s]));
+    maxLon = max(maxLon, fromE7(F.StopLon[s]));
+  }
+
+  //
+  // a degree of longitude is shortest at the latitude farthest from
+  // the equator, so use that one: cells are then never narrower
+  // than intended.
+  //
+  double farLat = (fabs(minLat) > fabs(maxLat)) ? minLat : maxLat;
+
+  this->MilesPerDegLat = distBetween2Points(farLat, minLon, farLat + 1.0, minLon);
+  this->MilesPerDegLon = max(1e-6, distBetween2Points(farLat, minLon, farLat, minLon + 1.0));
+
+  double cellMiles = max(this->Opts.MaxTransferMiles, 0.01);
+
+  while (true)
+  {
+    this->CellLat = cellMiles / this->MilesPerDegLat;
+    this->CellLon = cellMiles / this->MilesPerDegLon;
+    this->GridRows = (int) ((maxLat - minLat) / this->CellLat) + 1;
+    this->GridCols = (int) ((maxLon - minLon) / this->CellLon) + 1;
+
+    if ((double) this->GridRows * this->GridCols <= 4.0 * served.size() + 64)
+      break;
+
+    cellMiles *= 2.0;
+  }
+
+  this->GridLat0 = minLat;
+  this->GridLon0 = minLon;
+
+  this->Projection = LocalProjection(minLat, maxLat, minLon, maxLon);
+  this->StopX.assign(F.getNumStops(), 0.0);
+  this->StopY.assign(F.getNumStops(), 0.0);
+
+  for (int s : served)
+    this->Projection.project(fromE7(F.StopLat[s]), fromE7(F.StopLon[s]), this->StopX[s], this->StopY[s]);
+
+  auto cellOf = [&](int s) {
+    int r = (int) ((fromE7(F.StopLat[s]) - minLat) / this->CellLat);
+    int c = (int) ((fromE7(F.StopLon[s]) - minLon) / this->CellLon);
+    return min(r, this->GridRows - 1) * this->GridCols + min(c, this->GridCols - 1);
+  };
+
+  const int numCells = this->GridRows * this->GridCols;
+
+  this->GridStart.assign(numCells + 1, 0);
+
+  for (int s : served)
+    this->GridStart[cellOf(s) + 1]++;
+
+  for (int c = 0; c < numCells; c++)
+    this->GridStart[c + 1] += this->GridStart[c];
+
+  this->GridStops.resize(served.size());
+
+  vector<uint32_t> next(this->GridStart.begin(), this->GridStart.end() - 1);
+
+  for (int s : served)
+    this->GridStops[next[cellOf(s)]++] = s;
+}
+
+
+//
+// nearbyStops
+//
+void TransitRouter::nearbyStops(double lat, double lon, double miles, vector<pair<int, double>>& stops) const
+{
+  if (this->GridRows == 0)
+    return;
+
+  const GtfsFeed& F = *this->Feed;
+
+  int row = (int) floor((lat - this->GridLat0) / this->CellLat);
+  int col = (int) floor((lon - this->GridLon0) / this->CellLon);
+  int dr = (int) ceil(miles / this->MilesPerDegLat / this->CellLat);
+  int dc = (int) ceil(miles / this->MilesPerDegLon / this->CellLon);
+
+  int r0 = max(row - dr, 0), r1 = min(row + dr, this->GridRows - 1);
+  int c0 = max(col - dc, 0), c1 = min(col + dc, this->GridCols - 1);
+
+  //
+  // within the stops' box, a stop more than miles * (1 + error)
+  // away in the plane is more than miles away by haversine too:
+  //
+  bool planar = this->Projection.covers(lat, lon);
+  double x = 0.0, y = 0.0;
+  double limit = miles / LocalProjection::MILES_PER_METER * (1.0 + this->Projection.getError()) + 1e-6;
+
+  if (planar)
+    this->Projection.project(lat, lon, x, y);
+
+  for (int r = r0; r <= r1; r++)
+  {
+    for (int c = c0; c <= c1; c++)
+    {
+      int cell = r * this->GridCols + c;
+
+      for (uint32_t i = this->GridStart[cell]; i < this->GridStart[cell + 1]; i++)
+      {
+        int s = this->GridStops[i];
+
+        if (planar) {
+          double dx = this->StopX[s] - x, dy = this->StopY[s] - y;
+          if (dx * dx + dy * dy > limit * limit)
+            continue;
+        }
+
+        double d = distBetween2Points(lat, lon, fromE7(F.StopLat[s]), fromE7(F.StopLon[s]));
+
+        if (d <= miles)
+          stops.emplace_back(s, d);
+      }
+    }
+  }
+}
+
+
+//
+// buildTransfers
+//
+void TransitRouter::buildTransfers()
+{
+  const GtfsFeed& F = *this->Feed;
+  const int numStops = F.getNumStops();
+
+  this->TransferStart.assign(1, 0);
+  this->TransferStop.clear();
+  this->TransferSeconds.clear();
+
+  vector<pair<int, double>> nearby;
+
+  for (int s = 0; s < numStops; s++)
+  {
+    if (this->StopPatternStart[s + 1] > this->StopPatternStart[s])
+    {
+      nearby.clear();
+      this->nearbyStops(fromE7(F.StopLat[s]), fromE7(F.StopLon[s]), this->Opts.MaxTransferMiles, nearby);
+
+      for (const auto& n : nearby)
+      {
+        if (n.first == s)
+          continue;
+
+        this->TransferStop.push_back(n.first);
+        this->TransferSeconds.push_back(this->walkSeconds(n.second));
+      }
+    }
+
+    this->TransferStart.push_back((uint32_t) this->TransferStop.size());
+  }
+}
+
+
+//
+// getMemoryBytes
+//
+size_t TransitRouter::getMemoryBytes() const
+{
+  size_t bytes = 0;
+
+  for (const vector<uint32_t>* v : { &this->PatternStopStart, &this->PatternTripStart, &this->PatternTimeStart,
+    &this->StopPatternStart, &this->TransferStart, &this->GridStart })
+    bytes += v->capacity() * sizeof(uint32_t);
+
+  for (const vector<int32_t>* v : { &this->PatternStops, &this->PatternTrips, &this->Departure,
+    &this->StopPatterns, &this->StopPatternIndex, &this->TransferStop, &this->TransferSeconds, &this->GridStops })
+    bytes += v->capacity() * sizeof(int32_t);
+
+  bytes += (this->StopX.capacity() + this->StopY.capacity()) * sizeof(double);
+
+  return bytes;
+}
+
+
+//
+// Label
+//
+// How the earliest arrival at a stop in a round was reached: by bus
+// from the stop where it was boarded, or on foot from a stop reached
+// by bus in the same round. Labels are only read where Kind says
+// they were written, so they need no initialization.
+//
+namespace {
+
+enum LabelKind : uint8_t { NOT_REACHED, ACCESS, RIDE, TRANSFER };
+
+struct Label
+{
+  int32_t Stop;      // boarded at (ride) or walked from (transfer)
+  int32_t Trip;      // ride only
+  int32_t Depart;
+  int32_t Arrive;
+};
+
+}
+
+
+//
+// route
+//
+vector<TransitRouter::Journey> TransitRouter::route(double fromLat, double fromLon,
+  double toLat, double toLon, int depart) const
+{
+  LatencyTimer timer(LAT_TRANSIT);
+  const GtfsFeed& F = *this->Feed;
+  const int32_t INF = INT32_MAX;
+  const size_t S = (size_t) F.getNumStops();
+  const int rounds = this->Opts.MaxRides + 1;
+
+  vector<Journey> journeys;
+
+  //
+  // walking the whole way is always an answer, and every journey by
+  // bus must beat it:
+  //
+  double walkMiles = distBetween2Points(fromLat, fromLon, toLat, toLon);
+  int bound = depart + this->walkSeconds(walkMiles);
+
+  journeys.push_back({ depart, bound, 0, { { true, -1, -1, -1, depart, bound, walkMiles } } });
+
+  vector<pair<int, double>> access, egress;
+
+  this->nearbyStops(fromLat, fromLon, this->Opts.MaxAccessMiles, access);
+  this->nearbyStops(toLat, toLon, this->Opts.MaxAccessMiles, egress);
+
+  if (access.empty() || egress.empty())
+    return journeys;
+
+  vector<int> egressSeconds(egress.size());
+
+  for (size_t e = 0; e < egress.size(); e++)
+    egressSeconds[e] = this->walkSeconds(egress[e].second);
+
+  //
+  // per round k: Arrival[k * S + s] is the earliest arrival at stop s
+  // with k buses, if it improved on every earlier round:
+  //
+  vector<int32_t> arrival(rounds * S, INF);
+  vector<int32_t> best(S, INF);
+  vector<uint8_t> kind(rounds * S, NOT_REACHED);
+  unique_ptr<Label[]> rides(new Label[rounds * S]);
+  unique_ptr<Label[]> walks(new Label[rounds * S]);
+
+  vector<char> marked(S, 0);
+  vector<int> markedStops;
+
+  const int numPatterns = this->getNumPatterns();
+  vector<int> queueIndex(numPatterns, INT_MAX);
+  vector<int> queued;
+
+  //
+  // round 0: walk to the stops near the start
+  //
+  for (const auto& a : access)
+  {
+    int s = a.first;
+    int t = depart + this->walkSeconds(a.second);
+
+    if (t < arrival[s]) {
+      arrival[s] = best[s] = t;
+      kind[s] = ACCESS;
+      walks[s] = { -1, -1, depart, t };
+
+      if (!marked[s]) {
+        marked[s] = 1;
+        markedStops.push_back(s);
+      }
+    }
+  }
+
+  for (int k = 1; k < rounds && !markedStops.empty(); k++)
+  {
+    const int32_t* prev = &arrival[(k - 1) * S];
+    int32_t* cur = &arrival[k * S];
+    const size_t base = k * S;
+
+    //
+    // queue each pattern through a marked stop, from the earliest
+    // such stop along it:
+    //
+    for (int s : markedStops)
+    {
+      marked[s] = 0;
+
+      for (uint32_t r = this->StopPatternStart[s]; r < this->StopPatternStart[s + 1]; r++)
+      {
+        int p = this->StopPatterns[r];
+
+        if (queueIndex[p] == INT_MAX)
+          queued.push_back(p);
+
+        queueIndex[p] = min(queueIndex[p], (int) this->StopPatternIndex[r]);
+      }
+    }
+
+    markedStops.clear();
+
+    //
+    // ride each queued pattern: stay on the current trip, and switch
+    // to an earlier one wherever last round got us to a stop in time
+    // to catch it:
+    //
+    for (int p : queued)
+    {
+      const int first = queueIndex[p];
+      queueIndex[p] = INT_MAX;
+
+      const int32_t* stops = &this->PatternStops[this->PatternStopStart[p]];
+      const int n = (int) (this->PatternStopStart[p + 1] - this->PatternStopStart[p]);
+      const int32_t* trips = &this->PatternTrips[this->PatternTripStart[p]];
+      const int numTrips = (int) (this->PatternTripStart[p + 1] - this->PatternTripStart[p]);
+      const int32_t* departures = &this->Departure[this->PatternTimeStart[p]];
+
+      int trip = -1;                        // within the pattern
+      const int32_t* tripArrival = nullptr;
+      int boardStop = -1, boardTime = 0;
+
+      for (int i = first; i < n; i++)
+      {
+        const int s = stops[i];
+
+        if (trip >= 0)
+        {
+          int32_t a = tripArrival[i];
+
+          if (a < best[s] && a < bound)
+          {
+            cur[s] = best[s] = a;
+            kind[base + s] = RIDE;
+            rides[base + s] = { boardStop, trips[trip], boardTime, a };
+
+            if (!marked[s]) {
+              marked[s] = 1;
+              markedStops.push_back(s);
+            }
+          }
+        }
+
+        const int32_t ready = prev[s];
+        const int32_t* leaving = departures + (size_t) i * numTrips;
+
+        if (ready != INF && (trip < 0 || ready <= leaving[trip]))
+        {
+          int limit = (trip < 0) ? numTrips : trip + 1;
+          int j = (int) (lower_bound(leaving, leaving + limit, ready) - leaving);
+
+          if (j < limit) {
+            trip = j;
+            tripArrival = &F.StopTimeArrival[F.TripStart[trips[j]]];
+            boardStop = s;
+            boardTime = leaving[j];
+          }
+        }
+      }
+    }
+
+    queued.clear();
+
+    //
+    // walk from the stops reached by bus to nearby stops (only from
+    // those: two walks in a row are never needed):
+    //
+    const size_t ridden = markedStops.size();
+
+    for (size_t m = 0; m < ridden; m++)
+    {
+      const int s = markedStops[m];
+      const int32_t a = rides[base + s].Arrive;
+
+      for (uint32_t r = this->TransferStart[s]; r < this->TransferStart[s + 1]; r++)
+      {
+        const int t = this->TransferStop[r];
+        const int32_t w = a + this->TransferSeconds[r];
+
+        if (w < best[t] && w < bound)
+        {
+          cur[t] = best[t] = w;
+          kind[base + t] = TRANSFER;
+          walks[base + t] = { s, -1, a, w };
+
+          if (!marked[t]) {
+            marked[t] = 1;
+            markedStops.push_back(t);
+          }
+        }
+      }
+    }
+
+    //
+    // does k buses beat every journey with fewer?
+    //
+    int arrive = INF;
+    size_t via = 0;
+
+    for (size_t e = 0; e < egress.size(); e++)
+    {
+      int s = egress[e].first;
+
+      if (cur[s] != INF && cur[s] + egressSeconds[e] < arrive) {
+        arrive = cur[s] + egressSeconds[e];
+        via = e;
+      }
+    }
+
+    if (arrive >= bound)
+      continue;
+
+    bound = arrive;
+
+    //
+    // yes: trace it back from the destination
+    //
+    Journey J;
+    J.Rides = k;
+    J.Arrive = arrive;
+
+    int s = egress[via].first;
+    J.Legs.push_back({ true, s, -1, -1, cur[s], arrive, egress[via].second });
+
+    for (int round = k; ; )
+    {
+      size_t at = round * S + s;
+
+      if (kind[at] == ACCESS)
+      {
+        //
+        // leave as late as still catches the first bus:
+        //
+        int walk = walks[at].Arrive - walks[at].Depart;
+        int leave = J.Legs.back().Depart - walk;
+        double miles = distBetween2Points(fromLat, fromLon, fromE7(F.StopLat[s]), fromE7(F.StopLon[s]));
+
+        J.Legs.push_back({ true, -1, s, -1, leave, leave + walk, miles });
+        break;
+      }
+
+      if (kind[at] == TRANSFER)
+      {
+        const Label& w = walks[at];
+        double miles = distBetween2Points(fromE7(F.StopLat[w.Stop]), fromE7(F.StopLon[w.Stop]),
+          fromE7(F.StopLat[s]), fromE7(F.StopLon[s]));
+
+        J.Legs.push_back({ true, w.Stop, s, -1, w.Depart, w.Arrive, miles });
+        s = w.Stop;
+        at = round * S + s;
+      }
+
+      const Label& r = rides[at];
+
+      J.Legs.push_back({ false, r.Stop, s, r.Trip, r.Depart, r.Arrive, 0.0 });
+      s = r.Stop;
+      round--;
+    }
+
+    reverse(J.Legs.begin(), J.Legs.end());
+    J.Depart = J.Legs.front().Depart;
+
+    journeys.push_back(std::move(J));
+  }
+
+  return journeys;
+}
@@ -0,0 +1,190 @@
+/*raptor.h*/
+
+//
+// Schedule-based transit routing over a GTFS feed: the fastest ways
+// to get from one place to another by walking and riding buses,
+// leaving at a given time.
+//
+// The router uses RAPTOR (Round-bAsed Public Transit Optimized
+// Router). Round k finds the earliest arrival at every stop using
+// at most k buses: each round scans, stop by stop, only the routes
+// serving stops whose arrival improved in the previous round, then
+// relaxes short walks between nearby stops. There is no priority
+// queue and no graph of timetable events; the timetable is read in
+// the order it is laid out in memory. Stopping after each round
+// gives the Pareto-optimal journeys -- the earliest arrival with 1
+// bus, the earliest with 2 buses if that is sooner, and so on --
+// for the cost of one query.
+//
+// Walking is "as the crow flies" (distBetween2Points) at a fixed
+// speed: from the start to stops within a short walk, between stops
+// within a shorter walk (transfers, precomputed), and from stops to
+// the destination. Walking the whole way is always one of the
+// answers.
+//
+// Every trip in the feed is assumed to run; calendar.txt is not
+// consulted, so a feed with weekday and weekend services should be
+// filtered to one day first.
+//
+// References:
+//
+// Delling, Pajor and Werneck, "Round-Based Public Transit Routing",
+// Transportation Science 49(3), 2015:
+//   https://www.microsoft.com/en-us/research/publication/round-based-public-transit-routing/
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "gtfs.h"
+#include "projection.h"
+
+using namespace std;
+
+
+//
+// TransitRouter
+//
+// Built once from a feed, after which any number of threads may call
+// route() at the same time; each call allocates its own scratch
+// space.
+//
+class TransitRouter
+{
+public:
+  struct Options
+  {
+    double WalkMph = 3.0;            // walking speed
+    double MaxAccessMiles = 0.5;     // start -> first stop, last stop -> end
+    double MaxTransferMiles = 0.25;  // stop -> stop, when changing buses
+    int MaxRides = 5;                // buses per journey
+  };
+
+  //
+  // Leg
+  //
+  // One part of a journey. For a walk, FromStop is -1 if the walk
+  // begins at the start, and ToStop is -1 if it ends at the
+  // destination; Trip is -1. Stops and trips are feed indices.
+  //
+  struct Leg
+  {
+    bool Walk;
+    int FromStop;
+    int ToStop;
+    int Trip;
+    int Depart;      // seconds after midnight
+    int Arrive;
+    double Miles;    // walks only
+  };
+
+  struct Journey
+  {
+    int Depart;      // leaving the start
+    int Arrive;      // reaching the destination
+    int Rides;       // buses taken; transfers = Rides - 1
+    vector<Leg> Legs;
+  };
+
+private:
+  shared_ptr<const GtfsFeed> Feed;
+  Options Opts;
+
+  //
+  // patterns: trips that visit exactly the same stops in the same
+  // order, sorted so that no trip overtakes an earlier one. The
+  // stops of pattern p are PatternStops[PatternStopStart[p] ...] and
+  // its trips PatternTrips[PatternTripStart[p] ...]. Departures are
+  // stored stop by stop, so the search for the first trip leaving a
+  // stop reads consecutive memory: the j'th trip leaves the i'th
+  // stop at Departure[PatternTimeStart[p] + i * (# of trips) + j].
+  // Arrivals are read from the feed, where each trip's are
+  // consecutive:
+  //
+  vector<uint32_t> PatternStopStart;
+  vector<int32_t> PatternStops;
+  vector<uint32_t> PatternTripStart;
+  vector<int32_t> PatternTrips;
+  vector<uint32_t> PatternTimeStart;
+  vector<int32_t> Departure;
+
+  //
+  // the patterns through each stop, and the stop's position in each:
+  //
+  vector<uint32_t> StopPatternStart;
+  vector<int32_t> StopPatterns;
+  vector<int32_t> StopPatternIndex;
+
+  //
+  // walking transfers from each stop, with the time they take:
+  //
+  vector<uint32_t> TransferStart;
+  vector<int32_t> TransferStop;
+  vector<int32_t> TransferSeconds;
+
+  //
+  // a grid of cells MaxTransferMiles on a side, for finding the
+  // stops near a point:
+  //
+  double GridLat0 = 0.0, GridLon0 = 0.0;
+  double CellLat = 1.0, CellLon = 1.0;
+  double MilesPerDegLat = 1.0, MilesPerDegLon = 1.0;
+  int GridRows = 0, GridCols = 0;
+  vector<uint32_t> GridStart;
+  vector<int32_t> GridStops;
+
+  //
+  // the served stops' positions in a plane around them (see
+  // projection.h), to rule out stops too far away without haversine:
+  //
+  LocalProjection Projection;
+  vector<double> StopX;
+  vector<double> StopY;
+
+  void buildPatterns();
+  void buildGrid();
+  void buildTransfers();
+
+  int walkSeconds(double miles) const;
+
+public:
+  TransitRouter(shared_ptr<const GtfsFeed> feed, const Options& options);
+  explicit TransitRouter(shared_ptr<const GtfsFeed> feed);
+
+  //
+  // route
+  //
+  // Returns the Pareto-optimal journeys from (fromLat, fromLon) to
+  // (toLat, toLon) leaving no earlier than depart (seconds after
+  // midnight): walking, then each number of buses that arrives
+  // sooner than all journeys with fewer, in order of increasing
+  // buses (and so decreasing arrival time). Never empty.
+  //
+  vector<Journey> route(double fromLat, double fromLon, double toLat, double toLon, int depart) const;
+
+  //
+  // nearbyStops
+  //
+  // Appends (stop, miles) for each stop within the given distance of
+  // the point.
+  //
+  void nearbyStops(double lat, double lon, double miles, vector<pair<int, double>>& stops) const;
+
+  //
+  // accessors / getters
+  //
+  const GtfsFeed& getFeed() const { return *this->Feed; }
+  int getNumPatterns() const { return (int) this->PatternStopStart.size() - 1; }
+  long long getNumTransfers() const { return (long long) this->TransferStop.size(); }
+
+  //
+  // getMemoryBytes
+  //
+  // Approximate bytes held by the router's tables (not the feed's).
+  //
+  size_t getMemoryBytes() const;
+};
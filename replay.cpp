@@ -0,0 +1,272 @@
+/*replay.cpp*/
+
+//
+// Replays a query log (see querylog.h) against a loaded map: each
+// query logged is run again as the navigator runs it (see query.h),
+// at the pace it was asked or flat out. Reports throughput, the
+// latency distribution of each type of query, and that of the
+// searches within them (see latency.h).
+//
+// Usage:
+//
+//   navreplay mapfile stopfile logfile [--pace original|fast]
+//       [--speed X] [--max-gap S] [--threads N]
+//       [--prediction-source spec] [--output filename]
+//   navreplay --print logfile
+//
+// Flat out (the default), queries run back-to-back on --threads
+// threads, and each one's latency is the time it took. At the
+// original pace, each query is due as long after the one before as
+// it was asked, divided by --speed, with gaps longer than --max-gap
+// seconds (default 10; e.g. between runs logged to the same file)
+// cut short. Its latency is measured from when it was due, so a
+// query held up behind a slow one counts the wait. One thread keeps
+// time, and the other N - 1 run the queries (with one thread, it
+// does both).
+//
+// Predictions are fetched for the queries that asked for them, and
+// only given a source; replaying a recording (see predictions.h)
+// makes a replay repeatable end to end. A transit query asked for
+// "now" leaves at the time of day it was asked. A checksum of the
+// results is printed to compare runs by, and --output writes the
+// results themselves, a line of JSON per query in log order.
+//
+// --print writes the log as query text (see query.h), a query per
+// line, which batch mode reads (see batch.h).
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "mapdata.h"
+#include "query.h"
+#include "querylog.h"
+#include "predictions.h"
+#include "latency.h"
+#include "histogram.h"
+#include "taskpool.h"
+
+using namespace std;
+
+
+static const char* QueryTypeNames[] = { "building", "nearest", "predict", "route", "transit" };
+static const int NUM_QUERY_TYPES = 5;
+
+
+//
+// resolveNow
+//
+// A transit query asked for "now" leaves at the time of day it was
+// asked instead.
+//
+static void resolveNow(LoggedQuery& logged)
+{
+  if (logged.Q.Type != QueryType::Transit || logged.Q.Time >= 0)
+    return;
+
+  time_t when = (time_t) (logged.Micros / 1000000);
+  struct tm local;
+  localtime_r(&when, &local);
+
+  logged.Q.Time = local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+}
+
+
+//
+// fnv1a
+//
+// 64-bit FNV-1a hash of text, continuing from hash.
+//
+static uint64_t fnv1a(const string& text, uint64_t hash = 14695981039346656037ULL)
+{
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+
+int main(int argc, char* argv[])
+{
+  vector<string> positional;
+  bool fast = true;
+  bool print = false;
+  double speed = 1.0;
+  double maxGap = 10.0;
+  int threads = 1;
+  string predictionSpec;
+  string outputFilename;
+  bool usage = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+
+    if (arg == "--pace" && i + 1 < argc && (string(argv[i + 1]) == "original" || string(argv[i + 1]) == "fast"))
+      fast = string(argv[++i]) == "fast";
+    else if (arg == "--speed" && i + 1 < argc && atof(argv[i + 1]) > 0.0)
+      speed = atof(argv[++i]);
+    else if (arg == "--max-gap" && i + 1 < argc)
+      maxGap = max(0.0, atof(argv[++i]));
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = max(1, atoi(argv[++i]));
+    else if (arg == "--prediction-source" && i + 1 < argc)
+      predictionSpec = argv[++i];
+    else if (arg == "--output" && i + 1 < argc)
+      outputFilename = argv[++i];
+    else if (arg == "--print")
+      print = true;
+    else if (arg.compare(0, 2, "--") != 0)
+      positional.push_back(arg);
+    else
+      usage = true;
+  }
+
+  if (usage || positional.size() != (print ? 1u : 3u)) {
+    cerr << "usage: navreplay mapfile stopfile logfile [--pace original|fast] [--speed X] [--max-gap S]" << endl;
+    cerr << "         [--threads N] [--prediction-source spec] [--output filename]" << endl;
+    cerr << "       navreplay --print logfile" << endl;
+    return 1;
+  }
+
+  vector<LoggedQuery> queries;
+  string error;
+
+  if (!readQueryLog(positional.back(), queries, error)) {
+    cerr << "**ERROR: " << error << endl;
+    return 1;
+  }
+
+  if (print) {
+    for (const LoggedQuery& logged : queries)
+      cout << queryText(logged.Q) << '\n';
+    return 0;
+  }
+
+  unique_ptr<PredictionSource> predictions;
+
+  if (!predictionSpec.empty()) {
+    predictions = makePredictionSource(predictionSpec, error);
+
+    if (predictions == nullptr) {
+      cerr << "**ERROR: " << error << endl;
+      return 1;
+    }
+  }
+
+  TaskPool::setSharedThreads(threads);
+
+  MapData data;
+  LoadOptions load;
+  load.Report = &cerr;
+
+  if (!loadMapData(positional[0], positional[1], data, load))
+    return 1;
+
+  for (LoggedQuery& logged : queries)
+    resolveNow(logged);
+
+  //
+  // when each query is due, at the original pace (microseconds
+  // after the first):
+  //
+  vector<double> due(queries.size(), 0.0);
+
+  for (size_t i = 1; i < queries.size(); i++) {
+    double gap = (double) (queries[i].Micros - queries[i - 1].Micros);
+    due[i] = due[i - 1] + min(max(gap, 0.0), maxGap * 1e6) / speed;
+  }
+
+  vector<unique_ptr<LatencyHistogram>> byType;
+  for (int t = 0; t <= NUM_QUERY_TYPES; t++)   // and all
+    byType.push_back(make_unique<LatencyHistogram>());
+
+  vector<string> results(queries.size());
+
+  auto run = [&](size_t i, chrono::steady_clock::time_point from) {
+    const LoggedQuery& logged = queries[i];
+
+    runQuery(logged.Q, data, predictions.get(), logged.Predictions && predictions != nullptr, results[i]);
+
+    uint64_t nanos = (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - from).count();
+
+    byType[(int) logged.Q.Type]->record(nanos);
+    byType[NUM_QUERY_TYPES]->record(nanos);
+  };
+
+  cerr << "replaying " << queries.size() << " queries " << (fast ? "flat out" : "at the original pace")
+    << " on " << threads << (threads == 1 ? " thread" : " threads") << "..." << endl;
+
+  auto start = chrono::steady_clock::now();
+
+  if (fast && threads == 1) {
+    for (size_t i = 0; i < queries.size(); i++)
+      run(i, chrono::steady_clock::now());
+  }
+  else if (fast) {
+    TaskPool::shared().parallelFor(0, queries.size(), 1, [&](size_t lo, size_t hi) {
+      for (size_t i = lo; i < hi; i++)
+        run(i, chrono::steady_clock::now());
+    });
+  }
+  else {
+    TaskGroup group(TaskPool::shared());
+
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+      auto when = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, micro>(due[i]));
+
+      this_thread::sleep_until(when);
+
+      if (threads == 1)
+        run(i, when);
+      else
+        group.run([&run, i, when]() { run(i, when); });
+    }
+
+    group.wait();
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  uint64_t checksum = fnv1a("");
+  for (const string& result : results)
+    checksum = fnv1a(result, checksum);
+
+  if (!outputFilename.empty()) {
+    ofstream out(outputFilename, ios::binary);
+
+    for (const string& result : results)
+      out << result;
+
+    if (!out)
+      cerr << "**ERROR: unable to write '" << outputFilename << "'" << endl;
+  }
+
+  char line[128];
+  snprintf(line, sizeof(line), "queries: %zu in %.3f s (%.1f queries/s)", queries.size(), seconds,
+    (seconds > 0.0) ? queries.size() / seconds : 0.0);
+  cout << line << endl;
+  snprintf(line, sizeof(line), "results checksum: %016llx", (unsigned long long) checksum);
+  cout << line << endl;
+
+  vector<pair<string, const LatencyHistogram*>> rows;
+  for (int t = 0; t < NUM_QUERY_TYPES; t++)
+    rows.push_back({ QueryTypeNames[t], byType[t].get() });
+  rows.push_back({ "all", byType[NUM_QUERY_TYPES].get() });
+
+  printLatencyTable(cout, fast ? "latency by query type (us):" : "latency by query type, from when due (us):", rows);
+  latencyReport(cout);
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*results.h*/
+
+//
+// What a building search finds, as data: the building, the nearest
+// bus stop each way and how far it is, and the buses due there. The
+// output layer (see format.h) turns results into text for the
+// console, JSON or CSV; nothing here prints.
+//
+// Results point into the map and bus stops they came from, which
+// must outlive them.
+//
+
+#pragma once
+
+#include "busstop.h"
+#include "busstops.h"
+
+using namespace std;
+
+
+class Building;
+
+
+//
+// StopResult
+//
+// A bus stop found for a query, and -- if they were asked for --
+// the buses due there.
+//
+struct StopResult
+{
+  const BusStop* Stop = nullptr;   // nullptr if there's none
+  double Miles = 0.0;
+  bool Fetched = false;            // were predictions asked for?
+  Arrivals Predictions;
+};
+
+
+//
+// BuildingResult
+//
+struct BuildingResult
+{
+  const Building* B = nullptr;
+  double Lat = 0.0;
+  double Lon = 0.0;
+  StopResult Southbound;           // the nearest each way
+  StopResult Northbound;
+};
@@ -0,0 +1,385 @@
+/*scheduler.cpp*/
+
+//
+// Calls to the bus tracker, rate limited, prioritized, batched and
+// backed off. See scheduler.h.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+#include "scheduler.h"
+
+using namespace std;
+
+
+//
+// the quota is counted over this long:
+//
+static const chrono::hours QUOTA_PERIOD(24);
+
+
+template <typename Duration>
+static Duration seconds(double s)
+{
+  return chrono::duration_cast<Duration>(chrono::duration<double>(s));
+}
+
+
+PredictionScheduler::PredictionScheduler(unique_ptr<PredictionSource> inner, const Options& options)
+  : Inner(std::move(inner)), Opts(options), Tokens(max(options.Burst, 1))
+{
+  this->Refilled = this->Resume = this->DayStarted = Clock::now();
+
+  for (int i = 0; i < max(1, this->Opts.Dispatchers); i++)
+    this->Dispatchers.push_back(thread(&PredictionScheduler::dispatchLoop, this));
+}
+
+
+PredictionScheduler::PredictionScheduler(unique_ptr<PredictionSource> inner)
+  : PredictionScheduler(std::move(inner), Options())
+{
+}
+
+
+PredictionScheduler::~PredictionScheduler()
+{
+  {
+    lock_guard<mutex> lock(this->Mutex);
+    this->Stopping = true;
+  }
+  this->Wake.notify_all();
+
+  for (thread& t : this->Dispatchers)
+    t.join();
+}
+
+
+int PredictionScheduler::getMaxBatch() const
+{
+  return max(1, min(this->Opts.MaxBatch, this->Inner->getMaxBatch()));
+}
+
+
+//
+// finish
+//
+// Hands a request its reply; the caller holds the lock, and notifies
+// Finished.
+//
+void PredictionScheduler::finish(Request* r, bool ok, const string& response)
+{
+  r->Done = true;
+  r->OK = ok;
+
+  if (ok)
+    r->Response = response;
+}
+
+
+//
+// expire
+//
+// Fails the users' requests that have waited too long, and returns
+// when the next of the rest will have; the caller holds the lock.
+//
+PredictionScheduler::Clock::time_point PredictionScheduler::expire(Clock::time_point now)
+{
+  Clock::time_point next = Clock::time_point::max();
+  deque<Request*>& queue = this->Queues[(int) Priority::Interactive];
+  bool expired = false;
+
+  for (auto it = queue.begin(); it != queue.end(); )
+  {
+    if ((*it)->Deadline <= now) {
+      this->finish(*it, false, "");
+      this->Counts.TimedOut++;
+      expired = true;
+      it = queue.erase(it);
+    }
+    else {
+      next = min(next, (*it)->Deadline);
+      ++it;
+    }
+  }
+
+  if (expired)
+    this->Finished.notify_all();
+
+  return next;
+}
+
+
+//
+// takeBatch
+//
+// Takes the next call's requests off the queues: the first request
+// waiting, and every other one for the same route, users' first, up
+// to getMaxBatch() distinct stops. The caller holds the lock.
+//
+void PredictionScheduler::takeBatch(vector<Request*>& batch, vector<int>& stops, bool& interactive)
+{
+  int first = this->Queues[(int) Priority::Interactive].empty() ? (int) Priority::Background : (int) Priority::Interactive;
+  int route = this->Queues[first].front()->Route;
+  size_t most = (size_t) this->getMaxBatch();
+
+  interactive = (first == (int) Priority::Interactive);
+
+  for (int q = first; q < 2; q++)
+  {
+    deque<Request*>& queue = this->Queues[q];
+
+    for (auto it = queue.begin(); it != queue.end(); )
+    {
+      Request* r = *it;
+      bool known = find(stops.begin(), stops.end(), r->StopID) != stops.end();
+
+      if (r->Route == route && (known || stops.size() < most)) {
+        if (!known)
+          stops.push_back(r->StopID);
+        batch.push_back(r);
+        it = queue.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+}
+
+
+//
+// dispatchLoop
+//
+void PredictionScheduler::dispatchLoop()
+{
+  unique_lock<mutex> lock(this->Mutex);
+  bool heldBack = false;
+
+  while (true)
+  {
+    Clock::time_point now = Clock::now();
+    Clock::time_point deadline = this->expire(now);
+
+    if (this->Stopping)
+      break;
+
+    if (this->Queues[0].empty() && this->Queues[1].empty()) {
+      this->Wake.wait(lock);
+      continue;
+    }
+
+    //
+    // daily quota:
+    //
+    if (now - this->DayStarted >= QUOTA_PERIOD) {
+      this->DayStarted = now;
+      this->CallsToday = 0;
+    }
+
+    if (this->Opts.DailyQuota > 0 && this->CallsToday >= this->Opts.DailyQuota)
+    {
+      for (deque<Request*>& queue : this->Queues) {
+        for (Request* r : queue) {
+          this->finish(r, false, "");
+          this->Counts.OverQuota++;
+        }
+        queue.clear();
+      }
+
+      this->Finished.notify_all();
+      continue;
+    }
+
+    //
+    // rate limit, and backoff:
+    //
+    double rate = max(this->Opts.RequestsPerSecond, 0.001);
+
+    this->Tokens = min((double) max(this->Opts.Burst, 1),
+      this->Tokens + chrono::duration<double>(now - this->Refilled).count() * rate);
+    this->Refilled = now;
+
+    Clock::time_point ready = this->Resume;
+
+    if (this->Tokens < 1.0) {
+      ready = max(ready, now + seconds<Clock::duration>((1.0 - this->Tokens) / rate));
+      heldBack = true;
+    }
+
+    if (ready > now) {
+      this->Wake.wait_until(lock, min(ready, deadline));
+      continue;
+    }
+
+    this->Tokens -= 1.0;
+    this->CallsToday++;
+    this->Counts.Calls++;
+
+    if (heldBack) {
+      this->Counts.Throttled++;
+      heldBack = false;
+    }
+
+    vector<Request*> batch;
+    vector<int> stops;
+    bool interactive;
+
+    this->takeBatch(batch, stops, interactive);
+
+    if (stops.size() > 1)
+      this->Counts.Batched += stops.size();
+
+    int route = batch[0]->Route;
+
+    lock.unlock();
+
+    vector<string> responses;
+    vector<bool> ok;
+
+    this->Inner->fetchMany(route, stops, responses, ok, interactive ? Priority::Interactive : Priority::Background);
+
+    lock.lock();
+
+    bool answered = false;
+
+    for (Request* r : batch) {
+      size_t i = find(stops.begin(), stops.end(), r->StopID) - stops.begin();
+      this->finish(r, ok[i], responses[i]);
+      answered = answered || ok[i];
+    }
+
+    if (answered)
+      this->Backoff = 0.0;
+    else {
+      this->Counts.Failures++;
+      this->Backoff = (this->Backoff == 0.0) ? this->Opts.BackoffSeconds
+        : min(2 * this->Backoff, this->Opts.MaxBackoffSeconds);
+      this->Resume = Clock::now() + seconds<Clock::duration>(this->Backoff);
+    }
+
+    this->Finished.notify_all();
+  }
+
+  //
+  // stopping: nobody is left waiting
+  //
+  for (deque<Request*>& queue : this->Queues) {
+    for (Request* r : queue)
+      this->finish(r, false, "");
+    queue.clear();
+  }
+
+  this->Finished.notify_all();
+}
+
+
+//
+// fetch
+//
+bool PredictionScheduler::fetch(int route, int stopID, string& response)
+{
+  vector<string> responses;
+  vector<bool> ok;
+
+  this->fetchMany(route, { stopID }, responses, ok, Priority::Interactive);
+
+  if (ok[0])
+    response = responses[0];
+
+  return ok[0];
+}
+
+
+//
+// fetchMany
+//
+// Queues a request per stop, and waits for them all. A user's wait
+// is timed here rather than by the dispatchers, which may all be in
+// calls (or held back by the rate limit) when it runs out: stops
+// still queued then fail, while those already in a call are
+// answered when it returns.
+//
+void PredictionScheduler::fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+  vector<bool>& ok, Priority priority)
+{
+  vector<Request> requests(stopIDs.size());
+
+  Clock::time_point deadline = (priority == Priority::Interactive)
+    ? Clock::now() + seconds<Clock::duration>(this->Opts.MaxWaitSeconds)
+    : Clock::time_point::max();
+
+  {
+    unique_lock<mutex> lock(this->Mutex);
+
+    for (size_t i = 0; i < stopIDs.size(); i++) {
+      requests[i].Route = route;
+      requests[i].StopID = stopIDs[i];
+      requests[i].Deadline = deadline;
+
+      if (this->Stopping)
+        requests[i].Done = true;
+      else
+        this->Queues[(int) priority].push_back(&requests[i]);
+    }
+
+    this->Counts.Requests += stopIDs.size();
+    if (priority == Priority::Background)
+      this->Counts.Background += stopIDs.size();
+
+    this->Wake.notify_all();
+
+    auto done = [&] {
+      return all_of(requests.begin(), requests.end(), [](const Request& r) { return r.Done; });
+    };
+
+    if (priority == Priority::Interactive && !this->Finished.wait_until(lock, deadline, done))
+      this->expire(Clock::now());
+
+    this->Finished.wait(lock, done);
+  }
+
+  responses.assign(stopIDs.size(), "");
+  ok.assign(stopIDs.size(), false);
+
+  for (size_t i = 0; i < stopIDs.size(); i++) {
+    ok[i] = requests[i].OK;
+    responses[i] = std::move(requests[i].Response);
+  }
+}
+
+
+//
+// getStats
+//
+PredictionScheduler::Stats PredictionScheduler::getStats() const
+{
+  lock_guard<mutex> lock(this->Mutex);
+  return this->Counts;
+}
+
+
+//
+// statsJson
+//
+string PredictionScheduler::statsJson() const
+{
+  Stats s = this->getStats();
+  ostringstream json;
+
+  json << fixed << setprecision(4)
+    << "{\"requests\":" << s.Requests
+    << ",\"background\":" << s.Background
+    << ",\"calls\":" << s.Calls
+    << ",\"batched\":" << s.Batched
+    << ",\"stops_per_call\":" << s.stopsPerCall()
+    << ",\"throttled\":" << s.Throttled
+    << ",\"failures\":" << s.Failures
+    << ",\"timed_out\":" << s.TimedOut
+    << ",\"over_quota\":" << s.OverQuota
+    << "}";
+
+  return json.str();
+}
@@ -0,0 +1,124 @@
+/*scheduler.h*/
+
+//
+// Calls to the bus tracker, scheduled. The CTA limits how often a key
+// may call the API, and how many calls it may make in a day; without
+// a scheduler every prediction would be a call of its own, sent the
+// moment it was asked for.
+//
+// A PredictionScheduler sits in front of a source (the live API) and
+// queues what it is asked for. Dispatcher threads send the queued
+// stops as calls:
+//
+//   rate limit   a token bucket: RequestsPerSecond calls on average,
+//                up to Burst of them back to back
+//   priority     stops a user is waiting for go before prefetched
+//                ones; a user who would wait more than MaxWaitSeconds
+//                is told the call failed instead
+//   batching     each call asks about up to MaxBatch stops on one
+//                route -- whatever is queued for that route, users'
+//                stops first -- so stops queued together cost one call
+//   backoff      after a call fails, no calls for BackoffSeconds,
+//                doubling with each failure in a row up to
+//                MaxBackoffSeconds
+//   quota        once DailyQuota calls have been made in a day, the
+//                rest fail without calling
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+
+#include "predictions.h"
+
+using namespace std;
+
+
+class PredictionScheduler : public PredictionSource
+{
+public:
+  struct Options
+  {
+    double RequestsPerSecond = 5.0;   // calls per second, on average
+    int Burst = 5;                    // ... and back to back
+    int MaxBatch = 10;                // stops per call
+    int DailyQuota = 10000;           // calls per day; 0 => no limit
+    int Dispatchers = 2;              // calls in flight at once
+    double MaxWaitSeconds = 5.0;      // users wait no longer than this
+    double BackoffSeconds = 1.0;      // pause after a failed call
+    double MaxBackoffSeconds = 60.0;  // ... doubling up to this
+  };
+
+  struct Stats
+  {
+    uint64_t Requests = 0;       // stops asked for
+    uint64_t Background = 0;     // ... by prefetching
+    uint64_t Calls = 0;          // calls made to the source
+    uint64_t Batched = 0;        // stops that shared a call
+    uint64_t Throttled = 0;      // calls held back by the rate limit
+    uint64_t Failures = 0;       // calls that failed
+    uint64_t TimedOut = 0;       // stops users gave up waiting for
+    uint64_t OverQuota = 0;      // stops refused, daily quota used up
+
+    double stopsPerCall() const { return Calls == 0 ? 0.0 : (double) (Requests - TimedOut - OverQuota) / Calls; }
+  };
+
+private:
+  using Clock = chrono::steady_clock;
+
+  struct Request
+  {
+    int Route;
+    int StopID;
+    Clock::time_point Deadline;
+    bool Done = false;
+    bool OK = false;
+    string Response;
+  };
+
+  unique_ptr<PredictionSource> Inner;
+  Options Opts;
+
+  mutable mutex Mutex;
+  condition_variable Wake;       // dispatchers: work queued, or stopping
+  condition_variable Finished;   // callers: a request is done
+  deque<Request*> Queues[2];     // by Priority
+  bool Stopping = false;
+  Stats Counts;
+
+  double Tokens;
+  Clock::time_point Refilled;
+  Clock::time_point Resume;      // no calls before this (backoff)
+  double Backoff = 0.0;          // seconds; 0 => last call worked
+  int CallsToday = 0;
+  Clock::time_point DayStarted;
+
+  vector<thread> Dispatchers;
+
+  void finish(Request* r, bool ok, const string& response);
+  Clock::time_point expire(Clock::time_point now);
+  void takeBatch(vector<Request*>& batch, vector<int>& stops, bool& interactive);
+  void dispatchLoop();
+
+public:
+  PredictionScheduler(unique_ptr<PredictionSource> inner, const Options& options);
+  explicit PredictionScheduler(unique_ptr<PredictionSource> inner);
+  ~PredictionScheduler() override;
+
+  bool fetch(int route, int stopID, string& response) override;
+  void fetchMany(int route, const vector<int>& stopIDs, vector<string>& responses,
+    vector<bool>& ok, Priority priority) override;
+
+  int getMaxBatch() const override;
+
+  Stats getStats() const;
+  string statsJson() const override;
+};
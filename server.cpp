@@ -0,0 +1,1039 @@
+/*server.cpp*/
+
+//
+// Long-running local HTTP query server: loads the map and bus
+// stops once, then answers queries over HTTP/JSON on localhost.
+//
+// Threading: the event loop (main thread) is the only thread that
+// touches sockets and connection state. Workers only see copies of
+// parsed requests and return response strings, tagged with the
+// connection's fd and generation number so a response for a
+// connection that has since closed (and whose fd was reused) is
+// dropped rather than sent to the wrong client.
+//
+// References:
+//
+// epoll: https://man7.org/linux/man-pages/man7/epoll.7.html
+// HTTP/1.1 message syntax: RFC 9112
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+#include "server.h"
+#include "mapdata.h"
+#include "query.h"
+#include "predictions.h"
+#include "prefetch.h"
+#include "histogram.h"
+#include "latency.h"
+#include "querylog.h"
+
+using namespace std;
+
+
+static const size_t MAX_REQUEST_BYTES = 64 * 1024;
+
+static volatile sig_atomic_t Stopping = 0;
+static volatile sig_atomic_t ReloadSignalled = 0;
+
+static void onSignal(int)
+{
+  Stopping = 1;
+}
+
+static void onHangup(int)
+{
+  ReloadSignalled = 1;
+}
+
+
+//
+// Endpoints, each with its own latency histogram:
+//
+enum Endpoint { EP_BUILDING, EP_NEAREST, EP_PREDICTIONS, EP_ROUTE, EP_TRANSIT, EP_STUB, EP_STATS, EP_OTHER, NUM_ENDPOINTS };
+
+static const char* EndpointNames[NUM_ENDPOINTS] = {
+  "building", "nearest", "predictions", "route", "transit", "stub", "stats", "other"
+};
+
+
+//
+// Request / Job / Completion
+//
+// A parsed HTTP request; a request queued for a worker; and the
+// worker's response on its way back to the event loop.
+//
+struct Request
+{
+  string Method;
+  string Path;
+  map<string, string> Params;
+  bool KeepAlive = true;
+  size_t BodyBytes = 0;   // Content-Length: skipped, never read
+};
+
+struct Job
+{
+  int Fd;
+  uint64_t Gen;
+  Request Req;
+  chrono::steady_clock::time_point Arrived;
+};
+
+struct Completion
+{
+  int Fd;
+  uint64_t Gen;
+  string Response;
+  bool KeepAlive;
+};
+
+
+//
+// Connection
+//
+// Per-socket state, owned by the event loop.
+//
+struct Connection
+{
+  uint64_t Gen = 0;
+  string In;              // bytes read, not yet parsed
+  string Out;             // bytes to write
+  size_t OutPos = 0;
+  bool Busy = false;      // a request is with the workers
+  bool Closing = false;   // close once Out is written
+  bool TooLarge = false;  // input overflowed while Busy: 431 after the response
+};
+
+
+//
+// parseServerArgs
+//
+bool parseServerArgs(int argc, char* argv[], ServerOptions& options)
+{
+  vector<string> positional;
+
+  for (int i = 2; i < argc; i++)
+  {
+    string arg = argv[i];
+
+    if (arg == "--port" && i + 1 < argc)
+      options.Port = atoi(argv[++i]);
+    else if (arg == "--threads" && i + 1 < argc)
+      options.Threads = max(1, atoi(argv[++i]));
+    else if (arg == "--predictions")
+      options.Predictions = true;
+    else if (arg == "--watch" && i + 1 < argc)
+      options.WatchSeconds = max(0, atoi(argv[++i]));
+    else if (arg == "--prediction-source" && i + 1 < argc)
+      options.PredictionSpec = argv[++i];
+    else if (arg == "--stub-predictions" && i + 1 < argc)
+      options.StubFilename = argv[++i];
+    else if (arg == "--prefetch")
+      options.Prefetch = true;
+    else if (arg == "--log-queries" && i + 1 < argc)
+      options.LogFilename = argv[++i];
+    else if (arg == "--admin")
+      options.Admin = true;
+    else
+      positional.push_back(arg);
+  }
+
+  if (positional.size() != 2) {
+    cerr << "usage: EvanstonCampusNavigator --serve mapfile stopfile" << endl;
+    cerr << "         [--port N] [--threads N] [--predictions] [--watch S]" << endl;
+    cerr << "         [--prediction-source spec] [--stub-predictions recording] [--prefetch]" << endl;
+    cerr << "         [--log-queries logfile] [--admin]" << endl;
+    return false;
+  }
+
+  options.MapFilename = positional[0];
+  options.StopFilename = positional[1];
+
+  return true;
+}
+
+
+//
+// urlDecode
+//
+// Decodes %XX escapes and '+' (space) in a query string component.
+//
+static string urlDecode(const string& s)
+{
+  string result;
+  result.reserve(s.size());
+
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    if (s[i] == '+') {
+      result += ' ';
+    }
+    else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char) s[i + 1]) && isxdigit((unsigned char) s[i + 2])) {
+      result += (char) strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    }
+    else {
+      result += s[i];
+    }
+  }
+
+  return result;
+}
+
+
+//
+// parseRequest
+//
+// Parses the request line and headers of one HTTP request, given
+// the text up to (not including) the blank line. Returns false if
+// malformed.
+//
+static bool parseRequest(const string& head, Request& req)
+{
+  size_t eol = head.find("\r\n");
+  string requestLine = head.substr(0, eol);
+
+  size_t sp1 = requestLine.find(' ');
+  size_t sp2 = requestLine.rfind(' ');
+
+  if (sp1 == string::npos || sp2 == sp1)
+    return false;
+
+  req.Method = requestLine.substr(0, sp1);
+  string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+  string version = requestLine.substr(sp2 + 1);
+
+  req.KeepAlive = (version == "HTTP/1.1");
+  bool chunked = false;
+
+  size_t question = target.find('?');
+  req.Path = target.substr(0, question);
+
+  if (question != string::npos)
+  {
+    string qs = target.substr(question + 1);
+    size_t pos = 0;
+
+    while (pos <= qs.size())
+    {
+      size_t amp = qs.find('&', pos);
+      if (amp == string::npos)
+        amp = qs.size();
+
+      string pair = qs.substr(pos, amp - pos);
+      size_t eq = pair.find('=');
+
+      if (!pair.empty()) {
+        if (eq == string::npos)
+          req.Params[urlDecode(pair)] = "";
+        else
+          req.Params[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+      }
+
+      pos = amp + 1;
+    }
+  }
+
+  //
+  // headers: Connection, and the length of a body to skip. A body
+  // sent chunked can't be skipped, so the connection closes after
+  // the response:
+  //
+  size_t pos = (eol == string::npos) ? head.size() : eol + 2;
+
+  while (pos < head.size())
+  {
+    size_t end = head.find("\r\n", pos);
+    if (end == string::npos)
+      end = head.size();
+
+    string line = head.substr(pos, end - pos);
+    size_t colon = line.find(':');
+
+    if (colon != string::npos)
+    {
+      string name = line.substr(0, colon);
+      string value = line.substr(colon + 1);
+
+      for (char& c : name) c = (char) tolower((unsigned char) c);
+      for (char& c : value) c = (char) tolower((unsigned char) c);
+
+      if (name == "connection") {
+        if (value.find("close") != string::npos)
+          req.KeepAlive = false;
+        else if (value.find("keep-alive") != string::npos)
+          req.KeepAlive = true;
+      }
+      else if (name == "content-length") {
+        char* end = nullptr;
+        unsigned long long length = strtoull(value.c_str(), &end, 10);
+
+        while (*end == ' ' || *end == '\t')
+          end++;
+
+        if (end == value.c_str() || *end != '\0' || value.find('-') != string::npos)
+          return false;
+
+        req.BodyBytes = (size_t) length;
+      }
+      else if (name == "transfer-encoding")
+        chunked = true;
+    }
+
+    pos = end + 2;
+  }
+
+  if (chunked)
+    req.KeepAlive = false;
+
+  return true;
+}
+
+
+//
+// httpResponse
+//
+static string httpResponse(int status, const string& body, bool keepAlive)
+{
+  const char* reason = (status == 200) ? "OK" : (status == 400) ? "Bad Request"
+    : (status == 404) ? "Not Found" : (status == 405) ? "Method Not Allowed"
+    : (status == 413) ? "Payload Too Large" : (status == 431) ? "Request Header Fields Too Large" : "Error";
+
+  string response = "HTTP/1.1 " + to_string(status) + " " + reason + "\r\n";
+  response += "Content-Type: application/json\r\n";
+  response += "Content-Length: " + to_string(body.size()) + "\r\n";
+  response += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+  response += body;
+
+  return response;
+}
+
+
+static string jsonError(const string& message)
+{
+  return "{\"error\":\"" + message + "\"}\n";
+}
+
+
+//
+// QueryServer
+//
+class QueryServer
+{
+private:
+  const ServerOptions& Options;
+  MapStore& Store;
+  PredictionSource* Predictions;
+  PredictionSource* Stub;      // nullptr unless standing in for the bus tracker
+  QueryLog* Log;               // nullptr unless logging queries
+
+  int ListenFd = -1;
+  int EpollFd = -1;
+  int WakeFd = -1;     // eventfd: workers => event loop
+
+  unordered_map<int, Connection> Connections;
+  uint64_t NextGen = 1;
+
+  //
+  // worker pool:
+  //
+  vector<thread> Workers;
+  mutex JobsMutex;
+  condition_variable JobsReady;
+  deque<Job> Jobs;
+  bool ShuttingDown = false;
+
+  mutex DoneMutex;
+  vector<Completion> Done;
+
+  LatencyHistogram Latency[NUM_ENDPOINTS];
+
+  void workerLoop();
+  Completion handle(const Job& job);
+  string statsJson() const;
+
+  void acceptAll();
+  void readFrom(int fd);
+  void tryParse(int fd, Connection& conn);
+  void tryWrite(int fd, Connection& conn);
+  void closeConnection(int fd);
+  void drainCompletions();
+
+public:
+  QueryServer(const ServerOptions& options, MapStore& store, PredictionSource* predictions, PredictionSource* stub,
+    QueryLog* log)
+    : Options(options), Store(store), Predictions(predictions), Stub(stub), Log(log) { }
+
+  bool start();
+  void run();
+  void stop();
+};
+
+
+//
+// start
+//
+// Opens the listening socket on 127.0.0.1, the epoll instance and
+// the wakeup eventfd, and starts the workers.
+//
+bool QueryServer::start()
+{
+  this->ListenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (this->ListenFd < 0) {
+    cerr << "**ERROR: socket: " << strerror(errno) << endl;
+    return false;
+  }
+
+  int one = 1;
+  setsockopt(this->ListenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t) this->Options.Port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(this->ListenFd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(this->ListenFd, 1024) < 0) {
+    cerr << "**ERROR: unable to listen on port " << this->Options.Port << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  this->EpollFd = epoll_create1(EPOLL_CLOEXEC);
+  this->WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (this->EpollFd < 0 || this->WakeFd < 0) {
+    cerr << "**ERROR: epoll / eventfd: " << strerror(errno) << endl;
+    return false;
+  }
+
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = this->ListenFd;
+  epoll_ctl(this->EpollFd, EPOLL_CTL_ADD, this->ListenFd, &ev);
+
+  ev.events = EPOLLIN;
+  ev.data.fd = this->WakeFd;
+  epoll_ctl(this->EpollFd, EPOLL_CTL_ADD, this->WakeFd, &ev);
+
+  for (int t = 0; t < this->Options.Threads; t++)
+    this->Workers.push_back(thread(&QueryServer::workerLoop, this));
+
+  return true;
+}
+
+
+//
+// run
+//
+// The event loop; returns once a stop signal arrives.
+//
+void QueryServer::run()
+{
+  const int MAX_EVENTS = 256;
+  epoll_event events[MAX_EVENTS];
+
+  while (!Stopping)
+  {
+    if (ReloadSignalled) {
+      ReloadSignalled = 0;
+      this->Store.requestReload();
+    }
+
+    int n = epoll_wait(this->EpollFd, events, MAX_EVENTS, 250);
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      cerr << "**ERROR: epoll_wait: " << strerror(errno) << endl;
+      break;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+      int fd = events[i].data.fd;
+
+      if (fd == this->ListenFd) {
+        this->acceptAll();
+      }
+      else if (fd == this->WakeFd) {
+        uint64_t count;
+        while (read(this->WakeFd, &count, sizeof(count)) > 0)
+          ;
+        this->drainCompletions();
+      }
+      else {
+        auto ptr = this->Connections.find(fd);
+        if (ptr == this->Connections.end())
+          continue;
+
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          this->closeConnection(fd);
+          continue;
+        }
+
+        if (events[i].events & EPOLLOUT)
+          this->tryWrite(fd, ptr->second);
+
+        if ((events[i].events & EPOLLIN) && this->Connections.count(fd) > 0)
+          this->readFrom(fd);
+      }
+    }
+  }
+}
+
+
+//
+// stop
+//
+// Stops the workers and closes every socket.
+//
+void QueryServer::stop()
+{
+  {
+    lock_guard<mutex> lock(this->JobsMutex);
+    this->ShuttingDown = true;
+  }
+  this->JobsReady.notify_all();
+
+  for (thread& t : this->Workers)
+    t.join();
+
+  vector<int> fds;
+  for (auto& entry : this->Connections)
+    fds.push_back(entry.first);
+  for (int fd : fds)
+    this->closeConnection(fd);
+
+  if (this->ListenFd >= 0) close(this->ListenFd);
+  if (this->EpollFd >= 0) close(this->EpollFd);
+  if (this->WakeFd >= 0) close(this->WakeFd);
+}
+
+
+void QueryServer::acceptAll()
+{
+  while (true)
+  {
+    int fd = accept4(this->ListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0)
+      return;  // EAGAIN: no more pending, or a transient error
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Connection& conn = this->Connections[fd];
+    conn = Connection();
+    conn.Gen = this->NextGen++;
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(this->EpollFd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+
+void QueryServer::readFrom(int fd)
+{
+  Connection& conn = this->Connections[fd];
+  char buf[16 * 1024];
+
+  while (true)
+  {
+    ssize_t n = read(fd, buf, sizeof(buf));
+
+    if (n > 0) {
+      if (!conn.Closing && !conn.TooLarge)   // else nothing more will be parsed
+        conn.In.append(buf, (size_t) n);
+      continue;
+    }
+
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      this->closeConnection(fd);  // peer closed, or error
+      return;
+    }
+
+    if (errno == EINTR)
+      continue;
+
+    break;  // EAGAIN
+  }
+
+  this->tryParse(fd, conn);
+}
+
+
+//
+// tryParse
+//
+// If the connection is idle and a complete request has arrived,
+// hands it to the workers. One request per connection is in flight
+// at a time; pipelined requests wait in the input buffer, which is
+// capped at MAX_REQUEST_BYTES either way.
+//
+void QueryServer::tryParse(int fd, Connection& conn)
+{
+  if (conn.Closing)
+    return;
+
+  if (conn.Busy)
+  {
+    //
+    // pipelined input waits, but no more of it than one request may
+    // be; the 431 goes out after the response in flight:
+    //
+    if (conn.In.size() > MAX_REQUEST_BYTES) {
+      conn.In.clear();
+      conn.TooLarge = true;
+    }
+    return;
+  }
+
+  size_t end = conn.In.find("\r\n\r\n");
+
+  if (end == string::npos)
+  {
+    if (conn.In.size() > MAX_REQUEST_BYTES) {
+      conn.Out += httpResponse(431, jsonError("request too large"), false);
+      conn.Closing = true;
+      this->tryWrite(fd, conn);
+    }
+    return;
+  }
+
+  Job job;
+  job.Fd = fd;
+  job.Gen = conn.Gen;
+  job.Arrived = chrono::steady_clock::now();
+
+  if (!parseRequest(conn.In.substr(0, end), job.Req)) {
+    conn.In.clear();
+    conn.Out += httpResponse(400, jsonError("malformed request"), false);
+    conn.Closing = true;
+    this->tryWrite(fd, conn);
+    return;
+  }
+
+  //
+  // no endpoint takes a body, but one sent is skipped, not parsed
+  // as the next request -- once it has all arrived:
+  //
+  if (job.Req.BodyBytes > MAX_REQUEST_BYTES) {
+    conn.In.clear();
+    conn.Out += httpResponse(413, jsonError("request too large"), false);
+    conn.Closing = true;
+    this->tryWrite(fd, conn);
+    return;
+  }
+
+  if (conn.In.size() - (end + 4) < job.Req.BodyBytes)
+    return;
+
+  conn.In.erase(0, end + 4 + job.Req.BodyBytes);
+
+  conn.Busy = true;
+
+  {
+    lock_guard<mutex> lock(this->JobsMutex);
+    this->Jobs.push_back(move(job));
+  }
+  this->JobsReady.notify_one();
+}
+
+
+void QueryServer::tryWrite(int fd, Connection& conn)
+{
+  while (conn.OutPos < conn.Out.size())
+  {
+    ssize_t n = write(fd, conn.Out.data() + conn.OutPos, conn.Out.size() - conn.OutPos);
+
+    if (n > 0) {
+      conn.OutPos += (size_t) n;
+      continue;
+    }
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      //
+      // socket buffer full: wait for EPOLLOUT:
+      //
+      epoll_event ev;
+      ev.events = EPOLLIN | EPOLLOUT;
+      ev.data.fd = fd;
+      epoll_ctl(this->EpollFd, EPOLL_CTL_MOD, fd, &ev);
+      return;
+    }
+
+    this->closeConnection(fd);
+    return;
+  }
+
+  //
+  // all written:
+  //
+  bool wasWaiting = !conn.Out.empty();
+
+  conn.Out.clear();
+  conn.OutPos = 0;
+
+  if (conn.Closing) {
+    this->closeConnection(fd);
+    return;
+  }
+
+  if (wasWaiting) {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(this->EpollFd, EPOLL_CTL_MOD, fd, &ev);
+  }
+}
+
+
+void QueryServer::closeConnection(int fd)
+{
+  epoll_ctl(this->EpollFd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  this->Connections.erase(fd);
+}
+
+
+//
+// drainCompletions
+//
+// Moves finished responses into their connections' output buffers,
+// then looks for the next pipelined request on each.
+//
+void QueryServer::drainCompletions()
+{
+  vector<Completion> done;
+
+  {
+    lock_guard<mutex> lock(this->DoneMutex);
+    done.swap(this->Done);
+  }
+
+  for (Completion& c : done)
+  {
+    auto ptr = this->Connections.find(c.Fd);
+
+    if (ptr == this->Connections.end() || ptr->second.Gen != c.Gen)
+      continue;  // client went away
+
+    Connection& conn = ptr->second;
+
+    conn.Busy = false;
+    conn.Out += c.Response;
+    conn.Closing = !c.KeepAlive || conn.TooLarge;
+
+    if (conn.TooLarge)
+      conn.Out += httpResponse(431, jsonError("request too large"), false);
+
+    this->tryWrite(c.Fd, conn);
+
+    ptr = this->Connections.find(c.Fd);
+    if (ptr != this->Connections.end() && ptr->second.Gen == c.Gen)
+      this->tryParse(c.Fd, ptr->second);
+  }
+}
+
+
+//
+// workerLoop
+//
+void QueryServer::workerLoop()
+{
+  while (true)
+  {
+    Job job;
+
+    {
+      unique_lock<mutex> lock(this->JobsMutex);
+      this->JobsReady.wait(lock, [this] { return this->ShuttingDown || !this->Jobs.empty(); });
+
+      if (this->ShuttingDown)
+        break;
+
+      job = move(this->Jobs.front());
+      this->Jobs.pop_front();
+    }
+
+    Completion c = this->handle(job);
+
+    {
+      lock_guard<mutex> lock(this->DoneMutex);
+      this->Done.push_back(move(c));
+    }
+
+    uint64_t one = 1;
+    ssize_t rc = write(this->WakeFd, &one, sizeof(one));
+    (void) rc;
+  }
+}
+
+
+//
+// handle
+//
+// Runs one request, recording its latency (including time spent
+// waiting in the job queue) under its endpoint.
+//
+Completion QueryServer::handle(const Job& job)
+{
+  const Request& req = job.Req;
+  const map<string, string>& params = req.Params;
+
+  auto param = [&](const string& name) -> string {
+    auto ptr = params.find(name);
+    return (ptr == params.end()) ? "" : ptr->second;
+  };
+
+  Endpoint endpoint = EP_OTHER;
+  int status = 200;
+  string body;
+
+  Query query;
+  bool haveQuery = false;
+
+  if (req.Path == "/admin/reload" && this->Options.Admin) {
+    if (req.Method != "POST") {
+      status = 405;
+      body = jsonError("only POST is supported");
+    }
+    else {
+      this->Store.requestReload();
+      body = "{\"reloading\":true,\"version\":" + to_string(this->Store.getVersion()) + "}\n";
+    }
+  }
+  else if (req.Method != "GET") {
+    status = 405;
+    body = jsonError("only GET is supported");
+  }
+  else if (req.Path == "/building") {
+    endpoint = EP_BUILDING;
+    query.Type = QueryType::Building;
+    query.Name = param("name");
+    haveQuery = !query.Name.empty();
+  }
+  else if (req.Path == "/nearest") {
+    endpoint = EP_NEAREST;
+    query.Type = QueryType::Nearest;
+    query.Direction = param("dir");
+    char* end1 = nullptr;
+    char* end2 = nullptr;
+    string lat = param("lat"), lon = param("lon");
+    query.Lat = strtod(lat.c_str(), &end1);
+    query.Lon = strtod(lon.c_str(), &end2);
+    haveQuery = !lat.empty() && !lon.empty() && *end1 == '\0' && *end2 == '\0' && !query.Direction.empty();
+  }
+  else if (req.Path == "/predictions") {
+    endpoint = EP_PREDICTIONS;
+    query.Type = QueryType::Predict;
+    string stop = param("stop");
+    char* end = nullptr;
+    query.StopID = (int) strtol(stop.c_str(), &end, 10);
+    haveQuery = !stop.empty() && *end == '\0';
+  }
+  else if (req.Path == "/route") {
+    endpoint = EP_ROUTE;
+    query.Type = QueryType::Route;
+    query.Name = param("from");
+    query.ToName = param("to");
+    haveQuery = !query.Name.empty() && !query.ToName.empty();
+  }
+  else if (req.Path == "/transit") {
+    endpoint = EP_TRANSIT;
+    query.Type = QueryType::Transit;
+    query.Name = param("from");
+    query.ToName = param("to");
+    string at = param("at");
+    haveQuery = !query.Name.empty() && !query.ToName.empty() && (at.empty() || parseClock(at, query.Time));
+  }
+  else if (this->Stub != nullptr && req.Path.size() >= 15
+    && req.Path.compare(req.Path.size() - 15, 15, "/getpredictions") == 0) {
+    //
+    // standing in for the bus tracker: the recorded reply, as is, or
+    // for several stops (stpid=1,2,3), the recorded replies merged
+    //
+    endpoint = EP_STUB;
+    string rt = param("rt"), stpid = param("stpid");
+    vector<int> stops;
+
+    for (size_t pos = 0; !stpid.empty() && pos != string::npos; ) {
+      size_t comma = stpid.find(',', pos);
+      stops.push_back(atoi(stpid.substr(pos, comma == string::npos ? string::npos : comma - pos).c_str()));
+      pos = (comma == string::npos) ? comma : comma + 1;
+    }
+
+    if (rt.empty() || stops.empty())
+      body = "{\"bustime-response\":{\"error\":[{\"msg\":\"No data found for parameter\"}]}}\n";  // as the real API does
+    else if (stops.size() > 1) {
+      vector<string> replies;
+      vector<bool> ok;
+      this->Stub->fetchMany(atoi(rt.c_str()), stops, replies, ok, PredictionSource::Priority::Interactive);
+      body = mergePredictionReplies(stops, replies, ok);
+    }
+    else if (!this->Stub->fetch(atoi(rt.c_str()), stops[0], body))
+      body = mergePredictionReplies(stops, { "" }, { false });
+  }
+  else if (req.Path == "/stats") {
+    endpoint = EP_STATS;
+    body = this->statsJson();
+  }
+  else if (req.Path == "/health") {
+    body = "{\"status\":\"ok\",\"version\":" + to_string(this->Store.getVersion()) + "}\n";
+  }
+  else {
+    status = 404;
+    body = jsonError("no such endpoint");
+  }
+
+  if (endpoint != EP_OTHER && endpoint != EP_STATS && endpoint != EP_STUB)
+  {
+    if (haveQuery) {
+      //
+      // hold the snapshot for the whole query, so a reload can't
+      // free it underneath us:
+      //
+      shared_ptr<const MapData> data = this->Store.snapshot();
+
+      if (this->Log != nullptr)
+        this->Log->append(query, this->Options.Predictions);
+
+      runQuery(query, *data, this->Predictions, this->Options.Predictions, body);
+    }
+    else {
+      status = 400;
+      body = jsonError("missing or invalid parameters");
+    }
+  }
+
+  Completion c;
+  c.Fd = job.Fd;
+  c.Gen = job.Gen;
+  c.KeepAlive = req.KeepAlive;
+  c.Response = httpResponse(status, body, req.KeepAlive);
+
+  auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - job.Arrived);
+  this->Latency[endpoint].record((uint64_t) elapsed.count());
+
+  return c;
+}
+
+
+//
+// statsJson
+//
+string QueryServer::statsJson() const
+{
+  string json = "{";
+
+  for (int e = 0; e < NUM_ENDPOINTS; e++) {
+    if (e > 0)
+      json += ",";
+    json += "\"" + string(EndpointNames[e]) + "\":" + this->Latency[e].toJson("us");
+  }
+
+  json += ",\"queries\":" + latencyJson();
+
+  string predictions = this->Predictions->statsJson();
+
+  if (!predictions.empty())
+    json += ",\"predictions\":" + predictions;
+
+  json += "}\n";
+  return json;
+}
+
+
+//
+// runServer
+//
+int runServer(const ServerOptions& options)
+{
+  string error;
+  unique_ptr<PredictionSource> predictions = makePredictionSource(options.PredictionSpec, error);
+  unique_ptr<PredictionSource> stub;
+
+  if (predictions != nullptr && !options.StubFilename.empty())
+    stub = makePredictionSource("replay:" + options.StubFilename, error);
+
+  if (predictions == nullptr || (!options.StubFilename.empty() && stub == nullptr)) {
+    cerr << "**ERROR: " << error << endl;
+    return 1;
+  }
+
+  if (options.Prefetch)
+    predictions = make_unique<PredictionCache>(std::move(predictions));
+
+  QueryLog queryLog;
+
+  if (!options.LogFilename.empty() && !queryLog.open(options.LogFilename, error)) {
+    cerr << "**ERROR: " << error << endl;
+    return 1;
+  }
+
+  MapStore store(options.MapFilename, options.StopFilename);
+
+  if (!store.load())
+    return 1;
+
+  {
+    shared_ptr<const MapData> data = store.snapshot();
+
+    cout << "# of nodes: " << data->nodes.getNumMapNodes() << endl;
+    cout << "# of buildings: " << data->buildings.getNumMapBuildings() << endl;
+    cout << "# of bus stops: " << data->busStops.getNumBusStops() << endl;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGHUP, onHangup);
+  signal(SIGPIPE, SIG_IGN);
+
+  QueryServer server(options, store, predictions.get(), stub.get(), queryLog.isOpen() ? &queryLog : nullptr);
+
+  if (!server.start())
+    return 1;
+
+  store.start(options.WatchSeconds * 1000);
+
+  cout << "** listening on http://127.0.0.1:" << options.Port << " with "
+    << options.Threads << " worker threads **" << endl;
+
+  server.run();
+  server.stop();
+  store.stop();
+
+  cout << "** Done **" << endl;
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*server.h*/
+
+//
+// Long-running local HTTP query server: loads the map and bus
+// stops once, then answers queries over HTTP/JSON on localhost.
+//
+// Usage:
+//
+//   EvanstonCampusNavigator --serve mapfile stopfile
+//       [--port N] [--threads N] [--predictions] [--watch S]
+//       [--prediction-source spec] [--stub-predictions recording]
+//       [--prefetch] [--log-queries logfile] [--admin]
+//
+// Endpoints (GET unless noted, results as JSON; see query.h):
+//
+//   /building?name=Mudd
+//   /nearest?lat=42.05&lon=-87.67&dir=Northbound
+//   /predictions?stop=1834
+//   /route?from=Mudd&to=Tech
+//   /transit?from=Mudd&to=Tech&at=08:30
+//   /stats       per-endpoint latency histograms, and per kind of
+//                search within queries (see latency.h)
+//   /health
+//   /admin/reload  POST only, and only with --admin
+//
+// Predictions come from the live bus tracker unless another source
+// is given (see predictions.h). With --stub-predictions, the server
+// also stands in for the bus tracker itself, answering
+// .../getpredictions?rt=R&stpid=S (or stpid=S1,S2,...) from a
+// recording with the recorded latency, so another instance can be
+// pointed at it with
+// --prediction-source live:http://127.0.0.1:PORT/bustime/api/v2.
+// With --prefetch, predictions are cached, and prefetched for the
+// stops around each building queried (see prefetch.h). /stats
+// includes the cache's hit rates and the bus tracker scheduler's
+// call counts (see scheduler.h).
+//
+// With --log-queries, each query answered is appended to a query log
+// (see querylog.h) for navreplay to replay; the log is buffered, and
+// written out in full when the server stops.
+//
+// The map and bus stops can be reloaded without a restart, while
+// queries keep running (see MapStore in mapdata.h): by sending the
+// process SIGHUP, automatically with --watch S, which checks the
+// files for changes every S seconds, or with --admin, by POSTing to
+// /admin/reload. The server only listens on 127.0.0.1, but any local
+// user can connect, so the admin endpoint is off by default.
+//
+// The main thread runs an epoll event loop that owns every socket;
+// complete requests are handed to a pool of worker threads, which
+// hand finished responses back through an eventfd. The server runs
+// until interrupted (SIGINT / SIGTERM).
+//
+
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+
+//
+// ServerOptions
+//
+struct ServerOptions
+{
+  string MapFilename;
+  string StopFilename;
+  int Port = 8080;
+  int Threads = 4;
+  bool Predictions = false;  // fetch predictions for /building?
+  int WatchSeconds = 0;      // 0 => don't watch the files
+  string PredictionSpec = "live";
+  string StubFilename;       // recording to serve as the bus tracker
+  bool Prefetch = false;     // cache and prefetch predictions?
+  string LogFilename;        // empty => don't log queries
+  bool Admin = false;        // serve POST /admin/reload?
+};
+
+
+//
+// parseServerArgs
+//
+// Parses the command line following "--serve". Returns true if
+// successful, false if not (a usage message has been output).
+//
+bool parseServerArgs(int argc, char* argv[], ServerOptions& options);
+
+//
+// runServer
+//
+// Runs the server until interrupted, returning the process exit
+// code.
+//
+int runServer(const ServerOptions& options);
@@ -0,0 +1,195 @@
+/*startup.cpp*/
+
+//
+// Startup as a graph of phases run on the task pool. See startup.h.
+//
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <cassert>
+
+#include "startup.h"
+
+using namespace std;
+
+
+int StartupGraph::add(const string& name, const vector<int>& needs, function<bool()> run)
+{
+  int p = (int) this->Phases.size();
+
+  auto phase = make_unique<Phase>();
+  phase->Name = name;
+  phase->Needs = needs;
+  phase->Run = std::move(run);
+  phase->Waiting = (int) needs.size();
+
+  for (int need : needs) {
+    assert(need >= 0 && need < p);
+    this->Phases[need]->NeededBy.push_back(p);
+  }
+
+  this->Phases.push_back(std::move(phase));
+  return p;
+}
+
+
+//
+// runPhase
+//
+// Runs phase p, whose needs are all done, unless one of them failed.
+//
+void StartupGraph::runPhase(int p)
+{
+  Phase& phase = *this->Phases[p];
+
+  for (int need : phase.Needs)
+    if (!this->Phases[need]->OK)
+      phase.Skipped = true;
+
+  auto ms = [this]() {
+    return chrono::duration<double, milli>(Clock::now() - this->Started).count();
+  };
+
+  phase.StartMs = ms();
+
+  if (!phase.Skipped) {
+    ProfileScope scope(this->Profiler, phase.Name);
+    phase.OK = phase.Run();
+  }
+
+  phase.EndMs = ms();
+}
+
+
+//
+// start
+//
+// Queues phase p, whose needs are all done. When it is done, the
+// phases waiting on nothing else are queued in turn.
+//
+void StartupGraph::start(int p, TaskGroup& group)
+{
+  group.run([this, p, &group]() {
+    Phase& phase = *this->Phases[p];
+
+    this->runPhase(p);
+
+    for (int next : phase.NeededBy)
+      if (--this->Phases[next]->Waiting == 0)
+        this->start(next, group);
+  });
+}
+
+
+bool StartupGraph::run(TaskPool& pool)
+{
+  this->Started = Clock::now();
+
+  if (this->Profiler != nullptr)
+  {
+    for (int p = 0; p < (int) this->Phases.size(); p++)   // needs come first
+      this->runPhase(p);
+  }
+  else
+  {
+    TaskGroup group(pool);
+
+    for (int p = 0; p < (int) this->Phases.size(); p++)
+      if (this->Phases[p]->Needs.empty())
+        this->start(p, group);
+
+    group.wait();
+  }
+
+  this->ElapsedMs = chrono::duration<double, milli>(Clock::now() - this->Started).count();
+
+  for (const auto& phase : this->Phases)
+    if (!phase->OK)
+      return false;
+
+  return true;
+}
+
+
+//
+// longestChain
+//
+// The chain of phases, each needing the one before, whose times add
+// up to the most; phases are added after what they need, so one pass
+// in order finds it.
+//
+vector<int> StartupGraph::longestChain() const
+{
+  int N = (int) this->Phases.size();
+  vector<double> length(N, 0.0);
+  vector<int> previous(N, -1);
+  int last = -1;
+
+  for (int p = 0; p < N; p++)
+  {
+    const Phase& phase = *this->Phases[p];
+
+    for (int need : phase.Needs)
+      if (previous[p] < 0 || length[need] > length[previous[p]])
+        previous[p] = need;
+
+    length[p] = (phase.EndMs - phase.StartMs) + (previous[p] < 0 ? 0.0 : length[previous[p]]);
+
+    if (last < 0 || length[p] > length[last])
+      last = p;
+  }
+
+  vector<int> chain;
+
+  for (int p = last; p >= 0; p = previous[p])
+    chain.push_back(p);
+
+  reverse(chain.begin(), chain.end());
+  return chain;
+}
+
+
+double StartupGraph::getLongestChainMs() const
+{
+  double ms = 0.0;
+
+  for (int p : this->longestChain())
+    ms += this->Phases[p]->EndMs - this->Phases[p]->StartMs;
+
+  return ms;
+}
+
+
+void StartupGraph::report(ostream& out) const
+{
+  vector<int> chain = this->longestChain();
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+
+  out << "startup phases (ms):" << endl;
+  out << "  " << left << setw(24) << "phase" << right << setw(10) << "start" << setw(10) << "time" << endl;
+
+  for (int p = 0; p < (int) this->Phases.size(); p++)
+  {
+    const Phase& phase = *this->Phases[p];
+    bool onChain = find(chain.begin(), chain.end(), p) != chain.end();
+
+    out << "  " << left << setw(24) << phase.Name << right << fixed << setprecision(1);
+
+    if (phase.Skipped)
+      out << setw(20) << "skipped";
+    else
+      out << setw(10) << phase.StartMs << setw(10) << (phase.EndMs - phase.StartMs);
+
+    out << (onChain ? "  *" : "") << (!phase.Skipped && !phase.OK ? "  failed" : "") << endl;
+  }
+
+  out << "  total " << fixed << setprecision(1) << this->ElapsedMs << " ms; longest chain (*) "
+    << this->getLongestChainMs() << " ms" << endl;
+
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -0,0 +1,109 @@
+/*startup.h*/
+
+//
+// Startup as a graph of phases: each phase names the phases it needs
+// done first, and runs on the task pool (see taskpool.h) as soon as
+// they are, so independent phases -- reading the bus stops, parsing
+// the map -- overlap, and startup takes about as long as its longest
+// chain of dependent phases rather than the sum of them all.
+//
+//   StartupGraph startup;
+//
+//   int xml = startup.add("xml parse", {}, [&]() { return osmLoadMapFile(...); });
+//   int nodes = startup.add("nodes", { xml }, [&]() { ...; return true; });
+//
+//   bool ok = startup.run(TaskPool::shared());
+//   startup.report(cerr);
+//
+// A phase returns false if it failed (having output why); the phases
+// that need it are skipped, and run returns false once the rest are
+// done. Phases that run at the same time must not touch the same
+// data, except to read what a phase they both need has made.
+//
+// Given a profiler (see profiler.h), the graph runs its phases one at
+// a time, in the order they were added, and profiles each: the time,
+// memory and allocations measured are then the phase's own.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+#include "taskpool.h"
+#include "profiler.h"
+
+using namespace std;
+
+
+class StartupGraph
+{
+private:
+  using Clock = chrono::steady_clock;
+
+  struct Phase
+  {
+    string Name;
+    vector<int> Needs;
+    vector<int> NeededBy;
+    function<bool()> Run;
+    atomic<int> Waiting;       // phases needed that aren't done yet
+    bool OK = false;           // ran, and succeeded
+    bool Skipped = false;      // a phase needed failed
+    double StartMs = 0.0;      // since run() began
+    double EndMs = 0.0;
+
+    Phase() : Waiting(0) { }
+  };
+
+  vector<unique_ptr<Phase>> Phases;
+  Clock::time_point Started;
+  double ElapsedMs = 0.0;
+  LoadProfiler* Profiler = nullptr;
+
+  void runPhase(int p);
+  void start(int p, TaskGroup& group);
+  vector<int> longestChain() const;
+
+public:
+  //
+  // add
+  //
+  // Adds a phase, returning its number for later phases to name as
+  // needed; needs are phases added before it.
+  //
+  int add(const string& name, const vector<int>& needs, function<bool()> run);
+
+  //
+  // setProfiler
+  //
+  // Profiles each phase, running them one at a time; nullptr (the
+  // default) for neither.
+  //
+  void setProfiler(LoadProfiler* profiler) { this->Profiler = profiler; }
+
+  //
+  // run
+  //
+  // Runs every phase, each once all it needs is done; returns false
+  // if any phase failed or was skipped.
+  //
+  bool run(TaskPool& pool);
+
+  //
+  // report
+  //
+  // After run: when each phase started and how long it took, the
+  // phases of the longest chain marked with a '*', and the total
+  // against the length of that chain.
+  //
+  void report(ostream& out) const;
+
+  double getElapsedMs() const { return this->ElapsedMs; }
+  double getLongestChainMs() const;
+};
@@ -0,0 +1,255 @@
+/*taskpool.cpp*/
+
+//
+// A work-stealing task pool. See taskpool.h.
+//
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "taskpool.h"
+
+using namespace std;
+
+
+//
+// which pool's worker this thread is, if any, and which one:
+//
+static thread_local TaskPool* CurrentPool = nullptr;
+static thread_local int CurrentIndex = -1;
+
+
+static int threadsOrHardware(int threads)
+{
+  return (threads > 0) ? threads : max(1, (int) thread::hardware_concurrency());
+}
+
+
+TaskPool::TaskPool(int threads)
+  : Queued(0), Sleeping(0), Stopping(false)
+{
+  threads = threadsOrHardware(threads);
+
+  for (int i = 0; i < threads; i++)   // threads - 1 workers, and outside threads
+    this->Queues.push_back(make_unique<Queue>());
+
+  for (int i = 0; i < threads - 1; i++)
+    this->Workers.push_back(thread(&TaskPool::workerLoop, this, i));
+}
+
+
+TaskPool::~TaskPool()
+{
+  this->Stopping = true;
+  this->notifyAll();
+
+  for (thread& t : this->Workers)
+    t.join();
+}
+
+
+TaskPool::Queue& TaskPool::queueOfThisThread()
+{
+  if (CurrentPool == this)
+    return *this->Queues[CurrentIndex];
+  else
+    return *this->Queues.back();
+}
+
+
+//
+// push
+//
+// Queues the task at this thread's end of its queue, waking a
+// sleeping thread to take it if there is one.
+//
+void TaskPool::push(Task task)
+{
+  Queue& queue = this->queueOfThisThread();
+
+  {
+    lock_guard<mutex> lock(queue.Mutex);
+    queue.Tasks.push_back(std::move(task));
+  }
+
+  this->Queued++;
+
+  //
+  // a thread going to sleep counts itself before it checks Queued,
+  // and this checks Sleeping after adding to Queued, so one of the
+  // two sees the other:
+  //
+  if (this->Sleeping > 0) {
+    lock_guard<mutex> lock(this->SleepMutex);
+    this->Wake.notify_one();
+  }
+}
+
+
+//
+// runOne
+//
+// Runs one task: this thread's newest, or else the oldest of another
+// queue. Returns false if every queue was empty.
+//
+bool TaskPool::runOne()
+{
+  Task task;
+  bool found = false;
+
+  Queue& own = this->queueOfThisThread();
+
+  {
+    lock_guard<mutex> lock(own.Mutex);
+
+    if (!own.Tasks.empty()) {
+      task = std::move(own.Tasks.back());
+      own.Tasks.pop_back();
+      found = true;
+    }
+  }
+
+  size_t N = this->Queues.size();
+  size_t start = (CurrentPool == this) ? CurrentIndex : N - 1;
+
+  for (size_t k = 1; k < N && !found; k++)
+  {
+    Queue& victim = *this->Queues[(start + k) % N];
+    lock_guard<mutex> lock(victim.Mutex);
+
+    if (!victim.Tasks.empty()) {
+      task = std::move(victim.Tasks.front());
+      victim.Tasks.pop_front();
+      found = true;
+    }
+  }
+
+  if (!found)
+    return false;
+
+  this->Queued--;
+
+  try {
+    task.Run();
+  }
+  catch (...) {
+    lock_guard<mutex> lock(task.Group->ErrorMutex);
+
+    if (task.Group->Error == nullptr)
+      task.Group->Error = current_exception();
+  }
+
+  task.Group->finished();
+  return true;
+}
+
+
+//
+// sleepUntil
+//
+// Sleeps until ready() is true, there are tasks to run, or the pool
+// is stopping.
+//
+void TaskPool::sleepUntil(const function<bool()>& ready)
+{
+  unique_lock<mutex> lock(this->SleepMutex);
+
+  this->Sleeping++;
+  this->Wake.wait(lock, [&]() { return ready() || this->Queued > 0 || this->Stopping; });
+  this->Sleeping--;
+}
+
+
+void TaskPool::notifyAll()
+{
+  lock_guard<mutex> lock(this->SleepMutex);
+  this->Wake.notify_all();
+}
+
+
+void TaskPool::workerLoop(int index)
+{
+  CurrentPool = this;
+  CurrentIndex = index;
+
+  while (!this->Stopping)
+  {
+    if (!this->runOne())
+      this->sleepUntil([]() { return false; });
+  }
+}
+
+
+//
+// the shared pool:
+//
+static mutex SharedMutex;
+static unique_ptr<TaskPool> SharedPool;
+static int SharedThreads = 0;
+
+
+TaskPool& TaskPool::shared()
+{
+  lock_guard<mutex> lock(SharedMutex);
+
+  if (SharedPool == nullptr)
+    SharedPool = make_unique<TaskPool>(SharedThreads);
+
+  return *SharedPool;
+}
+
+
+void TaskPool::setSharedThreads(int threads)
+{
+  lock_guard<mutex> lock(SharedMutex);
+
+  SharedThreads = threads;
+
+  if (SharedPool != nullptr && SharedPool->getNumThreads() != threadsOrHardware(threads))
+    SharedPool.reset();   // started again, with the new count, on next use
+}
+
+
+void TaskGroup::run(function<void()> f)
+{
+  this->Pending++;
+  this->Pool.push({ std::move(f), this });
+}
+
+
+//
+// finished
+//
+// A task of the group is done. Once the last is, the group may be
+// destroyed at any moment, so the pool is taken first.
+//
+void TaskGroup::finished()
+{
+  TaskPool& pool = this->Pool;
+
+  if (--this->Pending == 0 && pool.Sleeping > 0)
+    pool.notifyAll();
+}
+
+
+void TaskGroup::wait()
+{
+  while (this->Pending > 0)
+  {
+    if (!this->Pool.runOne())
+      this->Pool.sleepUntil([this]() { return this->Pending == 0; });
+  }
+
+  lock_guard<mutex> lock(this->ErrorMutex);
+
+  if (this->Error != nullptr) {
+    exception_ptr error = this->Error;
+    this->Error = nullptr;
+    rethrow_exception(error);
+  }
+}
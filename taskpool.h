@@ -0,0 +1,239 @@
+/*taskpool.h*/
+
+//
+// A work-stealing task pool: one set of worker threads for everything
+// that runs in parallel -- loading, indexing, batch queries -- rather
+// than threads started and joined by each feature.
+//
+// Each worker has a deque of tasks. A worker takes its own newest
+// task first (the one whose data is most likely still in its cache),
+// and when it has none steals the oldest task of another, which for
+// a range split in halves (see parallelFor) is the biggest piece left.
+// Threads outside the pool add tasks to a queue of their own that the
+// workers steal from in the same way.
+//
+// A thread waiting for a TaskGroup runs queued tasks itself until the
+// group is done, so waiting never blocks a worker, and tasks can start
+// groups of their own and wait for them (parallelFor within
+// parallelFor) without deadlock.
+//
+//   TaskPool& pool = TaskPool::shared();
+//
+//   pool.parallelFor(0, buildings.size(), 0, [&](size_t lo, size_t hi) {
+//     for (size_t i = lo; i < hi; i++)
+//       ...
+//   });
+//
+//   TaskGroup group(pool);
+//   group.run([&]() { ... });
+//   group.run([&]() { ... });
+//   group.wait();
+//
+// A task that blocks -- on the network, say -- holds its thread
+// until it is done, so a pool for such tasks wants more threads than
+// there are cores. Tasks must never wait on a lock held by a task
+// still queued.
+//
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <condition_variable>
+#include <algorithm>
+#include <cstddef>
+
+using namespace std;
+
+
+class TaskGroup;
+
+
+class TaskPool
+{
+private:
+  struct Task
+  {
+    function<void()> Run;
+    TaskGroup* Group;
+  };
+
+  struct Queue
+  {
+    mutex Mutex;
+    deque<Task> Tasks;   // the owner's end is the back
+  };
+
+  vector<unique_ptr<Queue>> Queues;   // one per worker, then one for outside threads
+  vector<thread> Workers;
+
+  atomic<size_t> Queued;              // tasks in all the queues
+  atomic<int> Sleeping;               // threads in sleepUntil
+  atomic<bool> Stopping;
+  mutex SleepMutex;
+  condition_variable Wake;            // tasks queued, a group done, or stopping
+
+  Queue& queueOfThisThread();
+  bool runOne();
+  void workerLoop(int index);
+
+  void push(Task task);
+  void sleepUntil(const function<bool()>& ready);
+  void notifyAll();
+
+  template <class Body>
+  void splitRange(TaskGroup& group, size_t begin, size_t end, size_t grain, const Body& body);
+
+  friend class TaskGroup;
+
+public:
+  //
+  // constructor
+  //
+  // A pool of the given number of threads, counting the one that
+  // waits for a group: threads - 1 workers are started. 0 => one per
+  // hardware thread.
+  //
+  explicit TaskPool(int threads = 0);
+  ~TaskPool();
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+
+  //
+  // getNumThreads
+  //
+  // The workers plus the waiting thread; 1 => tasks run on the
+  // thread that waits for them, one after another.
+  //
+  int getNumThreads() const { return (int) this->Workers.size() + 1; }
+
+  //
+  // parallelFor
+  //
+  // Calls body(lo, hi) on pieces of [begin, end) that together cover
+  // it exactly once, in parallel, returning when all are done. The
+  // range is split in halves down to pieces of at most grain (0 =>
+  // about 8 pieces per thread). An exception thrown by the body is
+  // rethrown here, after the other pieces are done.
+  //
+  template <class Body>
+  void parallelFor(size_t begin, size_t end, size_t grain, const Body& body);
+
+  //
+  // shared
+  //
+  // The pool the program's parallel features share, started on first
+  // use with the thread count last given to setSharedThreads (by
+  // default one per hardware thread).
+  //
+  static TaskPool& shared();
+
+  //
+  // setSharedThreads
+  //
+  // Sets the shared pool's thread count; if it is already running
+  // with another count, it is replaced, so call this at startup,
+  // before anything is using it.
+  //
+  static void setSharedThreads(int threads);
+};
+
+
+//
+// TaskGroup
+//
+// Tasks run on a pool and waited for together. wait() must be called
+// before the group is destroyed, and tasks may add more tasks to the
+// group they belong to.
+//
+class TaskGroup
+{
+private:
+  TaskPool& Pool;
+  atomic<size_t> Pending;
+  mutex ErrorMutex;
+  exception_ptr Error;   // the first a task threw
+
+  void finished();
+  friend class TaskPool;
+
+public:
+  explicit TaskGroup(TaskPool& pool) : Pool(pool), Pending(0) { }
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  //
+  // run
+  //
+  // Queues f to run on the pool.
+  //
+  void run(function<void()> f);
+
+  //
+  // wait
+  //
+  // Runs queued tasks until every task of the group is done, then
+  // rethrows the first exception one of them threw, if any.
+  //
+  void wait();
+};
+
+
+template <class Body>
+void TaskPool::splitRange(TaskGroup& group, size_t begin, size_t end, size_t grain, const Body& body)
+{
+  //
+  // queue the upper half and go on with the lower, so thieves take
+  // big pieces and the owner works through its range in order:
+  //
+  while (end - begin > grain)
+  {
+    size_t middle = begin + (end - begin) / 2;
+
+    group.run([this, &group, middle, end, grain, &body]() {
+      this->splitRange(group, middle, end, grain, body);
+    });
+
+    end = middle;
+  }
+
+  body(begin, end);
+}
+
+
+template <class Body>
+void TaskPool::parallelFor(size_t begin, size_t end, size_t grain, const Body& body)
+{
+  if (begin >= end)
+    return;
+
+  size_t n = end - begin;
+
+  if (grain == 0)
+    grain = max<size_t>(1, n / (8 * (size_t) this->getNumThreads()));
+
+  if (this->Workers.empty() || n <= grain) {
+    body(begin, end);
+    return;
+  }
+
+  TaskGroup group(*this);
+
+  try {
+    this->splitRange(group, begin, end, grain, body);
+  }
+  catch (...) {
+    group.wait();   // the pieces queued still refer to body
+    throw;
+  }
+
+  group.wait();
+}
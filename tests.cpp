@@ -0,0 +1,486 @@
+/*tests.cpp*/
+
+//
+// Unit tests for the core library: CSV quoting, histogram
+// percentiles, query log round trips, reading map nodes, and nearest
+// stops against a brute-force haversine search.
+//
+// Usage:
+//
+//   navtest [test ...]
+//
+// Runs the named tests, or all of them; ctest runs each as a test of
+// its own (see CMakeLists.txt). Prints each failed check, and exits
+// non-zero if any failed. Files the tests write go in the system's
+// temporary directory, and are removed after.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+
+#include "csv.h"
+#include "histogram.h"
+#include "query.h"
+#include "querylog.h"
+#include "nodes.h"
+#include "busstops.h"
+#include "projection.h"
+#include "dist.h"
+
+using namespace std;
+
+
+static int Failures = 0;
+
+
+//
+// check
+//
+// Records a failure, printing where and what, unless ok.
+//
+static void check(bool ok, const char* what, const char* file, int line)
+{
+  if (!ok) {
+    cerr << file << ":" << line << ": check failed: " << what << endl;
+    Failures++;
+  }
+}
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+
+//
+// tempPath
+//
+// A file name in the temporary directory, unique to this run.
+//
+static string tempPath(const string& name)
+{
+  return (filesystem::temp_directory_path() / ("navtest-" + to_string(getpid()) + "-" + name)).string();
+}
+
+
+//
+// rows
+//
+// Every row of CSV text, with each row's line and error.
+//
+struct Row
+{
+  vector<string> Fields;
+  size_t Line;
+  string Error;
+};
+
+static vector<Row> rows(string_view text)
+{
+  vector<Row> result;
+  CsvReader csv(text);
+  vector<string_view> fields;
+
+  while (csv.next(fields))
+    result.push_back({ vector<string>(fields.begin(), fields.end()), csv.getLine(), csv.getError() });
+
+  return result;
+}
+
+
+//
+// csv: RFC 4180 quoting, line numbers, and the streaming parser
+// agreeing with the in-place one however the text is cut up.
+//
+static void testCsv()
+{
+  string text =
+    "\xEF\xBB\xBF" "a,b,c\r\n"
+    "\"x, y\",\"he said \"\"hi\"\"\",\"line one\nline two\"\n"
+    "\n"
+    "1,,\"\"\n"
+    "\"closed\"after,2\n"
+    "last,\"unterminated\n";
+
+  vector<Row> r = rows(text);
+
+  CHECK(r.size() == 5);
+  if (r.size() != 5)
+    return;
+
+  CHECK((r[0].Fields == vector<string>{ "a", "b", "c" }));
+  CHECK(r[0].Line == 1 && r[0].Error.empty());
+
+  CHECK((r[1].Fields == vector<string>{ "x, y", "he said \"hi\"", "line one\nline two" }));
+  CHECK(r[1].Line == 2 && r[1].Error.empty());
+
+  CHECK((r[2].Fields == vector<string>{ "1", "", "" }));
+  CHECK(r[2].Line == 5 && r[2].Error.empty());
+
+  CHECK(r[3].Line == 6 && !r[3].Error.empty());   // text after a closing quote
+  CHECK(r[4].Line == 7 && !r[4].Error.empty());   // a quote never closed
+
+  //
+  // fed a byte at a time, and in two halves:
+  //
+  for (size_t piece : { (size_t) 1, text.size() / 2 })
+  {
+    vector<Row> streamed;
+    CsvStream stream;
+    auto onRow = [&](const vector<string_view>& fields, size_t line, const string& error) {
+      streamed.push_back({ vector<string>(fields.begin(), fields.end()), line, error });
+    };
+
+    for (size_t i = 0; i < text.size(); i += piece)
+      stream.feed(string_view(text).substr(i, piece), onRow);
+    stream.finish(onRow);
+
+    CHECK(streamed.size() == r.size());
+
+    for (size_t i = 0; i < min(streamed.size(), r.size()); i++) {
+      CHECK(streamed[i].Fields == r[i].Fields);
+      CHECK(streamed[i].Line == r[i].Line);
+      CHECK(streamed[i].Error.empty() == r[i].Error.empty());
+    }
+  }
+
+  int i;
+  double d;
+
+  CHECK(parseField(" 42 ", i) && i == 42);
+  CHECK(parseField("+3.5", d) && d == 3.5);
+  CHECK(parseField("-87.6", d) && d == -87.6);
+  CHECK(!parseField("4x", i));
+  CHECK(!parseField("", i));
+  CHECK(!parseField("  ", d));
+}
+
+
+//
+// percentile: the nearest-rank percentile, to within the precision
+// of a bucket.
+//
+static void testPercentile()
+{
+  LatencyHistogram empty;
+  CHECK(empty.percentile(0.5) == 0);
+  CHECK(empty.getCount() == 0);
+
+  //
+  // small values are counted exactly:
+  //
+  LatencyHistogram h;
+  for (uint64_t v = 1; v <= 10; v++)
+    h.record(v);
+
+  CHECK(h.percentile(0.0) == 1);
+  CHECK(h.percentile(0.1) == 1);
+  CHECK(h.percentile(0.11) == 2);
+  CHECK(h.percentile(0.5) == 5);
+  CHECK(h.percentile(0.9) == 9);
+  CHECK(h.percentile(0.91) == 10);
+  CHECK(h.percentile(1.0) == 10);
+  CHECK(h.getMax() == 10);
+  CHECK(h.getMean() == 5.5);
+
+  LatencyHistogram two;
+  two.record(3);
+  two.record(7);
+  CHECK(two.percentile(0.5) == 3);
+  CHECK(two.percentile(0.51) == 7);
+
+  //
+  // larger ones to within 1/SUB_BUCKETS, never past the largest:
+  //
+  LatencyHistogram wide;
+  vector<uint64_t> values;
+  mt19937_64 rng(27);
+
+  for (int n = 0; n < 10000; n++) {
+    uint64_t v = rng() % 100000000;
+    values.push_back(v);
+    wide.record(v);
+  }
+
+  sort(values.begin(), values.end());
+
+  for (double fraction : { 0.01, 0.5, 0.99, 0.999, 1.0 })
+  {
+    size_t rank = (size_t) max(0.0, ceil(fraction * values.size()) - 1);
+    uint64_t exact = values[rank];
+    uint64_t p = wide.percentile(fraction);
+
+    CHECK(p >= exact);
+    CHECK(p - exact <= exact / LatencyHistogram::SUB_BUCKETS);
+    CHECK(p <= wide.getMax());
+  }
+
+  //
+  // merged, the same as recorded into one:
+  //
+  LatencyHistogram a, b, both;
+  for (uint64_t v = 0; v < 1000; v++) {
+    ((v % 3 == 0) ? a : b).record(v * 37);
+    both.record(v * 37);
+  }
+
+  a.merge(b);
+
+  CHECK(a.getCount() == both.getCount());
+  CHECK(a.getMax() == both.getMax());
+  for (double fraction : { 0.25, 0.5, 0.75, 0.99 })
+    CHECK(a.percentile(fraction) == both.percentile(fraction));
+}
+
+
+//
+// sameQuery
+//
+static bool sameQuery(const Query& a, const Query& b)
+{
+  return a.Type == b.Type && a.Name == b.Name && a.ToName == b.ToName && a.Direction == b.Direction
+    && memcmp(&a.Lat, &b.Lat, sizeof(double)) == 0 && memcmp(&a.Lon, &b.Lon, sizeof(double)) == 0
+    && a.StopID == b.StopID && a.Time == b.Time;
+}
+
+
+//
+// querylog: every type of query back as it was logged, across runs
+// appended to one file, and a log cut short.
+//
+static void testQueryLog()
+{
+  vector<Query> queries(7);
+
+  queries[0].Type = QueryType::Building;
+  queries[0].Name = "Tech";
+
+  queries[1].Type = QueryType::Nearest;
+  queries[1].Lat = 42.052345678901234;
+  queries[1].Lon = -87.6745678901234;
+  queries[1].Direction = "Northbound";
+
+  queries[2].Type = QueryType::Predict;
+  queries[2].StopID = 10135;
+
+  queries[3].Type = QueryType::Predict;
+  queries[3].StopID = -7;
+
+  queries[4].Type = QueryType::Route;
+  queries[4].Name = "Zürich";
+  queries[4].ToName = "Mudd";
+
+  queries[5].Type = QueryType::Transit;
+  queries[5].Name = "Tech";
+  queries[5].ToName = "Kellogg";
+
+  queries[6].Type = QueryType::Transit;
+  queries[6].Name = "Tech";
+  queries[6].ToName = "Kellogg";
+  queries[6].Time = 8 * 3600 + 5 * 60 + 9;
+
+  string filename = tempPath("queries.qlog");
+  string error;
+
+  //
+  // two runs, appended:
+  //
+  for (int run = 0; run < 2; run++)
+  {
+    QueryLog log;
+
+    CHECK(log.open(filename, error));
+
+    for (size_t i = 0; i < queries.size(); i++)
+      log.append(queries[i], i % 2 == 1);
+  }
+
+  vector<LoggedQuery> logged;
+
+  CHECK(readQueryLog(filename, logged, error));
+  CHECK(logged.size() == 2 * queries.size());
+
+  for (size_t i = 0; i < logged.size() && i < 2 * queries.size(); i++) {
+    CHECK(sameQuery(logged[i].Q, queries[i % queries.size()]));
+    CHECK(logged[i].Predictions == (i % queries.size() % 2 == 1));
+    CHECK(logged[i].Micros > 0 && (i == 0 || logged[i].Micros >= logged[i - 1].Micros));
+  }
+
+  //
+  // as text, each parses back to the same query:
+  //
+  for (const Query& q : queries) {
+    Query parsed;
+    CHECK(parseQuery(queryText(q), parsed, error));
+    CHECK(sameQuery(parsed, q));
+  }
+
+  //
+  // cut short in the last record, the log ends before it:
+  //
+  filesystem::resize_file(filename, filesystem::file_size(filename) - 3);
+
+  logged.clear();
+  CHECK(readQueryLog(filename, logged, error));
+  CHECK(logged.size() == 2 * queries.size() - 1);
+
+  //
+  // and anything else isn't a query log:
+  //
+  {
+    ofstream other(filename, ios::trunc);
+    other << "building Tech\n";
+  }
+
+  QueryLog log;
+  CHECK(!log.open(filename, error));
+  CHECK(!readQueryLog(filename, logged, error));
+
+  filesystem::remove(filename);
+}
+
+
+//
+// nodes: duplicate node ids, in id order and out of it, leave the
+// first of each.
+//
+static void testNodes()
+{
+  const char* maps[] = {
+    "<osm><node id='1' lat='42.01' lon='-87.61'/><node id='2' lat='42.02' lon='-87.62'/>"
+    "<node id='2' lat='42.09' lon='-87.69'/><node id='3' lat='42.03' lon='-87.63'/></osm>",
+    "<osm><node id='3' lat='42.03' lon='-87.63'/><node id='2' lat='42.02' lon='-87.62'/>"
+    "<node id='1' lat='42.01' lon='-87.61'/><node id='2' lat='42.09' lon='-87.69'/></osm>",
+  };
+
+  for (const char* map : maps)
+  {
+    XMLDocument xmldoc;
+    CHECK(xmldoc.Parse(map) == XML_SUCCESS);
+
+    Nodes nodes;
+    nodes.readMapNodes(xmldoc);
+    nodes.sortSpatially();
+
+    CHECK(nodes.getNumMapNodes() == 3);
+
+    double lat = 0, lon = 0;
+    bool entrance = true;
+
+    CHECK(nodes.find(2, lat, lon, entrance));
+    CHECK(fabs(lat - 42.02) < 1e-6 && fabs(lon + 87.62) < 1e-6 && !entrance);
+    CHECK(nodes.indexOf(1) >= 0 && nodes.indexOf(3) >= 0 && nodes.indexOf(4) == -1);
+  }
+}
+
+
+//
+// nearest: findClosestStop and findClosestStops against measuring
+// every stop by haversine, with stops inside the map's projection
+// and well outside it, and queries from both.
+//
+static void testNearest()
+{
+  string filename = tempPath("stops.txt");
+  mt19937 rng(45);
+  uniform_real_distribution<double> lat(41.95, 42.15), lon(-87.80, -87.55);
+
+  {
+    ofstream file(filename);
+
+    for (int i = 0; i < 400; i++)
+      file << (10000 + i) << "," << (i % 7) << ",Stop " << i << "," << ((i % 2) ? "Northbound" : "Southbound")
+        << ",NE corner," << to_string(lat(rng)) << "," << to_string(lon(rng)) << "\n";
+  }
+
+  BusStops stops;
+  stops.readFromCSV(filename);
+  filesystem::remove(filename);
+
+  CHECK(stops.getNumBusStops() == 400);
+
+  //
+  // projected with a map that covers a corner of where the stops
+  // are (so the projection is widened), and not projected at all:
+  //
+  for (const LocalProjection& projection : { LocalProjection(42.04, 42.07, -87.70, -87.66), LocalProjection() })
+  {
+    stops.project(projection);
+
+    for (int n = 0; n < 2000; n++)
+    {
+      double qlat = lat(rng), qlon = lon(rng);
+
+      for (const char* direction : { "Northbound", "Southbound" })
+      {
+        //
+        // every stop that way, by haversine:
+        //
+        vector<double> all;
+
+        for (const auto& s : stops.findClosestStops(qlat, qlon, direction, 1000))
+          all.push_back(haversineMiles(qlat, qlon, s.first->getLatitude(), s.first->getLongitude()));
+
+        CHECK(all.size() == 200);
+        sort(all.begin(), all.end());
+
+        auto closest = stops.findClosestStop(qlat, qlon, direction);
+
+        CHECK(closest.first != nullptr);
+        CHECK(closest.second == all[0]);
+        if (closest.first != nullptr)
+          CHECK(haversineMiles(qlat, qlon, closest.first->getLatitude(), closest.first->getLongitude()) == all[0]);
+
+        auto five = stops.findClosestStops(qlat, qlon, direction, 5);
+
+        CHECK(five.size() == 5);
+        for (size_t i = 0; i < five.size(); i++)
+          CHECK(five[i].second == all[i]);
+      }
+    }
+  }
+
+  CHECK(stops.findClosestStop(42.0, -87.7, "Eastbound").first == nullptr);
+  CHECK(stops.findClosestStops(42.0, -87.7, "Northbound", 0).empty());
+}
+
+
+static const struct { const char* Name; void (*Run)(); } TESTS[] = {
+  { "csv", testCsv },
+  { "percentile", testPercentile },
+  { "querylog", testQueryLog },
+  { "nodes", testNodes },
+  { "nearest", testNearest },
+};
+
+
+int main(int argc, char* argv[])
+{
+  vector<string> wanted(argv + 1, argv + argc);
+
+  for (const string& name : wanted)
+    if (none_of(begin(TESTS), end(TESTS), [&](const auto& t) { return name == t.Name; })) {
+      cerr << "usage: navtest [csv|percentile|querylog|nodes|nearest ...]" << endl;
+      return 2;
+    }
+
+  for (const auto& test : TESTS)
+  {
+    if (!wanted.empty() && find(wanted.begin(), wanted.end(), test.Name) == wanted.end())
+      continue;
+
+    int before = Failures;
+    test.Run();
+
+    cout << test.Name << ": " << ((Failures == before) ? "ok" : "FAILED") << endl;
+  }
+
+  return (Failures == 0) ? 0 : 1;
+}
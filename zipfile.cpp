@@ -0,0 +1,269 @@
+/*zipfile.cpp*/
+
+//
+// Reading files out of a zip archive, as GTFS feeds are distributed.
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+
+#ifdef NAV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "zipfile.h"
+
+using namespace std;
+
+
+//
+// little-endian fields, read byte by byte (the mapping is not
+// aligned for the structures):
+//
+static uint16_t get16(const char* p)
+{
+  const unsigned char* u = (const unsigned char*) p;
+  return (uint16_t) (u[0] | (u[1] << 8));
+}
+
+static uint32_t get32(const char* p)
+{
+  const unsigned char* u = (const unsigned char*) p;
+  return (uint32_t) u[0] | ((uint32_t) u[1] << 8) | ((uint32_t) u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+
+static const uint32_t END_OF_CENTRAL_DIR = 0x06054b50;
+static const uint32_t CENTRAL_DIR_HEADER = 0x02014b50;
+static const uint32_t LOCAL_HEADER = 0x04034b50;
+
+
+//
+// open
+//
+bool ZipArchive::open(const string& filename, string& error)
+{
+  this->Members.clear();
+
+  if (!this->File.open(filename)) {
+    error = "unable to open '" + filename + "'";
+    return false;
+  }
+
+  string_view data = this->File.view();
+
+  //
+  // the end of central directory record is the last 22 bytes, plus
+  // a comment of up to 64 KB; search backwards for its signature:
+  //
+  const size_t EOCD_SIZE = 22;
+
+  if (data.size() < EOCD_SIZE) {
+    error = "'" + filename + "' is not a zip file";
+    return false;
+  }
+
+  size_t eocd = string_view::npos;
+  size_t lowest = (data.size() > EOCD_SIZE + 65535) ? data.size() - EOCD_SIZE - 65535 : 0;
+
+  for (size_t p = data.size() - EOCD_SIZE + 1; p-- > lowest; ) {
+    if (get32(data.data() + p) == END_OF_CENTRAL_DIR) {
+      eocd = p;
+      break;
+    }
+  }
+
+  if (eocd == string_view::npos) {
+    error = "'" + filename + "' is not a zip file";
+    return false;
+  }
+
+  const char* e = data.data() + eocd;
+  uint16_t count = get16(e + 10);
+  uint32_t dirSize = get32(e + 12);
+  uint32_t dirOffset = get32(e + 16);
+
+  if (count == 0xFFFF || dirOffset == 0xFFFFFFFF) {
+    error = "'" + filename + "' is a zip64 archive, which is not supported";
+    return false;
+  }
+
+  if ((uint64_t) dirOffset + dirSize > eocd) {
+    error = "'" + filename + "': corrupt central directory";
+    return false;
+  }
+
+  //
+  // central directory: one 46-byte header plus name, extra field
+  // and comment per member:
+  //
+  size_t p = dirOffset;
+
+  for (int i = 0; i < count; i++)
+  {
+    if (p + 46 > eocd || get32(data.data() + p) != CENTRAL_DIR_HEADER) {
+      error = "'" + filename + "': corrupt central directory";
+      return false;
+    }
+
+    const char* h = data.data() + p;
+
+    Member m;
+    m.Method = get16(h + 10);
+    m.CompressedSize = get32(h + 20);
+    m.Size = get32(h + 24);
+    m.HeaderOffset = get32(h + 42);
+
+    uint16_t nameLen = get16(h + 28);
+    uint16_t extraLen = get16(h + 30);
+    uint16_t commentLen = get16(h + 32);
+
+    if (p + 46 + nameLen > eocd) {
+      error = "'" + filename + "': corrupt central directory";
+      return false;
+    }
+
+    m.Name.assign(h + 46, nameLen);
+
+    if (m.CompressedSize == 0xFFFFFFFF || m.Size == 0xFFFFFFFF || m.HeaderOffset == 0xFFFFFFFF) {
+      error = "'" + filename + "': member '" + m.Name + "' needs zip64, which is not supported";
+      return false;
+    }
+
+    this->Members.push_back(std::move(m));
+
+    p += 46 + nameLen + extraLen + commentLen;
+  }
+
+  return true;
+}
+
+
+//
+// find
+//
+const ZipArchive::Member* ZipArchive::find(string_view name) const
+{
+  for (const Member& m : this->Members)
+  {
+    string_view base = m.Name;
+    size_t slash = base.rfind('/');
+
+    if (slash != string_view::npos)
+      base.remove_prefix(slash + 1);
+
+    if (base == name)
+      return &m;
+  }
+
+  return nullptr;
+}
+
+
+//
+// read
+//
+bool ZipArchive::read(const Member& member, const function<void(string_view block)>& onBlock, string& error) const
+{
+  string_view data = this->File.view();
+
+  //
+  // the local header repeats the name and has its own extra field,
+  // which may differ in length from the central directory's:
+  //
+  if (member.HeaderOffset + 30 > data.size() || get32(data.data() + member.HeaderOffset) != LOCAL_HEADER) {
+    error = "'" + member.Name + "': corrupt local header";
+    return false;
+  }
+
+  const char* h = data.data() + member.HeaderOffset;
+  uint64_t start = member.HeaderOffset + 30 + get16(h + 26) + get16(h + 28);
+
+  if (start + member.CompressedSize > data.size()) {
+    error = "'" + member.Name + "': truncated";
+    return false;
+  }
+
+  string_view compressed = data.substr(start, member.CompressedSize);
+
+  if (member.Method == 0)  // stored
+  {
+    onBlock(compressed);
+    return true;
+  }
+
+  if (member.Method != 8) {
+    error = "'" + member.Name + "': unsupported compression method " + to_string(member.Method);
+    return false;
+  }
+
+#ifdef NAV_HAVE_ZLIB
+  //
+  // raw deflate (negative window bits: no zlib header), inflated a
+  // block at a time into a reused buffer:
+  //
+  const size_t BLOCK_SIZE = 1 << 20;
+  unique_ptr<char[]> buffer(new char[BLOCK_SIZE]);
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+
+  if (inflateInit2(&z, -MAX_WBITS) != Z_OK) {
+    error = "'" + member.Name + "': unable to start inflating";
+    return false;
+  }
+
+  z.next_in = (Bytef*) compressed.data();
+  uint64_t remaining = compressed.size();
+  uint64_t produced = 0;
+  int status = Z_OK;
+
+  while (status != Z_STREAM_END)
+  {
+    if (z.avail_in == 0) {
+      uInt n = (uInt) min<uint64_t>(remaining, 1u << 30);
+      z.avail_in = n;
+      remaining -= n;
+    }
+
+    z.next_out = (Bytef*) buffer.get();
+    z.avail_out = (uInt) BLOCK_SIZE;
+
+    status = inflate(&z, Z_NO_FLUSH);
+
+    if (status != Z_OK && status != Z_STREAM_END) {
+      inflateEnd(&z);
+      error = "'" + member.Name + "': corrupt compressed data";
+      return false;
+    }
+
+    size_t n = BLOCK_SIZE - z.avail_out;
+    produced += n;
+
+    if (n > 0)
+      onBlock(string_view(buffer.get(), n));
+
+    if (status == Z_OK && n == 0 && z.avail_in == 0 && remaining == 0) {
+      inflateEnd(&z);
+      error = "'" + member.Name + "': truncated compressed data";
+      return false;
+    }
+  }
+
+  inflateEnd(&z);
+
+  if (produced != member.Size) {
+    error = "'" + member.Name + "': size mismatch after inflating";
+    return false;
+  }
+
+  return true;
+#else
+  error = "'" + member.Name + "' is compressed, and this build has no zlib; unzip the feed";
+  return false;
+#endif
+}
@@ -0,0 +1,76 @@
+/*zipfile.h*/
+
+//
+// Reading files out of a zip archive, as GTFS feeds are distributed.
+//
+// The archive is memory-mapped; a stored (uncompressed) member is
+// handed back as a view of the mapping, and a deflated member is
+// inflated with zlib a block at a time, so a member far larger than
+// memory can still be read. Builds without zlib (NAV_HAVE_ZLIB not
+// defined) can only read stored members. Zip64 archives (members
+// or archives over 4 GB) are not supported.
+//
+// References:
+//
+// APPNOTE.TXT, the .ZIP file format specification:
+//   https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "csv.h"
+
+using namespace std;
+
+
+class ZipArchive
+{
+public:
+  struct Member
+  {
+    string Name;               // path within the archive
+    uint16_t Method;           // 0 = stored, 8 = deflated
+    uint64_t CompressedSize;
+    uint64_t Size;
+    uint64_t HeaderOffset;     // of the member's local header
+  };
+
+private:
+  MappedFile File;
+  vector<Member> Members;
+
+public:
+  //
+  // open
+  //
+  // Maps the archive and reads its central directory. Returns false
+  // and sets error if the file cannot be read or is not a zip file.
+  //
+  bool open(const string& filename, string& error);
+
+  //
+  // find
+  //
+  // Returns the member with the given file name, ignoring any
+  // directories in its path (feeds are often zipped inside a
+  // folder), or nullptr if there is none.
+  //
+  const Member* find(string_view name) const;
+
+  //
+  // read
+  //
+  // Calls onBlock with successive blocks of the member's contents,
+  // each valid only during the call. Returns false and sets error if
+  // the member is corrupt or uses an unsupported compression method.
+  //
+  bool read(const Member& member, const function<void(string_view block)>& onBlock, string& error) const;
+
+  const vector<Member>& getMembers() const { return this->Members; }
+};